@@ -27,7 +27,7 @@ static struct ml666_testcase* ml666_testcase_list;
   } \
   static int ML666_CONCAT(ml666_test_f_, __LINE__)(void)
 
-static size_t ml666__alloc_counter = 0;
+static _Atomic size_t ml666__alloc_counter = 0;
 
 void* ml666__d__malloc(void* that, size_t size){
   (void)that;
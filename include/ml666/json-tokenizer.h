@@ -44,6 +44,7 @@ struct ml666_json_tokenizer {
   const char* error;
   size_t line, column;
   void* user_ptr;
+  size_t offset; // The number of bytes read from the input so far.
 };
 
 typedef bool ml666_json_tokenizer_cb_next(struct ml666_json_tokenizer* tokenizer);
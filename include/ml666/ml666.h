@@ -9,13 +9,19 @@
 #include <ml666/utils.h>
 #include <ml666/common.h>
 #include <ml666/parser.h>
+#include <ml666/parser-dispatch.h>
+#include <ml666/tape.h>
 #include <ml666/tokenizer.h>
+#include <ml666/structure-scanner.h>
 #include <ml666/json-tokenizer.h>
 #include <ml666/json-token-emmiter.h>
 #include <ml666/binary-token-emmiter.h>
 #include <ml666/simple-tree.h>
 #include <ml666/simple-tree-parser.h>
 #include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-arena-builder.h>
+#include <ml666/simple-tree-frozen.h>
+#include <ml666/simple-tree-reclaimer.h>
 #include <ml666/simple-tree-serializer.h>
 #include <ml666/simple-tree-json-serializer.h>
 #include <ml666/simple-tree-ml666-serializer.h>
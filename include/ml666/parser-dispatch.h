@@ -0,0 +1,115 @@
+#ifndef ML666_PARSER_DISPATCH_H
+#define ML666_PARSER_DISPATCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <ml666/common.h>
+#include <ml666/parser.h>
+#include <ml666/utils.h>
+
+/** \addtogroup parser
+ * @{ */
+/** \addtogroup ml666-parser
+ * @{ */
+/** \addtogroup ml666-parser-dispatch Element Name Dispatch
+ * An \ref ml666_parser_api implementation, which routes the parser events to handlers registered per element name.
+ *
+ * The element names are interned using an \ref ml666_hashed_buffer_set. When an element is opened,
+ * its name is hashed & looked up once, and the handler is choosen using the interned entry.
+ * Elements without a handler, and everything directly inside of them, are skipped without calling anything.
+ * Their child elements are still dispatched normally, if they have a handler.
+ *
+ * Create the parser using `ml666_parser_create(.api=&ml666_parser_dispatch_api, .user_ptr=dispatch, ...)`.
+ * @{ */
+
+/**
+ * Register for any depth. See \ref ml666_parser_dispatch_register.
+ */
+#define ML666_PARSER_DISPATCH_ANY_DEPTH ((size_t)-1)
+
+/**
+ * The element dispatcher. Create it using \ref ml666_parser_dispatch_create.
+ */
+struct ml666_parser_dispatch {
+  void* user_ptr; ///< A userspecified pointer
+  size_t depth; ///< The depth of the innermost open element. The root elements have depth 1.
+};
+
+/** Called when a matching element was opened. */
+typedef bool ml666_parser_dispatch_handler_tag_push(struct ml666_parser* parser, void* handler_ptr, const ml666_hashed_buffer_set_entry* name, size_t depth);
+/** Called when a matching element was closed. */
+typedef bool ml666_parser_dispatch_handler_tag_pop(struct ml666_parser* parser, void* handler_ptr, const ml666_hashed_buffer_set_entry* name, size_t depth);
+/** Called for each attribute of a matching element. */
+typedef bool ml666_parser_dispatch_handler_set_attribute(struct ml666_parser* parser, void* handler_ptr, struct ml666_buffer_ro name);
+/** Called for the chunks of the value of the last attribute. */
+typedef bool ml666_parser_dispatch_handler_value_append(struct ml666_parser* parser, void* handler_ptr, struct ml666_buffer_ro data);
+/** Called for the chunks of content directly inside a matching element. */
+typedef bool ml666_parser_dispatch_handler_data_append(struct ml666_parser* parser, void* handler_ptr, struct ml666_buffer_ro data);
+/** Called for the chunks of comments directly inside a matching element. */
+typedef bool ml666_parser_dispatch_handler_comment_append(struct ml666_parser* parser, void* handler_ptr, struct ml666_buffer_ro data);
+
+/**
+ * The callbacks of a handler. All of them are optional.
+ * If a callback returns false, parsing is aborted. It may set parser->error.
+ */
+struct ml666_parser_dispatch_handler {
+  ml666_parser_dispatch_handler_tag_push* tag_push;
+  ml666_parser_dispatch_handler_tag_pop*  tag_pop;
+  ml666_parser_dispatch_handler_set_attribute* set_attribute;
+  ml666_parser_dispatch_handler_value_append*   value_append;
+  ml666_parser_dispatch_handler_data_append*    data_append;
+  ml666_parser_dispatch_handler_comment_append* comment_append;
+};
+
+/** \see ml666_parser_dispatch_create */
+struct ml666_parser_dispatch_create_args {
+  // Optional
+  struct ml666_hashed_buffer_set* buffer_set; ///< Optional. The set used for interning the element names.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_parser_dispatch_create */
+ML666_EXPORT struct ml666_parser_dispatch* ml666_parser_dispatch_create_p(struct ml666_parser_dispatch_create_args args);
+/**
+ * Creates an \ref ml666_parser_dispatch instance.
+ * \see ml666_parser_dispatch_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ */
+#define ml666_parser_dispatch_create(...) ml666_parser_dispatch_create_p((struct ml666_parser_dispatch_create_args){__VA_ARGS__})
+
+/**
+ * Destroys the \ref ml666_parser_dispatch instance. Destroy the parser using it first.
+ */
+ML666_EXPORT void ml666_parser_dispatch_destroy(struct ml666_parser_dispatch* dispatch);
+
+/**
+ * Registers a handler for elements with the given name.
+ * A handler registered for a specific depth takes precedence over one registered for \ref ML666_PARSER_DISPATCH_ANY_DEPTH.
+ * Registering the same name & depth again replaces the previous handler.
+ *
+ * \param dispatch The dispatcher
+ * \param name The element name
+ * \param depth The depth of the element, starting at 1, or \ref ML666_PARSER_DISPATCH_ANY_DEPTH
+ * \param handler The handler callbacks. They are not copied, they must stay valid.
+ * \param handler_ptr Passed to all callbacks of the handler
+ * \returns true on success, false otherwise
+ */
+ML666_EXPORT bool ml666_parser_dispatch_register(
+  struct ml666_parser_dispatch* dispatch,
+  struct ml666_buffer_ro name,
+  size_t depth,
+  const struct ml666_parser_dispatch_handler* handler,
+  void* handler_ptr
+);
+
+/**
+ * The \ref ml666_parser_api of the dispatcher. The user_ptr of the parser must be the \ref ml666_parser_dispatch.
+ */
+ML666_EXPORT extern const struct ml666_parser_api ml666_parser_dispatch_api;
+
+/** @} */
+/** @} */
+/** @} */
+
+#endif
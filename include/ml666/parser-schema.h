@@ -0,0 +1,154 @@
+#ifndef ML666_PARSER_SCHEMA_H
+#define ML666_PARSER_SCHEMA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <ml666/common.h>
+#include <ml666/parser.h>
+#include <ml666/utils.h>
+
+struct ml666_tokenizer;
+struct ml666_st_builder;
+struct ml666_st_node;
+
+/** \addtogroup parser
+ * @{ */
+/** \addtogroup ml666-parser
+ * @{ */
+/** \addtogroup ml666-parser-schema Schema Validation
+ * Checks documents against a schema, either while they are being parsed, or once they are in a simple tree.
+ *
+ * The schema is an ML666 document itself:
+ * ```
+ * <schema root=`catalog`>
+ *   <element name=`catalog` children=`item*`/>
+ *   <element name=`item` children=`title (price | free) tag*`>
+ *     <attribute name=`id` required/>
+ *     <attribute name=`lang` value=`ascii`/>
+ *   </element>
+ *   <element name=`title` content=`utf8`/>
+ *   <element name=`price` content=`ascii`/>
+ *   <element name=`free`/>
+ *   <element name=`tag` content=`utf8` extra-attributes/>
+ * </schema>
+ * ```
+ *
+ * The `schema` element:
+ *  - `root`: The content model of the document, see below. Per default, the document has to be empty.
+ *  - `content`: The encoding of content directly in the document. Per default, there mustn't be any.
+ *
+ * The `element` elements. Every element used in a document must be declared:
+ *  - `name`: The element name
+ *  - `children`: The content model. Per default, the element can't have any child elements.
+ *  - `content`: The encoding of the content of the element. Per default, there mustn't be any.
+ *  - `extra-attributes`: Allow attributes which weren't declared
+ *
+ * The `attribute` elements inside an `element`:
+ *  - `name`: The attribute name
+ *  - `required`: The attribute must be set
+ *  - `value`: The encoding of the value of the attribute. Per default, anything is allowed.
+ *
+ * The encodings are `none` (empty), `ascii`, `utf8` and `any`.
+ * A content model is a sequence of element names and groups in parentheses. A group contains a sequence,
+ * or alternatives separated by `|`. Names and groups can be followed by `?`, `*` or `+`.
+ * Comments are allowed everywhere.
+ *
+ * When a schema is compiled, each content model is turned into a DFA, with a transition table indexed
+ * by the state and the element declaration. When an element is opened, its name is hashed & looked up once,
+ * checking it against the content model of its parent is a single table lookup.
+ * @{ */
+
+/**
+ * A compiled schema. It can't be changed, so any number of validators can share it.
+ * Create it using \ref ml666_schema_compile.
+ */
+struct ml666_schema;
+
+/** \see ml666_schema_compile */
+struct ml666_schema_compile_args {
+  int fd; ///< The file descriptor to read the schema from. Only used if tokenizer and node aren't set.
+  // Optional
+  struct ml666_tokenizer* tokenizer; ///< Optional. The tokenizer to read the schema from. It will be destroyed.
+  struct ml666_st_builder* stb; ///< Optional. The builder of node.
+  struct ml666_st_node* node; ///< Optional. A schema which has already been parsed. The tree is only read.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_schema_compile */
+ML666_EXPORT struct ml666_schema* ml666_schema_compile_p(struct ml666_schema_compile_args args);
+/**
+ * Compiles a schema. The errors are printed to stderr.
+ * \see ml666_schema_compile_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the schema, or 0 if it couldn't be read or wasn't valid
+ */
+#define ml666_schema_compile(...) ml666_schema_compile_p((struct ml666_schema_compile_args){__VA_ARGS__})
+
+/**
+ * Destroys the \ref ml666_schema. Destroy the validators using it first.
+ */
+ML666_EXPORT void ml666_schema_destroy(struct ml666_schema* schema);
+
+/**
+ * Checks a simple tree against a schema.
+ * If node is a document, it is checked against the `schema` element, otherwise, against the declaration of its name.
+ * \param schema The schema
+ * \param stb The builder of the tree
+ * \param node The root of the subtree to be checked
+ * \param error Optional. Set to a description of the first problem found.
+ * \returns true if the tree is valid, false otherwise
+ */
+ML666_EXPORT bool ml666_schema_validate_tree(const struct ml666_schema* schema, struct ml666_st_builder* stb, struct ml666_st_node* node, const char** error);
+
+/**
+ * The validator. Create it using \ref ml666_parser_schema_create.
+ *
+ * It is an \ref ml666_parser_api implementation. Create the parser using
+ * `ml666_parser_create(.api=&ml666_parser_schema_api, .user_ptr=validator, ...)`.
+ * If there is a problem, parsing stops right away, with parser->error describing it.
+ * An incomplete document is reported once the parser is done.
+ *
+ * Every event which passed is forwarded to the next \ref ml666_parser_api, if there is one.
+ * For example, to only build the tree of valid documents, use a detached \ref ml666_simple_tree_parser,
+ * with \ref ml666_simple_tree_parser_api as the next api.
+ */
+struct ml666_parser_schema {
+  void* user_ptr; ///< A userspecified pointer
+  size_t depth; ///< The depth of the innermost open element. The root elements have depth 1.
+};
+
+/** \see ml666_parser_schema_create */
+struct ml666_parser_schema_create_args {
+  const struct ml666_schema* schema; ///< The schema. It must stay valid.
+  // Optional
+  const struct ml666_parser_api* next; ///< Optional. The api the events are forwarded to. It must use the default opaque names, see \ref ML666_DEFAULT_OPAQUE_TAG_NAME.
+  void* next_user_ptr; ///< Optional. While the callbacks of next are called, it is the user_ptr of the parser.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_parser_schema_create */
+ML666_EXPORT struct ml666_parser_schema* ml666_parser_schema_create_p(struct ml666_parser_schema_create_args args);
+/**
+ * Creates an \ref ml666_parser_schema instance.
+ * \see ml666_parser_schema_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ */
+#define ml666_parser_schema_create(...) ml666_parser_schema_create_p((struct ml666_parser_schema_create_args){__VA_ARGS__})
+
+/**
+ * Destroys the \ref ml666_parser_schema instance. Destroy the parser using it first.
+ */
+ML666_EXPORT void ml666_parser_schema_destroy(struct ml666_parser_schema* validator);
+
+/**
+ * The \ref ml666_parser_api of the validator. The user_ptr of the parser must be the \ref ml666_parser_schema.
+ */
+ML666_EXPORT extern const struct ml666_parser_api ml666_parser_schema_api;
+
+/** @} */
+/** @} */
+/** @} */
+
+#endif
@@ -20,6 +20,8 @@ struct ml666_parser {
   const char* error;
   size_t line, column;
   bool done;
+  size_t offset; // The number of bytes read from the input so far
+  size_t token_count; // The number of complete tokens processed so far
 };
 
 
@@ -92,10 +94,81 @@ struct ml666_parser_create_args {
 ML666_EXPORT struct ml666_parser* ml666_parser_create_p(struct ml666_parser_create_args args);
 #define ml666_parser_create(...) ml666_parser_create_p((struct ml666_parser_create_args){__VA_ARGS__})
 
+/**
+ * A consumer of a parser tee. \see ml666_parser_tee_create
+ */
+struct ml666_parser_tee_consumer {
+  const struct ml666_parser_api* api; ///< The callbacks of the consumer
+  void* user_ptr; ///< The user_ptr of the parser instance of the consumer
+};
+
+/** \see ml666_parser_tee_create */
+struct ml666_parser_tee_create_args {
+  size_t consumer_count; ///< The number of consumers
+  const struct ml666_parser_tee_consumer* consumers; ///< The consumers. They are copied, the array doesn't need to stay valid.
+  int fd; ///< only used if tokenizer is not set, optional otherwise
+  struct ml666_tokenizer* tokenizer; ///< Optional. Frees the tokenizer if set
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free* free; ///< Optional. Custom allocator.
+};
+/** \see ml666_parser_tee_create */
+ML666_EXPORT struct ml666_parser* ml666_parser_tee_create_p(struct ml666_parser_tee_create_args args);
+/**
+ * Creates a parser which drives multiple \ref ml666_parser_api consumers using a single tokenizer.
+ * The tokens are only read once, and all consumers get the same chunks, nothing is copied.
+ *
+ * Every consumer gets its own \ref ml666_parser instance, which is passed to its callbacks,
+ * and has its own user_ptr, error and done state. Use \ref ml666_parser_tee_get_consumer to get it.
+ * If a consumer fails, it is done, but the others continue. The error of the tee itself
+ * is only set if the tokenizer failed, or if all consumers failed.
+ *
+ * Use \ref ml666_parser_next and \ref ml666_parser_destroy on the returned instance,
+ * not on the consumer instances.
+ */
+#define ml666_parser_tee_create(...) ml666_parser_tee_create_p((struct ml666_parser_tee_create_args){__VA_ARGS__})
+
+/**
+ * \returns the \ref ml666_parser instance of the consumer at the given index, or 0 if there is none.
+ */
+ML666_EXPORT struct ml666_parser* ml666_parser_tee_get_consumer(struct ml666_parser* tee, size_t index);
+
 static inline bool ml666_parser_next(struct ml666_parser* parser){
   return parser->cb->next(parser);
 }
 
+/**
+ * Like \ref ml666_parser_next, but keeps on parsing until a budget has been used up.
+ * Use this to interleave many parsers in one thread, without one big document starving the others.
+ *
+ * It also returns early if a call read nothing and completed no token, which happens if a non-blocking fd has no more data for now.
+ * It can't interrupt a blocking read, so use a non-blocking fd if latency matters.
+ * The progress made can be checked using parser->offset and parser->token_count.
+ *
+ * \param parser The parser
+ * \param max_bytes The maximum number of input bytes to be read, 0 for no limit. It may read up to one buffer more.
+ * \param max_tokens The maximum number of complete tokens to be processed, 0 for no limit.
+ * \returns true if it's not done yet, false otherwise
+ */
+static inline bool ml666_parser_next_budget(struct ml666_parser* parser, size_t max_bytes, size_t max_tokens){
+  const size_t offset = parser->offset;
+  const size_t token_count = parser->token_count;
+  while(true){
+    const size_t last_offset = parser->offset;
+    const size_t last_token_count = parser->token_count;
+    if(!ml666_parser_next(parser))
+      return false;
+    if(max_bytes && parser->offset - offset >= max_bytes)
+      return true;
+    if(max_tokens && parser->token_count - token_count >= max_tokens)
+      return true;
+    if(parser->offset == last_offset && parser->token_count == last_token_count)
+      return true;
+  }
+}
+
 static inline void ml666_parser_destroy(struct ml666_parser* parser){
   parser->cb->destroy(parser);
 }
@@ -36,6 +36,25 @@ static inline bool ml666_refcount_decrement(struct ml666_refcount* ml666_refcoun
   return atomic_fetch_sub_explicit(&ml666_refcount->value, 1, memory_order_acq_rel) - 1;
 }
 
+/**
+ * Increment the ml666_refcount, without an atomic read-modify-write operation.
+ * This is only correct if the refcount is never used by more than one thread at a time.
+ */
+static inline void ml666_refcount_increment_local(struct ml666_refcount* ml666_refcount){
+  atomic_store_explicit(&ml666_refcount->value, atomic_load_explicit(&ml666_refcount->value, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * Decrement the ml666_refcount, without an atomic read-modify-write operation.
+ * This is only correct if the refcount is never used by more than one thread at a time.
+ * \returns false if the reference count has hit 0, true otherwise
+ */
+static inline bool ml666_refcount_decrement_local(struct ml666_refcount* ml666_refcount){
+  int_fast64_t value = atomic_load_explicit(&ml666_refcount->value, memory_order_relaxed) - 1;
+  atomic_store_explicit(&ml666_refcount->value, value, memory_order_relaxed);
+  return value;
+}
+
 /**
  * Checks if the ml666_refcount is 1. This usually means we have the only existing reference.
  * \returns true if the ml666_refcount is 1, 0 otherwise.
@@ -86,6 +105,21 @@ static inline bool ml666_refcount_is_static(struct ml666_refcount* ml666_refcoun
      : (fprintf(stderr, "false\n"), false) \
   )
 
+#define ml666_refcount_increment_local(R) \
+  do { \
+    struct ml666_refcount* _ml666_refcount = (R); \
+    fprintf(stderr, "%ld> %s:%d: %s: ml666_refcount_increment_local(%p: %s)\n", (long)gettid(), __FILE__, __LINE__, __func__, (void*)_ml666_refcount, #R); \
+    ml666_refcount_increment_local(_ml666_refcount); \
+  } while(0)
+
+#define ml666_refcount_decrement_local(R) \
+  ( \
+    fprintf(stderr, "%ld> %s:%d: %s: ml666_refcount_decrement_local(%p: %s) = " , (long)gettid(), __FILE__, __LINE__, __func__, (void*)(R), #R), \
+    ml666_refcount_decrement_local((R)) \
+     ? (fprintf(stderr, "true\n" ), true ) \
+     : (fprintf(stderr, "false\n"), false) \
+  )
+
 #define ml666_refcount_is_last(R) \
   ( \
     fprintf(stderr, "%ld> %s:%d: %s: ml666_refcount_is_last(%p: %s) = " , (long)gettid(), __FILE__, __LINE__, __func__, (void*)(R), #R), \
@@ -0,0 +1,57 @@
+#ifndef ML666_SIMPLE_TREE_ARENA_BUILDER_H
+#define ML666_SIMPLE_TREE_ARENA_BUILDER_H
+
+#include <ml666/simple-tree.h>
+#include <stddef.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-arena-builder Arena Simple Tree Builder
+ * An \ref ml666_st_builder which allocates everything belonging to a document from a per-document arena.
+ *
+ * Every document gets its own arena. Nodes are created in the arena of the most recently created document
+ * which still exists, creating a node while there is no document fails. The nodes, attributes, names
+ * and small strings are carved from big blocks, bigger strings are kept in the buffers they were set with.
+ * The node refcounts of members don't free anything. Once the last reference to the document is released,
+ * all of it is freed at once, without walking the tree. There is no need to detach the nodes first
+ * using \ref ml666_st_subtree_disintegrate, although that still works.
+ *
+ * This means members must not be used after their document is gone, and mustn't be moved to another document.
+ * Children don't keep their parent alive either, only the references to the document count.
+ * The names are interned per document, so unlike with the default builder, the name entries of
+ * different documents can't be compared by pointer, and there is no \ref ml666_hashed_buffer_set.
+ * @{
+ */
+
+ML666_ST_DECLARATION(ml666_arena, ml666_st__a_)
+
+/**
+ * ```
+ * ML666_ST_DECLARATION(ml666_arena, ml666_st__a_)
+ * ```
+ * Arena implementation of \ref ml666_st_builder.
+ */
+ML666_EXPORT extern const struct ml666_st_cb ml666_arena_st_api;
+
+/** \see ml666_st_arena_builder_create */
+struct ml666_st_arena_builder_create_args {
+  // Optional
+  size_t block_size; ///< Optional. The size of the first block of an arena. The following ones get bigger. 16KiB per default.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_arena_builder_create */
+ML666_EXPORT struct ml666_st_builder* ml666_st_arena_builder_create_p(struct ml666_st_arena_builder_create_args args);
+/**
+ * Creates an arena \ref ml666_st_builder.
+ * \see ml666_st_arena_builder_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ */
+#define ml666_st_arena_builder_create(...) ml666_st_arena_builder_create_p((struct ml666_st_arena_builder_create_args){__VA_ARGS__})
+
+/** @} */
+/** @} */
+
+#endif
@@ -13,11 +13,11 @@
  */
 
 
-ML666_ST_DECLARATION(ml666_default, ml666_st__d_)
+ML666_ST_DECLARATION_FULL(ml666_default, ml666_st__d_)
 
 /**
  * ```
- * ML666_ST_DECLARATION(ml666_default, ml666_st__d_)
+ * ML666_ST_DECLARATION_FULL(ml666_default, ml666_st__d_)
  * ```
  * Default implementation of \ref ml666_st_builder.
  */
@@ -28,11 +28,242 @@ struct ml666_st_builder_create_args {
   ml666__cb__malloc* malloc;
   ml666__cb__free*   free;
   struct ml666_hashed_buffer_set* buffer_set;
+  bool thread_confined; ///< The nodes are never used by more than one thread at a time. Their refcounts don't use atomic operations then. Unless a buffer_set is given, the builder gets its own thread confined one, which is destroyed with it.
+  bool stats; ///< Keep the counters for \ref ml666_st_builder_get_stats. Unless the builder is thread confined, that's two atomic additions for every allocation, so they are off by default.
 };
 
 ML666_EXPORT struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_builder_create_args args);
 #define ml666_st_builder_create(...) ml666_st_builder_create_p((struct ml666_st_builder_create_args){__VA_ARGS__})
 
+/**
+ * Creates another default builder, using the same allocators as stb, but a different buffer set.
+ * Nodes created by either of them can be moved between them, so long as the names they
+ * reference end up belonging to the buffer set of the builder releasing them.
+ * This allows building subtrees in other threads, which can't share a buffer set.
+ * \returns the new builder, or 0 if stb isn't a default builder or the allocation failed.
+ */
+ML666_EXPORT struct ml666_st_builder* ml666_st_builder_fork(struct ml666_st_builder* stb, struct ml666_hashed_buffer_set* buffer_set);
+
+/**
+ * \returns the buffer set used for the names, or 0 if stb isn't a default builder.
+ */
+ML666_EXPORT struct ml666_hashed_buffer_set* ml666_st_builder_get_buffer_set(struct ml666_st_builder* stb);
+
+/**
+ * \returns true if stb is a default builder created with \ref ml666_st_builder_create_args::thread_confined set.
+ * Its nodes can't be released in another thread while it's used, its forks are thread confined too.
+ */
+ML666_EXPORT bool ml666_st_builder_is_thread_confined(struct ml666_st_builder* stb);
+
+/**
+ * Adds an index of the elements by name to the document. It's built from the elements already in the document,
+ * and kept up to date by \ref ml666_st_member_set from then on, until the document is freed.
+ *
+ * Adding a member to or removing one from an indexed document has to find the document, which takes
+ * O(depth), and any elements in the subtree of the member are added to or removed from its index.
+ * Documents without an index aren't affected.
+ * \returns true on success, or if the document already has an index. False if stb isn't a default builder or the allocation failed.
+ */
+ML666_EXPORT bool ml666_st_document_index_names(struct ml666_st_builder* stb, struct ml666_st_document* document);
+
+/**
+ * Uses the index of the document to find the elements with the given name.
+ * The elements are in document order at first, elements added later are appended.
+ * \see ml666_st_document_index_names
+ * \see ml666_st_element_get_next_by_name
+ * \returns the first element with that name, or 0 if there is none or the document has no index.
+ */
+ML666_EXPORT struct ml666_st_element* ml666_st_document_get_first_by_name(struct ml666_st_builder* stb, struct ml666_st_document* document, const struct ml666_hashed_buffer* name);
+
+/**
+ * \returns the next element with the same name in the index of the document, or 0 if there is none.
+ * \see ml666_st_document_get_first_by_name
+ */
+ML666_EXPORT struct ml666_st_element* ml666_st_element_get_next_by_name(struct ml666_st_builder* stb, struct ml666_st_element* element);
+
+/**
+ * A hash of the subtree of the node: its element names, attributes, content, comments and the order of the children.
+ * The order of the attributes doesn't matter. Equal subtrees have equal hashes, different ones almost certainly don't.
+ *
+ * The hash of every document and element in the subtree is cached in the node, contents and comments are hashed
+ * again along with their parent. Changing a node discards the cached hashes of it and its ancestors, so asking
+ * again after a change only rehashes the nodes along the changed path and their direct children, and asking for
+ * an unchanged subtree is O(1). Because of the cache, this counts as changing the nodes when it comes to using
+ * them from multiple threads.
+ * \returns the hash, which is never 0. 0 if stb isn't a default builder, or if not all of the subtree could be loaded
+ *          or the cache couldn't be allocated.
+ */
+ML666_EXPORT uint64_t ml666_st_node_get_hash(struct ml666_st_builder* stb, struct ml666_st_node* node);
+
+/**
+ * A number which changes whenever the node or anything in its subtree changes. Once a generation has been returned,
+ * nodes which are changed or created afterwards get a newer one. So getting the same generation for a node at the same
+ * address again means the subtree is exactly as it was, even if the node was freed and replaced in between. Unlike the hash,
+ * this includes changing a subtree back to how it was, and changing only the order of the attributes.
+ *
+ * Like \ref ml666_st_node_get_hash, this counts as changing the node when it comes to using it from multiple threads.
+ * \returns the generation. 0 if stb isn't a default builder.
+ */
+ML666_EXPORT uint64_t ml666_st_node_get_generation(struct ml666_st_builder* stb, struct ml666_st_node* node);
+
+/**
+ * Node counts and memory use.
+ * \see ml666_st_builder_get_stats
+ * \see ml666_st_node_get_stats
+ */
+struct ml666_st_stats {
+  size_t document_count;
+  size_t element_count;
+  size_t content_count;
+  size_t comment_count;
+  size_t attribute_count;
+  size_t data_bytes; ///< The length of all content, comments and attribute values
+  size_t allocation_count; ///< The allocator usually needs another 8 to 16 bytes for each of them
+  size_t allocated_bytes; ///< The memory allocated for the nodes, attributes, data which isn't stored inline, and indices
+  size_t name_count; ///< Interned element and attribute names
+  size_t name_bytes; ///< The length of the interned names
+};
+
+/**
+ * Gets the counters of everything the builder currently has allocated.
+ *
+ * A fork has counters of its own. When it's destroyed, they are added to the counters of the builder it was forked from,
+ * which therefore has to exist until then. Nodes may be moved between them, only the sum of the counters is meaningful until then.
+ *
+ * The names are those of the buffer set of the builder, which may be shared with other builders.
+ * They are only known for buffer sets created using \ref ml666_default_hashed_buffer_set__create, and the global default one.
+ * \returns false if stb isn't a default builder, or wasn't created with \ref ml666_st_builder_create_args::stats set.
+ */
+ML666_EXPORT bool ml666_st_builder_get_stats(struct ml666_st_builder* stb, struct ml666_st_stats* stats);
+
+/**
+ * Counts the nodes, attributes, data and distinct names in the subtree of the node, including the node itself.
+ * The allocations are only known for the default builder. Data stored inline doesn't count as an allocation,
+ * nodes created by \ref ml666_st_build are counted with their share of the allocation they're in.
+ * This doesn't load lazily parsed elements, which haven't been loaded yet, they count as elements without attributes and children.
+ * \returns false if the allocation needed for counting the names failed.
+ */
+ML666_EXPORT bool ml666_st_node_get_stats(struct ml666_st_builder* stb, struct ml666_st_node* node, struct ml666_st_stats* stats);
+
+/**
+ * Creates a document from an ml666 document in memory, without parsing all of it.
+ *
+ * Only the top level is parsed at first. The other elements are found using the \ref ml666-structure-scanner,
+ * and only their names and where they are in the input are kept. Their attributes and children are parsed
+ * once they are first accessed using the \ref ml666_st_builder functions, one level at a time.
+ * Loading and memory use then depend on the parts of the document used, not on its size.
+ * Walking the whole tree, for example using \ref ml666_st_node_get_hash or a serializer, loads all of it.
+ * Freeing the document using \ref ml666_st_subtree_disintegrate doesn't load anything.
+ *
+ * Errors in an element are only found when it's loaded. \ref ml666_st_node_get_children then returns 0 for it,
+ * and it appears to have no attributes. A \ref ml666_st_cursor walking into it stops with \ref ml666_st_cursor::error set,
+ * so walking the tree, like \ref ml666_st_node_get_hash, the serializers and \ref ml666_st_clone do, fails instead of
+ * leaving it out. End tags aren't checked against the start tags.
+ * Loading an element counts as changing it when it comes to using the tree from multiple threads.
+ * \param stb The builder. It must be a default builder.
+ * \param input The whole document, for example a mapped file. It must stay valid until the document has been freed.
+ * \returns the document, or 0 if stb isn't a default builder or the top level couldn't be parsed.
+ */
+ML666_EXPORT struct ml666_st_document* ml666_st_parse_lazy(struct ml666_st_builder* stb, struct ml666_buffer_ro input);
+
+/**
+ * Creates a copy of a subtree which shares it with the original until either of them changes.
+ *
+ * A clone of an element starts out as an element with the same name, which refers to the original. Once its attributes
+ * or children are first accessed, it gets copies of the attributes, content and comments of the original, and its child
+ * elements become clones of those of the original in turn, one level at a time, like \ref ml666_st_parse_lazy does.
+ * A clone of a document gets its top level that way right away. Before the original or anything in its subtree changes,
+ * the clones which still refer to it get their copies first. So a clone always looks like the original did when it was
+ * created, and changing the clone doesn't affect the original.
+ *
+ * Cloning an element is O(1), cloning a document is O(n) in the number of its top level members. Changing something at
+ * depth d in the clone then copies the d elements above it, each with its direct children, everything else stays shared.
+ * This allows keeping the previous version of a document while the next one is made from the clone: making it only reads
+ * the original, so readers in other threads can keep using the original, as long as it's fully loaded and stays unchanged.
+ * Releasing it counts as changing it. An original which is removed from its tree keeps its children until its clones
+ * don't need them anymore, so \ref ml666_st_subtree_disintegrate doesn't free them yet.
+ *
+ * The builder keeps track of the clones, they have to be used with the same builder as the original.
+ * \see ml666_st_clone for a copy made right away, which works with any builder.
+ * \returns the clone, which doesn't have a parent. The caller owns the reference to it.
+ *          0 if stb isn't a default builder, or the allocation failed.
+ */
+ML666_EXPORT struct ml666_st_node* ml666_st_clone_lazy(struct ml666_st_builder* stb, struct ml666_st_node* node);
+
+/** \see ml666_st_build */
+struct ml666_st_attribute_description {
+  const struct ml666_hashed_buffer* name;
+  struct ml666_buffer_ro value; ///< Copied
+  bool has_value;
+};
+
+/** \see ml666_st_build */
+struct ml666_st_member_description {
+  enum ml666_st_node_type type; ///< \ref ML666_ST_NT_ELEMENT, \ref ML666_ST_NT_CONTENT or \ref ML666_ST_NT_COMMENT
+  size_t parent; ///< The index of the parent element. It must come earlier in the array. \ref ML666_ST_BUILD_PARENT for \ref ml666_st_build_args::parent.
+  const struct ml666_hashed_buffer* name; ///< For elements. Copied.
+  struct ml666_buffer_ro data; ///< For content and comments. Copied.
+  size_t attribute_count; ///< For elements. The names of the attributes of an element must differ.
+  const struct ml666_st_attribute_description* attribute;
+};
+
+/** \see ml666_st_member_description::parent */
+#define ML666_ST_BUILD_PARENT SIZE_MAX
+
+/** \see ml666_st_build */
+struct ml666_st_build_args {
+  struct ml666_st_builder* stb;
+  struct ml666_st_node* parent; ///< The document or element the members without a parent in the array are added to.
+  size_t count; ///< The number of members to be created
+  const struct ml666_st_member_description* member; ///< The members, every parent before its children.
+  // Optional
+  struct ml666_st_member* before; ///< Optional. A child of parent, the members are added before it. Per default, they are appended.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator, used for the data handed to builders other than the default one.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_build */
+ML666_EXPORT bool ml666_st_build_p(struct ml666_st_build_args args);
+/**
+ * Creates whole subtrees from an array of descriptions, and adds them to a parent. The children of each element are in array order.
+ *
+ * The default builder allocates all the nodes, attributes and data of the call together, in one allocation, and links them directly.
+ * That allocation is freed once all of them have been freed, so keeping a single node of it around keeps all of it.
+ * Other builders get the nodes created one at a time, using the \ref ml666_st_builder functions.
+ * \see ml666_st_build_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns true on success. On failure, nothing is added.
+ */
+#define ml666_st_build(...) ml666_st_build_p((struct ml666_st_build_args){__VA_ARGS__})
+
+/** \see ml666_st_compact */
+struct ml666_st_compact_args {
+  struct ml666_st_builder* stb;
+  struct ml666_st_node* node; ///< The root of the subtree to be compacted
+  // Optional
+  bool slab; ///< Optional. Move all the data which doesn't fit inline into one allocation. It's freed once all of that data has been replaced or freed.
+};
+
+/** \see ml666_st_compact */
+ML666_EXPORT bool ml666_st_compact_p(struct ml666_st_compact_args args);
+/**
+ * Reduces the memory used by a subtree, for documents which are kept around for a long time.
+ *
+ * Adjacent content nodes are merged into the first of them, and empty content nodes are removed.
+ * The removed nodes are released, anyone else holding a reference to one of them gets a detached node.
+ * Data which fits inline is moved into its node. Other data is copied into an allocation of exactly its size,
+ * or into the slab. Lazily parsed elements which haven't been loaded yet are left alone.
+ * \see ml666_st_compact_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns true on success. False if stb isn't a default builder or an allocation failed, the subtree may be partially compacted then.
+ */
+#define ml666_st_compact(...) ml666_st_compact_p((struct ml666_st_compact_args){__VA_ARGS__})
+
+/**
+ * Content, comments and attribute values up to this size are copied into the node, instead of being kept in a separate allocation.
+ * The buffer then points into the node itself.
+ */
+#define ML666_ST_INLINE_SIZE 24
+
 /**
  * This macro can be used for directly accessing the default simple tree data structures
  * It is recommended to use the API functions in simple-tree.h instead, because
@@ -45,7 +276,9 @@ ML666_EXPORT struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_
   \
   struct ml666_st_node { \
     enum ml666_st_node_type type; \
+    uint32_t block; /* For nodes created by ml666_st_build, how far into the allocation the node is. 0 otherwise. */ \
     struct ml666_refcount refcount; \
+    uint64_t generation; /* See ml666_st_node_get_generation */ \
   }; \
   \
   struct ml666_st_member { \
@@ -57,6 +290,9 @@ ML666_EXPORT struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_
   struct ml666_st_document { \
     struct ml666_st_node node; \
     struct ml666_st_children children; \
+    struct ml666_st_name_index* name_index; \
+    struct ml666_st_child_index* child_index; /* Built by ml666_st_child_at & ml666_st_child_count, kept while children are only appended */ \
+    uint64_t hash; /* 0 if it isn't known. Contents & comments don't keep theirs, elements keep it in their extra part. */ \
   }; \
   \
   struct ml666_st_attribute_set { \
@@ -79,9 +315,12 @@ ML666_EXPORT struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_
   \
   struct ml666_st_attribute { \
     struct ml666_st_attribute_set_entry entry; \
+    struct ml666_st_element* element; \
     const struct ml666_hashed_buffer_set_entry* name; \
     struct ml666_buffer value; \
+    uint32_t block; /* Like ml666_st_node::block */ \
     bool has_value; \
+    char inline_value[ML666_ST_INLINE_SIZE]; \
   }; \
   \
   struct ml666_st_element { \
@@ -89,16 +328,19 @@ ML666_EXPORT struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_
     struct ml666_st_children children; \
     const struct ml666_hashed_buffer_set_entry* name; \
     struct ml666_st_attribute_set attribute_list; \
+    struct ml666_st_element_extra* extra; /* The parts most elements never need, allocated on first use */ \
   }; \
   \
   struct ml666_st_content { \
     struct ml666_st_member member; \
     struct ml666_buffer buffer; \
+    char inline_buffer[ML666_ST_INLINE_SIZE]; \
   }; \
   \
   struct ml666_st_comment { \
     struct ml666_st_member member; \
     struct ml666_buffer buffer; \
+    char inline_buffer[ML666_ST_INLINE_SIZE]; \
   };
 
 /** @} */
@@ -0,0 +1,42 @@
+#ifndef ML666_SIMPLE_TREE_CLONE_H
+#define ML666_SIMPLE_TREE_CLONE_H
+
+#include <ml666/simple-tree.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-clone Simple Tree Clone
+ * Deep copies of subtrees, using only the functions of \ref ml666_st_builder.
+ *
+ * A clone is a full copy, creating it takes O(n) time and memory. Nothing is shared with the original,
+ * a member can only have one parent, so a subtree can't be shared between two trees.
+ * For the default builder, \ref ml666_st_clone_lazy creates copies which share the subtree until it changes.
+ * @{
+ */
+
+/** \see ml666_st_clone */
+struct ml666_st_clone_args {
+  struct ml666_st_builder* stb; ///< The builder of the node to be copied
+  struct ml666_st_node* node; ///< The root of the subtree to be copied. This may be a document or a member.
+  // Optional
+  struct ml666_st_builder* target; ///< Optional. The builder the copy is created with. Per default, stb.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator, used for the data handed to the target builder.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_clone */
+ML666_EXPORT struct ml666_st_node* ml666_st_clone_p(struct ml666_st_clone_args args);
+/**
+ * Copies a subtree, node by node. Element names, attributes, content, comments and the order of everything are kept.
+ * The copy doesn't have a parent. It doesn't recurse, so it works for subtrees of any depth.
+ * \see ml666_st_clone_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the root of the copy, or 0 on failure. The caller owns the reference to it.
+ */
+#define ml666_st_clone(...) ml666_st_clone_p((struct ml666_st_clone_args){__VA_ARGS__})
+
+/** @} */
+/** @} */
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef ML666_SIMPLE_TREE_DIFF_H
+#define ML666_SIMPLE_TREE_DIFF_H
+
+#include <ml666/simple-tree.h>
+#include <stddef.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-diff Simple Tree Diff
+ * Computing the changes between two trees, and applying them to another copy of the old one.
+ *
+ * \ref ml666_st_diff compares two trees, and creates an \ref ml666_st_edit_script, which turns the old tree into the new one.
+ * Subtrees with the same \ref ml666_st_node_get_hash are assumed to be equal and aren't looked at, so for the default builder,
+ * only the changed parts of the trees are visited. With other builders, everything is compared.
+ *
+ * Members are matched up with the members of the same parent in the other tree: equal subtrees first, then elements with the same
+ * name and other members of the same type, in order. Anything else is removed and inserted. Members only move within their parent.
+ *
+ * \ref ml666_st_patch applies the script. It only uses the functions of \ref ml666_st_builder, so the tree can belong to any builder.
+ * @{
+ */
+
+/** \see ml666_st_edit */
+enum ml666_st_edit_type {
+  ML666_ST_ET_REMOVE, ///< Remove the member at the path, with its subtree.
+  ML666_ST_ET_INSERT, ///< Insert a copy of \ref ml666_st_edit::node at the path.
+  ML666_ST_ET_MOVE,   ///< Move the member at position \ref ml666_st_edit::from among the same siblings to the path. \ref ml666_st_edit::from is always after the path, so members only move towards the front.
+  ML666_ST_ET_SET_ATTRIBUTE,    ///< Set the attribute \ref ml666_st_edit::name of the element at the path. It's added if it doesn't exist yet.
+  ML666_ST_ET_REMOVE_ATTRIBUTE, ///< Remove the attribute \ref ml666_st_edit::name of the element at the path.
+  ML666_ST_ET_SET_CONTENT,      ///< Replace the data of the content or comment at the path.
+};
+
+/**
+ * A single change. Everything it refers to belongs to the new tree.
+ */
+struct ml666_st_edit {
+  enum ml666_st_edit_type type;
+  /**
+   * The position of each node among its siblings, from a child of the root down to the node the edit is about.
+   * This is how it was when the edits before this one had been applied.
+   * For inserts and moves, the last entry is where the member will be afterwards.
+   */
+  const size_t* path;
+  size_t depth; ///< The number of entries in the path.
+  size_t from;  ///< For \ref ML666_ST_ET_MOVE, where the member is now.
+  struct ml666_st_node* node; ///< For \ref ML666_ST_ET_INSERT, the subtree to be copied.
+  const struct ml666_hashed_buffer* name; ///< For \ref ML666_ST_ET_SET_ATTRIBUTE and \ref ML666_ST_ET_REMOVE_ATTRIBUTE
+  struct ml666_buffer_ro value; ///< For \ref ML666_ST_ET_SET_ATTRIBUTE and \ref ML666_ST_ET_SET_CONTENT
+  bool has_value; ///< For \ref ML666_ST_ET_SET_ATTRIBUTE, whether the attribute has a value.
+};
+
+/**
+ * The edits, in the order they have to be applied.
+ * The script refers to the new tree, it mustn't be changed or freed until the script has been destroyed.
+ */
+struct ml666_st_edit_script {
+  size_t count;
+  const struct ml666_st_edit* edit;
+};
+
+/** \see ml666_st_diff */
+struct ml666_st_diff_args {
+  struct ml666_st_builder* stb; ///< The builder of both trees
+  struct ml666_st_node* from; ///< The old tree
+  struct ml666_st_node* to;   ///< The new tree. It must be of the same type as the old one, and for elements, have the same name.
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator. Also used for the data \ref ml666_st_patch hands to the builder.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_diff */
+ML666_EXPORT struct ml666_st_edit_script* ml666_st_diff_p(struct ml666_st_diff_args args);
+/**
+ * Computes the edits which turn the old tree into the new one.
+ * \see ml666_st_diff_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the edit script, or 0 on failure. It has to be freed using \ref ml666_st_edit_script_destroy.
+ */
+#define ml666_st_diff(...) ml666_st_diff_p((struct ml666_st_diff_args){__VA_ARGS__})
+
+/**
+ * Applies the edits to a tree equal to the old tree the script was created from.
+ * Inserted subtrees are copied from the new tree.
+ * \param stb The builder of the tree to be changed. It doesn't have to be the one of the trees the script was created from.
+ * \param root The root of the tree to be changed
+ * \param script The edits
+ * \returns true on success. False if an edit doesn't fit the tree or something failed, the edits before it remain applied.
+ */
+ML666_EXPORT bool ml666_st_patch(struct ml666_st_builder* stb, struct ml666_st_node* root, const struct ml666_st_edit_script* script);
+
+/**
+ * Frees the edit script.
+ */
+ML666_EXPORT void ml666_st_edit_script_destroy(struct ml666_st_edit_script* script);
+
+/** @} */
+/** @} */
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef ML666_SIMPLE_TREE_FROZEN_H
+#define ML666_SIMPLE_TREE_FROZEN_H
+
+#include <ml666/simple-tree.h>
+#include <stddef.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-frozen Frozen Simple Tree
+ * A compact, read-only copy of a finished document.
+ *
+ * \ref ml666_st_freeze copies a document into a single allocation. The nodes are stored in pre-order
+ * in a node table, the rest is kept in separate columns indexed by the position in that table:
+ * the parent, the previous sibling, the size of the subtree, the name or text, and the attributes.
+ * All names are stored once, all text is in one contiguous pool.
+ * The frozen document can be read using the usual functions of an \ref ml666_st_builder,
+ * so the serializers work on it too. Everything modifying it fails.
+ *
+ * The nodes don't have their own reference count, referencing any node references the document.
+ * It's freed once the last reference is released, there is no need for \ref ml666_st_subtree_disintegrate.
+ * @{
+ */
+
+ML666_ST_DECLARATION_FULL(ml666_frozen, ml666_st__f_)
+
+/**
+ * ```
+ * ML666_ST_DECLARATION_FULL(ml666_frozen, ml666_st__f_)
+ * ```
+ * Read-only implementation of \ref ml666_st_builder for frozen documents.
+ */
+ML666_EXPORT extern const struct ml666_st_cb ml666_frozen_st_api;
+
+/** \see ml666_st_frozen_builder_create */
+struct ml666_st_frozen_builder_create_args {
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_frozen_builder_create */
+ML666_EXPORT struct ml666_st_builder* ml666_st_frozen_builder_create_p(struct ml666_st_frozen_builder_create_args args);
+/**
+ * Creates the \ref ml666_st_builder for frozen documents. Use \ref ml666_st_freeze to create them.
+ * \see ml666_st_frozen_builder_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ */
+#define ml666_st_frozen_builder_create(...) ml666_st_frozen_builder_create_p((struct ml666_st_frozen_builder_create_args){__VA_ARGS__})
+
+/**
+ * Copies a document into a frozen document. The original document is left as it is.
+ * \param frozen A builder created using \ref ml666_st_frozen_builder_create. The new document belongs to it.
+ * \param stb The builder of the document to be copied
+ * \param document The document to be copied
+ * \returns the frozen document, or 0 on failure. It has to be released using \ref ml666_st_node_put with the frozen builder.
+ */
+ML666_EXPORT struct ml666_st_document* ml666_st_freeze(struct ml666_st_builder* frozen, struct ml666_st_builder* stb, struct ml666_st_document* document);
+
+/** @} */
+/** @} */
+
+#endif
@@ -20,6 +20,7 @@ struct ml666_st_ml666_serializer_create_args {
   void* user_ptr;
   ml666__cb__malloc* malloc;
   ml666__cb__free*   free;
+  struct ml666_st_serializer_cache* cache; ///< Optional. Used to only encode the subtrees which changed since the last time.
 };
 ML666_EXPORT struct ml666_st_serializer* ml666_st_ml666_serializer_create_p(struct ml666_st_ml666_serializer_create_args args);
 #define ml666_st_ml666_serializer_create(...) ml666_st_ml666_serializer_create_p((struct ml666_st_ml666_serializer_create_args){__VA_ARGS__})
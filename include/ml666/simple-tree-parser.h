@@ -2,6 +2,7 @@
 #define ML666_SIMPLE_TREE_PARSER_H
 
 #include <ml666/common.h>
+#include <ml666/parser.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -27,6 +28,8 @@ struct ml666_simple_tree_parser {
   size_t column; ///< The current column being processed.
   const char* error; ///< If an error occurs, this will be set to an error message.
   void* user_ptr; ///< A userspecified pointer
+  size_t offset; ///< The number of bytes read from the input so far.
+  size_t token_count; ///< The number of complete tokens processed so far.
 };
 
 typedef void ml666_simple_tree_parser_cb_destroy(struct ml666_simple_tree_parser* stp); ///< \see ml666_simple_tree_parser_destroy
@@ -49,6 +52,7 @@ struct ml666_simple_tree_parser_create_args {
   // Optional
   struct ml666_parser* parser; ///< Optional. The ml666 parser. The simple_tree_parser will take care of the cleanup.
   struct ml666_tokenizer* tokenizer; ///< Optional. The tokenizer. The simple_tree_parser will take care of the cleanup.
+  bool detached; ///< Optional. Don't create a parser. Feed it using \ref ml666_simple_tree_parser_api instead, for example using a parser tee.
   void* user_ptr; ///< Optional. A userspecified pointer.
   ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
   ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
@@ -62,6 +66,13 @@ ML666_EXPORT struct ml666_simple_tree_parser* ml666_simple_tree_parser_create_p(
  */
 #define ml666_simple_tree_parser_create(...) ml666_simple_tree_parser_create_p((struct ml666_simple_tree_parser_create_args){__VA_ARGS__})
 
+/**
+ * The \ref ml666_parser_api of the default implementation. The user_ptr of the parser must be the \ref ml666_simple_tree_parser.
+ * This is only needed for a detached \ref ml666_simple_tree_parser, see \ref ml666_simple_tree_parser_create_args.
+ * In that case, \ref ml666_simple_tree_parser_next must not be used, the line, column & error fields are not updated either.
+ */
+ML666_EXPORT extern const struct ml666_parser_api ml666_simple_tree_parser_api;
+
 /**
  * Destroys the \ref ml666_simple_tree_parser instance.
  */
@@ -81,6 +92,33 @@ static inline bool ml666_simple_tree_parser_next(struct ml666_simple_tree_parser
   return stp->cb->next(stp);
 }
 
+/**
+ * Like \ref ml666_simple_tree_parser_next, but keeps on parsing until a budget has been used up.
+ * It also returns early if no progress could be made without blocking.
+ * The progress made can be checked using stp->offset and stp->token_count.
+ * \see ml666_parser_next_budget
+ * \param stp The simple tree parser
+ * \param max_bytes The maximum number of input bytes to be read, 0 for no limit.
+ * \param max_tokens The maximum number of complete tokens to be processed, 0 for no limit.
+ * \returns true if it's not done yet, false otherwise
+ */
+static inline bool ml666_simple_tree_parser_next_budget(struct ml666_simple_tree_parser* stp, size_t max_bytes, size_t max_tokens){
+  const size_t offset = stp->offset;
+  const size_t token_count = stp->token_count;
+  while(true){
+    const size_t last_offset = stp->offset;
+    const size_t last_token_count = stp->token_count;
+    if(!ml666_simple_tree_parser_next(stp))
+      return false;
+    if(max_bytes && stp->offset - offset >= max_bytes)
+      return true;
+    if(max_tokens && stp->token_count - token_count >= max_tokens)
+      return true;
+    if(stp->offset == last_offset && stp->token_count == last_token_count)
+      return true;
+  }
+}
+
 /**
  * This can only be called once (returns 0 after that).
  *
@@ -117,6 +155,36 @@ static inline struct ml666_st_document* ml666_st_parse_p(struct ml666_simple_tre
   return result;
 }
 
+/** \see ml666_st_parse_parallel */
+struct ml666_st_parse_parallel_args {
+  struct ml666_st_builder* stb; ///< The \ref ml666_st_builder for creating the ml666 document tree. It must be a default builder, see \ref ml666_st_builder_fork.
+  struct ml666_buffer_ro input; ///< The whole ml666 document
+  // Optional
+  unsigned thread_count; ///< Optional. The number of threads to use, including the current one. 0 for the number of online CPUs.
+  size_t min_slice_size; ///< Optional. The minimum size of the parts the content is split into, in bytes. 64KiB per default.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator. It must be thread safe.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator. It must be thread safe.
+  ml666__cb__free*    free; ///< Optional. Custom allocator. It must be thread safe.
+};
+/** \see ml666_st_parse_parallel */
+ML666_EXPORT struct ml666_st_document* ml666_st_parse_parallel_p(struct ml666_st_parse_parallel_args args);
+/**
+ * Parses a whole document in memory using multiple threads.
+ *
+ * The document is prescanned using the \ref ml666-structure-scanner. The content of the top level element with
+ * the most children is split in front of its child elements, and the parts are parsed in parallel, every thread
+ * using its own forked builder. Their members are then moved to the element in document order.
+ * The allocators of the builder are used in all threads, so they must be thread safe too.
+ *
+ * If the document can't be split, or if there is any error, it is parsed sequentially,
+ * which also makes sure the error messages are the same as for \ref ml666_st_parse.
+ *
+ * \see ml666_st_parse_parallel_args for the arguments
+ * \returns the \ref ml666_st_document_t document, or 0 on error
+ */
+#define ml666_st_parse_parallel(...) ml666_st_parse_parallel_p((struct ml666_st_parse_parallel_args){__VA_ARGS__})
+
 /** @} */
 /** @} */
 
@@ -0,0 +1,66 @@
+#ifndef ML666_SIMPLE_TREE_RECLAIMER_H
+#define ML666_SIMPLE_TREE_RECLAIMER_H
+
+#include <ml666/simple-tree.h>
+#include <stdbool.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-reclaimer Deferred Simple Tree Destruction
+ * Frees trees of the default \ref ml666_st_builder in a background thread.
+ *
+ * Freeing a big tree takes about as long as building it. Nodes passed to \ref ml666_st_reclaim
+ * are queued, and disintegrated & released by a thread of the reclaimer instead.
+ *
+ * The names of the elements and attributes belong to the buffer set of the builder, which can't be
+ * used by multiple threads. The reclaimer thread only counts the name references it drops. They are
+ * released in the thread owning the builder, by \ref ml666_st_reclaimer_collect.
+ * That's just a refcount decrement per name reference, the nodes aren't touched.
+ * @{
+ */
+
+struct ml666_st_reclaimer;
+
+/** \see ml666_st_reclaimer_create */
+struct ml666_st_reclaimer_create_args {
+  struct ml666_st_builder* stb; ///< The default builder the nodes to be freed belong to. It mustn't be thread confined.
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_reclaimer_create */
+ML666_EXPORT struct ml666_st_reclaimer* ml666_st_reclaimer_create_p(struct ml666_st_reclaimer_create_args args);
+/**
+ * Creates a reclaimer and starts its thread.
+ * \see ml666_st_reclaimer_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the reclaimer, or 0 if stb isn't a default builder, is thread confined, or something failed.
+ */
+#define ml666_st_reclaimer_create(...) ml666_st_reclaimer_create_p((struct ml666_st_reclaimer_create_args){__VA_ARGS__})
+
+/**
+ * Hands a node over to the reclaimer. It takes over the reference of the caller.
+ * The node must be a document, or a member without a parent.
+ * Nothing else may still reference any node of the subtree.
+ * This also does a \ref ml666_st_reclaimer_collect.
+ * \returns true on success. On failure, the caller keeps the reference.
+ */
+ML666_EXPORT bool ml666_st_reclaim(struct ml666_st_reclaimer* reclaimer, struct ml666_st_node* node);
+
+/**
+ * Releases the name references dropped by the reclaimer thread so far.
+ * This has to be called by the thread using the builder.
+ */
+ML666_EXPORT void ml666_st_reclaimer_collect(struct ml666_st_reclaimer* reclaimer);
+
+/**
+ * Waits until all queued nodes are freed, collects the names, and stops the thread.
+ */
+ML666_EXPORT void ml666_st_reclaimer_destroy(struct ml666_st_reclaimer* reclaimer);
+
+/** @} */
+/** @} */
+
+#endif
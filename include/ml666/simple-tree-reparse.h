@@ -0,0 +1,76 @@
+#ifndef ML666_SIMPLE_TREE_REPARSE_H
+#define ML666_SIMPLE_TREE_REPARSE_H
+
+#include <ml666/simple-tree.h>
+
+/**
+ * \addtogroup ml666-simple-tree Simple Tree API
+ * @{
+ * \addtogroup ml666-simple-tree-reparse Simple Tree Incremental Reparse
+ * Updates a document after its source was edited, without parsing all of it again.
+ *
+ * A \ref ml666_st_source_map remembers where the start & end tags of every element are in the source.
+ * When a part of the source is replaced, only the part from the element boundary before the edit to the one after it
+ * is parsed again, and the members in between are replaced with the result. If that part isn't a complete fragment
+ * on its own, for example because an edit removed an end tag or opened a string, it's extended to the boundaries of
+ * the parent element, until the tokens after it are the same as before again. The time it takes depends on the size
+ * of the part parsed again, not on the size of the document.
+ * @{
+ */
+
+/**
+ * The positions of the tags of all the elements of a document in its source.
+ * Create it using \ref ml666_st_source_map_create.
+ * It doesn't take any references. The document must only be changed using \ref ml666_st_reparse while the map is used.
+ */
+struct ml666_st_source_map;
+
+/** \see ml666_st_source_map_create */
+struct ml666_st_source_map_create_args {
+  struct ml666_st_builder* stb; ///< The builder of the document
+  struct ml666_st_document* document; ///< The document
+  struct ml666_buffer_ro input; ///< The source the document was parsed from
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_st_source_map_create */
+ML666_EXPORT struct ml666_st_source_map* ml666_st_source_map_create_p(struct ml666_st_source_map_create_args args);
+/**
+ * Creates an \ref ml666_st_source_map, using the \ref ml666-structure-scanner.
+ * \see ml666_st_source_map_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the map, or 0 if the input doesn't match the document
+ */
+#define ml666_st_source_map_create(...) ml666_st_source_map_create_p((struct ml666_st_source_map_create_args){__VA_ARGS__})
+
+/**
+ * Destroys the \ref ml666_st_source_map. The document isn't affected.
+ */
+ML666_EXPORT void ml666_st_source_map_destroy(struct ml666_st_source_map* map);
+
+/** \see ml666_st_reparse */
+struct ml666_st_reparse_args {
+  struct ml666_st_source_map* map; ///< The source map of the document
+  struct ml666_buffer_ro input; ///< The source before the edit
+  size_t offset; ///< Where the replaced part of the source starts
+  size_t length; ///< The length of the replaced part of the source
+  struct ml666_buffer_ro replacement; ///< What it's replaced with
+  // Optional
+  size_t* reparsed; ///< Optional. Set to the number of bytes which were parsed again.
+};
+/** \see ml666_st_reparse */
+ML666_EXPORT bool ml666_st_reparse_p(struct ml666_st_reparse_args args);
+/**
+ * Applies an edit of the source to the document, and updates the source map.
+ * The members which were parsed again are new nodes, all the others are kept.
+ * \see ml666_st_reparse_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns true on success. On failure, for example if the edited source isn't valid, the document & map are left unchanged.
+ */
+#define ml666_st_reparse(...) ml666_st_reparse_p((struct ml666_st_reparse_args){__VA_ARGS__})
+
+/** @} */
+/** @} */
+
+#endif
@@ -46,6 +46,81 @@ static inline bool ml666_st_serialize(struct ml666_st_serializer* serializer){
   return true;
 }
 
+/**
+ * \addtogroup ml666-simple-tree-serializer-cache Serializer Cache
+ * Remembers the output of a serializer for each subtree, so that serializing the same tree again after a small change
+ * only encodes what changed. The output of unchanged subtrees is copied from the previous run.
+ *
+ * A subtree counts as unchanged if \ref ml666_st_node_get_generation of its root is the same as last time,
+ * and it's at the same depth. This only works with the default builder, with other builders, nothing is remembered.
+ * Only the output of the last complete run is kept, which is about as big as the output.
+ *
+ * A cache can be passed to the create function of the ml666 and JSON serializers. It must always be used with the same
+ * kind of serializer and the same builder, and only by one serializer at a time.
+ * The other functions are for implementing serializers.
+ * @{
+ */
+
+struct ml666_st_node;
+struct ml666_st_serializer_cache;
+
+/** \see ml666_st_serializer_cache_create */
+struct ml666_st_serializer_cache_create_args {
+  // Optional
+  size_t min_size; ///< Optional. Subtrees with less output than this aren't remembered. Per default, 256 bytes.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
+  ml666__cb__free*   free; ///< Optional. Custom allocator.
+};
+
+/** \see ml666_st_serializer_cache_create */
+ML666_EXPORT struct ml666_st_serializer_cache* ml666_st_serializer_cache_create_p(struct ml666_st_serializer_cache_create_args args);
+/**
+ * Creates an empty cache.
+ * \see ml666_st_serializer_cache_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ * \returns the cache, or 0 on failure.
+ */
+#define ml666_st_serializer_cache_create(...) ml666_st_serializer_cache_create_p((struct ml666_st_serializer_cache_create_args){__VA_ARGS__})
+
+/**
+ * Frees the cache. It mustn't be in use by a serializer anymore.
+ */
+ML666_EXPORT void ml666_st_serializer_cache_destroy(struct ml666_st_serializer_cache* cache);
+
+/**
+ * Starts a run. The output of the last complete run can be used until \ref ml666_st_serializer_cache_end is called.
+ * \param format Something which identifies the kind of serializer, such as the address of its callbacks.
+ * \returns false if the cache is already in use, or was used with another kind of serializer or builder.
+ */
+ML666_EXPORT bool ml666_st_serializer_cache_begin(struct ml666_st_serializer_cache* cache, struct ml666_st_builder* stb, const void* format);
+
+/**
+ * Called when the serializer is about to write a node, after everything before it was passed to \ref ml666_st_serializer_cache_output.
+ * \param level Anything else the output of the node depends on, usually how deep it is.
+ * \param output Set to the output of the node if it's unchanged. It stays valid until the end of the run.
+ * \returns true if the output is known. The serializer then writes that instead, and skips the node and its children.
+ * Writing a node mustn't change how the nodes after it are written.
+ */
+ML666_EXPORT bool ml666_st_serializer_cache_enter(struct ml666_st_serializer_cache* cache, struct ml666_st_node* node, unsigned level, struct ml666_buffer_ro* output);
+
+/**
+ * Called when all the output of a node was passed to \ref ml666_st_serializer_cache_output.
+ * It can be called for nodes for which \ref ml666_st_serializer_cache_enter returned true too, it does nothing then.
+ */
+ML666_EXPORT void ml666_st_serializer_cache_leave(struct ml666_st_serializer_cache* cache, struct ml666_st_node* node);
+
+/**
+ * Adds to the output of the run. All of it has to be passed here, in order.
+ */
+ML666_EXPORT void ml666_st_serializer_cache_output(struct ml666_st_serializer_cache* cache, struct ml666_buffer_ro data);
+
+/**
+ * Ends the run. If it was complete, its output replaces the remembered one. Otherwise, it's discarded.
+ */
+ML666_EXPORT void ml666_st_serializer_cache_end(struct ml666_st_serializer_cache* cache, bool complete);
+
+/** @} */
+
 /** @} */
 /** @} */
 
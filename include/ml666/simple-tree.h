@@ -119,6 +119,8 @@ typedef struct ml666_st_comment ml666_st_comment_t;
  * and create your own \ref ml666_simple_tree_parser instance.
  * There are some helpful macros for declaring and defining the necessary datastructures,
  * the compiler will tell you about any functions which still need to be implemented.
+ * child_count, child_at, cursor_next and subtree_disintegrate are optional, if they are 0,
+ * the generic implementations using the other callbacks are used.
  *
  * \see \ref ml666-simple-tree
  * \see ML666_ST_DECLARATION
@@ -245,6 +247,35 @@ typedef struct ml666_st_builder {
     const struct ml666_st_member*: (const struct ml666_st_children*)ml666_st_node_get_children((STB), (void*)(X)) \
   )
 
+/**
+ * What an \ref ml666_st_cursor did in its last step.
+ */
+enum ml666_st_cursor_event {
+  ML666_ST_CE_START, ///< The cursor hasn't moved yet
+  ML666_ST_CE_ENTER, ///< The cursor arrived at a node. Its children, if any, come next.
+  ML666_ST_CE_LEAVE, ///< The cursor is done with the node and all its children. Every node entered is also left.
+  ML666_ST_CE_END, ///< The whole subtree has been walked
+};
+
+/**
+ * A pre-order walk over a subtree, without any recursion.
+ * This is the cheapest way to visit every node of a subtree, the builder can implement it natively.
+ *
+ * The cursor doesn't hold any references. The subtree must not be restructured while it is walked.
+ * The nodes themselves may be changed, so long as they stay where they are.
+ *
+ * \see ml666_st_cursor_create
+ * \see ml666_st_cursor_next
+ */
+struct ml666_st_cursor {
+  struct ml666_st_node* root; ///< The node whose subtree is walked. It's entered first and left last.
+  struct ml666_st_node* node; ///< The current node
+  size_t depth; ///< The depth of the current node. The root has a depth of 0.
+  enum ml666_st_cursor_event event; ///< What happened at the current node
+  bool skip; ///< Don't enter the children of the current node. \see ml666_st_cursor_skip
+  bool error; ///< The children of the current node couldn't be gotten, for example because they couldn't be loaded. The walk ends there.
+};
+
 /**
  * The flags for \ref ml666_st_attribute_lookup.
  * These can be combined.
@@ -297,6 +328,13 @@ enum ml666_st_attribute_lookup_flags {
   X(get_first_child /** \see ml666_st_get_first_child */, struct ml666_st_member*, (struct ml666_st_builder* stb, struct ml666_st_children* children), __VA_ARGS__) \
   X(get_last_child /** \see ml666_st_get_last_child */, struct ml666_st_member*, (struct ml666_st_builder* stb, struct ml666_st_children* children), __VA_ARGS__)
 
+// These callbacks may be 0, the *_generic functions are used instead then
+#define ML666__ST_CB_OPTIONAL(X, ...) \
+  X(child_count /** \see ml666_st_child_count */, size_t, (struct ml666_st_builder* stb, struct ml666_st_children* children), __VA_ARGS__) \
+  X(child_at /** \see ml666_st_child_at */, struct ml666_st_member*, (struct ml666_st_builder* stb, struct ml666_st_children* children, size_t index), __VA_ARGS__) \
+  X(cursor_next /** \see ml666_st_cursor_next */, bool, (struct ml666_st_builder* stb, struct ml666_st_cursor* cursor), __VA_ARGS__) \
+  X(subtree_disintegrate /** \see ml666_st_subtree_disintegrate */, void, (struct ml666_st_builder* stb, struct ml666_st_children* children), __VA_ARGS__)
+
 
 #define ML666__ST_DECLARATION_SUB(FUNC, _1, _2, PREFIX) ML666_EXPORT ml666_st_cb_ ## FUNC PREFIX ## _ ## FUNC;
 #define ML666__ST_IMPLEMENTATION_SUB(X, _1, _2, PREFIX) .X = PREFIX ## _ ## X,
@@ -319,7 +357,7 @@ enum ml666_st_attribute_lookup_flags {
   ML666__ST_CB(ML666__ST_DECLARATION_SUB, PREFIX)
 
 /**
- * Creates a ml666_st_cb and fills in all the members.
+ * Creates a ml666_st_cb and fills in all the members, except for the optional ones.
  * Also includes \ref ML666_ST_DECLARATION
  * \see ML666_ST_DECLARATION for the details on how the members are called and so on.
  */
@@ -329,10 +367,30 @@ enum ml666_st_attribute_lookup_flags {
     ML666__ST_CB(ML666__ST_IMPLEMENTATION_SUB, PREFIX) \
   };
 
+/**
+ * Like \ref ML666_ST_DECLARATION, but also declares the optional callbacks
+ * (child_count, child_at, cursor_next and subtree_disintegrate).
+ */
+#define ML666_ST_DECLARATION_FULL(NAME, PREFIX) \
+  ML666_ST_DECLARATION(NAME, PREFIX) \
+  ML666__ST_CB_OPTIONAL(ML666__ST_DECLARATION_SUB, PREFIX)
+
+/**
+ * Like \ref ML666_ST_IMPLEMENTATION, but also fills in the optional callbacks.
+ * Also includes \ref ML666_ST_DECLARATION_FULL
+ */
+#define ML666_ST_IMPLEMENTATION_FULL(NAME, PREFIX) \
+  ML666_ST_DECLARATION_FULL(NAME, PREFIX) \
+  const struct ml666_st_cb NAME ## _st_api = { \
+    ML666__ST_CB(ML666__ST_IMPLEMENTATION_SUB, PREFIX) \
+    ML666__ST_CB_OPTIONAL(ML666__ST_IMPLEMENTATION_SUB, PREFIX) \
+  };
+
 
 // Callback function types
 #define X(FUNC, RET, PARAMS, _) typedef RET ml666_st_cb_ ## FUNC PARAMS;
 ML666__ST_CB(X, _)
+ML666__ST_CB_OPTIONAL(X, _)
 #undef X
 
 /**
@@ -343,6 +401,7 @@ ML666__ST_CB(X, _)
 struct ml666_st_cb {
 #define X2(FUNC, _1, _2, _3) ml666_st_cb_ ## FUNC* FUNC;
   ML666__ST_CB(X2, _)
+  ML666__ST_CB_OPTIONAL(X2, _) // May be 0
 #undef X2
 };
 
@@ -512,7 +571,8 @@ static inline struct ml666_st_attribute* ml666_st_attribute_get_first(const stru
 
 /**
  * Sets the content data of the content node.
- * The data is contained in a ml666_buffer, it will not be dublicated, the content node takes ownership of the data.
+ * The data is contained in a ml666_buffer, the content node takes ownership of the data.
+ * The builder may copy short data elsewhere and free the buffer right away, so don't use it anymore after this.
  * Any previousely set data will be freed.
  * \memberof ml666_st_content
  * \param stb The simple tree builder instance used to create the node
@@ -534,7 +594,12 @@ static inline struct ml666_buffer_ro ml666_st_content_get(struct ml666_st_builde
   return stb->cb->content_get(stb, content);
 }
 /**
+ * Take the data out of the content node. The node is empty afterwards.
  * \memberof ml666_st_content
+ * \param stb The simple tree builder instance used to create the node
+ * \param content The content node
+ * \returns The data, which belongs to the caller now. If it couldn't be moved out of the node,
+ *          an empty buffer is returned, and the node keeps its data.
  */
 static inline struct ml666_buffer ml666_st_content_take(struct ml666_st_builder* stb, struct ml666_st_content* content){
   return stb->cb->content_take(stb, content);
@@ -552,7 +617,12 @@ static inline struct ml666_buffer_ro ml666_st_comment_get(struct ml666_st_builde
   return stb->cb->comment_get(stb, comment);
 }
 /**
+ * Take the data out of the comment node. The node is empty afterwards.
  * \memberof ml666_st_comment
+ * \param stb The simple tree builder instance used to create the node
+ * \param comment The comment node
+ * \returns The data, which belongs to the caller now. If it couldn't be moved out of the node,
+ *          an empty buffer is returned, and the node keeps its data.
  */
 static inline struct ml666_buffer ml666_st_comment_take(struct ml666_st_builder* stb, struct ml666_st_comment* comment){
   return stb->cb->comment_take(stb, comment);
@@ -577,11 +647,22 @@ static inline bool ml666_st_attribute_set_value(struct ml666_st_builder* stb, st
 static inline const struct ml666_buffer_ro* ml666_st_attribute_get_value(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
   return stb->cb->attribute_get_value(stb, attribute);
 }
+/**
+ * Take the value out of the attribute. The attribute has no value afterwards.
+ * \returns The value, which belongs to the caller now, or 0 if the attribute has no value.
+ *          0 is also returned if the value couldn't be moved out of the attribute, which keeps it then.
+ */
 static inline const struct ml666_buffer* ml666_st_attribute_take_value(struct ml666_st_builder* stb, struct ml666_st_attribute* attribute){
   return stb->cb->attribute_take_value(stb, attribute);
 }
 /** @} */
 
+// Used for the optional callbacks a builder doesn't have, see below
+static inline size_t ml666_st_child_count_generic(struct ml666_st_builder* stb, struct ml666_st_children* children);
+static inline struct ml666_st_member* ml666_st_child_at_generic(struct ml666_st_builder* stb, struct ml666_st_children* children, size_t index);
+static inline bool ml666_st_cursor_next_generic(struct ml666_st_builder* stb, struct ml666_st_cursor* cursor);
+static inline void ml666_st_subtree_disintegrate_generic(struct ml666_st_builder* stb, struct ml666_st_children* children);
+
 /**
  * \memberof ml666_st_children
  * @{
@@ -596,6 +677,27 @@ static inline struct ml666_st_member* ml666_st_get_last_child(struct ml666_st_bu
     return 0;
   return stb->cb->get_last_child(stb, children);
 }
+/**
+ * \returns the number of children
+ */
+static inline size_t ml666_st_child_count(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  if(!children)
+    return 0;
+  if(!stb->cb->child_count)
+    return ml666_st_child_count_generic(stb, children);
+  return stb->cb->child_count(stb, children);
+}
+/**
+ * \param index The position of the child, 0 for the first one
+ * \returns the child at that position, or 0 if there are not that many children
+ */
+static inline struct ml666_st_member* ml666_st_child_at(struct ml666_st_builder* stb, struct ml666_st_children* children, size_t index){
+  if(!children)
+    return 0;
+  if(!stb->cb->child_at)
+    return ml666_st_child_at_generic(stb, children, index);
+  return stb->cb->child_at(stb, children, index);
+}
 /** @} */
 
 
@@ -639,17 +741,140 @@ static inline struct ml666_st_children* ml666_st_node_get_children(struct ml666_
 }
 
 /**
+ * Creates a cursor for walking the subtree of root, root included.
+ * \memberof ml666_st_cursor
+ */
+static inline struct ml666_st_cursor ml666_st_cursor_create(struct ml666_st_node* root){
+  return (struct ml666_st_cursor){
+    .root = root,
+    .node = root,
+  };
+}
+
+/**
+ * Moves the cursor to the next node, or leaves the current one.
+ * \memberof ml666_st_cursor
+ * \returns false once the whole subtree has been walked, or if \ref ml666_st_cursor::error got set
+ */
+static inline bool ml666_st_cursor_next(struct ml666_st_builder* stb, struct ml666_st_cursor* cursor){
+  if(!stb->cb->cursor_next)
+    return ml666_st_cursor_next_generic(stb, cursor);
+  return stb->cb->cursor_next(stb, cursor);
+}
+
+/**
+ * After an \ref ML666_ST_CE_ENTER, this makes the next step leave the node, instead of entering its children.
+ * \memberof ml666_st_cursor
+ */
+static inline void ml666_st_cursor_skip(struct ml666_st_cursor* cursor){
+  cursor->skip = true;
+}
+
+/**
+ * An implementation of \ref ml666_st_cursor_next using only the other callbacks.
+ * Builders without a faster way to walk their trees can use this one.
+ * \memberof ml666_st_cursor
+ */
+static inline bool ml666_st_cursor_next_generic(struct ml666_st_builder* stb, struct ml666_st_cursor* cursor){
+  struct ml666_st_node* node = cursor->node;
+  const bool skip = cursor->skip;
+  cursor->skip = false;
+  switch(cursor->event){
+    case ML666_ST_CE_START: {
+      cursor->event = ML666_ST_CE_ENTER;
+    } return true;
+    case ML666_ST_CE_ENTER: {
+      struct ml666_st_member* child = 0;
+      if(!skip){
+        const enum ml666_st_node_type type = ML666_ST_TYPE(node);
+        struct ml666_st_children* children = ml666_st_node_get_children(stb, node);
+        if(!children && (type == ML666_ST_NT_DOCUMENT || type == ML666_ST_NT_ELEMENT)){
+          cursor->error = true;
+          break;
+        }
+        child = ml666_st_get_first_child(stb, children);
+      }
+      if(child){
+        cursor->node = ML666_ST_NODE(child);
+        cursor->depth += 1;
+      }else{
+        cursor->event = ML666_ST_CE_LEAVE;
+      }
+    } return true;
+    case ML666_ST_CE_LEAVE: {
+      if(node == cursor->root)
+        break;
+      struct ml666_st_member* member = (struct ml666_st_member*)node;
+      struct ml666_st_member* next = ml666_st_member_get_next(stb, member);
+      if(next){
+        cursor->node = ML666_ST_NODE(next);
+        cursor->event = ML666_ST_CE_ENTER;
+      }else{
+        cursor->node = ml666_st_member_get_parent(stb, member);
+        cursor->depth -= 1;
+      }
+    } return true;
+    case ML666_ST_CE_END: break;
+  }
+  cursor->event = ML666_ST_CE_END;
+  return false;
+}
+
+/**
+ * An implementation of \ref ml666_st_child_count using only the other callbacks. It walks all the children.
+ * \memberof ml666_st_children
+ */
+static inline size_t ml666_st_child_count_generic(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  size_t count = 0;
+  for(struct ml666_st_member* it=ml666_st_get_first_child(stb, children); it; it=ml666_st_member_get_next(stb, it))
+    count++;
+  return count;
+}
+
+/**
+ * An implementation of \ref ml666_st_child_at using only the other callbacks. It walks the children up to the one at the index.
+ * \memberof ml666_st_children
+ */
+static inline struct ml666_st_member* ml666_st_child_at_generic(struct ml666_st_builder* stb, struct ml666_st_children* children, size_t index){
+  struct ml666_st_member* it = ml666_st_get_first_child(stb, children);
+  while(it && index--)
+    it = ml666_st_member_get_next(stb, it);
+  return it;
+}
+
+/**
+ * Detaches all nodes of the subtree from their parent, releasing the references the parents hold.
+ * This doesn't recurse, so it works for documents of any depth.
  * \memberof ml666_st_children
  */
 static inline void ml666_st_subtree_disintegrate(struct ml666_st_builder* stb, struct ml666_st_children* children){
-  for(struct ml666_st_member* it; (it=ml666_st_get_first_child(stb, children)); ){
-    struct ml666_st_children* chch = ml666_st_node_get_children(stb, ML666_ST_NODE(it));
-    if(chch)
-      ml666_st_subtree_disintegrate(stb, chch);
+  if(!stb->cb->subtree_disintegrate){
+    ml666_st_subtree_disintegrate_generic(stb, children);
+    return;
+  }
+  stb->cb->subtree_disintegrate(stb, children);
+}
+
+/**
+ * An implementation of \ref ml666_st_subtree_disintegrate using only the other callbacks.
+ * \memberof ml666_st_children
+ */
+static inline void ml666_st_subtree_disintegrate_generic(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  struct ml666_st_member* it = ml666_st_get_first_child(stb, children);
+  while(it){
+    struct ml666_st_member* child = ml666_st_get_first_child(stb, ml666_st_node_get_children(stb, ML666_ST_NODE(it)));
+    if(child){
+      it = child;
+      continue;
+    }
     // It's important for this to be depth first.
     // When the parent looses it's parent and children, it may get freed, as noone may be holding a reference anymore.
-    // But by removing the parent here, our unknown parent still has a reference
+    // But by only removing nodes without children, their parent still has a parent holding a reference,
+    // or it's the node the subtree belongs to.
+    struct ml666_st_node* parent = ml666_st_member_get_parent(stb, it);
+    bool top = ml666_st_node_get_children(stb, parent) == children;
     ml666_st_member_set(stb, 0, it, 0);
+    it = top ? ml666_st_get_first_child(stb, children) : (struct ml666_st_member*)parent;
   }
 }
 
@@ -0,0 +1,62 @@
+#ifndef ML666_STRUCTURE_SCANNER_H
+#define ML666_STRUCTURE_SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <ml666/common.h>
+
+/** \addtogroup tokenizer
+ * @{ */
+/** \addtogroup ml666-structure-scanner ML666 Structure Scanner
+ * A fast prescan of an ml666 document in memory, which only finds where the elements start and end.
+ *
+ * It skips over strings, comments and attributes without decoding or validating them,
+ * so it's a lot cheaper than the \ref ml666-tokenizer. It does not check the document
+ * is valid, only that its structure makes sense. The results can be used for splitting
+ * a document into parts which can be parsed independently.
+ *
+ * Everything the tokenizer accepts is accepted by the scanner too. Like the tokenizer, the end of the input
+ * ends any elements which are still open, their end events are at the end of the input then.
+ * @{ */
+
+/**
+ * The things the scanner reports.
+ */
+enum ml666_structure_scan_event {
+  ML666_SCAN_ELEMENT_BEGIN, ///< The offset of the "<" of a start tag
+  ML666_SCAN_CONTENT_BEGIN, ///< The offset after the ">" of a start tag. Not reported for self closing tags.
+  ML666_SCAN_CONTENT_END,   ///< The offset of the "</" of an end tag, or the end of the input if there is none. Not reported for self closing tags.
+  ML666_SCAN_ELEMENT_END,   ///< The offset after the ">" of an end tag or a self closing tag, or the end of the input if there is none
+};
+
+/**
+ * Called for every event of an element at a depth up to \ref ml666_structure_scan_args.max_depth.
+ * \param user_ptr The user_ptr from \ref ml666_structure_scan_args
+ * \param event The event
+ * \param offset The offset in the input buffer
+ * \param depth The number of elements the element is nested in, 0 for the top level elements
+ * \returns true to continue, false to stop the scan
+ */
+typedef bool ml666_structure_scan_cb(void* user_ptr, enum ml666_structure_scan_event event, size_t offset, size_t depth);
+
+/** \see ml666_structure_scan */
+struct ml666_structure_scan_args {
+  struct ml666_buffer_ro input; ///< The whole ml666 document
+  ml666_structure_scan_cb* cb; ///< The callback for the events
+  // Optional
+  size_t max_depth; ///< Optional. Deeper elements are skipped without calling cb. 0 only reports the top level elements.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+};
+/** \see ml666_structure_scan */
+ML666_EXPORT bool ml666_structure_scan_p(struct ml666_structure_scan_args args);
+/**
+ * Scans the structure of an ml666 document.
+ * \see ml666_structure_scan_args for the arguments.
+ * \returns false if the structure is broken or the callback stopped the scan, true otherwise.
+ */
+#define ml666_structure_scan(...) ml666_structure_scan_p((struct ml666_structure_scan_args){__VA_ARGS__})
+
+/** @} */
+/** @} */
+
+#endif
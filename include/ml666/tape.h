@@ -0,0 +1,116 @@
+#ifndef ML666_TAPE_H
+#define ML666_TAPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <ml666/common.h>
+#include <ml666/parser.h>
+#include <ml666/tokenizer.h>
+
+/** \addtogroup parser
+ * @{ */
+/** \addtogroup ml666-tape Event Tape
+ * A compact binary recording of the events of an \ref ml666_parser.
+ *
+ * The \ref ml666_tape_recorder_api records the events into a tape, and the \ref ml666_tape_token_emmiter_create
+ * tokenizer plays them back, so the same input can be fed to any \ref ml666_parser_api or the simple tree parser
+ * again without having to tokenize the text again.
+ *
+ * The tape starts with the 8 byte magic \ref ML666_TAPE_MAGIC, followed by the records.
+ * Each record starts with an \ref ml666_tape_opcode byte. Numbers are stored as unsigned LEB128 varints.
+ *  - \ref ML666_TAPE_OP_NAME: length, bytes. Defines the next name ID, starting at 0.
+ *  - \ref ML666_TAPE_OP_TAG, \ref ML666_TAPE_OP_ATTRIBUTE: name ID
+ *  - \ref ML666_TAPE_OP_END_TAG, \ref ML666_TAPE_OP_END: nothing
+ *  - \ref ML666_TAPE_OP_VALUE, \ref ML666_TAPE_OP_TEXT, \ref ML666_TAPE_OP_COMMENT: length, bytes. Consecutive records of the same kind are chunks of the same token.
+ * @{ */
+
+#define ML666_TAPE_MAGIC "ml666tp1" ///< The first 8 bytes of a tape
+
+/**
+ * The record types of a tape
+ */
+enum ml666_tape_opcode {
+  ML666_TAPE_OP_END       = 0, ///< The end of the tape. If it's missing, the tape was truncated.
+  ML666_TAPE_OP_NAME      = 1, ///< Defines a name
+  ML666_TAPE_OP_TAG       = 2, ///< Start of an element
+  ML666_TAPE_OP_END_TAG   = 3, ///< End of the current element
+  ML666_TAPE_OP_ATTRIBUTE = 4, ///< An attribute of the current element
+  ML666_TAPE_OP_VALUE     = 5, ///< A chunk of the value of the last attribute
+  ML666_TAPE_OP_TEXT      = 6, ///< A chunk of content
+  ML666_TAPE_OP_COMMENT   = 7, ///< A chunk of a comment
+};
+
+/**
+ * Records the events of a parser into a tape. Create it using \ref ml666_tape_recorder_create.
+ */
+struct ml666_tape_recorder {
+  void* user_ptr; ///< A userspecified pointer
+  size_t size; ///< The number of bytes written to the tape so far
+};
+
+/** \see ml666_tape_recorder_create */
+struct ml666_tape_recorder_create_args {
+  int fd; ///< The file descriptor to write the tape to. The recorder will take care of the cleanup (close the fd).
+  // Optional
+  struct ml666_hashed_buffer_set* buffer_set; ///< Optional. The set used for interning the names.
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_tape_recorder_create */
+ML666_EXPORT struct ml666_tape_recorder* ml666_tape_recorder_create_p(struct ml666_tape_recorder_create_args args);
+/**
+ * Creates an \ref ml666_tape_recorder instance.
+ * \see ml666_tape_recorder_create_args for the arguments. Please use designated initialisers for the optional arguments.
+ */
+#define ml666_tape_recorder_create(...) ml666_tape_recorder_create_p((struct ml666_tape_recorder_create_args){__VA_ARGS__})
+
+/**
+ * Destroys the \ref ml666_tape_recorder instance. Destroy the parser using it first.
+ * The tape is only terminated if the parser was done without an error.
+ */
+ML666_EXPORT void ml666_tape_recorder_destroy(struct ml666_tape_recorder* recorder);
+
+/**
+ * The \ref ml666_parser_api of the recorder. The user_ptr of the parser must be the \ref ml666_tape_recorder.
+ */
+ML666_EXPORT extern const struct ml666_parser_api ml666_tape_recorder_api;
+
+/** @} */
+/** @} */
+
+/**
+ * \addtogroup tokenizer
+ * @{
+ * \addtogroup ml666-tokenizer
+ * @{
+ * \addtogroup ml666-tape-token-emmiter Tape Token Emmiter
+ * Implements the \ref ml666-tokenizer for playing back an \ref ml666-tape.
+ * The tape is mapped into memory if possible, or read completely otherwise.
+ * The tokens point directly into it, nothing is copied or decoded.
+ * @{
+ */
+
+/** \see ml666_tape_token_emmiter_create */
+struct ml666_tape_token_emmiter_create_args {
+  int fd; ///< The file descriptor to read the tape from. The tokenizer will take care of the cleanup (close the fd).
+  // Optional
+  void* user_ptr; ///< Optional. A userspecified pointer.
+  ml666__cb__malloc*  malloc; ///< Optional. Custom allocator.
+  ml666__cb__realloc* realloc; ///< Optional. Custom allocator.
+  ml666__cb__free*    free; ///< Optional. Custom allocator.
+};
+/** \see ml666_tape_token_emmiter_create */
+ML666_EXPORT struct ml666_tokenizer* ml666_tape_token_emmiter_create_p(struct ml666_tape_token_emmiter_create_args args);
+/**
+ * Creates a tokenizer playing back a tape.
+ * \see ml666_tape_token_emmiter_create_args for the arguments.
+ */
+#define ml666_tape_token_emmiter_create(...) ml666_tape_token_emmiter_create_p((struct ml666_tape_token_emmiter_create_args){__VA_ARGS__})
+
+/** @} */
+/** @} */
+/** @} */
+
+#endif
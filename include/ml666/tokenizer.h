@@ -49,6 +49,7 @@ struct ml666_tokenizer {
   size_t line; ///< The current line being processed.
   size_t column; ///< The current column being processed.
   void* user_ptr; ///< A userspecified pointer
+  size_t offset; ///< The number of bytes read from the input so far.
 };
 
 typedef bool ml666_tokenizer_cb_next(struct ml666_tokenizer* tokenizer); ///< \see ml666_tokenizer_next
@@ -70,6 +71,7 @@ struct ml666_tokenizer_create_args {
   int fd; ///< The file descriptor to use. Only used if parser and tokenizer is not set. The ml666_tokenizer will take care of the cleanup (close the fd).
   // Optional
   bool disable_utf8_validation; ///< Optional. Can be used to disable the utf8 validation of the ml666 document.
+  struct ml666_buffer_ro input; ///< Optional. Read the document from this buffer instead of the fd, which is ignored then. It must stay valid until the tokenizer is done.
   void* user_ptr; ///< Optional. A userspecified pointer.
   ml666__cb__malloc* malloc; ///< Optional. Custom allocator.
   ml666__cb__free*   free; ///< Optional. Custom allocator.
@@ -83,6 +85,13 @@ ML666_EXPORT struct ml666_tokenizer* ml666_tokenizer_create_p(struct ml666_token
  */
 #define ml666_tokenizer_create(...) ml666_tokenizer_create_p((struct ml666_tokenizer_create_args){__VA_ARGS__})
 
+/**
+ * Makes a tokenizer of the default implementation, which reads from a buffer, start over with another buffer.
+ * This is a lot cheaper than creating a new one, for tokenizing many small buffers.
+ * \returns false if the tokenizer wasn't created by \ref ml666_tokenizer_create with an input buffer.
+ */
+ML666_EXPORT bool ml666_tokenizer_reset(struct ml666_tokenizer* tokenizer, struct ml666_buffer_ro input);
+
 /** @} */
 
 /**
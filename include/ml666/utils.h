@@ -110,6 +110,7 @@ struct ml666_buffer__append_args {
   // Optional
   void* that; ///< Optional. Userdefined parameter. Passed to all userdefined callbacks
   ml666__cb__realloc* realloc; ///< Optional. Custom allocator
+  size_t* capacity; ///< Optional. The size of the allocation. If set, the allocation grows geometrically and this is updated. It's treated as the buffer length if it's smaller.
 };
 typedef bool ml666_buffer__cb__append_p(struct ml666_buffer__append_args args);
 /** \see ml666_buffer__append */
@@ -366,6 +367,7 @@ struct ml666_default_hashed_buffer_set__create_args {
   ml666__cb__free* free;                   ///< Optional. Custom allocator.
   ml666_buffer__cb__dup_p* dup_buffer;     ///< Optional. Custom function for dublicating buffers.
   ml666_buffer__cb__clear_p* clear_buffer; ///< Optional. Custom function for clearing buffers.
+  bool thread_confined;                    ///< Optional. The set is never used by more than one thread at a time. Its refcounts don't use atomic operations then.
 };
 /** \see ml666_default_hashed_buffer_set__create */
 ML666_EXPORT struct ml666_hashed_buffer_set* ml666_default_hashed_buffer_set__create_p(struct ml666_default_hashed_buffer_set__create_args); // This creates a buffer set with custom parameters
@@ -374,6 +376,13 @@ ML666_EXPORT struct ml666_hashed_buffer_set* ml666_default_hashed_buffer_set__cr
  * \see ml666_default_hashed_buffer_set__create_args for the arguments.  Please use designated initialisers for the optional arguments. (they're all optional, though).
  */
 #define ml666_default_hashed_buffer_set__create(...) ml666_default_hashed_buffer_set__create_p((struct ml666_default_hashed_buffer_set__create_args){__VA_ARGS__})
+
+/**
+ * Gets the number of entries in a buffer set created using \ref ml666_default_hashed_buffer_set__create, or the global default one,
+ * and the total length of their buffers.
+ * \returns false if the buffer set is of another implementation.
+ */
+ML666_EXPORT bool ml666_default_hashed_buffer_set__get_size(struct ml666_hashed_buffer_set* buffer_set, size_t* count, size_t* bytes);
 ////
 
 /** @} */
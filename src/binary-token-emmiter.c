@@ -92,6 +92,7 @@ static bool ml666_binary_token_emmiter_d_next(struct ml666_tokenizer* _tokenizer
       goto final;
     }else{
       bte->public.complete = false;
+      bte->public.offset += result;
       bte->public.match.data = bte->buffer.ro.data;
       bte->public.match.length = result;
       break;
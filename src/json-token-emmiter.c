@@ -127,6 +127,7 @@ static bool ml666_json_token_emmiter_d_next(struct ml666_tokenizer* _tokenizer){
     bool res = ml666_json_tokenizer_next(json);
     jte->public.line = json->line;
     jte->public.column = json->column;
+    jte->public.offset = json->offset;
     if(!res){
       jte->public.error = json->error;
       return false;
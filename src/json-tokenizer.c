@@ -585,6 +585,7 @@ static bool ml666_json_tokenizer_d_next(struct ml666_json_tokenizer* _tokenizer)
         }
       }
       tokenizer->may_block = (unsigned)result < size - length;
+      tokenizer->public.offset += result;
       length += result;
       progress = true;
       break;
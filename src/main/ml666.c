@@ -1,21 +1,28 @@
 #include <ml666/utils.h>
+#include <ml666/tape.h>
 #include <ml666/simple-tree.h>
 #include <ml666/json-token-emmiter.h>
 #include <ml666/binary-token-emmiter.h>
 #include <ml666/simple-tree-parser.h>
 #include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-arena-builder.h>
+#include <ml666/simple-tree-frozen.h>
 #include <ml666/simple-tree-ml666-serializer.h>
 #include <ml666/simple-tree-json-serializer.h>
 #include <ml666/simple-tree-binary-serializer.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 enum format {
   F_ML666,
   F_JSON,
   F_BINARY,
+  F_TAPE,
 };
 
 struct arguments {
@@ -24,6 +31,11 @@ struct arguments {
   struct ml666_hashed_buffer attribute;
   bool recursive;
   bool lf;
+  bool parallel;
+  bool arena;
+  bool freeze;
+  bool stats;
+  unsigned threads;
 };
 
 bool parse_args(struct arguments* args, int* argc, char* argv[]){
@@ -39,6 +51,20 @@ bool parse_args(struct arguments* args, int* argc, char* argv[]){
       args->recursive = true;
     }else if(!strcmp(argv[i], "--lf")){
       args->lf = true;
+    }else if(!strcmp(argv[i], "--arena")){
+      args->arena = true;
+    }else if(!strcmp(argv[i], "--stats")){
+      args->stats = true;
+    }else if(!strcmp(argv[i], "--freeze")){
+      args->freeze = true;
+    }else if(!strcmp(argv[i], "-j") || !strcmp(argv[i], "--threads")){
+      if(++i >= n)
+        return false;
+      char* end = 0;
+      args->threads = strtoul(argv[i], &end, 10);
+      if(!*argv[i] || *end)
+        return false;
+      args->parallel = true;
     }else if(!strcmp(argv[i], "--input-format")){
       if(++i >= n)
         return false;
@@ -48,6 +74,8 @@ bool parse_args(struct arguments* args, int* argc, char* argv[]){
         args->input_format = F_JSON;
       }else if(!strcmp(argv[i], "binary")){
         args->input_format = F_BINARY;
+      }else if(!strcmp(argv[i], "tape")){
+        args->input_format = F_TAPE;
       }else return false;
     }else if(!strcmp(argv[i], "--output-format")){
       if(++i >= n)
@@ -58,6 +86,8 @@ bool parse_args(struct arguments* args, int* argc, char* argv[]){
         args->output_format = F_JSON;
       }else if(!strcmp(argv[i], "binary")){
         args->output_format = F_BINARY;
+      }else if(!strcmp(argv[i], "tape")){
+        args->output_format = F_TAPE;
       }else return false;
     }else if(!strcmp(argv[i], "--attribute")){
       if(++i >= n)
@@ -71,16 +101,86 @@ bool parse_args(struct arguments* args, int* argc, char* argv[]){
   }
   if(args->attribute.buffer.length && args->output_format != F_BINARY)
     return false;
+  if(args->parallel && (args->input_format != F_ML666 || args->output_format == F_TAPE))
+    return false;
   *argc = j;
   if(j > 1)
     return false;
   return true;
 }
 
+static bool mapped_input;
+
+// The parallel parser needs the whole document in memory
+static bool read_input(struct ml666_buffer_ro* input){
+  struct stat st;
+  if(!fstat(0, &st) && S_ISREG(st.st_mode) && st.st_size > 0){
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, 0, 0);
+    if(data != MAP_FAILED){
+      mapped_input = true;
+      *input = (struct ml666_buffer_ro){ .data = data, .length = st.st_size };
+      return true;
+    }
+  }
+  struct ml666_buffer buffer = {0};
+  size_t capacity = 0;
+  while(true){
+    if(buffer.length == capacity){
+      capacity = capacity ? capacity * 2 : 0x10000;
+      char* data = realloc(buffer.data, capacity);
+      if(!data){
+        perror("realloc failed");
+        free(buffer.data);
+        return false;
+      }
+      buffer.data = data;
+    }
+    ssize_t result = read(0, buffer.data + buffer.length, capacity - buffer.length);
+    if(result < 0){
+      if(errno == EINTR)
+        continue;
+      perror("read failed");
+      free(buffer.data);
+      return false;
+    }
+    if(!result)
+      break;
+    buffer.length += result;
+  }
+  *input = buffer.ro;
+  return true;
+}
+
+static void free_input(struct ml666_buffer_ro input){
+  if(mapped_input){
+    munmap((void*)input.data, input.length);
+  }else{
+    free((void*)input.data);
+  }
+}
+
+static void dispose(struct ml666_st_builder* stb, struct ml666_st_document* document, bool all_at_once){
+  // This recursively detaches all nodes from their parent, releasing their only reference
+  // The arena builder and frozen documents free them all at once together with the document
+  if(!all_at_once)
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  // We still have a reference on the document, so let's drop it
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+static void print_stats(const char* what, const struct ml666_st_stats* stats){
+  fprintf(stderr,
+    "%s: %zu documents, %zu elements, %zu contents, %zu comments, %zu attributes, %zu data bytes, "
+    "%zu allocations, %zu allocated bytes, %zu names, %zu name bytes\n",
+    what, stats->document_count, stats->element_count, stats->content_count, stats->comment_count, stats->attribute_count,
+    stats->data_bytes, stats->allocation_count, stats->allocated_bytes, stats->name_count, stats->name_bytes
+  );
+}
+
 int main(int argc, char* argv[]){
   struct arguments args = {0};
   if(!parse_args(&args, &argc, argv)){
-    fprintf(stderr, "usage: %s [-r] [--lf] [--input-format ml666|json|binary] [--output-format ml666|json|binary]\n", *argv);
+    fprintf(stderr, "usage: %s [-r] [--lf] [--arena] [--freeze] [--stats] [-j threads] [--input-format ml666|json|binary|tape] [--output-format ml666|json|binary|tape]\n", *argv);
     return 1;
   }
 
@@ -91,7 +191,7 @@ int main(int argc, char* argv[]){
   }
 
   // Instanciating the tree builder
-  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_st_builder* stb = args.arena ? ml666_st_arena_builder_create(0) : ml666_st_builder_create(.thread_confined=true, .stats=args.stats);
   if(!stb){
     fprintf(stderr, "ml666_st_builder_create failed\n");
     return 1;
@@ -102,15 +202,80 @@ int main(int argc, char* argv[]){
     case F_ML666: break;
     case F_JSON : tokenizer = ml666_json_token_emmiter_create(0); break;
     case F_BINARY: tokenizer = ml666_binary_token_emmiter_create(0); break;
+    case F_TAPE  : tokenizer = ml666_tape_token_emmiter_create(0); break;
+  }
+  if(args.input_format != F_ML666 && !tokenizer){
+    ml666_st_builder_destroy(stb);
+    return 1;
+  }
+
+  // Recording a tape doesn't need the tree, the parser events are written out directly
+  if(args.output_format == F_TAPE){
+    struct ml666_tape_recorder* recorder = ml666_tape_recorder_create(fd_out);
+    if(!recorder){
+      fprintf(stderr, "ml666_tape_recorder_create failed\n");
+      return 1;
+    }
+    struct ml666_parser* parser = ml666_parser_create(.api=&ml666_tape_recorder_api, .fd=0, .tokenizer=tokenizer, .user_ptr=recorder);
+    if(!parser){
+      fprintf(stderr, "ml666_parser_create failed\n");
+      return 1;
+    }
+    while(ml666_parser_next(parser));
+    int result = 0;
+    if(parser->error){
+      fprintf(stderr, "ml666_parser_next failed: line %zu, column %zu: %s\n", parser->line, parser->column, parser->error);
+      result = 1;
+    }
+    ml666_parser_destroy(parser);
+    ml666_tape_recorder_destroy(recorder);
+    ml666_st_builder_destroy(stb);
+    return result;
   }
 
   // Parsing the document
-  struct ml666_st_document* document = ml666_st_parse(stb, 0, .tokenizer=tokenizer);
+  struct ml666_st_document* document = 0;
+  if(args.parallel){
+    struct ml666_buffer_ro input;
+    if(!read_input(&input)){
+      ml666_st_builder_destroy(stb);
+      return 1;
+    }
+    document = ml666_st_parse_parallel(stb, input, .thread_count=args.threads);
+    free_input(input);
+  }else{
+    document = ml666_st_parse(stb, 0, .tokenizer=tokenizer);
+  }
   if(!document){
     ml666_st_builder_destroy(stb);
     return 1;
   }
 
+  // Replacing the document by a read-only copy
+  if(args.freeze){
+    struct ml666_st_builder* frozen = ml666_st_frozen_builder_create(0);
+    struct ml666_st_document* frozen_document = frozen ? ml666_st_freeze(frozen, stb, document) : 0;
+    dispose(stb, document, args.arena);
+    ml666_st_builder_destroy(stb);
+    if(!frozen_document){
+      fprintf(stderr, "ml666_st_freeze failed\n");
+      if(frozen)
+        ml666_st_builder_destroy(frozen);
+      return 1;
+    }
+    stb = frozen;
+    document = frozen_document;
+  }
+
+  // Reporting the memory use, on stderr so it doesn't end up in the output
+  if(args.stats){
+    struct ml666_st_stats stats;
+    if(ml666_st_node_get_stats(stb, ML666_ST_NODE(document), &stats))
+      print_stats("document", &stats);
+    if(ml666_st_builder_get_stats(stb, &stats))
+      print_stats("builder", &stats);
+  }
+
   // Serializing the document
   struct ml666_st_serializer* serializer = 0;
   switch(args.output_format){
@@ -123,6 +288,7 @@ int main(int argc, char* argv[]){
         .attribute=args.attribute.buffer.length ? &args.attribute : 0,
       );
     } break;
+    case F_TAPE: break;
   }
   if(!serializer){
     fprintf(stderr, "error: couldn't create serializer\n");
@@ -132,10 +298,7 @@ int main(int argc, char* argv[]){
   ml666_st_serializer_destroy(serializer);
 
   // Freeing all nodes
-  // This recursively detaches all nodes from their parent, releasing their only reference
-  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
-  // We still have a reference on the document, so let's drop it
-  ml666_st_node_put(stb, ML666_ST_NODE(document));
+  dispose(stb, document, args.arena || args.freeze);
 
   // Freeing the tree builder
   ml666_st_builder_destroy(stb);
@@ -0,0 +1,322 @@
+#include <ml666/parser-dispatch.h>
+#include <ml666/utils.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+
+ML666_DEFAULT_OPAQUE_TAG_NAME
+ML666_DEFAULT_OPAQUE_ATTRIBUTE_NAME
+
+struct ml666__parser_dispatch_registration {
+  const ml666_hashed_buffer_set_entry* name; // 0 if the slot is free
+  size_t depth;
+  const struct ml666_parser_dispatch_handler* handler;
+  void* handler_ptr;
+};
+
+struct ml666__parser_dispatch_frame {
+  const ml666_hashed_buffer_set_entry* name; // 0 if there is no handler for this element
+  const struct ml666_parser_dispatch_handler* handler;
+  void* handler_ptr;
+  size_t name_offset;
+  size_t name_length;
+};
+
+struct ml666__parser_dispatch_private {
+  struct ml666_parser_dispatch public;
+  struct ml666_hashed_buffer_set* buffer_set;
+
+  // Open addressing, the size is always a power of 2
+  struct ml666__parser_dispatch_registration* registration;
+  size_t registration_size;
+  size_t registration_count;
+
+  // The stack of open elements, and the names of all of them, for checking the end tags
+  struct ml666__parser_dispatch_frame* frame;
+  size_t frame_size;
+  char* name_stack;
+  size_t name_stack_size;
+  size_t name_stack_length;
+
+  ml666__cb__malloc* malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free* free;
+};
+static_assert(offsetof(struct ml666__parser_dispatch_private, public) == 0);
+
+static inline size_t registration_hash(const ml666_hashed_buffer_set_entry* name, size_t depth){
+  // The hash of the name was already calculated, no need to hash the pointer
+  return ml666_hashed_buffer_set__peek(name)->hash ^ (depth * (size_t)0x9E3779B97F4A7C15llu);
+}
+
+static struct ml666__parser_dispatch_registration* registration_find(
+  struct ml666__parser_dispatch_private* that,
+  const ml666_hashed_buffer_set_entry* name,
+  size_t depth
+){
+  if(!that->registration_size)
+    return 0;
+  const size_t mask = that->registration_size - 1;
+  for(size_t i=registration_hash(name, depth) & mask; ; i=(i+1) & mask){
+    struct ml666__parser_dispatch_registration* reg = &that->registration[i];
+    if(!reg->name)
+      return reg;
+    if(reg->name == name && reg->depth == depth)
+      return reg;
+  }
+}
+
+static bool registration_grow(struct ml666__parser_dispatch_private* that){
+  size_t size = that->registration_size ? that->registration_size * 2 : 16;
+  struct ml666__parser_dispatch_registration* old = that->registration;
+  const size_t old_size = that->registration_size;
+  struct ml666__parser_dispatch_registration* registration = that->malloc(that->public.user_ptr, size * sizeof(*registration));
+  if(!registration){
+    fprintf(stderr, "ml666_parser_dispatch_register: *malloc failed (%d): %s\n", errno, strerror(errno));
+    return false;
+  }
+  memset(registration, 0, size * sizeof(*registration));
+  that->registration = registration;
+  that->registration_size = size;
+  for(size_t i=0; i<old_size; i++){
+    if(!old[i].name)
+      continue;
+    *registration_find(that, old[i].name, old[i].depth) = old[i];
+  }
+  if(old)
+    that->free(that->public.user_ptr, old);
+  return true;
+}
+
+struct ml666_parser_dispatch* ml666_parser_dispatch_create_p(struct ml666_parser_dispatch_create_args args){
+  if(!args.buffer_set)
+    args.buffer_set = ml666_hashed_buffer_set__get_default();
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666__parser_dispatch_private* dispatch = args.malloc(args.user_ptr, sizeof(*dispatch));
+  if(!dispatch){
+    fprintf(stderr, "ml666_parser_dispatch_create_p: *malloc failed (%d): %s\n", errno, strerror(errno));
+    return 0;
+  }
+  memset(dispatch, 0, sizeof(*dispatch));
+  dispatch->public.user_ptr = args.user_ptr;
+  dispatch->buffer_set = args.buffer_set;
+  dispatch->malloc = args.malloc;
+  dispatch->realloc = args.realloc;
+  dispatch->free = args.free;
+  return &dispatch->public;
+}
+
+void ml666_parser_dispatch_destroy(struct ml666_parser_dispatch* _dispatch){
+  struct ml666__parser_dispatch_private* dispatch = (struct ml666__parser_dispatch_private*)_dispatch;
+  for(size_t i=0; i<dispatch->registration_size; i++)
+    if(dispatch->registration[i].name)
+      ml666_hashed_buffer_set__put(dispatch->buffer_set, dispatch->registration[i].name);
+  if(dispatch->registration)
+    dispatch->free(dispatch->public.user_ptr, dispatch->registration);
+  if(dispatch->frame)
+    dispatch->realloc(dispatch->public.user_ptr, dispatch->frame, 0);
+  if(dispatch->name_stack)
+    dispatch->realloc(dispatch->public.user_ptr, dispatch->name_stack, 0);
+  dispatch->free(dispatch->public.user_ptr, dispatch);
+}
+
+bool ml666_parser_dispatch_register(
+  struct ml666_parser_dispatch* _dispatch,
+  struct ml666_buffer_ro name,
+  size_t depth,
+  const struct ml666_parser_dispatch_handler* handler,
+  void* handler_ptr
+){
+  struct ml666__parser_dispatch_private* dispatch = (struct ml666__parser_dispatch_private*)_dispatch;
+  if(!depth){
+    fprintf(stderr, "ml666_parser_dispatch_register: depth must be at least 1\n");
+    return false;
+  }
+  if(!handler){
+    fprintf(stderr, "ml666_parser_dispatch_register: handler must be set\n");
+    return false;
+  }
+  if((dispatch->registration_count + 1) * 2 > dispatch->registration_size)
+    if(!registration_grow(dispatch))
+      return false;
+  const ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(dispatch->buffer_set, ML666_LCPTR(ml666_hashed_buffer__create(name)), ML666_HBS_M_ADD_COPY);
+  if(!entry)
+    return false;
+  struct ml666__parser_dispatch_registration* reg = registration_find(dispatch, entry, depth);
+  if(reg->name){
+    // Already registered, we already have a reference
+    ml666_hashed_buffer_set__put(dispatch->buffer_set, entry);
+  }else{
+    reg->name = entry;
+    reg->depth = depth;
+    dispatch->registration_count += 1;
+  }
+  reg->handler = handler;
+  reg->handler_ptr = handler_ptr;
+  return true;
+}
+
+static bool ml666_parser_dispatch__init(struct ml666_parser* parser){
+  struct ml666__parser_dispatch_private* that = parser->user_ptr;
+  that->public.depth = 0;
+  that->name_stack_length = 0;
+  return true;
+}
+
+static void ml666_parser_dispatch__done(struct ml666_parser* parser){
+  struct ml666__parser_dispatch_private* that = parser->user_ptr;
+  that->public.depth = 0;
+  that->name_stack_length = 0;
+}
+
+static bool ml666_parser_dispatch__tag_push(struct ml666_parser* parser, ml666_opaque_tag_name* name){
+  struct ml666__parser_dispatch_private* that = parser->user_ptr;
+  const struct ml666_buffer_ro name_buffer = *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0};
+  const size_t depth = that->public.depth + 1;
+
+  if(depth > that->frame_size){
+    size_t size = that->frame_size ? that->frame_size * 2 : 16;
+    struct ml666__parser_dispatch_frame* frame = that->realloc(that->public.user_ptr, that->frame, size * sizeof(*frame));
+    if(!frame){
+      parser->error = "ml666_parser_dispatch: *realloc failed";
+      return false;
+    }
+    that->frame = frame;
+    that->frame_size = size;
+  }
+  if(that->name_stack_length + name_buffer.length > that->name_stack_size){
+    size_t size = that->name_stack_size ? that->name_stack_size : 256;
+    while(size < that->name_stack_length + name_buffer.length)
+      size *= 2;
+    char* name_stack = that->realloc(that->public.user_ptr, that->name_stack, size);
+    if(!name_stack){
+      parser->error = "ml666_parser_dispatch: *realloc failed";
+      return false;
+    }
+    that->name_stack = name_stack;
+    that->name_stack_size = size;
+  }
+
+  struct ml666__parser_dispatch_frame* frame = &that->frame[depth-1];
+  memset(frame, 0, sizeof(*frame));
+  frame->name_offset = that->name_stack_length;
+  frame->name_length = name_buffer.length;
+  if(name_buffer.length)
+    memcpy(&that->name_stack[that->name_stack_length], name_buffer.data, name_buffer.length);
+  that->name_stack_length += name_buffer.length;
+  that->public.depth = depth;
+
+  if(!that->registration_count)
+    return true;
+
+  // If the name was never interned, nobody can have registered a handler for it
+  const ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(that->buffer_set, ML666_LCPTR(ml666_hashed_buffer__create(name_buffer)), ML666_HBS_M_GET);
+  if(!entry)
+    return true;
+  const struct ml666__parser_dispatch_registration* reg = registration_find(that, entry, depth);
+  if(!reg->name)
+    reg = registration_find(that, entry, ML666_PARSER_DISPATCH_ANY_DEPTH);
+  // The registration holds a reference, the entry can't go away
+  ml666_hashed_buffer_set__put(that->buffer_set, entry);
+  if(!reg->name)
+    return true;
+
+  frame->name = reg->name;
+  frame->handler = reg->handler;
+  frame->handler_ptr = reg->handler_ptr;
+  if(frame->handler->tag_push)
+    return frame->handler->tag_push(parser, frame->handler_ptr, frame->name, depth);
+  return true;
+}
+
+static bool ml666_parser_dispatch__end_tag_check(struct ml666_parser* parser, ml666_opaque_tag_name name){
+  struct ml666__parser_dispatch_private* that = parser->user_ptr;
+  if(!that->public.depth)
+    return false;
+  const struct ml666__parser_dispatch_frame* frame = &that->frame[that->public.depth-1];
+  const struct ml666_buffer_ro name_buffer = name ? name->buffer.ro : (struct ml666_buffer_ro){0};
+  return ml666_buffer__equal(name_buffer, (struct ml666_buffer_ro){
+    .data = &that->name_stack[frame->name_offset],
+    .length = frame->name_length,
+  });
+}
+
+static bool ml666_parser_dispatch__tag_pop(struct ml666_parser* parser){
+  struct ml666__parser_dispatch_private* that = parser->user_ptr;
+  if(!that->public.depth){
+    parser->error = "ml666_parser_dispatch: end tag without matching opening tag";
+    return false;
+  }
+  const size_t depth = that->public.depth;
+  const struct ml666__parser_dispatch_frame* frame = &that->frame[depth-1];
+  that->name_stack_length = frame->name_offset;
+  that->public.depth = depth - 1;
+  if(frame->name && frame->handler->tag_pop)
+    return frame->handler->tag_pop(parser, frame->handler_ptr, frame->name, depth);
+  return true;
+}
+
+static inline const struct ml666__parser_dispatch_frame* current_frame(struct ml666__parser_dispatch_private* that){
+  if(!that->public.depth)
+    return 0;
+  const struct ml666__parser_dispatch_frame* frame = &that->frame[that->public.depth-1];
+  if(!frame->name)
+    return 0;
+  return frame;
+}
+
+static bool ml666_parser_dispatch__set_attribute(struct ml666_parser* parser, ml666_opaque_attribute_name* name){
+  const struct ml666__parser_dispatch_frame* frame = current_frame(parser->user_ptr);
+  if(!frame || !frame->handler->set_attribute)
+    return true;
+  return frame->handler->set_attribute(parser, frame->handler_ptr, *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0});
+}
+
+static bool ml666_parser_dispatch__value_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  const struct ml666__parser_dispatch_frame* frame = current_frame(parser->user_ptr);
+  if(!frame || !frame->handler->value_append)
+    return true;
+  return frame->handler->value_append(parser, frame->handler_ptr, data);
+}
+
+static bool ml666_parser_dispatch__data_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  const struct ml666__parser_dispatch_frame* frame = current_frame(parser->user_ptr);
+  if(!frame || !frame->handler->data_append)
+    return true;
+  return frame->handler->data_append(parser, frame->handler_ptr, data);
+}
+
+static bool ml666_parser_dispatch__comment_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  const struct ml666__parser_dispatch_frame* frame = current_frame(parser->user_ptr);
+  if(!frame || !frame->handler->comment_append)
+    return true;
+  return frame->handler->comment_append(parser, frame->handler_ptr, data);
+}
+
+const struct ml666_parser_api ml666_parser_dispatch_api = {
+  .init    = ml666_parser_dispatch__init,
+  .done    = ml666_parser_dispatch__done,
+  .cleanup = ml666_parser_dispatch__done,
+
+  .tag_name_append       = ml666_parser__d_mal__tag_name_append,
+  .tag_name_free         = ml666_parser__d_mal__tag_name_free,
+  .attribute_name_append = ml666_parser__d_mal__attribute_name_append,
+  .attribute_name_free   = ml666_parser__d_mal__attribute_name_free,
+
+  .tag_push      = ml666_parser_dispatch__tag_push,
+  .end_tag_check = ml666_parser_dispatch__end_tag_check,
+  .tag_pop       = ml666_parser_dispatch__tag_pop,
+
+  .set_attribute = ml666_parser_dispatch__set_attribute,
+
+  .value_append   = ml666_parser_dispatch__value_append,
+  .data_append    = ml666_parser_dispatch__data_append,
+  .comment_append = ml666_parser_dispatch__comment_append,
+};
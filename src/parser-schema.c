@@ -0,0 +1,1050 @@
+#include <ml666/parser-schema.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/tokenizer.h>
+#include <ml666/utils.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+
+ML666_DEFAULT_OPAQUE_TAG_NAME
+ML666_DEFAULT_OPAQUE_ATTRIBUTE_NAME
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+#define TEXT(X) {sizeof(X)-1, (X)}
+
+// A content model can have at most this many element names in it. The last bit of a position set stands for the start.
+#define MAX_POSITIONS 63
+#define START_POSITION ((uint64_t)1 << MAX_POSITIONS)
+#define MAX_STATES 0xFFFF
+#define MAX_NESTING 32
+// The element index of the frame of the root of a subtree which isn't a document. Anything declared is allowed in it.
+#define ANY_ELEMENT ((size_t)-1)
+
+enum encoding {
+  E_NONE,
+  E_ASCII,
+  E_UTF8,
+  E_ANY,
+};
+
+struct ml666__schema_attribute {
+  const ml666_hashed_buffer_set_entry* name;
+  bool required;
+  enum encoding value;
+};
+
+struct ml666__schema_element {
+  const ml666_hashed_buffer_set_entry* name; // 0 for the document
+  enum encoding content;
+  bool extra_attributes;
+  size_t attribute_count;
+  struct ml666__schema_attribute* attribute;
+  // The DFA of the content model. State 0 is the start state.
+  size_t state_count;
+  uint16_t* transition; // [state * element_count + child], the next state plus one, 0 if the child isn't allowed
+  bool* accepting;
+};
+
+struct ml666_schema {
+  struct ml666_hashed_buffer_set* buffer_set;
+  size_t element_count;
+  struct ml666__schema_element* element; // There is one more, the last one is the document
+  // Open addressing, the size is always a power of 2
+  size_t* table; // Indices into element, plus one
+  size_t table_mask;
+  size_t max_attribute_count;
+  void* user_ptr;
+  ml666__cb__malloc* malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free* free;
+};
+
+static bool name_equal(const ml666_hashed_buffer_set_entry* entry, const struct ml666_hashed_buffer* name){
+  const struct ml666_hashed_buffer* it = ml666_hashed_buffer_set__peek(entry);
+  return it->hash == name->hash && ml666_buffer__equal(it->buffer, name->buffer);
+}
+
+// The index of the declaration, or the slot where it would go plus element_count
+static size_t element_find(const struct ml666_schema* schema, const struct ml666_hashed_buffer* name){
+  for(size_t i=name->hash; ; i++){
+    const size_t index = schema->table[i & schema->table_mask];
+    if(!index)
+      return schema->element_count + (i & schema->table_mask);
+    if(name_equal(schema->element[index-1].name, name))
+      return index - 1;
+  }
+}
+
+static const struct ml666__schema_element* element_lookup(const struct ml666_schema* schema, struct ml666_buffer_ro name, size_t* index){
+  const struct ml666_hashed_buffer hashed = ml666_hashed_buffer__create(name);
+  const size_t i = element_find(schema, &hashed);
+  if(i >= schema->element_count)
+    return 0;
+  *index = i;
+  return &schema->element[i];
+}
+
+static const struct ml666__schema_attribute* attribute_lookup(const struct ml666__schema_element* element, struct ml666_buffer_ro name){
+  const struct ml666_hashed_buffer hashed = ml666_hashed_buffer__create(name);
+  for(size_t i=0; i<element->attribute_count; i++)
+    if(name_equal(element->attribute[i].name, &hashed))
+      return &element->attribute[i];
+  return 0;
+}
+
+void ml666_schema_destroy(struct ml666_schema* schema){
+  if(schema->element){
+    for(size_t i=0; i<=schema->element_count; i++){
+      struct ml666__schema_element* element = &schema->element[i];
+      if(element->name)
+        ml666_hashed_buffer_set__put(schema->buffer_set, element->name);
+      for(size_t j=0; j<element->attribute_count; j++)
+        if(element->attribute[j].name)
+          ml666_hashed_buffer_set__put(schema->buffer_set, element->attribute[j].name);
+      if(element->attribute)
+        schema->free(schema->user_ptr, element->attribute);
+      if(element->transition)
+        schema->realloc(schema->user_ptr, element->transition, 0);
+      if(element->accepting)
+        schema->free(schema->user_ptr, element->accepting);
+    }
+    schema->free(schema->user_ptr, schema->element);
+  }
+  if(schema->table)
+    schema->free(schema->user_ptr, schema->table);
+  schema->free(schema->user_ptr, schema);
+}
+
+//// Compiling the schema
+
+struct compile {
+  struct ml666_schema* schema;
+  struct ml666_st_builder* stb;
+};
+
+static bool is_named(struct ml666_st_builder* stb, struct ml666_st_member* member, struct ml666_buffer_ro name){
+  if(ML666_ST_TYPE(member) != ML666_ST_NT_ELEMENT)
+    return false;
+  return ml666_buffer__equal(ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, (struct ml666_st_element*)member))->buffer, name);
+}
+
+// The members of the schema elements may only be elements with the expected name & comments
+static bool check_children(struct compile* c, struct ml666_st_node* node, struct ml666_buffer_ro name, size_t* count){
+  *count = 0;
+  for(struct ml666_st_member* it=ml666_st_get_first_child(c->stb, ML666_ST_U_CHILDREN(c->stb, node)); it; it=ml666_st_member_get_next(c->stb, it)){
+    if(ML666_ST_TYPE(it) == ML666_ST_NT_COMMENT)
+      continue;
+    if(!is_named(c->stb, it, name)){
+      fprintf(stderr, "ml666_schema_compile: expected only \"%.*s\" elements\n", (int)name.length, name.data);
+      return false;
+    }
+    *count += 1;
+  }
+  return true;
+}
+
+static bool check_attributes(struct compile* c, struct ml666_st_element* element, const char*const allowed[]){
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(c->stb, element); it; it=ml666_st_attribute_get_next(c->stb, it)){
+    const struct ml666_buffer_ro name = ml666_st_attribute_get_name(c->stb, it)->buffer;
+    bool found = false;
+    for(const char*const* jt=allowed; *jt && !found; jt++)
+      found = ml666_buffer__equal(name, (struct ml666_buffer_ro){strlen(*jt), *jt});
+    if(!found){
+      fprintf(stderr, "ml666_schema_compile: unknown attribute \"%.*s\"\n", (int)name.length, name.data);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether the attribute is set. If it has no value, value is empty.
+static bool get_attribute(struct compile* c, struct ml666_st_element* element, const char* name, struct ml666_buffer_ro* value){
+  const struct ml666_hashed_buffer hashed = ml666_hashed_buffer__create((struct ml666_buffer_ro){strlen(name), name});
+  struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(c->stb, element, &hashed, 0);
+  if(!attribute)
+    return false;
+  const struct ml666_buffer_ro* v = ml666_st_attribute_get_value(c->stb, attribute);
+  *value = v ? *v : (struct ml666_buffer_ro){0};
+  return true;
+}
+
+static bool get_encoding(struct compile* c, struct ml666_st_element* element, const char* name, enum encoding* encoding){
+  static const struct ml666_buffer_ro names[] = {
+    [E_NONE]  = TEXT("none"),
+    [E_ASCII] = TEXT("ascii"),
+    [E_UTF8]  = TEXT("utf8"),
+    [E_ANY]   = TEXT("any"),
+  };
+  struct ml666_buffer_ro value;
+  if(!get_attribute(c, element, name, &value))
+    return true;
+  for(size_t i=0; i<sizeof(names)/sizeof(*names); i++){
+    if(ml666_buffer__equal(value, names[i])){
+      *encoding = i;
+      return true;
+    }
+  }
+  fprintf(stderr, "ml666_schema_compile: unknown encoding \"%.*s\", expected none, ascii, utf8 or any\n", (int)value.length, value.data);
+  return false;
+}
+
+static const ml666_hashed_buffer_set_entry* get_name(struct compile* c, struct ml666_st_element* element){
+  struct ml666_buffer_ro name;
+  if(!get_attribute(c, element, "name", &name) || !name.length){
+    fprintf(stderr, "ml666_schema_compile: a declaration has no name\n");
+    return 0;
+  }
+  return ml666_hashed_buffer_set__lookup(c->schema->buffer_set, ML666_LCPTR(ml666_hashed_buffer__create(name)), ML666_HBS_M_ADD_COPY);
+}
+
+// Content models are turned into a position automaton first, every element name in it is a position.
+// The DFA is then created using the subset construction, each state is a set of positions.
+struct model {
+  struct ml666_schema* schema;
+  struct ml666_buffer_ro text;
+  size_t offset;
+  unsigned nesting;
+  size_t count;
+  size_t symbol[MAX_POSITIONS];
+  uint64_t follow[MAX_POSITIONS+1];
+};
+
+struct term {
+  bool nullable;
+  uint64_t first, last;
+};
+
+static void model_follow(struct model* m, uint64_t from, uint64_t to){
+  for(size_t i=0; i<=MAX_POSITIONS; i++)
+    if(from & ((uint64_t)1 << i))
+      m->follow[i] |= to;
+}
+
+static int model_peek(struct model* m){
+  while(m->offset < m->text.length && strchr(" \t\r\n", m->text.data[m->offset]))
+    m->offset++;
+  return m->offset < m->text.length ? (unsigned char)m->text.data[m->offset] : EOF;
+}
+
+static bool model_alternatives(struct model* m, struct term* result);
+
+static bool model_particle(struct model* m, struct term* result){
+  if(model_peek(m) == '('){
+    m->offset++;
+    if(++m->nesting > MAX_NESTING){
+      fprintf(stderr, "ml666_schema_compile: content model nested too deeply\n");
+      return false;
+    }
+    if(!model_alternatives(m, result))
+      return false;
+    if(model_peek(m) != ')'){
+      fprintf(stderr, "ml666_schema_compile: content model: expected \")\"\n");
+      return false;
+    }
+    m->offset++;
+    m->nesting--;
+  }else{
+    const size_t start = m->offset;
+    while(m->offset < m->text.length && !strchr(" \t\r\n()|?*+", m->text.data[m->offset]))
+      m->offset++;
+    const struct ml666_buffer_ro name = {
+      .data = m->text.data + start,
+      .length = m->offset - start,
+    };
+    size_t index;
+    if(!element_lookup(m->schema, name, &index)){
+      fprintf(stderr, "ml666_schema_compile: content model: element \"%.*s\" not declared\n", (int)name.length, name.data);
+      return false;
+    }
+    if(m->count >= MAX_POSITIONS){
+      fprintf(stderr, "ml666_schema_compile: content model has more than %d element names\n", MAX_POSITIONS);
+      return false;
+    }
+    const uint64_t position = (uint64_t)1 << m->count;
+    m->symbol[m->count++] = index;
+    *result = (struct term){
+      .first = position,
+      .last = position,
+    };
+  }
+  switch(model_peek(m)){
+    case '?': {
+      result->nullable = true;
+    } break;
+    case '*': {
+      result->nullable = true;
+      model_follow(m, result->last, result->first);
+    } break;
+    case '+': {
+      model_follow(m, result->last, result->first);
+    } break;
+    default: return true;
+  }
+  m->offset++;
+  return true;
+}
+
+static bool model_sequence(struct model* m, struct term* result){
+  *result = (struct term){ .nullable = true };
+  while(true){
+    const int ch = model_peek(m);
+    if(ch == EOF || ch == ')' || ch == '|')
+      return true;
+    struct term next;
+    if(!model_particle(m, &next))
+      return false;
+    model_follow(m, result->last, next.first);
+    if(result->nullable)
+      result->first |= next.first;
+    if(next.nullable){
+      result->last |= next.last;
+    }else{
+      result->last = next.last;
+    }
+    result->nullable = result->nullable && next.nullable;
+  }
+}
+
+static bool model_alternatives(struct model* m, struct term* result){
+  if(!model_sequence(m, result))
+    return false;
+  while(model_peek(m) == '|'){
+    m->offset++;
+    struct term next;
+    if(!model_sequence(m, &next))
+      return false;
+    result->nullable = result->nullable || next.nullable;
+    result->first |= next.first;
+    result->last |= next.last;
+  }
+  return true;
+}
+
+// Makes room for more DFA states
+static bool model_grow(struct ml666_schema* schema, struct ml666__schema_element* element, uint64_t** set, size_t* capacity){
+  const size_t width = schema->element_count;
+  const size_t new_capacity = *capacity ? *capacity * 2 : 8;
+  uint64_t* new_set = schema->realloc(schema->user_ptr, *set, new_capacity * sizeof(**set));
+  if(!new_set){
+    fprintf(stderr, "ml666_schema_compile: *realloc failed (%d): %s\n", errno, strerror(errno));
+    return false;
+  }
+  *set = new_set;
+  // One more byte, there may be no elements at all
+  uint16_t* transition = schema->realloc(schema->user_ptr, element->transition, new_capacity * width * sizeof(*transition) + 1);
+  if(!transition){
+    fprintf(stderr, "ml666_schema_compile: *realloc failed (%d): %s\n", errno, strerror(errno));
+    return false;
+  }
+  memset(transition + *capacity * width, 0, (new_capacity - *capacity) * width * sizeof(*transition));
+  element->transition = transition;
+  *capacity = new_capacity;
+  return true;
+}
+
+static bool model_compile(struct ml666_schema* schema, struct ml666__schema_element* element, struct ml666_buffer_ro text){
+  struct model m = {
+    .schema = schema,
+    .text = text,
+  };
+  struct term term;
+  if(!model_alternatives(&m, &term))
+    return false;
+  if(model_peek(&m) != EOF){
+    fprintf(stderr, "ml666_schema_compile: content model: unexpected \"%c\"\n", text.data[m.offset]);
+    return false;
+  }
+  m.follow[MAX_POSITIONS] = term.first;
+  if(term.nullable)
+    term.last |= START_POSITION;
+
+  const size_t width = schema->element_count;
+  uint64_t* set = 0;
+  size_t capacity = 0;
+  size_t count = 0;
+  bool ok = false;
+  if(!model_grow(schema, element, &set, &capacity))
+    goto error;
+  set[count++] = START_POSITION;
+  for(size_t state=0; state<count; state++){
+    uint64_t next = 0;
+    for(size_t i=0; i<=MAX_POSITIONS; i++)
+      if(set[state] & ((uint64_t)1 << i))
+        next |= m.follow[i];
+    // The positions with the same element name together are the next state for it
+    for(size_t i=0; i<MAX_POSITIONS && next; i++){
+      if(!(next & ((uint64_t)1 << i)))
+        continue;
+      const size_t symbol = m.symbol[i];
+      uint64_t target = 0;
+      for(size_t j=i; j<MAX_POSITIONS; j++)
+        if((next & ((uint64_t)1 << j)) && m.symbol[j] == symbol)
+          target |= (uint64_t)1 << j;
+      next &= ~target;
+      size_t target_state = 0;
+      while(target_state < count && set[target_state] != target)
+        target_state++;
+      if(target_state == count){
+        if(count >= MAX_STATES){
+          fprintf(stderr, "ml666_schema_compile: content model has too many states\n");
+          goto error;
+        }
+        if(count >= capacity && !model_grow(schema, element, &set, &capacity))
+          goto error;
+        set[count++] = target;
+      }
+      element->transition[state * width + symbol] = target_state + 1;
+    }
+  }
+  element->state_count = count;
+  element->accepting = schema->malloc(schema->user_ptr, count * sizeof(*element->accepting));
+  if(!element->accepting){
+    fprintf(stderr, "ml666_schema_compile: *malloc failed (%d): %s\n", errno, strerror(errno));
+    goto error;
+  }
+  for(size_t state=0; state<count; state++)
+    element->accepting[state] = set[state] & term.last;
+  ok = true;
+error:
+  if(set)
+    schema->realloc(schema->user_ptr, set, 0);
+  return ok;
+}
+
+static bool compile_attributes(struct compile* c, struct ml666__schema_element* element, struct ml666_st_element* declaration){
+  static const char*const allowed[] = {"name", "required", "value", 0};
+  size_t count;
+  if(!check_children(c, ML666_ST_NODE(declaration), ML666_BUFFER_STR("attribute"), &count))
+    return false;
+  if(!count)
+    return true;
+  element->attribute = c->schema->malloc(c->schema->user_ptr, count * sizeof(*element->attribute));
+  if(!element->attribute){
+    fprintf(stderr, "ml666_schema_compile: *malloc failed (%d): %s\n", errno, strerror(errno));
+    return false;
+  }
+  memset(element->attribute, 0, count * sizeof(*element->attribute));
+  for(struct ml666_st_member* it=ml666_st_get_first_child(c->stb, ML666_ST_U_CHILDREN(c->stb, ML666_ST_NODE(declaration))); it; it=ml666_st_member_get_next(c->stb, it)){
+    if(ML666_ST_TYPE(it) != ML666_ST_NT_ELEMENT)
+      continue;
+    struct ml666_st_element* attribute = (struct ml666_st_element*)it;
+    if(!check_attributes(c, attribute, allowed))
+      return false;
+    struct ml666__schema_attribute* result = &element->attribute[element->attribute_count];
+    result->value = E_ANY;
+    result->name = get_name(c, attribute);
+    if(!result->name)
+      return false;
+    element->attribute_count += 1;
+    if(attribute_lookup(element, ml666_hashed_buffer_set__peek(result->name)->buffer) != result){
+      const struct ml666_buffer_ro name = ml666_hashed_buffer_set__peek(result->name)->buffer;
+      fprintf(stderr, "ml666_schema_compile: attribute \"%.*s\" declared twice\n", (int)name.length, name.data);
+      return false;
+    }
+    struct ml666_buffer_ro value;
+    result->required = get_attribute(c, attribute, "required", &value);
+    if(!get_encoding(c, attribute, "value", &result->value))
+      return false;
+  }
+  if(c->schema->max_attribute_count < count)
+    c->schema->max_attribute_count = count;
+  return true;
+}
+
+static bool compile_element(struct compile* c, struct ml666__schema_element* element, struct ml666_st_element* declaration, bool document){
+  static const char*const allowed_element[] = {"name", "children", "content", "extra-attributes", 0};
+  static const char*const allowed_schema[] = {"root", "content", 0};
+  if(!check_attributes(c, declaration, document ? allowed_schema : allowed_element))
+    return false;
+  element->content = E_NONE;
+  if(!get_encoding(c, declaration, "content", &element->content))
+    return false;
+  struct ml666_buffer_ro value = {0};
+  element->extra_attributes = get_attribute(c, declaration, "extra-attributes", &value);
+  value = (struct ml666_buffer_ro){0};
+  get_attribute(c, declaration, document ? "root" : "children", &value);
+  if(!model_compile(c->schema, element, value))
+    return false;
+  if(document)
+    return true;
+  return compile_attributes(c, element, declaration);
+}
+
+static bool compile_schema(struct compile* c, struct ml666_st_element* root){
+  struct ml666_schema* schema = c->schema;
+  size_t count;
+  if(!check_children(c, ML666_ST_NODE(root), ML666_BUFFER_STR("element"), &count))
+    return false;
+  schema->element = schema->malloc(schema->user_ptr, (count + 1) * sizeof(*schema->element));
+  size_t size = 16;
+  while(size < count * 2)
+    size *= 2;
+  schema->table = schema->malloc(schema->user_ptr, size * sizeof(*schema->table));
+  if(!schema->element || !schema->table){
+    fprintf(stderr, "ml666_schema_compile: *malloc failed (%d): %s\n", errno, strerror(errno));
+    return false;
+  }
+  memset(schema->element, 0, (count + 1) * sizeof(*schema->element));
+  memset(schema->table, 0, size * sizeof(*schema->table));
+  schema->table_mask = size - 1;
+  // All the names have to be known before the content models can refer to them
+  for(struct ml666_st_member* it=ml666_st_get_first_child(c->stb, ML666_ST_U_CHILDREN(c->stb, ML666_ST_NODE(root))); it; it=ml666_st_member_get_next(c->stb, it)){
+    if(ML666_ST_TYPE(it) != ML666_ST_NT_ELEMENT)
+      continue;
+    struct ml666__schema_element* element = &schema->element[schema->element_count];
+    element->name = get_name(c, (struct ml666_st_element*)it);
+    if(!element->name)
+      return false;
+    const size_t slot = element_find(schema, ml666_hashed_buffer_set__peek(element->name));
+    if(slot < schema->element_count){
+      const struct ml666_buffer_ro name = ml666_hashed_buffer_set__peek(element->name)->buffer;
+      fprintf(stderr, "ml666_schema_compile: element \"%.*s\" declared twice\n", (int)name.length, name.data);
+      return false;
+    }
+    schema->table[slot - schema->element_count] = schema->element_count + 1;
+    schema->element_count += 1;
+  }
+  size_t i = 0;
+  for(struct ml666_st_member* it=ml666_st_get_first_child(c->stb, ML666_ST_U_CHILDREN(c->stb, ML666_ST_NODE(root))); it; it=ml666_st_member_get_next(c->stb, it))
+    if(ML666_ST_TYPE(it) == ML666_ST_NT_ELEMENT)
+      if(!compile_element(c, &schema->element[i++], (struct ml666_st_element*)it, false))
+        return false;
+  return compile_element(c, &schema->element[schema->element_count], root, true);
+}
+
+struct ml666_schema* ml666_schema_compile_p(struct ml666_schema_compile_args args){
+  if(args.node && !args.stb){
+    fprintf(stderr, "ml666_schema_compile_p: argument \"stb\" must be set if \"node\" is set\n");
+    return 0;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_schema* schema = args.malloc(args.user_ptr, sizeof(*schema));
+  if(!schema){
+    fprintf(stderr, "ml666_schema_compile_p: *malloc failed (%d): %s\n", errno, strerror(errno));
+    if(args.tokenizer)
+      ml666_tokenizer_destroy(args.tokenizer);
+    return 0;
+  }
+  memset(schema, 0, sizeof(*schema));
+  schema->buffer_set = ml666_hashed_buffer_set__get_default();
+  schema->user_ptr = args.user_ptr;
+  schema->malloc = args.malloc;
+  schema->realloc = args.realloc;
+  schema->free = args.free;
+
+  struct compile c = {
+    .schema = schema,
+    .stb = args.stb,
+  };
+  struct ml666_st_document* document = 0;
+  if(!args.node){
+    c.stb = ml666_st_builder_create(0);
+    if(!c.stb){
+      if(args.tokenizer)
+        ml666_tokenizer_destroy(args.tokenizer);
+      goto error;
+    }
+    document = ml666_st_parse(c.stb, .fd=args.fd, .tokenizer=args.tokenizer);
+    if(!document)
+      goto error;
+    args.node = ML666_ST_NODE(document);
+  }
+  struct ml666_st_element* root = 0;
+  if(ML666_ST_TYPE(args.node) == ML666_ST_NT_DOCUMENT){
+    size_t count;
+    if(!check_children(&c, args.node, ML666_BUFFER_STR("schema"), &count))
+      goto error;
+    if(count != 1){
+      fprintf(stderr, "ml666_schema_compile: expected exactly one \"schema\" element\n");
+      goto error;
+    }
+    for(struct ml666_st_member* it=ml666_st_get_first_child(c.stb, ML666_ST_U_CHILDREN(c.stb, args.node)); !root; it=ml666_st_member_get_next(c.stb, it))
+      if(ML666_ST_TYPE(it) == ML666_ST_NT_ELEMENT)
+        root = (struct ml666_st_element*)it;
+  }else if(is_named(c.stb, (struct ml666_st_member*)args.node, ML666_BUFFER_STR("schema"))){
+    root = (struct ml666_st_element*)args.node;
+  }else{
+    fprintf(stderr, "ml666_schema_compile: expected a \"schema\" element\n");
+    goto error;
+  }
+  if(!compile_schema(&c, root))
+    goto error;
+  if(document){
+    ml666_st_subtree_disintegrate(c.stb, ML666_ST_CHILDREN(c.stb, document));
+    ml666_st_node_put(c.stb, ML666_ST_NODE(document));
+    ml666_st_builder_destroy(c.stb);
+  }
+  return schema;
+error:
+  if(document){
+    ml666_st_subtree_disintegrate(c.stb, ML666_ST_CHILDREN(c.stb, document));
+    ml666_st_node_put(c.stb, ML666_ST_NODE(document));
+  }
+  if(c.stb && c.stb != args.stb)
+    ml666_st_builder_destroy(c.stb);
+  ml666_schema_destroy(schema);
+  return 0;
+}
+
+//// Validating
+
+struct ml666__parser_schema_frame {
+  size_t element; // Index of the declaration, or ANY_ELEMENT
+  size_t state; // The state of the DFA of the content model
+};
+
+enum text {
+  T_NONE,
+  T_VALUE,
+  T_CONTENT,
+};
+
+struct ml666__parser_schema_private {
+  struct ml666_parser_schema public;
+  const struct ml666_schema* schema;
+  const struct ml666_parser_api* next;
+  void* next_user_ptr;
+
+  // frame[0] is the document, frame[depth] the innermost element
+  struct ml666__parser_schema_frame* frame;
+  size_t frame_size;
+
+  // Attributes always come first, only the ones of the innermost element need to be tracked
+  bool attributes_done;
+  bool* seen;
+
+  // The attribute value or content currently being checked
+  enum text text;
+  enum encoding encoding;
+  struct ml666_streaming_utf8_validator u8v;
+
+  ml666__cb__malloc* malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free* free;
+};
+static_assert(offsetof(struct ml666__parser_schema_private, public) == 0);
+
+static inline const struct ml666__schema_element* current_element(const struct ml666__parser_schema_private* that){
+  const size_t element = that->frame[that->public.depth].element;
+  return element == ANY_ELEMENT ? 0 : &that->schema->element[element];
+}
+
+static void validator_begin(struct ml666__parser_schema_private* that, bool document){
+  that->public.depth = 0;
+  that->frame[0] = (struct ml666__parser_schema_frame){
+    .element = document ? that->schema->element_count : ANY_ELEMENT,
+  };
+  that->attributes_done = true;
+  that->text = T_NONE;
+}
+
+static const char* text_end(struct ml666__parser_schema_private* that){
+  const bool incomplete = that->text != T_NONE && that->encoding == E_UTF8 && !ml666_utf8_validate(&that->u8v, EOF);
+  that->text = T_NONE;
+  return incomplete ? "ml666_parser_schema: invalid UTF-8" : 0;
+}
+
+static const char* attributes_end(struct ml666__parser_schema_private* that){
+  if(that->attributes_done)
+    return 0;
+  that->attributes_done = true;
+  const struct ml666__schema_element* element = current_element(that);
+  for(size_t i=0; i<element->attribute_count; i++)
+    if(element->attribute[i].required && !that->seen[i])
+      return "ml666_parser_schema: required attribute missing";
+  return 0;
+}
+
+static void text_begin(struct ml666__parser_schema_private* that, enum text text, enum encoding encoding){
+  that->text = text;
+  that->encoding = encoding;
+  that->u8v = (struct ml666_streaming_utf8_validator){0};
+}
+
+static const char* text_check(struct ml666__parser_schema_private* that, struct ml666_buffer_ro data){
+  switch(that->encoding){
+    case E_NONE: {
+      if(data.length)
+        return that->text == T_VALUE ? "ml666_parser_schema: attribute can't have a value" : "ml666_parser_schema: content not allowed here";
+    } break;
+    case E_ASCII: {
+      for(size_t i=0; i<data.length; i++)
+        if((unsigned char)data.data[i] >= 0x80)
+          return "ml666_parser_schema: not ASCII";
+    } break;
+    case E_UTF8: {
+      for(size_t i=0; i<data.length; i++)
+        if(!ml666_utf8_validate(&that->u8v, (unsigned char)data.data[i]))
+          return "ml666_parser_schema: invalid UTF-8";
+    } break;
+    case E_ANY: break;
+  }
+  return 0;
+}
+
+static const char* validator_push(struct ml666__parser_schema_private* that, struct ml666_buffer_ro name){
+  const char* error = text_end(that);
+  if(!error)
+    error = attributes_end(that);
+  if(error)
+    return error;
+  const struct ml666_schema* schema = that->schema;
+  size_t index;
+  const struct ml666__schema_element* element = element_lookup(schema, name, &index);
+  if(!element)
+    return "ml666_parser_schema: element not declared";
+  struct ml666__parser_schema_frame* parent = &that->frame[that->public.depth];
+  if(parent->element != ANY_ELEMENT){
+    const uint16_t next = schema->element[parent->element].transition[parent->state * schema->element_count + index];
+    if(!next)
+      return "ml666_parser_schema: element not allowed here";
+    parent->state = next - 1;
+  }
+  const size_t depth = that->public.depth + 1;
+  if(depth >= that->frame_size){
+    size_t size = that->frame_size * 2;
+    struct ml666__parser_schema_frame* frame = that->realloc(that->public.user_ptr, that->frame, size * sizeof(*frame));
+    if(!frame)
+      return "ml666_parser_schema: *realloc failed";
+    that->frame = frame;
+    that->frame_size = size;
+  }
+  that->frame[depth] = (struct ml666__parser_schema_frame){
+    .element = index,
+  };
+  that->public.depth = depth;
+  that->attributes_done = false;
+  if(element->attribute_count)
+    memset(that->seen, 0, element->attribute_count * sizeof(*that->seen));
+  return 0;
+}
+
+static const char* validator_pop(struct ml666__parser_schema_private* that){
+  const char* error = text_end(that);
+  if(!error)
+    error = attributes_end(that);
+  if(error)
+    return error;
+  if(!that->public.depth)
+    return "ml666_parser_schema: end tag without matching opening tag";
+  const struct ml666__parser_schema_frame* frame = &that->frame[that->public.depth];
+  if(!that->schema->element[frame->element].accepting[frame->state])
+    return "ml666_parser_schema: child elements missing";
+  that->public.depth -= 1;
+  return 0;
+}
+
+static const char* validator_attribute(struct ml666__parser_schema_private* that, struct ml666_buffer_ro name){
+  const char* error = text_end(that);
+  if(error)
+    return error;
+  const struct ml666__schema_element* element = current_element(that);
+  if(!element || that->attributes_done)
+    return "ml666_parser_schema: invalid parser state";
+  const struct ml666__schema_attribute* attribute = attribute_lookup(element, name);
+  if(!attribute){
+    if(!element->extra_attributes)
+      return "ml666_parser_schema: attribute not declared";
+    text_begin(that, T_VALUE, E_ANY);
+    return 0;
+  }
+  that->seen[attribute - element->attribute] = true;
+  text_begin(that, T_VALUE, attribute->value);
+  return 0;
+}
+
+static const char* validator_value(struct ml666__parser_schema_private* that, struct ml666_buffer_ro data){
+  if(that->text != T_VALUE)
+    return "ml666_parser_schema: invalid parser state";
+  return text_check(that, data);
+}
+
+static const char* validator_content(struct ml666__parser_schema_private* that, struct ml666_buffer_ro data){
+  if(that->text != T_CONTENT){
+    const char* error = text_end(that);
+    if(!error)
+      error = attributes_end(that);
+    if(error)
+      return error;
+    const struct ml666__schema_element* element = current_element(that);
+    text_begin(that, T_CONTENT, element ? element->content : E_ANY);
+  }
+  return text_check(that, data);
+}
+
+static const char* validator_comment(struct ml666__parser_schema_private* that){
+  const char* error = text_end(that);
+  if(!error)
+    error = attributes_end(that);
+  return error;
+}
+
+// Whether the document is complete
+static const char* validator_end(struct ml666__parser_schema_private* that){
+  const char* error = text_end(that);
+  if(!error)
+    error = attributes_end(that);
+  if(error)
+    return error;
+  if(that->public.depth)
+    return "ml666_parser_schema: elements not closed";
+  const struct ml666__parser_schema_frame* frame = &that->frame[0];
+  if(frame->element != ANY_ELEMENT && !that->schema->element[frame->element].accepting[frame->state])
+    return "ml666_parser_schema: root elements missing";
+  return 0;
+}
+
+struct ml666_parser_schema* ml666_parser_schema_create_p(struct ml666_parser_schema_create_args args){
+  if(!args.schema){
+    fprintf(stderr, "ml666_parser_schema_create_p: mandatory argument \"schema\" not set!\n");
+    return 0;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666__parser_schema_private* that = args.malloc(args.user_ptr, sizeof(*that));
+  if(!that){
+    fprintf(stderr, "ml666_parser_schema_create_p: *malloc failed (%d): %s\n", errno, strerror(errno));
+    return 0;
+  }
+  memset(that, 0, sizeof(*that));
+  that->public.user_ptr = args.user_ptr;
+  that->schema = args.schema;
+  that->next = args.next;
+  that->next_user_ptr = args.next_user_ptr;
+  that->malloc = args.malloc;
+  that->realloc = args.realloc;
+  that->free = args.free;
+  that->frame_size = 16;
+  that->frame = args.realloc(args.user_ptr, 0, that->frame_size * sizeof(*that->frame));
+  that->seen = args.malloc(args.user_ptr, args.schema->max_attribute_count * sizeof(*that->seen) + 1);
+  if(!that->frame || !that->seen){
+    fprintf(stderr, "ml666_parser_schema_create_p: *alloc failed (%d): %s\n", errno, strerror(errno));
+    ml666_parser_schema_destroy(&that->public);
+    return 0;
+  }
+  validator_begin(that, true);
+  return &that->public;
+}
+
+void ml666_parser_schema_destroy(struct ml666_parser_schema* _that){
+  struct ml666__parser_schema_private* that = (struct ml666__parser_schema_private*)_that;
+  if(that->frame)
+    that->realloc(that->public.user_ptr, that->frame, 0);
+  if(that->seen)
+    that->free(that->public.user_ptr, that->seen);
+  that->free(that->public.user_ptr, that);
+}
+
+bool ml666_schema_validate_tree(const struct ml666_schema* schema, struct ml666_st_builder* stb, struct ml666_st_node* node, const char** error){
+  const char* dummy;
+  if(!error)
+    error = &dummy;
+  *error = 0;
+  struct ml666__parser_schema_private* that = (struct ml666__parser_schema_private*)ml666_parser_schema_create(
+    .schema = schema,
+    .malloc = schema->malloc,
+    .realloc = schema->realloc,
+    .free = schema->free,
+    .user_ptr = schema->user_ptr,
+  );
+  if(!that){
+    *error = "ml666_parser_schema: ml666_parser_schema_create failed";
+    return false;
+  }
+  const bool document = ML666_ST_TYPE(node) == ML666_ST_NT_DOCUMENT;
+  validator_begin(that, document);
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(!*error && ml666_st_cursor_next(stb, &cursor)){
+    const enum ml666_st_node_type type = ML666_ST_TYPE(cursor.node);
+    if(cursor.event == ML666_ST_CE_LEAVE){
+      if(type == ML666_ST_NT_ELEMENT)
+        *error = validator_pop(that);
+      continue;
+    }
+    if(cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    switch(type){
+      case ML666_ST_NT_DOCUMENT: break;
+      case ML666_ST_NT_ELEMENT: {
+        struct ml666_st_element* element = (struct ml666_st_element*)cursor.node;
+        *error = validator_push(that, ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, element))->buffer);
+        for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, element); it && !*error; it=ml666_st_attribute_get_next(stb, it)){
+          *error = validator_attribute(that, ml666_st_attribute_get_name(stb, it)->buffer);
+          const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(stb, it);
+          if(!*error && value)
+            *error = validator_value(that, *value);
+        }
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        // Every content node is checked on its own
+        *error = text_end(that);
+        if(!*error)
+          *error = validator_content(that, ml666_st_content_get(stb, (struct ml666_st_content*)cursor.node));
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        *error = validator_comment(that);
+      } break;
+    }
+  }
+  if(!*error && cursor.error)
+    *error = "ml666_parser_schema: the children of an element couldn't be loaded";
+  if(!*error)
+    *error = validator_end(that);
+  ml666_parser_schema_destroy(&that->public);
+  return !*error;
+}
+
+//// The ml666_parser_api. Everything which passed is forwarded to the next api.
+
+#define FORWARD(CALL) \
+  do { \
+    parser->user_ptr = that->next_user_ptr; \
+    const bool result = that->next->CALL; \
+    parser->user_ptr = that; \
+    return result; \
+  } while(0)
+
+static bool ml666_parser_schema__init(struct ml666_parser* parser){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  validator_begin(that, true);
+  if(!that->next || !that->next->init)
+    return true;
+  FORWARD(init(parser));
+}
+
+static void ml666_parser_schema__done(struct ml666_parser* parser){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  // The parser is done once it's read everything, or after a problem. Only the former can be checked for completeness.
+  if(!parser->error)
+    parser->error = validator_end(that);
+  if(!that->next || !that->next->done)
+    return;
+  parser->user_ptr = that->next_user_ptr;
+  that->next->done(parser);
+  parser->user_ptr = that;
+}
+
+static void ml666_parser_schema__cleanup(struct ml666_parser* parser){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  if(!that->next || !that->next->cleanup)
+    return;
+  parser->user_ptr = that->next_user_ptr;
+  that->next->cleanup(parser);
+  parser->user_ptr = that;
+}
+
+static bool ml666_parser_schema__tag_push(struct ml666_parser* parser, ml666_opaque_tag_name* name){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_push(that, *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0});
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next)
+    return true;
+  FORWARD(tag_push(parser, name));
+}
+
+static bool ml666_parser_schema__end_tag_check(struct ml666_parser* parser, ml666_opaque_tag_name name){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  if(that->next)
+    FORWARD(end_tag_check(parser, name));
+  const struct ml666__schema_element* element = current_element(that);
+  if(!element || !element->name)
+    return false;
+  return ml666_buffer__equal(name ? name->buffer.ro : (struct ml666_buffer_ro){0}, ml666_hashed_buffer_set__peek(element->name)->buffer);
+}
+
+static bool ml666_parser_schema__tag_pop(struct ml666_parser* parser){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_pop(that);
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next)
+    return true;
+  FORWARD(tag_pop(parser));
+}
+
+static bool ml666_parser_schema__set_attribute(struct ml666_parser* parser, ml666_opaque_attribute_name* name){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_attribute(that, *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0});
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next || !that->next->set_attribute)
+    return true;
+  FORWARD(set_attribute(parser, name));
+}
+
+static bool ml666_parser_schema__value_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_value(that, data);
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next || !that->next->value_append)
+    return true;
+  FORWARD(value_append(parser, data));
+}
+
+static bool ml666_parser_schema__data_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_content(that, data);
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next || !that->next->data_append)
+    return true;
+  FORWARD(data_append(parser, data));
+}
+
+static bool ml666_parser_schema__comment_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  struct ml666__parser_schema_private* that = parser->user_ptr;
+  const char* error = validator_comment(that);
+  if(error){
+    parser->error = error;
+    return false;
+  }
+  if(!that->next || !that->next->comment_append)
+    return true;
+  FORWARD(comment_append(parser, data));
+}
+
+const struct ml666_parser_api ml666_parser_schema_api = {
+  .init    = ml666_parser_schema__init,
+  .done    = ml666_parser_schema__done,
+  .cleanup = ml666_parser_schema__cleanup,
+
+  .tag_name_append       = ml666_parser__d_mal__tag_name_append,
+  .tag_name_free         = ml666_parser__d_mal__tag_name_free,
+  .attribute_name_append = ml666_parser__d_mal__attribute_name_append,
+  .attribute_name_free   = ml666_parser__d_mal__attribute_name_free,
+
+  .tag_push      = ml666_parser_schema__tag_push,
+  .end_tag_check = ml666_parser_schema__end_tag_check,
+  .tag_pop       = ml666_parser_schema__tag_pop,
+
+  .set_attribute = ml666_parser_schema__set_attribute,
+
+  .value_append   = ml666_parser_schema__value_append,
+  .data_append    = ml666_parser_schema__data_append,
+  .comment_append = ml666_parser_schema__comment_append,
+};
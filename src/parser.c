@@ -47,7 +47,8 @@ static bool ml666_parser_a_init(struct ml666__parser_private* that){
 static void ml666_parser_a_done(struct ml666__parser_private* that){
   if(that->public.api->done)
     that->public.api->done(&that->public);
-  ml666_tokenizer_destroy(that->tokenizer);
+  if(that->tokenizer)
+    ml666_tokenizer_destroy(that->tokenizer);
   that->tokenizer = 0;
 }
 
@@ -156,37 +157,43 @@ static const struct ml666_parser_cb parser_cb = {
   .destroy = ml666_parser_d_destroy,
 };
 
+static bool ml666_parser_check_api(const struct ml666_parser_api* api, const char* caller){
+  bool ok = true;
+  if(!api){
+    fprintf(stderr, "%s: argument cb must be set\n", caller);
+    return false;
+  }
+  if(!api->attribute_name_append){
+    fprintf(stderr, "%s: callback attribute_name_append is mandatory\n", caller);
+    ok = false;
+  }
+  if(!api->tag_name_append){
+    fprintf(stderr, "%s: callback tag_name_append is mandatory\n", caller);
+    ok = false;
+  }
+  if(!api->tag_push){
+    fprintf(stderr, "%s: callback tag_push is mandatory\n", caller);
+    ok = false;
+  }
+  if(!api->end_tag_check){
+    fprintf(stderr, "%s: callback end_tag_check is mandatory\n", caller);
+    ok = false;
+  }
+  if(!api->tag_pop){
+    fprintf(stderr, "%s: callback tag_pop is mandatory\n", caller);
+    ok = false;
+  }
+  return ok;
+}
+
 struct ml666_parser* ml666_parser_create_p(struct ml666_parser_create_args args){
   bool fail = false;
   if(args.fd < 0){
     fprintf(stderr, "ml666_parser_create_p: invalid fd arguent\n");
     fail = true;
   }
-  if(!args.api){
-    fprintf(stderr, "ml666_parser_create_p: argument cb must be set\n");
+  if(!ml666_parser_check_api(args.api, "ml666_parser_create_p"))
     fail = true;
-  }else{
-    if(!args.api->attribute_name_append){
-      fprintf(stderr, "ml666_parser_create_p: callback attribute_name_append is mandatory\n");
-      fail = true;
-    }
-    if(!args.api->tag_name_append){
-      fprintf(stderr, "ml666_parser_create_p: callback tag_name_append is mandatory\n");
-      fail = true;
-    }
-    if(!args.api->tag_push){
-      fprintf(stderr, "ml666_parser_create_p: callback tag_push is mandatory\n");
-      fail = true;
-    }
-    if(!args.api->end_tag_check){
-      fprintf(stderr, "ml666_parser_create_p: callback end_tag_check is mandatory\n");
-      fail = true;
-    }
-    if(!args.api->tag_pop){
-      fprintf(stderr, "ml666_parser_create_p: callback tag_pop is mandatory\n");
-      fail = true;
-    }
-  }
   if(fail)
     goto error;
   if(!args.malloc)
@@ -228,15 +235,8 @@ error:
   return 0;
 }
 
-static bool ml666_parser_d_next(struct ml666_parser* _parser){
-  struct ml666__parser_private*restrict parser = (struct ml666__parser_private*)_parser;
-  if(!parser->tokenizer || parser->tokenizer->token == ML666_EOF)
-    return false;
-  struct ml666_tokenizer* tokenizer = parser->tokenizer;
-  bool done = !ml666_tokenizer_next(tokenizer);
-  parser->public.line = tokenizer->line;
-  parser->public.column = tokenizer->column;
-  parser->public.error = tokenizer->error;
+static bool ml666_parser_d_process(struct ml666__parser_private*restrict parser, const struct ml666_tokenizer* tokenizer){
+  bool ok = true;
   if(tokenizer->match.length)
     parser->nonempty_token = true;
   switch(tokenizer->token){
@@ -246,14 +246,14 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_tag_name_append(parser, &parser->state.tag_name, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::tag_name_append failed";
-        done = true;
+        ok = false;
         break;
       }
       if(tokenizer->complete){
         if(!ml666_parser_a_tag_push(parser, &parser->state.tag_name)){
           if(!parser->public.error)
             parser->public.error = "ml666_parser::tag_push failed";
-          done = true;
+          ok = false;
           break;
         }
         if(parser->state.tag_name){
@@ -266,7 +266,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_tag_name_append(parser, &parser->state.tag_name, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::tag_name_append failed";
-        done = true;
+        ok = false;
         break;
       }
       if(tokenizer->complete){
@@ -274,7 +274,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
           if(!ml666_parser_a_end_tag_check(parser, parser->state.tag_name)){
             if(!parser->public.error)
               parser->public.error = "ml666_parser::end_tag_check failed, did the opening / closing tags missmatch?";
-            done = true;
+            ok = false;
             break;
           }
         }
@@ -283,7 +283,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
         if(!ml666_parser_a_tag_pop(parser)){
           if(!parser->public.error)
             parser->public.error = "ml666_parser::tag_pop failed";
-          done = true;
+          ok = false;
           break;
         }
       }
@@ -292,14 +292,14 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_attribute_name_append(parser, &parser->state.attribute_name, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::attribute_name_append failed";
-        done = true;
+        ok = false;
         break;
       }
       if(tokenizer->complete){
         if(!ml666_parser_a_set_attribute(parser, &parser->state.attribute_name)){
           if(!parser->public.error)
             parser->public.error = "ml666_parser::set_attribute failed";
-          done = true;
+          ok = false;
           break;
         }
         if(parser->state.attribute_name){
@@ -312,7 +312,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_value_append(parser, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::value_append failed";
-        done = true;
+        ok = false;
         break;
       }
     } break;
@@ -320,7 +320,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_data_append(parser, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::data_append failed";
-        done = true;
+        ok = false;
         break;
       }
     } break;
@@ -328,7 +328,7 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
       if(!ml666_parser_a_comment_append(parser, tokenizer->match)){
         if(!parser->public.error)
           parser->public.error = "ml666_parser::comment_append failed";
-        done = true;
+        ok = false;
         break;
       }
     } break;
@@ -336,13 +336,40 @@ static bool ml666_parser_d_next(struct ml666_parser* _parser){
   }
   if(tokenizer->complete)
     parser->nonempty_token = false;
+  return ok;
+}
+
+static void ml666_parser_d_update(struct ml666__parser_private*restrict parser, const struct ml666_tokenizer* tokenizer){
+  parser->public.line = tokenizer->line;
+  parser->public.column = tokenizer->column;
+  parser->public.offset = tokenizer->offset;
+  if(tokenizer->token != ML666_NONE && tokenizer->token != ML666_EOF && tokenizer->complete)
+    parser->public.token_count += 1;
+}
+
+static void ml666_parser_d_finish(struct ml666__parser_private*restrict parser){
+  if(parser->state.tag_name)
+    ml666_parser_a_tag_name_free(parser, parser->state.tag_name);
+  if(parser->state.attribute_name)
+    ml666_parser_a_attribute_name_free(parser, parser->state.attribute_name);
+  parser->state.tag_name = 0;
+  parser->state.attribute_name = 0;
+  parser->public.done = true;
+  ml666_parser_a_done(parser);
+}
+
+static bool ml666_parser_d_next(struct ml666_parser* _parser){
+  struct ml666__parser_private*restrict parser = (struct ml666__parser_private*)_parser;
+  if(!parser->tokenizer || parser->tokenizer->token == ML666_EOF)
+    return false;
+  struct ml666_tokenizer* tokenizer = parser->tokenizer;
+  bool done = !ml666_tokenizer_next(tokenizer);
+  ml666_parser_d_update(parser, tokenizer);
+  parser->public.error = tokenizer->error;
+  if(!ml666_parser_d_process(parser, tokenizer))
+    done = true;
   if(done){
-    if(parser->state.tag_name)
-      ml666_parser_a_tag_name_free(parser, parser->state.tag_name);
-    if(parser->state.attribute_name)
-      ml666_parser_a_attribute_name_free(parser, parser->state.attribute_name);
-    parser->public.done = true;
-    ml666_parser_a_done(parser);
+    ml666_parser_d_finish(parser);
     return false;
   }else{
     return true;
@@ -354,3 +381,165 @@ static void ml666_parser_d_destroy(struct ml666_parser* _parser){
   ml666_parser_a_cleanup(parser);
   parser->free(parser->public.user_ptr, parser);
 }
+
+
+struct ml666__parser_tee_private {
+  struct ml666_parser public;
+  struct ml666_tokenizer* tokenizer;
+  size_t consumer_count;
+  ml666__cb__free* free;
+  struct ml666__parser_private consumer[];
+};
+
+static ml666_parser_cb_next ml666_parser_tee_next;
+static ml666_parser_cb_destroy ml666_parser_tee_destroy;
+static ml666_parser_cb_next ml666_parser_tee_consumer_next;
+static ml666_parser_cb_destroy ml666_parser_tee_consumer_destroy;
+
+static const struct ml666_parser_cb parser_tee_cb = {
+  .next = ml666_parser_tee_next,
+  .destroy = ml666_parser_tee_destroy,
+};
+
+// The consumers are driven by the tee, and owned by it
+static const struct ml666_parser_cb parser_tee_consumer_cb = {
+  .next = ml666_parser_tee_consumer_next,
+  .destroy = ml666_parser_tee_consumer_destroy,
+};
+
+struct ml666_parser* ml666_parser_tee_create_p(struct ml666_parser_tee_create_args args){
+  bool fail = false;
+  if(!args.tokenizer && args.fd < 0){
+    fprintf(stderr, "ml666_parser_tee_create_p: invalid fd arguent\n");
+    fail = true;
+  }
+  if(!args.consumer_count || !args.consumers){
+    fprintf(stderr, "ml666_parser_tee_create_p: at least one consumer is needed\n");
+    fail = true;
+  }else{
+    for(size_t i=0; i<args.consumer_count; i++)
+      if(!ml666_parser_check_api(args.consumers[i].api, "ml666_parser_tee_create_p"))
+        fail = true;
+  }
+  if(fail)
+    goto error;
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666__parser_tee_private* tee = args.malloc(args.user_ptr, sizeof(*tee) + sizeof(*tee->consumer) * args.consumer_count);
+  if(!tee){
+    fprintf(stderr, "ml666_parser_tee_create_p: *malloc failed (%d): %s\n", errno, strerror(errno));
+    goto error;
+  }
+  memset(tee, 0, sizeof(*tee) + sizeof(*tee->consumer) * args.consumer_count);
+  *(const struct ml666_parser_cb**)&tee->public.cb = &parser_tee_cb;
+  tee->public.user_ptr = args.user_ptr;
+  tee->consumer_count = args.consumer_count;
+  tee->free = args.free;
+  for(size_t i=0; i<args.consumer_count; i++){
+    struct ml666__parser_private* consumer = &tee->consumer[i];
+    *(const struct ml666_parser_cb**)&consumer->public.cb = &parser_tee_consumer_cb;
+    *(const struct ml666_parser_api**)&consumer->public.api = args.consumers[i].api;
+    consumer->public.user_ptr = args.consumers[i].user_ptr;
+    consumer->malloc = args.malloc;
+    consumer->realloc = args.realloc;
+    consumer->free = args.free;
+  }
+  if(!args.tokenizer){
+    args.tokenizer = ml666_tokenizer_create(args.fd, .user_ptr=0, .malloc=args.malloc, .free=args.free);
+    if(!args.tokenizer)
+      goto error_after_calloc;
+  }
+  tee->tokenizer = args.tokenizer;
+  args.fd = -1;
+  for(size_t i=0; i<args.consumer_count; i++){
+    if(!ml666_parser_a_init(&tee->consumer[i])){
+      while(i--)
+        ml666_parser_a_cleanup(&tee->consumer[i]);
+      goto error_after_calloc;
+    }
+  }
+  return &tee->public;
+
+error_after_calloc:
+  args.free(args.user_ptr, tee);
+error:
+  if(args.fd >= 0)
+    close(args.fd);
+  if(args.tokenizer)
+    ml666_tokenizer_destroy(args.tokenizer);
+  return 0;
+}
+
+struct ml666_parser* ml666_parser_tee_get_consumer(struct ml666_parser* _tee, size_t index){
+  struct ml666__parser_tee_private* tee = (struct ml666__parser_tee_private*)_tee;
+  if(tee->public.cb != &parser_tee_cb || index >= tee->consumer_count)
+    return 0;
+  return &tee->consumer[index].public;
+}
+
+static bool ml666_parser_tee_next(struct ml666_parser* _tee){
+  struct ml666__parser_tee_private*restrict tee = (struct ml666__parser_tee_private*)_tee;
+  if(!tee->tokenizer || tee->tokenizer->token == ML666_EOF)
+    return false;
+  struct ml666_tokenizer* tokenizer = tee->tokenizer;
+  bool done = !ml666_tokenizer_next(tokenizer);
+  tee->public.line = tokenizer->line;
+  tee->public.column = tokenizer->column;
+  tee->public.offset = tokenizer->offset;
+  if(tokenizer->token != ML666_NONE && tokenizer->token != ML666_EOF && tokenizer->complete)
+    tee->public.token_count += 1;
+  tee->public.error = tokenizer->error;
+  size_t active = 0;
+  for(size_t i=0, n=tee->consumer_count; i<n; i++){
+    struct ml666__parser_private*restrict consumer = &tee->consumer[i];
+    if(consumer->public.done)
+      continue;
+    ml666_parser_d_update(consumer, tokenizer);
+    if(tokenizer->error)
+      consumer->public.error = tokenizer->error;
+    if(!ml666_parser_d_process(consumer, tokenizer) || done){
+      ml666_parser_d_finish(consumer);
+      continue;
+    }
+    active += 1;
+  }
+  if(!active && !done){
+    tee->public.error = "ml666_parser_tee: all consumers failed";
+    done = true;
+  }
+  if(done){
+    tee->public.done = true;
+    ml666_tokenizer_destroy(tee->tokenizer);
+    tee->tokenizer = 0;
+    return false;
+  }
+  return true;
+}
+
+static void ml666_parser_tee_destroy(struct ml666_parser* _tee){
+  struct ml666__parser_tee_private* tee = (struct ml666__parser_tee_private*)_tee;
+  for(size_t i=0, n=tee->consumer_count; i<n; i++){
+    struct ml666__parser_private* consumer = &tee->consumer[i];
+    if(consumer->state.tag_name)
+      ml666_parser_a_tag_name_free(consumer, consumer->state.tag_name);
+    if(consumer->state.attribute_name)
+      ml666_parser_a_attribute_name_free(consumer, consumer->state.attribute_name);
+    ml666_parser_a_cleanup(consumer);
+  }
+  if(tee->tokenizer)
+    ml666_tokenizer_destroy(tee->tokenizer);
+  tee->free(tee->public.user_ptr, tee);
+}
+
+static bool ml666_parser_tee_consumer_next(struct ml666_parser* parser){
+  (void)parser;
+  return false;
+}
+
+static void ml666_parser_tee_consumer_destroy(struct ml666_parser* parser){
+  (void)parser;
+}
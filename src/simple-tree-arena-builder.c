@@ -0,0 +1,599 @@
+#include <ml666/simple-tree-arena-builder.h>
+#include <ml666/refcount.h>
+#include <ml666/utils.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+// Strings up to this size are copied into the arena, bigger ones are kept in the buffer they were set with
+#define ARENA_SMALL_BUFFER 256
+#define ARENA_MAX_BLOCK_SIZE (4ul<<20)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_block {
+  struct arena_block* next;
+  size_t size, used;
+  alignas(ARENA_ALIGN) char data[];
+};
+
+// Owns a buffer which isn't in the arena. Freed with the arena, unless it's taken before.
+struct heap_buffer {
+  struct heap_buffer* next;
+  char* data;
+};
+
+struct arena_buffer {
+  struct ml666_buffer_ro data;
+  struct heap_buffer* heap; // If heap->data is set, it's what data points to
+};
+
+struct arena {
+  struct arena *previous, *next;
+  struct arena_block* block;
+  size_t next_block_size;
+  struct heap_buffer* heap_list;
+  struct ml666_hashed_buffer** name;
+  size_t name_count, name_capacity;
+};
+
+struct ml666_st_children {
+  struct ml666_st_member *first, *last;
+};
+
+struct ml666_st_node {
+  enum ml666_st_node_type type;
+  struct ml666_refcount refcount;
+};
+
+struct ml666_st_member {
+  struct ml666_st_node node;
+  struct arena* arena;
+  struct ml666_st_node *parent;
+  struct ml666_st_member *previous, *next;
+};
+
+struct ml666_st_document {
+  struct ml666_st_node node;
+  struct ml666_st_children children;
+  struct arena arena;
+};
+
+struct ml666_st_attribute {
+  struct ml666_st_element* element;
+  struct ml666_st_attribute *previous, *next;
+  const struct ml666_hashed_buffer* name;
+  struct arena_buffer value;
+  struct ml666_buffer taken;
+  bool has_value;
+};
+
+struct ml666_st_element {
+  struct ml666_st_member member;
+  struct ml666_st_children children;
+  const struct ml666_hashed_buffer* name;
+  struct ml666_st_attribute *first_attribute, *last_attribute;
+};
+
+struct ml666_st_content {
+  struct ml666_st_member member;
+  struct arena_buffer buffer;
+};
+
+struct ml666_st_comment {
+  struct ml666_st_member member;
+  struct arena_buffer buffer;
+};
+
+struct ml666_st_builder_arena {
+  struct ml666_st_builder public;
+  struct ml666_st_arena_builder_create_args a;
+  struct arena* last; // The arena of the most recently created document which still exists
+};
+static_assert(offsetof(struct ml666_st_builder_arena, public) == 0, "ml666_st_builder_arena::public must be the first member");
+
+static void* arena_alloc(struct ml666_st_builder_arena* stb, struct arena* arena, size_t size){
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  struct arena_block* block = arena->block;
+  if(!block || block->size - block->used < size){
+    size_t block_size = arena->next_block_size;
+    if(block_size < size)
+      block_size = size;
+    block = stb->a.malloc(stb->public.user_ptr, sizeof(*block) + block_size);
+    if(!block){
+      perror("malloc failed");
+      return 0;
+    }
+    block->size = block_size;
+    block->used = 0;
+    block->next = arena->block;
+    arena->block = block;
+    if(arena->next_block_size < ARENA_MAX_BLOCK_SIZE)
+      arena->next_block_size *= 2;
+  }
+  void* result = block->data + block->used;
+  block->used += size;
+  return result;
+}
+
+static void arena_destroy(struct ml666_st_builder_arena* stb, struct arena* arena){
+  for(struct heap_buffer* it=arena->heap_list; it; it=it->next)
+    if(it->data)
+      stb->a.free(stb->public.user_ptr, it->data);
+  for(struct arena_block *it=arena->block, *next; it; it=next){
+    next = it->next;
+    stb->a.free(stb->public.user_ptr, it);
+  }
+  stb->a.free(stb->public.user_ptr, arena->name);
+  if(arena->next)
+    arena->next->previous = arena->previous;
+  if(arena->previous)
+    arena->previous->next = arena->next;
+  if(stb->last == arena)
+    stb->last = arena->previous;
+}
+
+static size_t name_slot(uint64_t hash, size_t capacity){
+  return (hash ^ (hash >> 32)) & (capacity - 1);
+}
+
+static const struct ml666_hashed_buffer* arena_intern(struct ml666_st_builder_arena* stb, struct arena* arena, const struct ml666_hashed_buffer* key, enum ml666_hashed_buffer_set_mode mode){
+  const struct ml666_hashed_buffer* result = 0;
+  size_t i = 0;
+  if(arena->name_capacity){
+    for(i=name_slot(key->hash, arena->name_capacity); arena->name[i]; i=(i+1)&(arena->name_capacity-1)){
+      const struct ml666_hashed_buffer* cur = arena->name[i];
+      if( cur == key || (
+          cur->hash == key->hash
+       && cur->buffer.length == key->buffer.length
+       && memcmp(cur->buffer.data, key->buffer.data, key->buffer.length) == 0
+      )){
+        result = cur;
+        goto out;
+      }
+    }
+  }
+  if(mode == ML666_HBS_M_GET)
+    return 0;
+  if((arena->name_count + 1) * 2 > arena->name_capacity){
+    const size_t capacity = arena->name_capacity ? arena->name_capacity * 2 : 32;
+    struct ml666_hashed_buffer** name = stb->a.malloc(stb->public.user_ptr, capacity * sizeof(*name));
+    if(!name){
+      perror("malloc failed");
+      goto out;
+    }
+    memset(name, 0, capacity * sizeof(*name));
+    for(size_t j=0; j<arena->name_capacity; j++){
+      if(!arena->name[j])
+        continue;
+      size_t k = name_slot(arena->name[j]->hash, capacity);
+      while(name[k])
+        k = (k + 1) & (capacity - 1);
+      name[k] = arena->name[j];
+    }
+    stb->a.free(stb->public.user_ptr, arena->name);
+    arena->name = name;
+    arena->name_capacity = capacity;
+    i = name_slot(key->hash, capacity);
+    while(name[i])
+      i = (i + 1) & (capacity - 1);
+  }
+  struct ml666_hashed_buffer* entry = arena_alloc(stb, arena, sizeof(*entry) + key->buffer.length);
+  if(!entry)
+    goto out;
+  char* data = (char*)(entry + 1);
+  memcpy(data, key->buffer.data, key->buffer.length);
+  *entry = (struct ml666_hashed_buffer){
+    .buffer = { .data = data, .length = key->buffer.length },
+    .hash = key->hash,
+  };
+  arena->name[i] = entry;
+  arena->name_count += 1;
+  result = entry;
+out:
+  if(mode == ML666_HBS_M_ADD_TAKE)
+    stb->a.free(stb->public.user_ptr, (char*)key->buffer.data);
+  return result;
+}
+
+static void arena_buffer_release(struct ml666_st_builder_arena* stb, struct arena_buffer* buffer){
+  if(buffer->heap && buffer->heap->data){
+    stb->a.free(stb->public.user_ptr, buffer->heap->data);
+    buffer->heap->data = 0;
+  }
+  buffer->data = (struct ml666_buffer_ro){0};
+}
+
+static bool arena_buffer_set(struct ml666_st_builder_arena* stb, struct arena* arena, struct arena_buffer* buffer, struct ml666_buffer value){
+  arena_buffer_release(stb, buffer);
+  if(!value.length){
+    stb->a.free(stb->public.user_ptr, value.data);
+    return true;
+  }
+  if(value.length <= ARENA_SMALL_BUFFER){
+    char* data = arena_alloc(stb, arena, value.length);
+    if(data){
+      memcpy(data, value.data, value.length);
+      stb->a.free(stb->public.user_ptr, value.data);
+      buffer->data = (struct ml666_buffer_ro){ .data = data, .length = value.length };
+      return true;
+    }
+  }
+  if(!buffer->heap){
+    struct heap_buffer* heap = arena_alloc(stb, arena, sizeof(*heap));
+    if(!heap)
+      return false;
+    heap->next = arena->heap_list;
+    arena->heap_list = heap;
+    buffer->heap = heap;
+  }
+  buffer->heap->data = value.data;
+  buffer->data = value.ro;
+  return true;
+}
+
+static struct ml666_buffer arena_buffer_take(struct ml666_st_builder_arena* stb, struct arena_buffer* buffer){
+  struct ml666_buffer result = {0};
+  if(buffer->heap && buffer->heap->data){
+    result.data = buffer->heap->data;
+    result.length = buffer->data.length;
+    buffer->heap->data = 0;
+  }else if(buffer->data.length){
+    // The caller may realloc it, so it has to be moved out of the arena
+    if(!ml666_buffer__dup(&result, buffer->data, stb->public.user_ptr, stb->a.malloc))
+      return result;
+  }
+  buffer->data = (struct ml666_buffer_ro){0};
+  return result;
+}
+
+static struct arena* node_get_arena(struct ml666_st_node* node){
+  if(node->type == ML666_ST_NT_DOCUMENT)
+    return &((struct ml666_st_document*)node)->arena;
+  return ((struct ml666_st_member*)node)->arena;
+}
+
+void ml666_st__a__node_put(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  if(ml666_refcount_decrement(&node->refcount))
+    return;
+  // Members are freed together with the arena of their document
+  if(node->type != ML666_ST_NT_DOCUMENT)
+    return;
+  struct ml666_st_document* document = (struct ml666_st_document*)node;
+  arena_destroy(stb, &document->arena);
+  stb->a.free(stb->public.user_ptr, document);
+}
+
+void ml666_st__a__node_ref(struct ml666_st_builder* stb, struct ml666_st_node* node){
+  (void)stb;
+  ml666_refcount_increment(&node->refcount);
+}
+
+struct ml666_st_children* ml666_st__a__document_get_children(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  (void)stb;
+  return &document->children;
+}
+
+struct ml666_st_children* ml666_st__a__element_get_children(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  return &element->children;
+}
+
+struct ml666_st_node* ml666_st__a__member_get_parent(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->parent;
+}
+
+struct ml666_st_member* ml666_st__a__member_get_previous(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->previous;
+}
+
+struct ml666_st_member* ml666_st__a__member_get_next(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->next;
+}
+
+const struct ml666_hashed_buffer_set_entry* ml666_st__a__element_get_name(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  // An ml666_hashed_buffer_set_entry only needs to start with an ml666_hashed_buffer
+  return (const struct ml666_hashed_buffer_set_entry*)element->name;
+}
+
+bool ml666_st__a__content_set(struct ml666_st_builder* _stb, struct ml666_st_content* content, struct ml666_buffer buffer){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return arena_buffer_set(stb, content->member.arena, &content->buffer, buffer);
+}
+
+struct ml666_buffer_ro ml666_st__a__content_get(struct ml666_st_builder* stb, const struct ml666_st_content* content){
+  (void)stb;
+  return content->buffer.data;
+}
+
+struct ml666_buffer ml666_st__a__content_take(struct ml666_st_builder* _stb, struct ml666_st_content* content){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return arena_buffer_take(stb, &content->buffer);
+}
+
+bool ml666_st__a__comment_set(struct ml666_st_builder* _stb, struct ml666_st_comment* comment, struct ml666_buffer buffer){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return arena_buffer_set(stb, comment->member.arena, &comment->buffer, buffer);
+}
+
+struct ml666_buffer_ro ml666_st__a__comment_get(struct ml666_st_builder* stb, const struct ml666_st_comment* comment){
+  (void)stb;
+  return comment->buffer.data;
+}
+
+struct ml666_buffer ml666_st__a__comment_take(struct ml666_st_builder* _stb, struct ml666_st_comment* comment){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return arena_buffer_take(stb, &comment->buffer);
+}
+
+static void unlink_member(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  struct ml666_st_node* old_parent = member->parent;
+  if(!old_parent)
+    return;
+  struct ml666_st_children* old_children = ml666_st_node_get_children(stb, old_parent);
+  if(old_children->first == member){
+    old_children->first = member->next;
+  }else{
+    member->previous->next = member->next;
+  }
+  if(old_children->last == member){
+    old_children->last = member->previous;
+  }else{
+    member->next->previous = member->previous;
+  }
+}
+
+bool ml666_st__a__member_set(
+  struct ml666_st_builder* stb,
+  struct ml666_st_node* parent,
+  struct ml666_st_member* member,
+  struct ml666_st_member* before
+){
+  if(!parent && !before){
+    unlink_member(stb, member);
+    member->previous = 0;
+    member->next = 0;
+    member->parent = 0;
+    return true;
+  }
+  if(before){
+    if(parent){
+      if(parent != before->parent)
+        return false;
+    }else{
+      parent = before->parent;
+    }
+  }
+  if(!parent)
+    return false;
+  if(node_get_arena(parent) != member->arena){
+    fprintf(stderr, "ml666_st__a__member_set: the member belongs to another document\n");
+    return false;
+  }
+  struct ml666_st_children* children = ml666_st_node_get_children(stb, parent);
+  if(!children)
+    return false;
+  unlink_member(stb, member);
+  member->parent = parent;
+  member->next = before;
+  struct ml666_st_member* after = 0;
+  if(before){
+    after = before->previous;
+    before->previous = member;
+  }else{
+    after = children->last;
+    children->last = member;
+  }
+  member->previous = after;
+  if(after){
+    after->next = member;
+  }else{
+    children->first = member;
+  }
+  return true;
+}
+
+struct ml666_st_document* ml666_st__a__document_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  struct ml666_st_document* document = stb->a.malloc(stb->public.user_ptr, sizeof(*document));
+  if(!document){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(document, 0, sizeof(*document));
+  ml666_refcount_increment(&document->node.refcount);
+  document->node.type = ML666_ST_NT_DOCUMENT;
+  document->arena.next_block_size = stb->a.block_size;
+  document->arena.previous = stb->last;
+  if(stb->last)
+    stb->last->next = &document->arena;
+  stb->last = &document->arena;
+  return document;
+}
+
+static void* member_create(struct ml666_st_builder_arena* stb, size_t size, enum ml666_st_node_type type){
+  if(!stb->last){
+    fprintf(stderr, "ml666_st_arena_builder: create a document first, the nodes belong to its arena\n");
+    return 0;
+  }
+  struct ml666_st_member* member = arena_alloc(stb, stb->last, size);
+  if(!member)
+    return 0;
+  memset(member, 0, size);
+  ml666_refcount_increment(&member->node.refcount);
+  member->node.type = type;
+  member->arena = stb->last;
+  return member;
+}
+
+struct ml666_st_element* ml666_st__a__element_create(struct ml666_st_builder* _stb, const struct ml666_hashed_buffer* entry, bool copy_name){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  struct ml666_st_element* element = member_create(stb, sizeof(*element), ML666_ST_NT_ELEMENT);
+  if(!element){
+    if(!copy_name)
+      stb->a.free(stb->public.user_ptr, (char*)entry->buffer.data);
+    return 0;
+  }
+  if(!(element->name = arena_intern(stb, element->member.arena, entry, copy_name ? ML666_HBS_M_ADD_COPY : ML666_HBS_M_ADD_TAKE))){
+    fprintf(stderr, "ml666_st_arena_builder: interning the name failed\n");
+    return 0;
+  }
+  return element;
+}
+
+struct ml666_st_content* ml666_st__a__content_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return member_create(stb, sizeof(struct ml666_st_content), ML666_ST_NT_CONTENT);
+}
+
+struct ml666_st_comment* ml666_st__a__comment_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  return member_create(stb, sizeof(struct ml666_st_comment), ML666_ST_NT_COMMENT);
+}
+
+struct ml666_st_member* ml666_st__a__get_first_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  return children->first;
+}
+
+struct ml666_st_member* ml666_st__a__get_last_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  return children->last;
+}
+
+struct ml666_st_attribute* ml666_st__a__attribute_get_first(const struct ml666_st_builder* stb, const struct ml666_st_element* element){
+  (void)stb;
+  return element->first_attribute;
+}
+
+struct ml666_st_attribute* ml666_st__a__attribute_get_next(const struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  return attribute->next;
+}
+
+struct ml666_st_attribute* ml666_st__a__attribute_lookup(struct ml666_st_builder* _stb, struct ml666_st_element* element, const struct ml666_hashed_buffer* name, enum ml666_st_attribute_lookup_flags flags){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  enum ml666_hashed_buffer_set_mode mode = ML666_HBS_M_GET;
+  if((flags & ML666_ST_AOF_CREATE_NOCOPY) == ML666_ST_AOF_CREATE_NOCOPY){
+    mode = ML666_HBS_M_ADD_TAKE;
+  }else if((flags & ML666_ST_AOF_CREATE) == ML666_ST_AOF_CREATE){
+    mode = ML666_HBS_M_ADD_COPY;
+  }
+  struct arena* arena = element->member.arena;
+  const struct ml666_hashed_buffer* entry = arena_intern(stb, arena, name, mode);
+  if(!entry){
+    if(mode != ML666_HBS_M_GET)
+      fprintf(stderr, "ml666_st_arena_builder: interning the name failed\n");
+    return 0;
+  }
+  struct ml666_st_attribute* attribute = 0;
+  for(attribute=element->first_attribute; attribute; attribute=attribute->next)
+    if(attribute->name == entry)
+      break;
+  if(attribute){
+    if((flags & ML666_ST_AOF_CREATE_EXCLUSIVE) == ML666_ST_AOF_CREATE_EXCLUSIVE){
+      fprintf(stderr, "ml666_st__a__attribute_lookup failed: attribute already exists\n");
+      return 0;
+    }
+    return attribute;
+  }
+  if(mode == ML666_HBS_M_GET)
+    return 0;
+  attribute = arena_alloc(stb, arena, sizeof(*attribute));
+  if(!attribute)
+    return 0;
+  memset(attribute, 0, sizeof(*attribute));
+  attribute->name = entry;
+  attribute->element = element;
+  attribute->previous = element->last_attribute;
+  if(element->last_attribute){
+    element->last_attribute->next = attribute;
+  }else{
+    element->first_attribute = attribute;
+  }
+  element->last_attribute = attribute;
+  return attribute;
+}
+
+void ml666_st__a__attribute_remove(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  struct ml666_st_element* element = attribute->element;
+  if(attribute->previous){
+    attribute->previous->next = attribute->next;
+  }else{
+    element->first_attribute = attribute->next;
+  }
+  if(attribute->next){
+    attribute->next->previous = attribute->previous;
+  }else{
+    element->last_attribute = attribute->previous;
+  }
+  arena_buffer_release(stb, &attribute->value);
+  attribute->has_value = false;
+}
+
+const struct ml666_hashed_buffer* ml666_st__a__attribute_get_name(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  return attribute->name;
+}
+
+bool ml666_st__a__attribute_set_value(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute, struct ml666_buffer* value){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  if(!value){
+    arena_buffer_release(stb, &attribute->value);
+    attribute->has_value = false;
+    return true;
+  }
+  if(!arena_buffer_set(stb, attribute->element->member.arena, &attribute->value, *value))
+    return false;
+  attribute->has_value = true;
+  return true;
+}
+
+const struct ml666_buffer_ro* ml666_st__a__attribute_get_value(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  if(!attribute->has_value)
+    return 0;
+  return &attribute->value.data;
+}
+
+const struct ml666_buffer* ml666_st__a__attribute_take_value(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  if(!attribute->has_value)
+    return 0;
+  attribute->has_value = false;
+  attribute->taken = arena_buffer_take(stb, &attribute->value);
+  return &attribute->taken;
+}
+
+void ml666_st__a__builder_destroy(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_arena* stb = (struct ml666_st_builder_arena*)_stb;
+  stb->a.free(stb->public.user_ptr, stb);
+}
+
+ML666_ST_IMPLEMENTATION(ml666_arena, ml666_st__a_)
+
+struct ml666_st_builder* ml666_st_arena_builder_create_p(struct ml666_st_arena_builder_create_args args){
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  if(!args.block_size)
+    args.block_size = 0x4000;
+  struct ml666_st_builder_arena* stb = args.malloc(args.user_ptr, sizeof(*stb));
+  if(!stb){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(stb, 0, sizeof(*stb));
+  *(const struct ml666_st_cb**)&stb->public.cb = &ml666_arena_st_api;
+  stb->public.user_ptr = args.user_ptr;
+  stb->a = args;
+  return &stb->public;
+}
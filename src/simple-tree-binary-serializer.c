@@ -11,7 +11,7 @@ struct ml666_st_serializer_private {
   struct ml666_st_serializer public;
   struct ml666_st_node* node;
   int fd;
-  struct ml666_st_member* cur;
+  struct ml666_st_cursor cursor;
   struct ml666_buffer_ro buf;
   bool recursive;
   ml666__cb__malloc* malloc;
@@ -39,13 +39,14 @@ struct ml666_st_serializer* ml666_st_binary_serializer_create_p(struct ml666_st_
     args.malloc = ml666__d__malloc;
   if(!args.free)
     args.free = ml666__d__free;
-  struct ml666_st_member* first_child = 0;
   if(ML666_ST_TYPE(args.node) == ML666_ST_NT_DOCUMENT){
     struct ml666_st_children* children = ML666_ST_U_CHILDREN(args.stb, args.node);
-    if(children && ml666_st_get_first_child(args.stb, children) == ml666_st_get_last_child(args.stb, children))
-      args.node = ML666_ST_NODE(ml666_st_get_first_child(args.stb, children));
+    struct ml666_st_member* first_child = ml666_st_get_first_child(args.stb, children);
+    if(first_child && first_child == ml666_st_get_last_child(args.stb, children))
+      args.node = ML666_ST_NODE(first_child);
   }
   const struct ml666_buffer_ro* buf = 0;
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(args.node);
   if(args.attribute){
     struct ml666_st_element* element = ML666_ST_U_ELEMENT(args.node);
     if(!element){
@@ -55,12 +56,7 @@ struct ml666_st_serializer* ml666_st_binary_serializer_create_p(struct ml666_st_
     struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(args.stb, element, args.attribute, 0);
     if(attribute)
       buf = ml666_st_attribute_get_value(args.stb, attribute);
-  }else if(ML666_ST_TYPE(args.node) == ML666_ST_NT_DOCUMENT || ML666_ST_TYPE(args.node) == ML666_ST_NT_ELEMENT){
-    struct ml666_st_children* children = ML666_ST_U_CHILDREN(args.stb, args.node);
-    if(children)
-      first_child = ml666_st_get_first_child(args.stb, children);
-  }else{
-    first_child = ML666_ST_U_MEMBER(args.node);
+    cursor.event = ML666_ST_CE_END;
   }
   struct ml666_st_serializer_private* sts = args.malloc(args.user_ptr, sizeof(*sts));
   if(!sts){
@@ -73,7 +69,7 @@ struct ml666_st_serializer* ml666_st_binary_serializer_create_p(struct ml666_st_
   sts->public.user_ptr = args.user_ptr;
   sts->fd = args.fd;
   sts->node = args.node;
-  sts->cur = first_child;
+  sts->cursor = cursor;
   if(buf)
     sts->buf = *buf;
   sts->recursive = args.recursive;
@@ -83,35 +79,11 @@ struct ml666_st_serializer* ml666_st_binary_serializer_create_p(struct ml666_st_
   return &sts->public;
 }
 
-static inline struct ml666_st_member* next(struct ml666_st_builder* stb, struct ml666_st_node* top, struct ml666_st_member* member, bool recursive){
-  if(ML666_ST_NODE(member) == top)
-    return 0;
-  if(recursive){
-    struct ml666_st_member* first_child = ml666_st_get_first_child(stb, ML666_ST_U_CHILDREN(stb, member));
-    if(first_child)
-      return first_child;
-  }
-  struct ml666_st_member* n = ml666_st_member_get_next(stb, member);
-  if(n) return n;
-  if(recursive){
-    struct ml666_st_node* m = ML666_ST_NODE(member);
-    while(ML666_ST_U_MEMBER(m)){
-      m = ml666_st_member_get_parent(stb, ML666_ST_U_MEMBER(m));
-      if(!m || m == top || !ML666_ST_U_MEMBER(m))
-        return 0;
-      struct ml666_st_member* m2 = ml666_st_member_get_next(stb, ML666_ST_U_MEMBER(m));
-      if(m2)
-        return m2;
-    }
-  }
-  return 0;
-}
-
 static bool ml666_st_binary_serializer_next(struct ml666_st_serializer* _sts){
   struct ml666_st_serializer_private*restrict const sts = (struct ml666_st_serializer_private*)_sts;
   if(sts->fd == -1)
     return false;
-  while(sts->cur || sts->buf.length){
+  while(true){
     if(sts->buf.length){
       ssize_t res = write(sts->fd, sts->buf.data, sts->buf.length);
       if(res < 0){
@@ -122,11 +94,19 @@ static bool ml666_st_binary_serializer_next(struct ml666_st_serializer* _sts){
       sts->buf.data   += res;
       sts->buf.length -= res;
       return true;
-    }else{
-      struct ml666_st_content* content = ML666_ST_U_CONTENT(sts->cur);
-      if(content)
-        sts->buf = ml666_st_content_get(sts->public.stb, content);
-      sts->cur = next(sts->public.stb, sts->node, sts->cur, sts->recursive);
+    }
+    if(!ml666_st_cursor_next(sts->public.stb, &sts->cursor)){
+      if(sts->cursor.error)
+        sts->public.error = "the children of an element couldn't be loaded";
+      break;
+    }
+    if(sts->cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    struct ml666_st_content* content = ML666_ST_U_CONTENT(sts->cursor.node);
+    if(content){
+      sts->buf = ml666_st_content_get(sts->public.stb, content);
+    }else if(sts->cursor.depth && !sts->recursive){
+      ml666_st_cursor_skip(&sts->cursor);
     }
   }
   close(sts->fd);
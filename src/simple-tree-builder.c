@@ -1,6 +1,11 @@
 #include <ml666/simple-tree-builder.h>
+#include <ml666/structure-scanner.h>
+#include <ml666/tokenizer.h>
 #include <ml666/utils.h>
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -10,373 +15,1755 @@
 
 ML666_DEFAULT_SIMPLE_TREE
 
+// What currently exists, for ml666_st_builder_get_stats
+struct builder_stats {
+  atomic_size_t node_count[4]; // By ml666_st_node_type
+  atomic_size_t attribute_count;
+  atomic_size_t data_bytes;
+  atomic_size_t allocation_count;
+  atomic_size_t allocated_bytes;
+};
+
 struct ml666_st_builder_default {
   struct ml666_st_builder public;
   struct ml666_st_builder_create_args a;
+  struct ml666_tokenizer*_Atomic tokenizer; // Kept for loading lazily parsed elements. Taken by whoever uses it.
+  struct ml666_st_builder_default* origin; // The builder this one was forked from. It gets the stats of this one when it's destroyed.
+  bool own_buffer_set; // The buffer set was created for this builder, and is destroyed with it
+  struct builder_stats stats;
+  uint64_t generation; // The one changed nodes get, see generation_current
+  bool generation_seen; // Whether ml666_st_node_get_generation returned the current generation
+  struct ml666_st_clone_index* clone_index; // The lazy clones of each element which has some, see ml666_st_clone_lazy
+  size_t loading; // Elements being loaded. That doesn't change what they are, so their lazy clones don't need copies for it.
 };
 
-void ml666_st__d__node_put(struct ml666_st_builder* _stb, struct ml666_st_node* node){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  if(ml666_refcount_decrement(&node->refcount))
-    return;
-  switch(node->type){
-    case ML666_ST_NT_DOCUMENT: break;
-    case ML666_ST_NT_ELEMENT: {
-      struct ml666_st_element* element = (struct ml666_st_element*)node;
-      ml666_hashed_buffer_set__put(stb->a.buffer_set, element->name);
-      for(struct ml666_st_attribute* attribute; (attribute=ml666_st_attribute_get_first(&stb->public, element));)
-        ml666_st_attribute_remove(&stb->public, attribute);
-    } break;
-    case ML666_ST_NT_CONTENT: {
-      struct ml666_st_content* content = (struct ml666_st_content*)node;
-      stb->a.free(stb->public.user_ptr, content->buffer.data);
-    } break;
-    case ML666_ST_NT_COMMENT: {
-      struct ml666_st_comment* comment = (struct ml666_st_comment*)node;
-      stb->a.free(stb->public.user_ptr, comment->buffer.data);
-    } break;
+static inline void node_refcount_increment(const struct ml666_st_builder_default* stb, struct ml666_st_node* node){
+  if(stb->a.thread_confined){
+    ml666_refcount_increment_local(&node->refcount);
+  }else{
+    ml666_refcount_increment(&node->refcount);
   }
-  stb->a.free(stb->public.user_ptr, node);
 }
 
-void ml666_st__d__node_ref(struct ml666_st_builder* stb, struct ml666_st_node* node){
-  (void)stb;
-  ml666_refcount_increment(&node->refcount);
+static inline bool node_refcount_decrement(const struct ml666_st_builder_default* stb, struct ml666_st_node* node){
+  if(stb->a.thread_confined)
+    return ml666_refcount_decrement_local(&node->refcount);
+  return ml666_refcount_decrement(&node->refcount);
 }
 
-enum ml666_st_node_type ml666_st__d__node_get_type(struct ml666_st_builder* stb, struct ml666_st_node* node){
-  (void)stb;
-  return node->type;
+// The counters are only kept if they were asked for, they'd be two atomic additions for every allocation otherwise
+static inline void stats_add(const struct ml666_st_builder_default* stb, atomic_size_t* counter, size_t amount){
+  if(!stb->a.stats)
+    return;
+  if(stb->a.thread_confined){
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+  }else{
+    atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+  }
 }
+#define STATS_ADD(STB, FIELD, AMOUNT) stats_add((STB), &(STB)->stats.FIELD, (AMOUNT))
+#define STATS_SUB(STB, FIELD, AMOUNT) stats_add((STB), &(STB)->stats.FIELD, -(size_t)(AMOUNT))
 
-struct ml666_st_children* ml666_st__d__document_get_children(struct ml666_st_builder* stb, struct ml666_st_document* document){
-  (void)stb;
-  return &document->children;
+// Everything the builder allocates for the nodes goes through these, so it's counted
+static void* builder_malloc(struct ml666_st_builder_default* stb, size_t size){
+  void* memory = stb->a.malloc(stb->public.user_ptr, size);
+  if(!memory)
+    return 0;
+  STATS_ADD(stb, allocation_count, 1);
+  STATS_ADD(stb, allocated_bytes, size);
+  return memory;
 }
 
-struct ml666_st_children* ml666_st__d__element_get_children(struct ml666_st_builder* stb, struct ml666_st_element* element){
-  (void)stb;
-  return &element->children;
+static void builder_free(struct ml666_st_builder_default* stb, void* memory, size_t size){
+  STATS_SUB(stb, allocation_count, 1);
+  STATS_SUB(stb, allocated_bytes, size);
+  stb->a.free(stb->public.user_ptr, memory);
 }
 
-struct ml666_st_node* ml666_st__d__member_get_parent(struct ml666_st_builder* stb, struct ml666_st_member* member){
-  (void)stb;
-  return member->parent;
+static size_t node_size(enum ml666_st_node_type type){
+  switch(type){
+    case ML666_ST_NT_DOCUMENT: return sizeof(struct ml666_st_document);
+    case ML666_ST_NT_ELEMENT: return sizeof(struct ml666_st_element);
+    case ML666_ST_NT_CONTENT: return sizeof(struct ml666_st_content);
+    case ML666_ST_NT_COMMENT: return sizeof(struct ml666_st_comment);
+  }
+  return 0;
 }
 
-struct ml666_st_member* ml666_st__d__member_get_previous(struct ml666_st_builder* stb, struct ml666_st_member* member){
-  (void)stb;
-  return member->previous;
-}
+// The parts of an element most of them never need
+struct ml666_st_element_extra {
+  uint64_t hash; // 0 if it isn't known
+  struct ml666_st_child_index* child_index; // See ml666_st_document::child_index
+  struct ml666_st_attribute_index* attribute_index;
+  struct ml666_st_element *name_previous, *name_next;
+  bool name_indexed; // It's in the name index of its document. Only then does adding members to it look for the document.
+  struct ml666_buffer_ro source; // While it's set, the attributes and children haven't been parsed from it yet
+  struct ml666_st_element* original; // While it's set, this is a lazy clone of it, which doesn't have attributes and children of its own yet
+  struct ml666_st_element *clone_previous, *clone_next; // The other lazy clones of the same original
+};
 
-struct ml666_st_member* ml666_st__d__member_get_next(struct ml666_st_builder* stb, struct ml666_st_member* member){
-  (void)stb;
-  return member->next;
+static struct ml666_st_element_extra* element_extra(struct ml666_st_builder_default* stb, struct ml666_st_element* element){
+  if(element->extra)
+    return element->extra;
+  struct ml666_st_element_extra* extra = builder_malloc(stb, sizeof(*extra));
+  if(!extra){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(extra, 0, sizeof(*extra));
+  element->extra = extra;
+  return extra;
 }
 
-const struct ml666_hashed_buffer_set_entry* ml666_st__d__element_get_name(struct ml666_st_builder* stb, struct ml666_st_element* element){
-  (void)stb;
-  return element->name;
+// Once nothing is left in it
+static void element_extra_trim(struct ml666_st_builder_default* stb, struct ml666_st_element* element){
+  const struct ml666_st_element_extra* extra = element->extra;
+  if(!extra || extra->hash || extra->child_index || extra->attribute_index || extra->name_indexed || extra->source.data || extra->original)
+    return;
+  builder_free(stb, element->extra, sizeof(*extra));
+  element->extra = 0;
 }
 
-bool ml666_st__d__content_set(struct ml666_st_builder* _stb, struct ml666_st_content* content, struct ml666_buffer buffer){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  ml666_buffer__clear(&content->buffer, stb->public.user_ptr, stb->a.free);
-  content->buffer = buffer;
-  return true;
+static struct ml666_buffer_ro element_source(const struct ml666_st_element* element){
+  return element->extra ? element->extra->source : (struct ml666_buffer_ro){0};
 }
 
-struct ml666_buffer_ro ml666_st__d__content_get(struct ml666_st_builder* stb, const struct ml666_st_content* content){
-  (void)stb;
-  return content->buffer.ro;
-}
+/**
+ * Elements with more attributes than this get an index, so looking them up doesn't need to scan the whole list.
+ * The list is still what keeps the attributes in order.
+ */
+#define ML666_ST_ATTRIBUTE_INDEX_THRESHOLD 8
 
-struct ml666_buffer ml666_st__d__content_take(struct ml666_st_builder* stb, struct ml666_st_content* content){
-  (void)stb;
-  struct ml666_buffer ret = content->buffer;
-  content->buffer = (struct ml666_buffer){0};
-  return ret;
-}
+// Open addressing with linear probing, keyed by the name entry. At most half full.
+struct ml666_st_attribute_index {
+  size_t mask, count; // The count is that of the list, attributes are only missing here if adding them failed
+  struct ml666_st_attribute* slot[];
+};
 
-bool ml666_st__d__comment_set(struct ml666_st_builder* _stb, struct ml666_st_comment* comment, struct ml666_buffer buffer){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  ml666_buffer__clear(&comment->buffer, stb->public.user_ptr, stb->a.free);
-  comment->buffer = buffer;
-  return true;
+static size_t attribute_index_size(const struct ml666_st_attribute_index* index){
+  return sizeof(*index) + (index->mask + 1) * sizeof(*index->slot);
 }
 
-struct ml666_buffer_ro ml666_st__d__comment_get(struct ml666_st_builder* stb, const struct ml666_st_comment* comment){
-  (void)stb;
-  return comment->buffer.ro;
+static size_t attribute_index_home(const struct ml666_st_attribute_index* index, const struct ml666_hashed_buffer_set_entry* name){
+  return ml666_hashed_buffer_set__peek(name)->hash & index->mask;
 }
 
-struct ml666_buffer ml666_st__d__comment_take(struct ml666_st_builder* stb, struct ml666_st_comment* comment){
-  (void)stb;
-  struct ml666_buffer ret = comment->buffer;
-  comment->buffer = (struct ml666_buffer){0};
-  return ret;
+static struct ml666_st_attribute** attribute_index_find(struct ml666_st_attribute_index* index, const struct ml666_hashed_buffer_set_entry* name){
+  size_t i = attribute_index_home(index, name);
+  while(index->slot[i] && index->slot[i]->name != name)
+    i = (i + 1) & index->mask;
+  return &index->slot[i];
 }
 
-static void st_set_helper(struct ml666_st_builder* stb, struct ml666_st_member* member){
-  struct ml666_st_node* old_parent = member->parent;
-  if(!old_parent)
+static void attribute_index_remove(struct ml666_st_attribute_index* index, struct ml666_st_attribute* attribute){
+  struct ml666_st_attribute** slot = attribute_index_find(index, attribute->name);
+  if(!*slot)
     return;
-  struct ml666_st_children* old_children = ml666_st_node_get_children(stb, old_parent);
-  if(old_children->first == member){
-    old_children->first = member->next;
-  }else{
-    member->previous->next = member->next;
-  }
-  if(old_children->last == member){
-    old_children->last = member->previous;
-  }else{
-    member->next->previous = member->previous;
+  // Move the following entries of the cluster back where needed, so there is no need for tombstones
+  size_t hole = slot - index->slot;
+  index->slot[hole] = 0;
+  for(size_t i=(hole+1)&index->mask; index->slot[i]; i=(i+1)&index->mask){
+    size_t home = attribute_index_home(index, index->slot[i]->name);
+    if(((i - home) & index->mask) < ((i - hole) & index->mask))
+      continue;
+    index->slot[hole] = index->slot[i];
+    index->slot[i] = 0;
+    hole = i;
   }
-  if(!old_children->first)
-    ml666_st__d__node_put(stb, old_parent);
 }
 
-bool ml666_st__d__member_set(
-  struct ml666_st_builder* stb,
-  struct ml666_st_node* parent,
-  struct ml666_st_member* member,
-  struct ml666_st_member* before
-){
-  if(!parent && !before){
-    st_set_helper(stb, member);
-    member->previous = 0;
-    member->next = 0;
-    member->parent = 0;
-    ml666_st__d__node_put(stb, &member->node);
-    return true;
-  }
-  if(before){
-    if(parent){
-      if(parent != before->parent)
-        return false;
-    }else{
-      parent = before->parent;
+// The attribute has been appended to the list already
+static bool attribute_index_update(struct ml666_st_builder_default* stb, struct ml666_st_element* element, struct ml666_st_attribute* attribute){
+  struct ml666_st_attribute_index* index = element->extra ? element->extra->attribute_index : 0;
+  size_t count = 0;
+  if(index){
+    count = ++index->count;
+    if(count * 2 <= index->mask + 1){
+      *attribute_index_find(index, attribute->name) = attribute;
+      return true;
     }
+  }else{
+    // Short lists aren't counted to the end
+    for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(&stb->public, element); it && count <= ML666_ST_ATTRIBUTE_INDEX_THRESHOLD; it=ml666_st_attribute_get_next(&stb->public, it))
+      count++;
+    if(count <= ML666_ST_ATTRIBUTE_INDEX_THRESHOLD)
+      return true;
+    count = 0;
+    for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(&stb->public, element); it; it=ml666_st_attribute_get_next(&stb->public, it))
+      count++;
   }
-  if(!parent)
+  struct ml666_st_element_extra* extra = element_extra(stb, element);
+  if(!extra)
     return false;
-  struct ml666_st_children* children = ml666_st_node_get_children(stb, parent);
-  if(!children)
+  // (Re)build the index from the list. That includes the new attribute, it's already in there.
+  size_t size = 2 * ML666_ST_ATTRIBUTE_INDEX_THRESHOLD;
+  while(size < count * 4)
+    size *= 2;
+  struct ml666_st_attribute_index* new_index = builder_malloc(stb, sizeof(*new_index) + size * sizeof(*new_index->slot));
+  if(!new_index){
+    perror("malloc failed");
     return false;
-  struct ml666_st_node* old_parent = member->parent;
-  if(!old_parent){
-    ml666_st__d__node_ref(stb, &member->node);
-    if(!children->first)
-      ml666_st__d__node_ref(stb, parent);
-  }else if(old_parent != parent){
-    if(!children->first)
-      ml666_st__d__node_ref(stb, parent);
-    st_set_helper(stb, member);
-  }
-  member->parent = parent;
-  member->next = before;
-  struct ml666_st_member* after = 0;
-  if(before){
-    after = before->previous;
-    before->previous = member;
-  }else{
-    after = children->last;
-    children->last = member;
-  }
-  member->previous = after;
-  if(after){
-    after->next = member;
-  }else{
-    children->first = member;
   }
+  new_index->mask = size - 1;
+  new_index->count = count;
+  memset(new_index->slot, 0, size * sizeof(*new_index->slot));
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(&stb->public, element); it; it=ml666_st_attribute_get_next(&stb->public, it))
+    *attribute_index_find(new_index, it->name) = it;
+  if(index)
+    builder_free(stb, index, attribute_index_size(index));
+  extra->attribute_index = new_index;
   return true;
 }
 
-struct ml666_st_document* ml666_st__d__document_create(struct ml666_st_builder* _stb){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  struct ml666_st_document* document = stb->a.malloc(stb->public.user_ptr, sizeof(*document));
-  if(!document){
+// The children in order, for ml666_st_child_at & ml666_st_child_count. Appending keeps it, any other change drops it.
+struct ml666_st_child_index {
+  size_t count, capacity;
+  struct ml666_st_member* child[];
+};
+
+static size_t child_index_size(const struct ml666_st_child_index* index){
+  return sizeof(*index) + index->capacity * sizeof(*index->child);
+}
+
+// Where the index of the children of a node is kept. 0 if an element doesn't have its extra part.
+static struct ml666_st_child_index** child_index_slot(struct ml666_st_node* node){
+  if(node->type == ML666_ST_NT_DOCUMENT)
+    return &((struct ml666_st_document*)node)->child_index;
+  struct ml666_st_element* element = (struct ml666_st_element*)node;
+  return element->extra ? &element->extra->child_index : 0;
+}
+
+static void child_index_drop(struct ml666_st_builder_default* stb, struct ml666_st_node* node){
+  struct ml666_st_child_index** slot = child_index_slot(node);
+  if(!slot || !*slot)
+    return;
+  builder_free(stb, *slot, child_index_size(*slot));
+  *slot = 0;
+}
+
+static struct ml666_st_child_index* child_index_alloc(struct ml666_st_builder_default* stb, size_t capacity){
+  struct ml666_st_child_index* index = builder_malloc(stb, sizeof(*index) + capacity * sizeof(*index->child));
+  if(!index){
     perror("malloc failed");
     return 0;
   }
-  memset(document, 0, sizeof(*document));
-  ml666_refcount_increment(&document->node.refcount);
-  document->node.type = ML666_ST_NT_DOCUMENT;
-  return document;
+  index->count = 0;
+  index->capacity = capacity;
+  return index;
 }
 
-struct ml666_st_element* ml666_st__d__element_create(struct ml666_st_builder* _stb, const struct ml666_hashed_buffer* entry, bool copy_name){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  struct ml666_st_element* element = stb->a.malloc(stb->public.user_ptr, sizeof(*element));
-  if(!element){
-    perror("malloc failed");
+// Without any children, there is nothing to index, and nothing to tell whose children they are
+static struct ml666_st_child_index* child_index_get(struct ml666_st_builder_default* stb, struct ml666_st_children* children){
+  if(!children->first)
     return 0;
-  }
-  memset(element, 0, sizeof(*element));
-  ml666_refcount_increment(&element->member.node.refcount);
-  element->member.node.type = ML666_ST_NT_ELEMENT;
-  if(!(element->name = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, entry, copy_name ? ML666_HBS_M_ADD_COPY : ML666_HBS_M_ADD_TAKE))){
-    ml666_st__d__node_put(&stb->public, &element->member.node);
-    fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
+  struct ml666_st_node* node = children->first->parent;
+  if(node->type == ML666_ST_NT_ELEMENT && !element_extra(stb, (struct ml666_st_element*)node))
     return 0;
-  }
-  return element;
+  struct ml666_st_child_index** slot = child_index_slot(node);
+  if(*slot)
+    return *slot;
+  size_t count = 0;
+  for(struct ml666_st_member* it=children->first; it; it=it->next)
+    count++;
+  struct ml666_st_child_index* index = child_index_alloc(stb, count);
+  if(!index)
+    return 0;
+  for(struct ml666_st_member* it=children->first; it; it=it->next)
+    index->child[index->count++] = it;
+  *slot = index;
+  return index;
 }
 
-struct ml666_st_content* ml666_st__d__content_create(struct ml666_st_builder* _stb){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  struct ml666_st_content* content = stb->a.malloc(stb->public.user_ptr, sizeof(*content));
-  if(!content){
-    perror("malloc failed");
-    return 0;
+static void child_index_append(struct ml666_st_builder_default* stb, struct ml666_st_node* node, struct ml666_st_member* member){
+  struct ml666_st_child_index** slot = child_index_slot(node);
+  struct ml666_st_child_index* index = slot ? *slot : 0;
+  if(!index)
+    return;
+  if(index->count == index->capacity){
+    struct ml666_st_child_index* bigger = child_index_alloc(stb, index->capacity * 2 + 8);
+    if(!bigger){
+      child_index_drop(stb, node);
+      return;
+    }
+    bigger->count = index->count;
+    memcpy(bigger->child, index->child, index->count * sizeof(*index->child));
+    builder_free(stb, index, child_index_size(index));
+    *slot = index = bigger;
   }
-  memset(content, 0, sizeof(*content));
-  ml666_refcount_increment(&content->member.node.refcount);
-  content->member.node.type = ML666_ST_NT_CONTENT;
-  return content;
+  index->child[index->count++] = member;
 }
 
-struct ml666_st_comment* ml666_st__d__comment_create(struct ml666_st_builder* _stb){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  struct ml666_st_comment* comment = stb->a.malloc(stb->public.user_ptr, sizeof(*comment));
-  if(!comment){
-    perror("malloc failed");
-    return 0;
+// Where the hash of a node is cached. Contents and comments are hashed again each time, their parents read all of them anyway.
+static uint64_t* hash_slot(struct ml666_st_node* node){
+  switch(node->type){
+    case ML666_ST_NT_DOCUMENT: return &((struct ml666_st_document*)node)->hash;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      return element->extra ? &element->extra->hash : 0;
+    }
+    default: return 0;
   }
-  memset(comment, 0, sizeof(*comment));
-  ml666_refcount_increment(&comment->member.node.refcount);
-  comment->member.node.type = ML666_ST_NT_COMMENT;
-  return comment;
 }
 
-struct ml666_st_member* ml666_st__d__get_first_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
-  (void)stb;
-  return children->first;
+// The hash of a node is only cached if the hashes of all its descendants are, so this can stop at the first one which isn't.
+static void hash_invalidate(struct ml666_st_node* node){
+  if(node && (node->type == ML666_ST_NT_CONTENT || node->type == ML666_ST_NT_COMMENT))
+    node = ((struct ml666_st_member*)node)->parent;
+  for(uint64_t* hash; node && (hash=hash_slot(node)) && *hash; node=((struct ml666_st_member*)node)->parent){
+    *hash = 0;
+    if(node->type == ML666_ST_NT_DOCUMENT)
+      break;
+  }
 }
 
-struct ml666_st_member* ml666_st__d__get_last_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
-  (void)stb;
-  return children->last;
+// Once a generation has been handed out by ml666_st_node_get_generation, the next change starts a new one
+static uint64_t generation_current(struct ml666_st_builder_default* stb){
+  if(stb->generation_seen){
+    stb->generation += 1;
+    stb->generation_seen = false;
+  }
+  return stb->generation;
 }
 
-struct ml666_st_attribute* ml666_st__d__attribute_get_first(const struct ml666_st_builder* stb, const struct ml666_st_element* element){
-  (void)stb;
-  return ml666__container_of(element->attribute_list.first, struct ml666_st_attribute, entry);
+// All ancestors of a node with the current generation have it too, so this can stop at the first one which does.
+static void node_changed(struct ml666_st_builder_default* stb, struct ml666_st_node* node){
+  hash_invalidate(node);
+  const uint64_t generation = generation_current(stb);
+  while(node && node->generation != generation){
+    node->generation = generation;
+    if(node->type == ML666_ST_NT_DOCUMENT)
+      break;
+    node = ((struct ml666_st_member*)node)->parent;
+  }
 }
 
-struct ml666_st_attribute* ml666_st__d__attribute_get_next(const struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
-  (void)stb;
-  if(attribute->entry.llist->last == &attribute->entry)
+// The nodes, attributes and data created by one ml666_st_build call share an allocation, which starts with this.
+// Each of the nodes and attributes holds a reference to it.
+struct ml666_st_block {
+  struct ml666_refcount refcount;
+  size_t size;
+};
+
+#define BLOCK_ALIGN alignof(max_align_t)
+#define BLOCK_ROUND(X) (((X) + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN)
+
+static struct ml666_st_block* block_of(const void* object, uint32_t block){
+  if(!block)
     return 0;
-  return ml666__container_of(attribute->entry.next, struct ml666_st_attribute, entry);
+  return (struct ml666_st_block*)((char*)object - (size_t)block * BLOCK_ALIGN);
 }
 
-struct ml666_st_attribute* ml666_st__d__attribute_lookup(struct ml666_st_builder* _stb, struct ml666_st_element* element, const struct ml666_hashed_buffer* name, unsigned flags){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  enum ml666_hashed_buffer_set_mode mode = ML666_HBS_M_GET;
-  if((flags & ML666_ST_AOF_CREATE_NOCOPY) == ML666_ST_AOF_CREATE_NOCOPY){
-    mode = ML666_HBS_M_ADD_TAKE;
-  }else if((flags & ML666_ST_AOF_CREATE) == ML666_ST_AOF_CREATE){
-    mode = ML666_HBS_M_ADD_COPY;
-  }
-  const struct ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, name, mode);
-  if(!entry){
-    if(mode != ML666_HBS_M_GET)
-      fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
-    return 0;
-  }
-  struct ml666_st_attribute* attribute = 0;
-  for(attribute=ml666_st_attribute_get_first(&stb->public, element); attribute; attribute=ml666_st_attribute_get_next(&stb->public, attribute))
-    if(attribute->name == entry)
-      break;
-  if(attribute){
-    ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
-    if((flags & ML666_ST_AOF_CREATE_EXCLUSIVE) == ML666_ST_AOF_CREATE_EXCLUSIVE){
-      fprintf(stderr, "ml666_st__d__attribute_open failed: attribute already exists\n");
-      return 0;
-    }
+static void block_ref(struct ml666_st_builder_default* stb, struct ml666_st_block* block){
+  if(stb->a.thread_confined){
+    ml666_refcount_increment_local(&block->refcount);
   }else{
-    attribute = stb->a.malloc(stb->public.user_ptr, sizeof(*attribute));
-    if(!attribute){
-      ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
-      perror("malloc failed");
-      return 0;
-    }
-    memset(attribute, 0, sizeof(*attribute));
-    attribute->name = entry;
-    if(!element->attribute_list.first)
-      element->attribute_list.first = &attribute->entry;
-    if(element->attribute_list.last){
-      attribute->entry.previous = element->attribute_list.last;
-      element->attribute_list.last->next = &attribute->entry;
-    }else{
-      attribute->entry.flist = &element->attribute_list;
-    }
-    element->attribute_list.last = &attribute->entry;
-    attribute->entry.llist = &element->attribute_list;
+    ml666_refcount_increment(&block->refcount);
   }
-  return attribute;
 }
 
-void ml666_st__d__attribute_remove(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute){
-  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
-  if(attribute->entry.llist->last == &attribute->entry && attribute->entry.flist->first == &attribute->entry){
-    attribute->entry.llist->last  = 0;
-    attribute->entry.llist->first = 0;
-  }else if(attribute->entry.flist->first == &attribute->entry){
-    attribute->entry.next->flist = attribute->entry.flist;
-    attribute->entry.flist->first = attribute->entry.next;
-  }else if(attribute->entry.llist->last == &attribute->entry){
-    attribute->entry.previous->llist = attribute->entry.llist;
-    attribute->entry.llist->last = attribute->entry.previous;
+static void block_put(struct ml666_st_builder_default* stb, struct ml666_st_block* block){
+  if(stb->a.thread_confined ? ml666_refcount_decrement_local(&block->refcount) : ml666_refcount_decrement(&block->refcount))
+    return;
+  builder_free(stb, block, block->size);
+}
+
+// Frees a node or attribute
+static void object_free(struct ml666_st_builder_default* stb, void* object, uint32_t block, size_t size){
+  if(block){
+    block_put(stb, block_of(object, block));
   }else{
-    attribute->entry.previous->next = attribute->entry.next;
-    attribute->entry.next->previous = attribute->entry.previous;
+    builder_free(stb, object, size);
   }
-  ml666_st_attribute_set_value(&stb->public, attribute, 0);
-  stb->a.free(stb->public.user_ptr, attribute);
 }
 
-const struct ml666_hashed_buffer* ml666_st__d__attribute_get_name(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
-  (void)stb;
-  return ml666_hashed_buffer_set__peek(attribute->name);
-}
+// Data which doesn't fit inline may be in a slab made by ml666_st_compact, which is a block holding only data.
+// The unused inline buffer then points to it. It's 0 for any other data which isn't stored inline.
+static_assert(ML666_ST_INLINE_SIZE >= sizeof(struct ml666_st_block*), "The inline buffers must be able to hold a pointer to a slab");
+
+static struct ml666_st_block* buffer_slab(const struct ml666_buffer* buffer, const char* inline_data){
+  if(!buffer->data || buffer->data == inline_data)
+    return 0;
+  struct ml666_st_block* slab;
+  memcpy(&slab, inline_data, sizeof(slab));
+  return slab;
+}
+
+static void buffer_slab_set(char* inline_data, struct ml666_st_block* slab){
+  memcpy(inline_data, &slab, sizeof(slab));
+}
+
+// Whether the data is in its own allocation, rather than in the node, its block or a slab
+static bool buffer_is_separate(const struct ml666_buffer* buffer, const char* inline_data, const struct ml666_st_block* block){
+  if(!buffer->data || buffer->data == inline_data || buffer_slab(buffer, inline_data))
+    return false;
+  return !block || (uintptr_t)buffer->data < (uintptr_t)block || (uintptr_t)buffer->data >= (uintptr_t)block + block->size;
+}
+
+static void inline_buffer_clear(struct ml666_st_builder_default* stb, struct ml666_buffer* buffer, char* inline_data, const struct ml666_st_block* block){
+  STATS_SUB(stb, data_bytes, buffer->length);
+  struct ml666_st_block* slab = buffer_slab(buffer, inline_data);
+  if(slab){
+    buffer_slab_set(inline_data, 0);
+    block_put(stb, slab);
+  }else if(buffer_is_separate(buffer, inline_data, block)){
+    builder_free(stb, buffer->data, buffer->length);
+  }
+  *buffer = (struct ml666_buffer){0};
+}
+
+// The buffer must be empty already
+static void inline_buffer_set(struct ml666_st_builder_default* stb, struct ml666_buffer* buffer, char* inline_data, struct ml666_buffer value){
+  STATS_ADD(stb, data_bytes, value.length);
+  if(!value.data || value.length > ML666_ST_INLINE_SIZE){
+    // The builder owns it now
+    if(value.data){
+      STATS_ADD(stb, allocation_count, 1);
+      STATS_ADD(stb, allocated_bytes, value.length);
+    }
+    buffer_slab_set(inline_data, 0);
+    *buffer = value;
+    return;
+  }
+  memcpy(inline_data, value.data, value.length);
+  stb->a.free(stb->public.user_ptr, value.data);
+  buffer->data = inline_data;
+  buffer->length = value.length;
+}
+
+static bool inline_buffer_take(struct ml666_st_builder_default* stb, struct ml666_buffer* buffer, char* inline_data, const struct ml666_st_block* block, struct ml666_buffer* result){
+  if(!buffer_is_separate(buffer, inline_data, block)){
+    // The caller may realloc or free it, so it has to be moved out of the node
+    struct ml666_buffer copy = {0};
+    if(!ml666_buffer__dup(&copy, buffer->ro, stb->public.user_ptr, stb->a.malloc)){
+      fprintf(stderr, "%s: couldn't copy the data out of the node\n", __func__);
+      return false;
+    }
+    *result = copy;
+  }else{
+    *result = *buffer;
+    STATS_SUB(stb, allocation_count, 1);
+    STATS_SUB(stb, allocated_bytes, buffer->length);
+  }
+  STATS_SUB(stb, data_bytes, buffer->length);
+  struct ml666_st_block* slab = buffer_slab(buffer, inline_data);
+  if(slab){
+    buffer_slab_set(inline_data, 0);
+    block_put(stb, slab);
+  }
+  *buffer = (struct ml666_buffer){0};
+  return true;
+}
+
+// The buffer must be empty already. Data which fits is copied into the node right away, rather than into an allocation first.
+static bool inline_buffer_copy(struct ml666_st_builder_default* stb, struct ml666_buffer* buffer, char* inline_data, struct ml666_buffer_ro value){
+  if(value.length > ML666_ST_INLINE_SIZE){
+    struct ml666_buffer copy;
+    if(!ml666_buffer__dup(&copy, value, stb->public.user_ptr, stb->a.malloc))
+      return false;
+    inline_buffer_set(stb, buffer, inline_data, copy);
+    return true;
+  }
+  STATS_ADD(stb, data_bytes, value.length);
+  if(value.length)
+    memcpy(inline_data, value.data, value.length);
+  buffer->data = inline_data;
+  buffer->length = value.length;
+  return true;
+}
+
+struct name_index_slot {
+  const struct ml666_hashed_buffer_set_entry* name;
+  struct ml666_st_element *first, *last;
+};
+
+// Open addressing with linear probing, keyed by the name entry. At most half full.
+struct ml666_st_name_index {
+  size_t mask, count;
+  struct name_index_slot slot[];
+};
+
+static size_t name_index_size(const struct ml666_st_name_index* index){
+  return sizeof(*index) + (index->mask + 1) * sizeof(*index->slot);
+}
+
+static size_t name_index_home(const struct ml666_st_name_index* index, const struct ml666_hashed_buffer_set_entry* name){
+  return ml666_hashed_buffer_set__peek(name)->hash & index->mask;
+}
+
+static struct name_index_slot* name_index_find(struct ml666_st_name_index* index, const struct ml666_hashed_buffer_set_entry* name){
+  size_t i = name_index_home(index, name);
+  while(index->slot[i].name && index->slot[i].name != name)
+    i = (i + 1) & index->mask;
+  return &index->slot[i];
+}
+
+static bool name_index_grow(struct ml666_st_builder_default* stb, struct ml666_st_document* document){
+  struct ml666_st_name_index* index = document->name_index;
+  const size_t size = index ? (index->mask + 1) * 2 : 64;
+  struct ml666_st_name_index* new_index = builder_malloc(stb, sizeof(*new_index) + size * sizeof(*new_index->slot));
+  if(!new_index){
+    perror("malloc failed");
+    return false;
+  }
+  new_index->mask = size - 1;
+  new_index->count = 0;
+  memset(new_index->slot, 0, size * sizeof(*new_index->slot));
+  if(index){
+    for(size_t i=0; i<=index->mask; i++)
+      if(index->slot[i].name)
+        *name_index_find(new_index, index->slot[i].name) = index->slot[i];
+    new_index->count = index->count;
+    builder_free(stb, index, name_index_size(index));
+  }
+  document->name_index = new_index;
+  return true;
+}
+
+static bool name_index_add(struct ml666_st_builder_default* stb, struct ml666_st_document* document, struct ml666_st_element* element){
+  if((document->name_index->count + 1) * 2 > document->name_index->mask + 1 && !name_index_grow(stb, document))
+    return false;
+  struct ml666_st_element_extra* extra = element_extra(stb, element);
+  if(!extra)
+    return false;
+  struct ml666_st_name_index* index = document->name_index;
+  struct name_index_slot* slot = name_index_find(index, element->name);
+  if(!slot->name){
+    slot->name = element->name;
+    index->count += 1;
+  }
+  extra->name_next = 0;
+  extra->name_previous = slot->last;
+  if(slot->last){
+    slot->last->extra->name_next = element;
+  }else{
+    slot->first = element;
+  }
+  slot->last = element;
+  extra->name_indexed = true;
+  return true;
+}
+
+static void name_index_remove(struct ml666_st_name_index* index, struct ml666_st_element* element){
+  struct name_index_slot* slot = name_index_find(index, element->name);
+  struct ml666_st_element_extra* extra = element->extra;
+  if(extra->name_previous){
+    extra->name_previous->extra->name_next = extra->name_next;
+  }else{
+    slot->first = extra->name_next;
+  }
+  if(extra->name_next){
+    extra->name_next->extra->name_previous = extra->name_previous;
+  }else{
+    slot->last = extra->name_previous;
+  }
+  extra->name_previous = 0;
+  extra->name_next = 0;
+  extra->name_indexed = false;
+  if(slot->first)
+    return;
+  // Move the following entries of the cluster back where needed, so there is no need for tombstones
+  index->count -= 1;
+  size_t hole = slot - index->slot;
+  index->slot[hole] = (struct name_index_slot){0};
+  for(size_t i=(hole+1)&index->mask; index->slot[i].name; i=(i+1)&index->mask){
+    size_t home = name_index_home(index, index->slot[i].name);
+    if(((i - home) & index->mask) < ((i - hole) & index->mask))
+      continue;
+    index->slot[hole] = index->slot[i];
+    index->slot[i] = (struct name_index_slot){0};
+    hole = i;
+  }
+}
+
+static bool cursor_walk(struct ml666_st_builder_default* stb, struct ml666_st_cursor* cursor, bool load);
+
+// The indexed document a parent belongs to, if any. Parents outside of indexed documents don't look any further.
+static struct ml666_st_document* name_index_document(struct ml666_st_node* node){
+  if(node->type == ML666_ST_NT_ELEMENT){
+    const struct ml666_st_element_extra* extra = ((struct ml666_st_element*)node)->extra;
+    if(!extra || !extra->name_indexed)
+      return 0;
+  }
+  while(node->type != ML666_ST_NT_DOCUMENT){
+    node = ((struct ml666_st_member*)node)->parent;
+    if(!node)
+      return 0;
+  }
+  struct ml666_st_document* document = (struct ml666_st_document*)node;
+  return document->name_index ? document : 0;
+}
+
+static void name_index_remove_subtree(struct ml666_st_builder* stb, struct ml666_st_document* document, struct ml666_st_node* node, struct ml666_st_node* end){
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(cursor_walk((struct ml666_st_builder_default*)stb, &cursor, false) && cursor.node != end)
+    if(cursor.event == ML666_ST_CE_ENTER && cursor.node->type == ML666_ST_NT_ELEMENT)
+      name_index_remove(document->name_index, (struct ml666_st_element*)cursor.node);
+}
+
+static bool name_index_add_subtree(struct ml666_st_builder_default* stb, struct ml666_st_document* document, struct ml666_st_node* node){
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(cursor_walk(stb, &cursor, false)){
+    if(cursor.event != ML666_ST_CE_ENTER || cursor.node->type != ML666_ST_NT_ELEMENT)
+      continue;
+    if(!name_index_add(stb, document, (struct ml666_st_element*)cursor.node)){
+      // Undo it, up to where it failed
+      name_index_remove_subtree(&stb->public, document, node, cursor.node);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Lazily loaded documents. An element with a source has been found by the structure scanner, but hasn't been parsed yet.
+
+static bool is_space(char ch){
+  return ch == ' ' || ch == '\n';
+}
+
+// The length of the name of a start tag, if it can be used as is. 0 if the tokenizer has to decode it.
+static size_t plain_name_length(struct ml666_buffer_ro tag){
+  size_t i = 1;
+  for(; i<tag.length && !is_space(tag.data[i]) && tag.data[i] != '>' && tag.data[i] != '/'; i++){
+    const unsigned char ch = tag.data[i];
+    if(ch <= 0x20 || ch >= 0x7F || ch == '\\')
+      return 0;
+  }
+  return i - 1;
+}
+
+// A text being put together from the chunks the tokenizer returns
+struct lazy_text {
+  struct ml666_buffer buffer;
+  size_t capacity;
+  bool pending; // Whether there has been a token for it, it may still be empty
+};
+
+static bool text_append(struct ml666_st_builder_default* stb, struct lazy_text* text, struct ml666_buffer_ro data){
+  text->pending = true;
+  if(!data.length)
+    return true;
+  struct ml666_buffer* buffer = &text->buffer;
+  if(buffer->length + data.length > text->capacity){
+    // Most texts come in one piece, they get a buffer of just the right size
+    size_t size = text->capacity * 2;
+    if(size < buffer->length + data.length)
+      size = buffer->length + data.length;
+    char* memory = stb->a.malloc(stb->public.user_ptr, size);
+    if(!memory){
+      perror("malloc failed");
+      return false;
+    }
+    if(buffer->data){
+      memcpy(memory, buffer->data, buffer->length);
+      stb->a.free(stb->public.user_ptr, buffer->data);
+    }
+    buffer->data = memory;
+    text->capacity = size;
+  }
+  memcpy(buffer->data + buffer->length, data.data, data.length);
+  buffer->length += data.length;
+  return true;
+}
+
+// The buffer now belongs to someone else, or has been freed
+static void text_forget(struct lazy_text* text){
+  *text = (struct lazy_text){0};
+}
+
+static void text_free(struct ml666_st_builder_default* stb, struct lazy_text* text){
+  if(text->buffer.data)
+    stb->a.free(stb->public.user_ptr, text->buffer.data);
+  text_forget(text);
+}
+
+// Adds a content or comment to the node
+static bool text_finish(struct ml666_st_builder_default* stb, struct ml666_st_node* node, struct lazy_text* text, enum ml666_st_node_type type){
+  if(!text->pending)
+    return true;
+  struct ml666_st_member* member = 0;
+  if(type == ML666_ST_NT_CONTENT){
+    struct ml666_st_content* content = ml666_st__d__content_create(&stb->public);
+    if(!content)
+      return false;
+    ml666_st__d__content_set(&stb->public, content, text->buffer);
+    member = &content->member;
+  }else{
+    struct ml666_st_comment* comment = ml666_st__d__comment_create(&stb->public);
+    if(!comment)
+      return false;
+    ml666_st__d__comment_set(&stb->public, comment, text->buffer);
+    member = &comment->member;
+  }
+  text_forget(text);
+  const bool ok = ml666_st__d__member_set(&stb->public, node, member, 0);
+  ml666_st__d__node_put(&stb->public, &member->node);
+  return ok;
+}
+
+// Creating a tokenizer is expensive, there is usually one left from the last time
+static struct ml666_tokenizer* lazy_tokenizer_get(struct ml666_st_builder_default* stb, struct ml666_buffer_ro input){
+  struct ml666_tokenizer* tokenizer = atomic_exchange_explicit(&stb->tokenizer, 0, memory_order_acquire);
+  if(tokenizer && ml666_tokenizer_reset(tokenizer, input))
+    return tokenizer;
+  if(tokenizer)
+    ml666_tokenizer_destroy(tokenizer);
+  return ml666_tokenizer_create(.input=input, .user_ptr=stb->public.user_ptr, .malloc=stb->a.malloc, .free=stb->a.free);
+}
+
+static void lazy_tokenizer_put(struct ml666_st_builder_default* stb, struct ml666_tokenizer* tokenizer){
+  tokenizer = atomic_exchange_explicit(&stb->tokenizer, tokenizer, memory_order_release);
+  if(tokenizer)
+    ml666_tokenizer_destroy(tokenizer);
+}
+
+static bool lazy_tokenizer_next(struct ml666_tokenizer* tokenizer, bool* more){
+  *more = ml666_tokenizer_next(tokenizer);
+  if(tokenizer->error){
+    fprintf(stderr, "ml666_st_parse_lazy: line %zu, column %zu: %s\n", tokenizer->line, tokenizer->column, tokenizer->error);
+    return false;
+  }
+  return true;
+}
+
+// For start tags with a name the tokenizer has to decode
+static bool name_load(struct ml666_st_builder_default* stb, struct ml666_buffer_ro tag, struct lazy_text* name){
+  struct ml666_tokenizer* tokenizer = lazy_tokenizer_get(stb, tag);
+  if(!tokenizer)
+    return false;
+  bool ok = false;
+  for(bool more=true; more && lazy_tokenizer_next(tokenizer, &more); ){
+    if(tokenizer->token == ML666_NONE)
+      continue;
+    if(tokenizer->token != ML666_TAG || !text_append(stb, name, tokenizer->match))
+      break;
+    if(tokenizer->complete){
+      ok = true;
+      break;
+    }
+  }
+  lazy_tokenizer_put(stb, tokenizer);
+  if(!ok)
+    text_free(stb, name);
+  return ok;
+}
+
+/**
+ * Parses content and comments, and adds them to the node. If tag is set, the input starts with the start tag
+ * of the element, and its attributes are added too. Texts and comments are merged like the parser does it.
+ */
+static bool tokens_load(struct ml666_st_builder_default* stb, struct ml666_st_node* node, struct ml666_buffer_ro input, bool tag){
+  struct ml666_tokenizer* tokenizer = lazy_tokenizer_get(stb, input);
+  if(!tokenizer)
+    return false;
+  struct lazy_text content = {0}, comment = {0}, name = {0}, value = {0};
+  struct ml666_st_attribute* attribute = 0;
+  bool ok = true;
+  for(bool more=true; ok && more; ){
+    if(!(ok = lazy_tokenizer_next(tokenizer, &more)))
+      break;
+    const enum ml666_token token = tokenizer->token;
+    if(value.pending && token != ML666_ATTRIBUTE_VALUE && token != ML666_NONE){
+      ml666_st__d__attribute_set_value(&stb->public, attribute, &value.buffer);
+      text_forget(&value);
+    }
+    switch(token){
+      case ML666_NONE: case ML666_EOF: break;
+      case ML666_TAG: case ML666_END_TAG: {
+        if(!tag)
+          goto unexpected;
+      } break;
+      case ML666_ATTRIBUTE: {
+        if(!tag)
+          goto unexpected;
+        if(!(ok = text_append(stb, &name, tokenizer->match)) || !tokenizer->complete)
+          break;
+        const struct ml666_hashed_buffer entry = ml666_hashed_buffer__create(name.buffer.ro);
+        ok = (attribute = ml666_st__d__attribute_lookup(&stb->public, (struct ml666_st_element*)node, &entry, ML666_ST_AOF_CREATE_EXCLUSIVE));
+        text_free(stb, &name);
+      } break;
+      case ML666_ATTRIBUTE_VALUE: {
+        if(!tag || !attribute)
+          goto unexpected;
+        ok = text_append(stb, &value, tokenizer->match);
+      } break;
+      case ML666_TEXT: {
+        ok = text_finish(stb, node, &comment, ML666_ST_NT_COMMENT)
+          && text_append(stb, &content, tokenizer->match);
+      } break;
+      case ML666_COMMENT: {
+        ok = text_finish(stb, node, &content, ML666_ST_NT_CONTENT)
+          && text_append(stb, &comment, tokenizer->match);
+      } break;
+      default: unexpected: {
+        fprintf(stderr, "ml666_st_parse_lazy: unexpected token %s\n", ml666__token_name[token]);
+        ok = false;
+      } break;
+    }
+  }
+  if(ok)
+    ok = text_finish(stb, node, &content, ML666_ST_NT_CONTENT)
+      && text_finish(stb, node, &comment, ML666_ST_NT_COMMENT);
+  text_free(stb, &content);
+  text_free(stb, &comment);
+  text_free(stb, &name);
+  text_free(stb, &value);
+  lazy_tokenizer_put(stb, tokenizer);
+  return ok;
+}
+
+struct lazy_load {
+  struct ml666_st_builder_default* stb;
+  struct ml666_st_node* node;
+  struct ml666_buffer_ro source;
+  size_t depth; // The depth of the children in the source
+  size_t offset; // Where the content after the last child starts
+  size_t child; // Where the current child starts
+  bool tag; // Whether the start tag is still to be parsed. It's parsed along with the content up to the first child.
+  bool content; // Whether the element has an end tag
+  bool failed;
+};
+
+// The length of a start tag without attributes, if the name can be used as is. 0 if the tokenizer is needed.
+static size_t plain_start_tag_length(struct ml666_buffer_ro tag){
+  size_t i = plain_name_length(tag);
+  if(!i)
+    return 0;
+  i += 1;
+  while(i < tag.length && is_space(tag.data[i]))
+    i++;
+  if(i < tag.length && tag.data[i] == '>')
+    return i + 1;
+  if(i+1 < tag.length && tag.data[i] == '/' && tag.data[i+1] == '>')
+    return i + 2;
+  return 0;
+}
+
+// Content & comments between the children, and the start tag before the first one. There usually isn't anything but whitespace.
+static bool gap_load(struct lazy_load* ll, size_t end){
+  struct ml666_buffer_ro gap = {end - ll->offset, ll->source.data + ll->offset};
+  if(ll->tag){
+    ll->tag = false;
+    const size_t length = plain_start_tag_length(gap);
+    if(!length)
+      return tokens_load(ll->stb, ll->node, gap, true);
+    gap.data += length;
+    gap.length -= length;
+  }
+  size_t i = 0;
+  while(i < gap.length && is_space(gap.data[i]))
+    i++;
+  return i == gap.length || tokens_load(ll->stb, ll->node, gap, false);
+}
+
+static bool child_load(struct lazy_load* ll, size_t end){
+  struct ml666_st_builder_default* stb = ll->stb;
+  const struct ml666_buffer_ro source = {end - ll->child, ll->source.data + ll->child};
+  struct lazy_text name = {0};
+  const size_t length = plain_name_length(source);
+  if(!length && !name_load(stb, source, &name))
+    return false;
+  const struct ml666_hashed_buffer entry = ml666_hashed_buffer__create(length ? (struct ml666_buffer_ro){length, source.data+1} : name.buffer.ro);
+  struct ml666_st_element* element = ml666_st__d__element_create(&stb->public, &entry, true);
+  text_free(stb, &name);
+  if(!element)
+    return false;
+  struct ml666_st_element_extra* extra = element_extra(stb, element);
+  if(extra)
+    extra->source = source;
+  const bool ok = extra && ml666_st__d__member_set(&stb->public, ll->node, &element->member, 0);
+  ml666_st__d__node_put(&stb->public, &element->member.node);
+  return ok;
+}
+
+static bool lazy_scan(void* user_ptr, enum ml666_structure_scan_event event, size_t offset, size_t depth){
+  struct lazy_load* ll = user_ptr;
+  bool ok = true;
+  if(depth < ll->depth){
+    // The element being loaded
+    switch(event){
+      case ML666_SCAN_CONTENT_BEGIN: ll->content = true; break;
+      case ML666_SCAN_CONTENT_END: ok = gap_load(ll, offset); break;
+      case ML666_SCAN_ELEMENT_END: ok = ll->content || gap_load(ll, offset); break;
+      default: break;
+    }
+  }else{
+    switch(event){
+      case ML666_SCAN_ELEMENT_BEGIN: {
+        ok = gap_load(ll, offset);
+        ll->child = offset;
+      } break;
+      case ML666_SCAN_ELEMENT_END: {
+        ok = child_load(ll, offset);
+        ll->offset = offset;
+      } break;
+      default: break;
+    }
+  }
+  ll->failed = !ok;
+  return ok;
+}
+
+// Parses one level: the attributes of an element, its content and comments, and its child elements, which aren't loaded yet.
+static bool source_load(struct ml666_st_builder_default* stb, struct ml666_st_node* node, struct ml666_buffer_ro source){
+  const bool document = node->type == ML666_ST_NT_DOCUMENT;
+  struct lazy_load ll = {
+    .stb = stb,
+    .node = node,
+    .source = source,
+    .depth = document ? 0 : 1,
+    .tag = !document,
+  };
+  if(!ml666_structure_scan(.input=source, .cb=lazy_scan, .max_depth=ll.depth, .user_ptr=&ll)){
+    if(!ll.failed)
+      fprintf(stderr, "ml666_st_parse_lazy: the structure of the document is broken\n");
+    return false;
+  }
+  // The content after the last top level element
+  return !document || gap_load(&ll, source.length);
+}
+
+// Lazy clones, see ml666_st_clone_lazy. The builder keeps track of the clones of each original, so the originals aren't changed by cloning them.
+
+struct clone_index_slot {
+  struct ml666_st_element *original, *first;
+};
+
+// Open addressing with linear probing, keyed by the original. At most half full.
+struct ml666_st_clone_index {
+  size_t mask, count;
+  struct clone_index_slot slot[];
+};
+
+static size_t clone_index_size(const struct ml666_st_clone_index* index){
+  return sizeof(*index) + (index->mask + 1) * sizeof(*index->slot);
+}
+
+static size_t clone_index_home(const struct ml666_st_clone_index* index, const struct ml666_st_element* original){
+  return (((uint64_t)(uintptr_t)original >> 4) * UINT64_C(0x9E3779B97F4A7C15) >> 32) & index->mask;
+}
+
+static struct clone_index_slot* clone_index_find(struct ml666_st_clone_index* index, const struct ml666_st_element* original){
+  size_t i = clone_index_home(index, original);
+  while(index->slot[i].original && index->slot[i].original != original)
+    i = (i + 1) & index->mask;
+  return &index->slot[i];
+}
+
+static bool clone_index_grow(struct ml666_st_builder_default* stb){
+  struct ml666_st_clone_index* index = stb->clone_index;
+  const size_t size = index ? (index->mask + 1) * 2 : 16;
+  struct ml666_st_clone_index* new_index = builder_malloc(stb, sizeof(*new_index) + size * sizeof(*new_index->slot));
+  if(!new_index){
+    perror("malloc failed");
+    return false;
+  }
+  new_index->mask = size - 1;
+  new_index->count = 0;
+  memset(new_index->slot, 0, size * sizeof(*new_index->slot));
+  if(index){
+    for(size_t i=0; i<=index->mask; i++)
+      if(index->slot[i].original)
+        *clone_index_find(new_index, index->slot[i].original) = index->slot[i];
+    new_index->count = index->count;
+    builder_free(stb, index, clone_index_size(index));
+  }
+  stb->clone_index = new_index;
+  return true;
+}
+
+// The clone must have its extra part already
+static bool clone_index_add(struct ml666_st_builder_default* stb, struct ml666_st_element* original, struct ml666_st_element* clone){
+  if((!stb->clone_index || (stb->clone_index->count + 1) * 2 > stb->clone_index->mask + 1) && !clone_index_grow(stb))
+    return false;
+  struct clone_index_slot* slot = clone_index_find(stb->clone_index, original);
+  if(!slot->original){
+    slot->original = original;
+    stb->clone_index->count += 1;
+  }
+  struct ml666_st_element_extra* extra = clone->extra;
+  extra->clone_previous = 0;
+  extra->clone_next = slot->first;
+  if(slot->first)
+    slot->first->extra->clone_previous = clone;
+  slot->first = clone;
+  return true;
+}
+
+static void clone_index_remove(struct ml666_st_builder_default* stb, struct ml666_st_element* original, struct ml666_st_element* clone){
+  struct ml666_st_clone_index* index = stb->clone_index;
+  struct clone_index_slot* slot = clone_index_find(index, original);
+  struct ml666_st_element_extra* extra = clone->extra;
+  if(extra->clone_previous){
+    extra->clone_previous->extra->clone_next = extra->clone_next;
+  }else{
+    slot->first = extra->clone_next;
+  }
+  if(extra->clone_next)
+    extra->clone_next->extra->clone_previous = extra->clone_previous;
+  extra->clone_previous = 0;
+  extra->clone_next = 0;
+  if(slot->first)
+    return;
+  index->count -= 1;
+  if(!index->count){
+    // Without any clones, changes don't need to look for them at all
+    builder_free(stb, index, clone_index_size(index));
+    stb->clone_index = 0;
+    return;
+  }
+  // Move the following entries of the cluster back where needed, so there is no need for tombstones
+  size_t hole = slot - index->slot;
+  index->slot[hole] = (struct clone_index_slot){0};
+  for(size_t i=(hole+1)&index->mask; index->slot[i].original; i=(i+1)&index->mask){
+    size_t home = clone_index_home(index, index->slot[i].original);
+    if(((i - home) & index->mask) < ((i - hole) & index->mask))
+      continue;
+    index->slot[hole] = index->slot[i];
+    index->slot[i] = (struct clone_index_slot){0};
+    hole = i;
+  }
+}
+
+static struct ml666_st_element* clone_index_first(struct ml666_st_builder_default* stb, const struct ml666_st_element* original){
+  return stb->clone_index ? clone_index_find(stb->clone_index, original)->first : 0;
+}
+
+// An original which was removed from its tree keeps its children for its clones. Once the last one is gone, nothing else may need them.
+static void clone_unlink(struct ml666_st_builder_default* stb, struct ml666_st_element* clone, struct ml666_st_element* original){
+  clone_index_remove(stb, original, clone);
+  clone->extra->original = 0;
+  // Its children and this clone would be the only references left
+  const bool orphan = !clone_index_first(stb, original) && !original->member.parent && original->children.first
+    && atomic_load_explicit(&original->member.node.refcount.value, memory_order_acquire) == 2;
+  if(orphan)
+    ml666_st__d__subtree_disintegrate(&stb->public, &original->children);
+  ml666_st__d__node_put(&stb->public, &original->member.node);
+}
+
+// A clone which doesn't have anything of its own yet. Clones of lazy clones refer to the same original.
+static struct ml666_st_element* clone_create(struct ml666_st_builder_default* stb, struct ml666_st_element* element){
+  if(element->extra && element->extra->original)
+    element = element->extra->original;
+  struct ml666_st_element* clone = ml666_st__d__element_create(&stb->public, ml666_hashed_buffer_set__peek(element->name), true);
+  if(!clone)
+    return 0;
+  struct ml666_st_element_extra* extra = element_extra(stb, clone);
+  if(!extra || !clone_index_add(stb, element, clone)){
+    ml666_st__d__node_put(&stb->public, &clone->member.node);
+    return 0;
+  }
+  extra->original = element;
+  node_refcount_increment(stb, &element->member.node);
+  return clone;
+}
+
+// Child elements become lazy clones, content and comments are copied
+static struct ml666_st_member* member_copy(struct ml666_st_builder_default* stb, struct ml666_st_member* member){
+  switch(member->node.type){
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* clone = clone_create(stb, (struct ml666_st_element*)member);
+      return clone ? &clone->member : 0;
+    }
+    case ML666_ST_NT_CONTENT: {
+      const struct ml666_st_content* content = (struct ml666_st_content*)member;
+      struct ml666_st_content* copy = ml666_st__d__content_create(&stb->public);
+      if(copy && !inline_buffer_copy(stb, &copy->buffer, copy->inline_buffer, content->buffer.ro)){
+        ml666_st__d__node_put(&stb->public, &copy->member.node);
+        return 0;
+      }
+      return copy ? &copy->member : 0;
+    }
+    case ML666_ST_NT_COMMENT: {
+      const struct ml666_st_comment* comment = (struct ml666_st_comment*)member;
+      struct ml666_st_comment* copy = ml666_st__d__comment_create(&stb->public);
+      if(copy && !inline_buffer_copy(stb, &copy->buffer, copy->inline_buffer, comment->buffer.ro)){
+        ml666_st__d__node_put(&stb->public, &copy->member.node);
+        return 0;
+      }
+      return copy ? &copy->member : 0;
+    }
+    default: return 0;
+  }
+}
+
+// Undoes a failed load, it'll be tried again next time
+static void element_unload(struct ml666_st_builder_default* stb, struct ml666_st_element* element){
+  ml666_st__d__subtree_disintegrate(&stb->public, &element->children);
+  for(struct ml666_st_attribute* attribute; (attribute=ml666_st__d__attribute_get_first(&stb->public, element));)
+    ml666_st__d__attribute_remove(&stb->public, attribute);
+}
+
+static bool element_load(struct ml666_st_builder_default* stb, struct ml666_st_element* element);
+
+// Gives a lazy clone copies of the attributes, content and comments of its original. The child elements become lazy clones of those of the original.
+static bool clone_load(struct ml666_st_builder_default* stb, struct ml666_st_element* clone){
+  struct ml666_st_element_extra* extra = clone->extra;
+  struct ml666_st_element* original = extra->original;
+  if(!element_load(stb, original))
+    return false;
+  // It counts as loaded from here on, adding the attributes looks it up
+  extra->original = 0;
+  stb->loading += 1;
+  bool ok = true;
+  for(struct ml666_st_attribute* it=ml666_st__d__attribute_get_first(&stb->public, original); ok && it; it=ml666_st__d__attribute_get_next(&stb->public, it)){
+    struct ml666_st_attribute* attribute = ml666_st__d__attribute_lookup(&stb->public, clone, ml666_hashed_buffer_set__peek(it->name), ML666_ST_AOF_CREATE);
+    ok = attribute && (!it->has_value || inline_buffer_copy(stb, &attribute->value, attribute->inline_value, it->value.ro));
+    if(ok)
+      attribute->has_value = it->has_value;
+  }
+  for(struct ml666_st_member* it=original->children.first; ok && it; it=it->next){
+    struct ml666_st_member* copy = member_copy(stb, it);
+    ok = copy && ml666_st__d__member_set(&stb->public, &clone->member.node, copy, 0);
+    if(copy)
+      ml666_st__d__node_put(&stb->public, &copy->node);
+  }
+  if(!ok)
+    element_unload(stb, clone);
+  stb->loading -= 1;
+  if(!ok){
+    extra->original = original;
+    return false;
+  }
+  // The original isn't needed anymore
+  clone_unlink(stb, clone, original);
+  element_extra_trim(stb, clone);
+  return true;
+}
+
+// Before anything in the subtree of a node changes, the lazy clones of it and its ancestors get copies of what they have now.
+// The topmost one goes first, its copies of the elements on the path to the node are lazy clones, which are then next.
+static bool clones_detach(struct ml666_st_builder_default* stb, struct ml666_st_node* node){
+  if(!stb->clone_index || stb->loading)
+    return true;
+  while(true){
+    struct ml666_st_element* original = 0;
+    for(struct ml666_st_node* it=node; it && it->type != ML666_ST_NT_DOCUMENT; it=((struct ml666_st_member*)it)->parent)
+      if(it->type == ML666_ST_NT_ELEMENT && clone_index_first(stb, (struct ml666_st_element*)it))
+        original = (struct ml666_st_element*)it;
+    if(!original)
+      return true;
+    for(struct ml666_st_element* clone; (clone=clone_index_first(stb, original));)
+      if(!element_load(stb, clone))
+        return false;
+  }
+}
+
+// The extra part is kept until it's done, it's where the source goes back if it fails
+static bool element_load(struct ml666_st_builder_default* stb, struct ml666_st_element* element){
+  struct ml666_st_element_extra* extra = element->extra;
+  if(extra && extra->original)
+    return clone_load(stb, element);
+  const struct ml666_buffer_ro source = element_source(element);
+  if(!source.data)
+    return true;
+  extra->source = (struct ml666_buffer_ro){0};
+  stb->loading += 1;
+  const bool ok = source_load(stb, &element->member.node, source);
+  if(!ok)
+    element_unload(stb, element);
+  stb->loading -= 1;
+  if(!ok){
+    extra->source = source;
+    return false;
+  }
+  element_extra_trim(stb, element);
+  return true;
+}
+
+void ml666_st__d__node_put(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(node_refcount_decrement(stb, node))
+    return;
+  switch(node->type){
+    case ML666_ST_NT_DOCUMENT: {
+      struct ml666_st_document* document = (struct ml666_st_document*)node;
+      child_index_drop(stb, node);
+      if(document->name_index)
+        builder_free(stb, document->name_index, name_index_size(document->name_index));
+    } break;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      ml666_hashed_buffer_set__put(stb->a.buffer_set, element->name);
+      child_index_drop(stb, node);
+      if(element->extra && element->extra->original)
+        clone_unlink(stb, element, element->extra->original);
+      if(element->extra)
+        element->extra->source = (struct ml666_buffer_ro){0};
+      for(struct ml666_st_attribute* attribute; (attribute=ml666_st_attribute_get_first(&stb->public, element));)
+        ml666_st_attribute_remove(&stb->public, attribute);
+      if(element->extra)
+        builder_free(stb, element->extra, sizeof(*element->extra));
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      struct ml666_st_content* content = (struct ml666_st_content*)node;
+      inline_buffer_clear(stb, &content->buffer, content->inline_buffer, block_of(content, content->member.node.block));
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      struct ml666_st_comment* comment = (struct ml666_st_comment*)node;
+      inline_buffer_clear(stb, &comment->buffer, comment->inline_buffer, block_of(comment, comment->member.node.block));
+    } break;
+  }
+  STATS_SUB(stb, node_count[node->type], 1);
+  object_free(stb, node, node->block, node_size(node->type));
+}
+
+void ml666_st__d__node_ref(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  node_refcount_increment(stb, node);
+}
+
+enum ml666_st_node_type ml666_st__d__node_get_type(struct ml666_st_builder* stb, struct ml666_st_node* node){
+  (void)stb;
+  return node->type;
+}
+
+struct ml666_st_children* ml666_st__d__document_get_children(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  (void)stb;
+  return &document->children;
+}
+
+struct ml666_st_children* ml666_st__d__element_get_children(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  if(!element_load((struct ml666_st_builder_default*)stb, element))
+    return 0;
+  return &element->children;
+}
+
+struct ml666_st_node* ml666_st__d__member_get_parent(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->parent;
+}
+
+struct ml666_st_member* ml666_st__d__member_get_previous(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->previous;
+}
+
+struct ml666_st_member* ml666_st__d__member_get_next(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  return member->next;
+}
+
+const struct ml666_hashed_buffer_set_entry* ml666_st__d__element_get_name(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  return element->name;
+}
+
+bool ml666_st__d__content_set(struct ml666_st_builder* _stb, struct ml666_st_content* content, struct ml666_buffer buffer){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(!clones_detach(stb, &content->member.node))
+    return false;
+  node_changed(stb, &content->member.node);
+  inline_buffer_clear(stb, &content->buffer, content->inline_buffer, block_of(content, content->member.node.block));
+  inline_buffer_set(stb, &content->buffer, content->inline_buffer, buffer);
+  return true;
+}
+
+struct ml666_buffer_ro ml666_st__d__content_get(struct ml666_st_builder* stb, const struct ml666_st_content* content){
+  (void)stb;
+  return content->buffer.ro;
+}
+
+struct ml666_buffer ml666_st__d__content_take(struct ml666_st_builder* _stb, struct ml666_st_content* content){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_buffer result = {0};
+  if(!clones_detach(stb, &content->member.node))
+    return result;
+  if(!inline_buffer_take(stb, &content->buffer, content->inline_buffer, block_of(content, content->member.node.block), &result))
+    return result;
+  node_changed(stb, &content->member.node);
+  return result;
+}
+
+bool ml666_st__d__comment_set(struct ml666_st_builder* _stb, struct ml666_st_comment* comment, struct ml666_buffer buffer){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(!clones_detach(stb, &comment->member.node))
+    return false;
+  node_changed(stb, &comment->member.node);
+  inline_buffer_clear(stb, &comment->buffer, comment->inline_buffer, block_of(comment, comment->member.node.block));
+  inline_buffer_set(stb, &comment->buffer, comment->inline_buffer, buffer);
+  return true;
+}
+
+struct ml666_buffer_ro ml666_st__d__comment_get(struct ml666_st_builder* stb, const struct ml666_st_comment* comment){
+  (void)stb;
+  return comment->buffer.ro;
+}
+
+struct ml666_buffer ml666_st__d__comment_take(struct ml666_st_builder* _stb, struct ml666_st_comment* comment){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_buffer result = {0};
+  if(!clones_detach(stb, &comment->member.node))
+    return result;
+  if(!inline_buffer_take(stb, &comment->buffer, comment->inline_buffer, block_of(comment, comment->member.node.block), &result))
+    return result;
+  node_changed(stb, &comment->member.node);
+  return result;
+}
+
+static void st_set_helper(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  struct ml666_st_node* old_parent = member->parent;
+  if(!old_parent)
+    return;
+  struct ml666_st_children* old_children = ml666_st_node_get_children(stb, old_parent);
+  child_index_drop((struct ml666_st_builder_default*)stb, old_parent);
+  if(old_children->first == member){
+    old_children->first = member->next;
+  }else{
+    member->previous->next = member->next;
+  }
+  if(old_children->last == member){
+    old_children->last = member->previous;
+  }else{
+    member->next->previous = member->previous;
+  }
+  if(!old_children->first)
+    ml666_st__d__node_put(stb, old_parent);
+}
+
+bool ml666_st__d__member_set(
+  struct ml666_st_builder* stb,
+  struct ml666_st_node* parent,
+  struct ml666_st_member* member,
+  struct ml666_st_member* before
+){
+  if(member->parent && !clones_detach((struct ml666_st_builder_default*)stb, member->parent))
+    return false;
+  if(!parent && !before){
+    struct ml666_st_document* old_document = member->parent ? name_index_document(member->parent) : 0;
+    if(old_document)
+      name_index_remove_subtree(stb, old_document, &member->node, 0);
+    node_changed((struct ml666_st_builder_default*)stb, member->parent);
+    st_set_helper(stb, member);
+    member->previous = 0;
+    member->next = 0;
+    member->parent = 0;
+    ml666_st__d__node_put(stb, &member->node);
+    return true;
+  }
+  if(before){
+    if(parent){
+      if(parent != before->parent)
+        return false;
+    }else{
+      parent = before->parent;
+    }
+  }
+  if(!parent || !clones_detach((struct ml666_st_builder_default*)stb, parent))
+    return false;
+  struct ml666_st_children* children = ml666_st_node_get_children(stb, parent);
+  if(!children)
+    return false;
+  struct ml666_st_node* old_parent = member->parent;
+  struct ml666_st_document* old_document = old_parent ? name_index_document(old_parent) : 0;
+  struct ml666_st_document* new_document = name_index_document(parent);
+  if(old_document != new_document){
+    if(old_document)
+      name_index_remove_subtree(stb, old_document, &member->node, 0);
+    if(new_document && !name_index_add_subtree((struct ml666_st_builder_default*)stb, new_document, &member->node)){
+      // This can't fail, the index didn't shrink
+      if(old_document)
+        name_index_add_subtree((struct ml666_st_builder_default*)stb, old_document, &member->node);
+      return false;
+    }
+  }
+  node_changed((struct ml666_st_builder_default*)stb, old_parent);
+  node_changed((struct ml666_st_builder_default*)stb, parent);
+  if(!old_parent){
+    ml666_st__d__node_ref(stb, &member->node);
+    if(!children->first)
+      ml666_st__d__node_ref(stb, parent);
+  }else{
+    if(old_parent == parent){
+      // It's already there. Otherwise, there is another child, so removing it won't release the parent.
+      if(member->next == before || member == before)
+        return true;
+    }else if(!children->first){
+      ml666_st__d__node_ref(stb, parent);
+    }
+    st_set_helper(stb, member);
+  }
+  member->parent = parent;
+  member->next = before;
+  struct ml666_st_member* after = 0;
+  if(before){
+    child_index_drop((struct ml666_st_builder_default*)stb, parent);
+    after = before->previous;
+    before->previous = member;
+  }else{
+    child_index_append((struct ml666_st_builder_default*)stb, parent, member);
+    after = children->last;
+    children->last = member;
+  }
+  member->previous = after;
+  if(after){
+    after->next = member;
+  }else{
+    children->first = member;
+  }
+  return true;
+}
+
+struct ml666_st_document* ml666_st__d__document_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_document* document = builder_malloc(stb, sizeof(*document));
+  if(!document){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(document, 0, sizeof(*document));
+  node_refcount_increment(stb, &document->node);
+  document->node.type = ML666_ST_NT_DOCUMENT;
+  document->node.generation = generation_current(stb);
+  STATS_ADD(stb, node_count[ML666_ST_NT_DOCUMENT], 1);
+  return document;
+}
+
+struct ml666_st_element* ml666_st__d__element_create(struct ml666_st_builder* _stb, const struct ml666_hashed_buffer* entry, bool copy_name){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_element* element = builder_malloc(stb, sizeof(*element));
+  if(!element){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(element, 0, sizeof(*element));
+  node_refcount_increment(stb, &element->member.node);
+  element->member.node.type = ML666_ST_NT_ELEMENT;
+  element->member.node.generation = generation_current(stb);
+  STATS_ADD(stb, node_count[ML666_ST_NT_ELEMENT], 1);
+  if(!(element->name = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, entry, copy_name ? ML666_HBS_M_ADD_COPY : ML666_HBS_M_ADD_TAKE))){
+    ml666_st__d__node_put(&stb->public, &element->member.node);
+    fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
+    return 0;
+  }
+  return element;
+}
+
+struct ml666_st_content* ml666_st__d__content_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_content* content = builder_malloc(stb, sizeof(*content));
+  if(!content){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(content, 0, sizeof(*content));
+  node_refcount_increment(stb, &content->member.node);
+  content->member.node.type = ML666_ST_NT_CONTENT;
+  content->member.node.generation = generation_current(stb);
+  STATS_ADD(stb, node_count[ML666_ST_NT_CONTENT], 1);
+  return content;
+}
+
+struct ml666_st_comment* ml666_st__d__comment_create(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_comment* comment = builder_malloc(stb, sizeof(*comment));
+  if(!comment){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(comment, 0, sizeof(*comment));
+  node_refcount_increment(stb, &comment->member.node);
+  comment->member.node.type = ML666_ST_NT_COMMENT;
+  comment->member.node.generation = generation_current(stb);
+  STATS_ADD(stb, node_count[ML666_ST_NT_COMMENT], 1);
+  return comment;
+}
+
+struct ml666_st_member* ml666_st__d__get_first_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  return children->first;
+}
+
+struct ml666_st_member* ml666_st__d__get_last_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  return children->last;
+}
+
+size_t ml666_st__d__child_count(struct ml666_st_builder* _stb, struct ml666_st_children* children){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_child_index* index = child_index_get(stb, children);
+  return index ? index->count : ml666_st_child_count_generic(_stb, children);
+}
+
+struct ml666_st_member* ml666_st__d__child_at(struct ml666_st_builder* _stb, struct ml666_st_children* children, size_t i){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_child_index* index = child_index_get(stb, children);
+  if(!index)
+    return ml666_st_child_at_generic(_stb, children, i);
+  return i < index->count ? index->child[i] : 0;
+}
+
+struct ml666_st_attribute* ml666_st__d__attribute_get_first(const struct ml666_st_builder* stb, const struct ml666_st_element* element){
+  // Loading it doesn't change what it is, only what's known about it
+  if(element_source(element).data && !element_load((struct ml666_st_builder_default*)stb, (struct ml666_st_element*)element))
+    return 0;
+  return ml666__container_of(element->attribute_list.first, struct ml666_st_attribute, entry);
+}
+
+struct ml666_st_attribute* ml666_st__d__attribute_get_next(const struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  if(attribute->entry.llist->last == &attribute->entry)
+    return 0;
+  return ml666__container_of(attribute->entry.next, struct ml666_st_attribute, entry);
+}
+
+// The element must be loaded already
+static struct ml666_st_attribute* attribute_find(struct ml666_st_builder_default* stb, struct ml666_st_element* element, const struct ml666_hashed_buffer_set_entry* name){
+  if(element->extra && element->extra->attribute_index)
+    return *attribute_index_find(element->extra->attribute_index, name);
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(&stb->public, element); it; it=ml666_st_attribute_get_next(&stb->public, it))
+    if(it->name == name)
+      return it;
+  return 0;
+}
+
+// Appends a new attribute to the element. If that fails, the attribute is removed again.
+static bool attribute_link(struct ml666_st_builder_default* stb, struct ml666_st_element* element, struct ml666_st_attribute* attribute){
+  attribute->element = element;
+  if(!element->attribute_list.first)
+    element->attribute_list.first = &attribute->entry;
+  if(element->attribute_list.last){
+    attribute->entry.previous = element->attribute_list.last;
+    element->attribute_list.last->next = &attribute->entry;
+  }else{
+    attribute->entry.flist = &element->attribute_list;
+  }
+  element->attribute_list.last = &attribute->entry;
+  attribute->entry.llist = &element->attribute_list;
+  node_changed(stb, &element->member.node);
+  if(!attribute_index_update(stb, element, attribute)){
+    ml666_st__d__attribute_remove(&stb->public, attribute);
+    return false;
+  }
+  return true;
+}
+
+struct ml666_st_attribute* ml666_st__d__attribute_lookup(struct ml666_st_builder* _stb, struct ml666_st_element* element, const struct ml666_hashed_buffer* name, unsigned flags){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  enum ml666_hashed_buffer_set_mode mode = ML666_HBS_M_GET;
+  if((flags & ML666_ST_AOF_CREATE_NOCOPY) == ML666_ST_AOF_CREATE_NOCOPY){
+    mode = ML666_HBS_M_ADD_TAKE;
+  }else if((flags & ML666_ST_AOF_CREATE) == ML666_ST_AOF_CREATE){
+    mode = ML666_HBS_M_ADD_COPY;
+  }
+  if(!element_load(stb, element))
+    return 0;
+  const struct ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, name, mode);
+  if(!entry){
+    if(mode != ML666_HBS_M_GET)
+      fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
+    return 0;
+  }
+  struct ml666_st_attribute* attribute = attribute_find(stb, element, entry);
+  if(attribute){
+    ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+    if((flags & ML666_ST_AOF_CREATE_EXCLUSIVE) == ML666_ST_AOF_CREATE_EXCLUSIVE){
+      fprintf(stderr, "ml666_st__d__attribute_open failed: attribute already exists\n");
+      return 0;
+    }
+  }else if(mode == ML666_HBS_M_GET){
+    ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+    return 0;
+  }else if(!clones_detach(stb, &element->member.node)){
+    ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+    return 0;
+  }else{
+    attribute = builder_malloc(stb, sizeof(*attribute));
+    if(!attribute){
+      ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+      perror("malloc failed");
+      return 0;
+    }
+    memset(attribute, 0, sizeof(*attribute));
+    attribute->name = entry;
+    STATS_ADD(stb, attribute_count, 1);
+    if(!attribute_link(stb, element, attribute))
+      return 0;
+  }
+  return attribute;
+}
+
+void ml666_st__d__attribute_remove(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_element* element = attribute->element;
+  if(!clones_detach(stb, &element->member.node))
+    return;
+  struct ml666_st_attribute_index* index = element->extra ? element->extra->attribute_index : 0;
+  if(index){
+    if(index->count > 1){
+      attribute_index_remove(index, attribute);
+      index->count -= 1;
+    }else{
+      builder_free(stb, index, attribute_index_size(index));
+      element->extra->attribute_index = 0;
+    }
+  }
+  node_changed(stb, &element->member.node);
+  if(attribute->entry.llist->last == &attribute->entry && attribute->entry.flist->first == &attribute->entry){
+    attribute->entry.llist->last  = 0;
+    attribute->entry.llist->first = 0;
+  }else if(attribute->entry.flist->first == &attribute->entry){
+    attribute->entry.next->flist = attribute->entry.flist;
+    attribute->entry.flist->first = attribute->entry.next;
+  }else if(attribute->entry.llist->last == &attribute->entry){
+    attribute->entry.previous->llist = attribute->entry.llist;
+    attribute->entry.llist->last = attribute->entry.previous;
+  }else{
+    attribute->entry.previous->next = attribute->entry.next;
+    attribute->entry.next->previous = attribute->entry.previous;
+  }
+  ml666_st_attribute_set_value(&stb->public, attribute, 0);
+  ml666_hashed_buffer_set__put(stb->a.buffer_set, attribute->name);
+  STATS_SUB(stb, attribute_count, 1);
+  object_free(stb, attribute, attribute->block, sizeof(*attribute));
+}
+
+const struct ml666_hashed_buffer* ml666_st__d__attribute_get_name(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  return ml666_hashed_buffer_set__peek(attribute->name);
+}
 
 bool ml666_st__d__attribute_set_value(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute, struct ml666_buffer* value){
   struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(!clones_detach(stb, &attribute->element->member.node))
+    return false;
+  node_changed(stb, &attribute->element->member.node);
   if(attribute->has_value)
-    ml666_buffer__clear(&attribute->value, stb->public.user_ptr, stb->a.free);
+    inline_buffer_clear(stb, &attribute->value, attribute->inline_value, block_of(attribute, attribute->block));
   if(value)
-    attribute->value = *value;
+    inline_buffer_set(stb, &attribute->value, attribute->inline_value, *value);
   attribute->has_value = !!value;
   return true;
 }
 
-const struct ml666_buffer_ro* ml666_st__d__attribute_get_value(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
-  (void)stb;
-  if(!attribute->has_value)
-    return 0;
-  return &attribute->value.ro;
+const struct ml666_buffer_ro* ml666_st__d__attribute_get_value(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  if(!attribute->has_value)
+    return 0;
+  return &attribute->value.ro;
+}
+
+const struct ml666_buffer* ml666_st__d__attribute_take_value(struct ml666_st_builder* _stb, struct ml666_st_attribute* attribute){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(!attribute->has_value || !clones_detach(stb, &attribute->element->member.node))
+    return 0;
+  // Once taken, the value isn't freed by the attribute anymore, it's the callers now
+  struct ml666_buffer value;
+  if(!inline_buffer_take(stb, &attribute->value, attribute->inline_value, block_of(attribute, attribute->block), &value))
+    return 0;
+  attribute->value = value;
+  attribute->has_value = false;
+  node_changed(stb, &attribute->element->member.node);
+  return &attribute->value;
+}
+
+static struct ml666_st_member* first_child(struct ml666_st_builder_default* stb, struct ml666_st_node* node, bool load){
+  switch(node->type){
+    case ML666_ST_NT_DOCUMENT: return ((struct ml666_st_document*)node)->children.first;
+    case ML666_ST_NT_ELEMENT : {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      if(load && !element_load(stb, element))
+        return 0;
+      return element->children.first;
+    }
+    default: return 0;
+  }
+}
+
+// Called for every member the cursor enters. Its first child is needed next, its sibling once its subtree is done.
+static inline void cursor_prefetch(struct ml666_st_member* member){
+  __builtin_prefetch(member->next);
+  if(member->node.type == ML666_ST_NT_ELEMENT)
+    __builtin_prefetch(((struct ml666_st_element*)member)->children.first);
+}
+
+// Elements which haven't been loaded yet appear to have no children, unless load is set
+static bool cursor_walk(struct ml666_st_builder_default* stb, struct ml666_st_cursor* cursor, bool load){
+  struct ml666_st_node* node = cursor->node;
+  const bool skip = cursor->skip;
+  cursor->skip = false;
+  switch(cursor->event){
+    case ML666_ST_CE_START: {
+      cursor->event = ML666_ST_CE_ENTER;
+    } return true;
+    case ML666_ST_CE_ENTER: {
+      if(!skip && load && node->type == ML666_ST_NT_ELEMENT && !element_load(stb, (struct ml666_st_element*)node)){
+        cursor->error = true;
+        break;
+      }
+      struct ml666_st_member* child = skip ? 0 : first_child(stb, node, false);
+      if(child){
+        cursor_prefetch(child);
+        cursor->node = &child->node;
+        cursor->depth += 1;
+      }else{
+        cursor->event = ML666_ST_CE_LEAVE;
+      }
+    } return true;
+    case ML666_ST_CE_LEAVE: {
+      if(node == cursor->root)
+        break;
+      struct ml666_st_member* member = (struct ml666_st_member*)node;
+      if(member->next){
+        cursor_prefetch(member->next);
+        cursor->node = &member->next->node;
+        cursor->event = ML666_ST_CE_ENTER;
+      }else{
+        cursor->node = member->parent;
+        cursor->depth -= 1;
+      }
+    } return true;
+    case ML666_ST_CE_END: break;
+  }
+  cursor->event = ML666_ST_CE_END;
+  return false;
+}
+
+bool ml666_st__d__cursor_next(struct ml666_st_builder* stb, struct ml666_st_cursor* cursor){
+  return cursor_walk((struct ml666_st_builder_default*)stb, cursor, true);
 }
 
-const struct ml666_buffer* ml666_st__d__attribute_take_value(struct ml666_st_builder* stb, struct ml666_st_attribute* attribute){
-  (void)stb;
-  if(!attribute->has_value)
-    return 0;
-  attribute->has_value = false;
-  return &attribute->value;
+// Like ml666_st_subtree_disintegrate_generic, but without loading anything
+void ml666_st__d__subtree_disintegrate(struct ml666_st_builder* _stb, struct ml666_st_children* children){
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_member* it = children->first;
+  while(it){
+    // Elements with lazy clones keep their children until the clones don't need them anymore, see clone_unlink
+    const bool shared = it->node.type == ML666_ST_NT_ELEMENT && clone_index_first(stb, (struct ml666_st_element*)it);
+    struct ml666_st_member* child = shared ? 0 : first_child(stb, &it->node, false);
+    if(child){
+      it = child;
+      continue;
+    }
+    struct ml666_st_node* parent = it->parent;
+    const bool top = parent->type == ML666_ST_NT_DOCUMENT
+      ? &((struct ml666_st_document*)parent)->children == children
+      : &((struct ml666_st_element*)parent)->children == children;
+    ml666_st__d__member_set(&stb->public, 0, it, 0);
+    it = top ? children->first : (struct ml666_st_member*)parent;
+  }
 }
 
 void ml666_st__d__builder_destroy(struct ml666_st_builder* _stb){
   struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(stb->tokenizer)
+    ml666_tokenizer_destroy(stb->tokenizer);
+  if(stb->own_buffer_set)
+    ml666_hashed_buffer_set__destroy(stb->a.buffer_set);
+  if(stb->clone_index)
+    builder_free(stb, stb->clone_index, clone_index_size(stb->clone_index));
+  if(stb->origin){
+    // Nodes may have been moved between the two, only the sum of their counters is meaningful
+    atomic_size_t* from = (atomic_size_t*)&stb->stats;
+    atomic_size_t* to = (atomic_size_t*)&stb->origin->stats;
+    for(size_t i=0; i<sizeof(stb->stats)/sizeof(*from); i++)
+      atomic_fetch_add_explicit(&to[i], atomic_load_explicit(&from[i], memory_order_relaxed), memory_order_relaxed);
+  }
   stb->a.free(stb->public.user_ptr, stb);
 }
 
-ML666_ST_IMPLEMENTATION(ml666_default, ml666_st__d_)
+ML666_ST_IMPLEMENTATION_FULL(ml666_default, ml666_st__d_)
 
 struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_builder_create_args args){
-  if(!args.buffer_set)
-    args.buffer_set = ml666_hashed_buffer_set__get_default();
   if(!args.malloc)
     args.malloc = ml666__d__malloc;
   if(!args.free)
@@ -387,8 +1774,858 @@ struct ml666_st_builder* ml666_st_builder_create_p(struct ml666_st_builder_creat
     return false;
   }
   memset(stb, 0, sizeof(*stb));
+  if(!args.buffer_set && args.thread_confined){
+    // The global default set is shared with other builders, which may be used from other threads
+    args.buffer_set = ml666_default_hashed_buffer_set__create(
+      .that = args.user_ptr,
+      .malloc = args.malloc,
+      .free = args.free,
+      .thread_confined = true,
+    );
+    if(!args.buffer_set){
+      args.free(args.user_ptr, stb);
+      return 0;
+    }
+    stb->own_buffer_set = true;
+  }
+  if(!args.buffer_set)
+    args.buffer_set = ml666_hashed_buffer_set__get_default();
   *(const struct ml666_st_cb**)&stb->public.cb = &ml666_default_st_api;
   stb->public.user_ptr = args.user_ptr;
   stb->a = args;
+  stb->generation = 1;
   return &stb->public;
 }
+
+struct ml666_st_builder* ml666_st_builder_fork(struct ml666_st_builder* _stb, struct ml666_hashed_buffer_set* buffer_set){
+  if(_stb->cb != &ml666_default_st_api)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_builder_create_args args = stb->a;
+  args.buffer_set = buffer_set;
+  struct ml666_st_builder* fork = ml666_st_builder_create_p(args);
+  if(fork){
+    ((struct ml666_st_builder_default*)fork)->origin = stb;
+    ((struct ml666_st_builder_default*)fork)->generation = generation_current(stb);
+  }
+  return fork;
+}
+
+struct ml666_hashed_buffer_set* ml666_st_builder_get_buffer_set(struct ml666_st_builder* _stb){
+  if(_stb->cb != &ml666_default_st_api)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  return stb->a.buffer_set;
+}
+
+bool ml666_st_builder_is_thread_confined(struct ml666_st_builder* _stb){
+  if(_stb->cb != &ml666_default_st_api)
+    return false;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  return stb->a.thread_confined;
+}
+
+bool ml666_st_document_index_names(struct ml666_st_builder* _stb, struct ml666_st_document* document){
+  if(_stb->cb != &ml666_default_st_api)
+    return false;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(document->name_index)
+    return true;
+  if(!name_index_grow(stb, document))
+    return false;
+  for(struct ml666_st_member* it=document->children.first; it; it=it->next){
+    if(!name_index_add_subtree(stb, document, &it->node)){
+      for(struct ml666_st_member* it2=document->children.first; it2!=it; it2=it2->next)
+        name_index_remove_subtree(_stb, document, &it2->node, 0);
+      builder_free(stb, document->name_index, name_index_size(document->name_index));
+      document->name_index = 0;
+      return false;
+    }
+  }
+  return true;
+}
+
+struct ml666_st_element* ml666_st_document_get_first_by_name(struct ml666_st_builder* _stb, struct ml666_st_document* document, const struct ml666_hashed_buffer* name){
+  if(_stb->cb != &ml666_default_st_api || !document->name_index)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  // Only names which exist can be in the index
+  const struct ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, name, ML666_HBS_M_GET);
+  if(!entry)
+    return 0;
+  struct ml666_st_element* element = name_index_find(document->name_index, entry)->first;
+  ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+  return element;
+}
+
+struct ml666_st_element* ml666_st_element_get_next_by_name(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  return element->extra ? element->extra->name_next : 0;
+}
+
+static uint64_t hash_mix(uint64_t hash){
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9llu;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBllu;
+  return hash ^ (hash >> 31);
+}
+
+static uint64_t hash_append(uint64_t hash, uint64_t value){
+  return ml666_hash_FNV_1a_append((struct ml666_buffer_ro){sizeof(value), (const char*)&value}, hash);
+}
+
+// The hashes of the child elements must be known already, and the element must be loaded
+static uint64_t node_hash(struct ml666_st_node* node){
+  uint64_t hash = hash_append(ML666_FNV_OFFSET_BASIS, node->type);
+  const struct ml666_st_children* children = 0;
+  switch(node->type){
+    case ML666_ST_NT_DOCUMENT: {
+      children = &((const struct ml666_st_document*)node)->children;
+    } break;
+    case ML666_ST_NT_ELEMENT: {
+      const struct ml666_st_element* element = (const struct ml666_st_element*)node;
+      children = &element->children;
+      hash = hash_append(hash, ml666_hashed_buffer_set__peek(element->name)->hash);
+      // A sum, so the order of the attributes doesn't matter
+      uint64_t attributes = 0;
+      for(struct ml666_st_attribute_set_entry* entry=element->attribute_list.first; entry; entry=entry==element->attribute_list.last ? 0 : entry->next){
+        const struct ml666_st_attribute* it = ml666__container_of(entry, struct ml666_st_attribute, entry);
+        const uint64_t value = it->has_value ? ml666_hash_FNV_1a(it->value.ro) : 0;
+        attributes += hash_mix(ml666_hashed_buffer_set__peek(it->name)->hash + hash_mix(value));
+      }
+      hash = hash_append(hash, attributes);
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      const struct ml666_buffer_ro buffer = ((const struct ml666_st_content*)node)->buffer.ro;
+      hash = ml666_hash_FNV_1a_append(buffer, hash_append(hash, buffer.length));
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      const struct ml666_buffer_ro buffer = ((const struct ml666_st_comment*)node)->buffer.ro;
+      hash = ml666_hash_FNV_1a_append(buffer, hash_append(hash, buffer.length));
+    } break;
+  }
+  if(children){
+    for(struct ml666_st_member* it=children->first; it; it=it->next){
+      const uint64_t* child = hash_slot(&it->node);
+      hash = hash_append(hash, child ? *child : node_hash(&it->node));
+    }
+  }
+  hash = hash_mix(hash);
+  return hash ? hash : 1;
+}
+
+uint64_t ml666_st_node_get_hash(struct ml666_st_builder* stb, struct ml666_st_node* node){
+  if(stb->cb != &ml666_default_st_api)
+    return 0;
+  if(node->type == ML666_ST_NT_CONTENT || node->type == ML666_ST_NT_COMMENT)
+    return node_hash(node);
+  const uint64_t* known = hash_slot(node);
+  if(known && *known)
+    return *known;
+  // Children are left before their parents, so their hashes are known by then. Subtrees with a known hash are skipped, and so are contents & comments.
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(ml666_st__d__cursor_next(stb, &cursor)){
+    if(cursor.node->type == ML666_ST_NT_CONTENT || cursor.node->type == ML666_ST_NT_COMMENT){
+      ml666_st_cursor_skip(&cursor);
+      continue;
+    }
+    uint64_t* hash = hash_slot(cursor.node);
+    if(hash && *hash){
+      ml666_st_cursor_skip(&cursor);
+    }else if(cursor.event == ML666_ST_CE_LEAVE){
+      if(!hash && !element_extra((struct ml666_st_builder_default*)stb, (struct ml666_st_element*)cursor.node))
+        return 0;
+      *hash_slot(cursor.node) = node_hash(cursor.node);
+    }
+  }
+  if(cursor.error){
+    fprintf(stderr, "ml666_st_node_get_hash: not all of the subtree could be loaded\n");
+    return 0;
+  }
+  return *hash_slot(node);
+}
+
+uint64_t ml666_st_node_get_generation(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  if(_stb->cb != &ml666_default_st_api)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(node->generation == stb->generation)
+    stb->generation_seen = true;
+  return node->generation;
+}
+
+struct ml666_st_document* ml666_st_parse_lazy(struct ml666_st_builder* _stb, struct ml666_buffer_ro input){
+  if(_stb->cb != &ml666_default_st_api)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  struct ml666_st_document* document = ml666_st__d__document_create(&stb->public);
+  if(!document)
+    return 0;
+  if(!source_load(stb, &document->node, input)){
+    ml666_st__d__subtree_disintegrate(&stb->public, &document->children);
+    ml666_st__d__node_put(&stb->public, &document->node);
+    return 0;
+  }
+  return document;
+}
+
+struct ml666_st_node* ml666_st_clone_lazy(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  if(_stb->cb != &ml666_default_st_api)
+    return 0;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(node->type != ML666_ST_NT_DOCUMENT){
+    struct ml666_st_member* copy = member_copy(stb, (struct ml666_st_member*)node);
+    return copy ? &copy->node : 0;
+  }
+  // Documents can't be lazy clones, they get their top level right away
+  struct ml666_st_document* original = (struct ml666_st_document*)node;
+  struct ml666_st_document* document = ml666_st__d__document_create(&stb->public);
+  if(!document)
+    return 0;
+  for(struct ml666_st_member* it=original->children.first; it; it=it->next){
+    struct ml666_st_member* copy = member_copy(stb, it);
+    const bool ok = copy && ml666_st__d__member_set(&stb->public, &document->node, copy, 0);
+    if(copy)
+      ml666_st__d__node_put(&stb->public, &copy->node);
+    if(!ok){
+      ml666_st__d__subtree_disintegrate(&stb->public, &document->children);
+      ml666_st__d__node_put(&stb->public, &document->node);
+      return 0;
+    }
+  }
+  return &document->node;
+}
+
+static bool build_check(const struct ml666_st_build_args* a){
+  for(size_t i=0; i<a->count; i++){
+    const struct ml666_st_member_description* d = &a->member[i];
+    if(d->type != ML666_ST_NT_ELEMENT && d->type != ML666_ST_NT_CONTENT && d->type != ML666_ST_NT_COMMENT){
+      fprintf(stderr, "ml666_st_build_p: member %zu: invalid type\n", i);
+      return false;
+    }
+    if(d->parent != ML666_ST_BUILD_PARENT && (d->parent >= i || a->member[d->parent].type != ML666_ST_NT_ELEMENT)){
+      fprintf(stderr, "ml666_st_build_p: member %zu: the parent must be an element earlier in the array\n", i);
+      return false;
+    }
+    if(d->type == ML666_ST_NT_ELEMENT && !d->name){
+      fprintf(stderr, "ml666_st_build_p: member %zu: elements need a name\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Adds the members without a parent in the array to args.parent, and drops the references from creating them.
+// If that fails, or if creating them failed, everything is removed again.
+static bool build_finish(const struct ml666_st_build_args* a, struct ml666_st_member** member, size_t created, bool ok){
+  struct ml666_st_builder* stb = a->stb;
+  for(size_t i=0; ok && i<created; i++)
+    if(a->member[i].parent == ML666_ST_BUILD_PARENT)
+      ok = ml666_st_member_set(stb, a->parent, member[i], a->before);
+  for(size_t i=0; i<created; i++){
+    if(a->member[i].parent != ML666_ST_BUILD_PARENT)
+      continue;
+    if(!ok){
+      struct ml666_st_children* children = ml666_st_node_get_children(stb, &member[i]->node);
+      if(children)
+        ml666_st_subtree_disintegrate(stb, children);
+      if(ml666_st_member_get_parent(stb, member[i]))
+        ml666_st_member_set(stb, 0, member[i], 0);
+    }
+    ml666_st_node_put(stb, &member[i]->node);
+  }
+  return ok;
+}
+
+static bool build_text_generic(const struct ml666_st_build_args* a, struct ml666_st_node* node, struct ml666_buffer_ro value){
+  struct ml666_buffer buffer;
+  if(!ml666_buffer__dup(&buffer, value, a->user_ptr, a->malloc))
+    return false;
+  bool ok;
+  if(ML666_ST_TYPE(node) == ML666_ST_NT_CONTENT){
+    ok = ml666_st_content_set(a->stb, (struct ml666_st_content*)node, buffer);
+  }else{
+    ok = ml666_st_comment_set(a->stb, (struct ml666_st_comment*)node, buffer);
+  }
+  if(!ok && buffer.data)
+    a->free(a->user_ptr, buffer.data);
+  return ok;
+}
+
+static bool build_attributes_generic(const struct ml666_st_build_args* a, struct ml666_st_element* element, const struct ml666_st_member_description* d){
+  for(size_t i=0; i<d->attribute_count; i++){
+    struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(a->stb, element, d->attribute[i].name, ML666_ST_AOF_CREATE_EXCLUSIVE);
+    if(!attribute)
+      return false;
+    if(!d->attribute[i].has_value)
+      continue;
+    struct ml666_buffer buffer;
+    if(!ml666_buffer__dup(&buffer, d->attribute[i].value, a->user_ptr, a->malloc))
+      return false;
+    if(!ml666_st_attribute_set_value(a->stb, attribute, &buffer)){
+      if(buffer.data)
+        a->free(a->user_ptr, buffer.data);
+      return false;
+    }
+  }
+  return true;
+}
+
+// One node at a time, using the builder functions
+static bool build_generic(const struct ml666_st_build_args* a, struct ml666_st_member** member, size_t* created){
+  struct ml666_st_builder* stb = a->stb;
+  for(size_t i=0; i<a->count; i++){
+    const struct ml666_st_member_description* d = &a->member[i];
+    struct ml666_st_node* node = 0;
+    bool ok = false;
+    switch(d->type){
+      case ML666_ST_NT_ELEMENT: {
+        struct ml666_st_element* element = ml666_st_element_create(stb, d->name, true);
+        node = ML666_ST_NODE(element);
+        ok = element && build_attributes_generic(a, element, d);
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        node = ML666_ST_NODE(ml666_st_content_create(stb));
+        ok = node && build_text_generic(a, node, d->data);
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        node = ML666_ST_NODE(ml666_st_comment_create(stb));
+        ok = node && build_text_generic(a, node, d->data);
+      } break;
+      case ML666_ST_NT_DOCUMENT: break;
+    }
+    if(d->parent != ML666_ST_BUILD_PARENT && ok){
+      ok = ml666_st_member_set(stb, &member[d->parent]->node, (struct ml666_st_member*)node, 0);
+      ml666_st_node_put(stb, node);
+    }else if(!ok && node){
+      ml666_st_node_put(stb, node);
+    }
+    if(!ok)
+      return false;
+    member[i] = (struct ml666_st_member*)node;
+    *created = i + 1;
+  }
+  return true;
+}
+
+// Copies data into the node if it fits, or else to the end of the block
+static void build_text(struct ml666_st_builder_default* stb, struct ml666_buffer* buffer, char* inline_data, char** next_data, struct ml666_buffer_ro value){
+  if(!value.length)
+    return;
+  STATS_ADD(stb, data_bytes, value.length);
+  char* data = inline_data;
+  if(value.length > ML666_ST_INLINE_SIZE){
+    data = *next_data;
+    *next_data += value.length;
+  }
+  memcpy(data, value.data, value.length);
+  buffer->data = data;
+  buffer->length = value.length;
+}
+
+static bool build_attributes(struct ml666_st_builder_default* stb, struct ml666_st_block* block, char** next_object, char** next_data, struct ml666_st_element* element, const struct ml666_st_member_description* d){
+  for(size_t i=0; i<d->attribute_count; i++){
+    struct ml666_st_attribute* attribute = (struct ml666_st_attribute*)*next_object;
+    *next_object += BLOCK_ROUND(sizeof(*attribute));
+    memset(attribute, 0, sizeof(*attribute));
+    attribute->block = ((char*)attribute - (char*)block) / BLOCK_ALIGN;
+    const struct ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, d->attribute[i].name, ML666_HBS_M_ADD_COPY);
+    if(!entry){
+      fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
+      return false;
+    }
+    if(attribute_find(stb, element, entry)){
+      ml666_hashed_buffer_set__put(stb->a.buffer_set, entry);
+      fprintf(stderr, "ml666_st_build_p: attribute specified twice\n");
+      return false;
+    }
+    attribute->name = entry;
+    block_ref(stb, block);
+    STATS_ADD(stb, attribute_count, 1);
+    if(d->attribute[i].has_value){
+      attribute->has_value = true;
+      build_text(stb, &attribute->value, attribute->inline_value, next_data, d->attribute[i].value);
+    }
+    if(!attribute_link(stb, element, attribute))
+      return false;
+  }
+  return true;
+}
+
+// Everything in one allocation. The nodes are linked directly, only adding them to args.parent uses member_set.
+static bool build_default(struct ml666_st_builder_default* stb, const struct ml666_st_build_args* a, struct ml666_st_member** member, size_t* created){
+  // The nodes & attributes come first, their offsets have to fit into ml666_st_node::block. The data which doesn't fit inline follows.
+  size_t objects = BLOCK_ROUND(sizeof(struct ml666_st_block));
+  size_t data = 0;
+  for(size_t i=0; i<a->count; i++){
+    const struct ml666_st_member_description* d = &a->member[i];
+    if(d->type == ML666_ST_NT_ELEMENT){
+      objects += BLOCK_ROUND(sizeof(struct ml666_st_element)) + d->attribute_count * BLOCK_ROUND(sizeof(struct ml666_st_attribute));
+      for(size_t j=0; j<d->attribute_count; j++)
+        if(d->attribute[j].has_value && d->attribute[j].value.length > ML666_ST_INLINE_SIZE)
+          data += d->attribute[j].value.length;
+    }else{
+      objects += BLOCK_ROUND(d->type == ML666_ST_NT_CONTENT ? sizeof(struct ml666_st_content) : sizeof(struct ml666_st_comment));
+      if(d->data.length > ML666_ST_INLINE_SIZE)
+        data += d->data.length;
+    }
+  }
+  if(objects / BLOCK_ALIGN > UINT32_MAX)
+    return build_generic(a, member, created);
+  struct ml666_st_block* block = builder_malloc(stb, objects + data);
+  if(!block){
+    perror("malloc failed");
+    return false;
+  }
+  memset(block, 0, sizeof(*block));
+  block->size = objects + data;
+  block_ref(stb, block); // Until everything has been created
+  const uint64_t generation = generation_current(stb);
+  char* next_object = (char*)block + BLOCK_ROUND(sizeof(*block));
+  char* next_data = (char*)block + objects;
+  bool ok = true;
+  for(size_t i=0; ok && i<a->count; i++){
+    const struct ml666_st_member_description* d = &a->member[i];
+    size_t size = d->type == ML666_ST_NT_ELEMENT ? sizeof(struct ml666_st_element)
+                : d->type == ML666_ST_NT_CONTENT ? sizeof(struct ml666_st_content)
+                : sizeof(struct ml666_st_comment);
+    struct ml666_st_member* it = (struct ml666_st_member*)next_object;
+    next_object += BLOCK_ROUND(size);
+    memset(it, 0, size);
+    it->node.type = d->type;
+    it->node.block = ((char*)it - (char*)block) / BLOCK_ALIGN;
+    it->node.generation = generation;
+    struct ml666_st_element* element = 0;
+    if(d->type == ML666_ST_NT_ELEMENT){
+      element = (struct ml666_st_element*)it;
+      if(!(element->name = ml666_hashed_buffer_set__lookup(stb->a.buffer_set, d->name, ML666_HBS_M_ADD_COPY))){
+        fprintf(stderr, "ml666_hashed_buffer_set::lookup failed\n");
+        ok = false;
+        break;
+      }
+    }else if(d->type == ML666_ST_NT_CONTENT){
+      struct ml666_st_content* content = (struct ml666_st_content*)it;
+      build_text(stb, &content->buffer, content->inline_buffer, &next_data, d->data);
+    }else{
+      struct ml666_st_comment* comment = (struct ml666_st_comment*)it;
+      build_text(stb, &comment->buffer, comment->inline_buffer, &next_data, d->data);
+    }
+    node_refcount_increment(stb, &it->node);
+    block_ref(stb, block);
+    STATS_ADD(stb, node_count[d->type], 1);
+    if(d->parent != ML666_ST_BUILD_PARENT){
+      // The parent gets the reference from creating it
+      struct ml666_st_element* parent = (struct ml666_st_element*)member[d->parent];
+      it->parent = &parent->member.node;
+      it->previous = parent->children.last;
+      if(it->previous){
+        it->previous->next = it;
+      }else{
+        parent->children.first = it;
+        node_refcount_increment(stb, &parent->member.node);
+      }
+      parent->children.last = it;
+    }
+    member[i] = it;
+    *created = i + 1;
+    if(element)
+      ok = build_attributes(stb, block, &next_object, &next_data, element, d);
+  }
+  block_put(stb, block);
+  return ok;
+}
+
+bool ml666_st_build_p(struct ml666_st_build_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_build_p: mandatory argument \"stb\" not set!\n");
+    return false;
+  }
+  if(!args.parent){
+    fprintf(stderr, "ml666_st_build_p: mandatory argument \"parent\" not set!\n");
+    return false;
+  }
+  if(args.count && !args.member){
+    fprintf(stderr, "ml666_st_build_p: mandatory argument \"member\" not set!\n");
+    return false;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  if(!build_check(&args))
+    return false;
+  struct ml666_st_member** member = args.malloc(args.user_ptr, (args.count ? args.count : 1) * sizeof(*member));
+  if(!member){
+    perror("malloc failed");
+    return false;
+  }
+  size_t created = 0;
+  bool ok;
+  if(args.stb->cb == &ml666_default_st_api){
+    ok = build_default((struct ml666_st_builder_default*)args.stb, &args, member, &created);
+  }else{
+    ok = build_generic(&args, member, &created);
+  }
+  ok = build_finish(&args, member, created, ok);
+  args.free(args.user_ptr, member);
+  return ok;
+}
+
+bool ml666_st_builder_get_stats(struct ml666_st_builder* _stb, struct ml666_st_stats* stats){
+  if(_stb->cb != &ml666_default_st_api)
+    return false;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)_stb;
+  if(!stb->a.stats)
+    return false;
+  *stats = (struct ml666_st_stats){
+    .document_count   = atomic_load_explicit(&stb->stats.node_count[ML666_ST_NT_DOCUMENT], memory_order_relaxed),
+    .element_count    = atomic_load_explicit(&stb->stats.node_count[ML666_ST_NT_ELEMENT], memory_order_relaxed),
+    .content_count    = atomic_load_explicit(&stb->stats.node_count[ML666_ST_NT_CONTENT], memory_order_relaxed),
+    .comment_count    = atomic_load_explicit(&stb->stats.node_count[ML666_ST_NT_COMMENT], memory_order_relaxed),
+    .attribute_count  = atomic_load_explicit(&stb->stats.attribute_count, memory_order_relaxed),
+    .data_bytes       = atomic_load_explicit(&stb->stats.data_bytes, memory_order_relaxed),
+    .allocation_count = atomic_load_explicit(&stb->stats.allocation_count, memory_order_relaxed),
+    .allocated_bytes  = atomic_load_explicit(&stb->stats.allocated_bytes, memory_order_relaxed),
+  };
+  ml666_default_hashed_buffer_set__get_size(stb->a.buffer_set, &stats->name_count, &stats->name_bytes);
+  return true;
+}
+
+// The distinct names seen so far. Open addressing with linear probing, at most half full.
+struct name_set {
+  size_t mask, count;
+  const struct ml666_hashed_buffer** slot;
+  void* user_ptr;
+  ml666__cb__malloc* malloc;
+  ml666__cb__free* free;
+};
+
+static bool name_set_add(struct name_set* set, const struct ml666_hashed_buffer* name, struct ml666_st_stats* stats){
+  if((set->count + 1) * 2 > set->mask + 1){
+    const size_t size = set->slot ? (set->mask + 1) * 2 : 64;
+    const struct ml666_hashed_buffer** slot = set->malloc(set->user_ptr, size * sizeof(*slot));
+    if(!slot){
+      perror("malloc failed");
+      return false;
+    }
+    memset(slot, 0, size * sizeof(*slot));
+    for(size_t i=0; set->slot && i<=set->mask; i++){
+      if(!set->slot[i])
+        continue;
+      size_t j = set->slot[i]->hash & (size - 1);
+      while(slot[j])
+        j = (j + 1) & (size - 1);
+      slot[j] = set->slot[i];
+    }
+    if(set->slot)
+      set->free(set->user_ptr, set->slot);
+    set->slot = slot;
+    set->mask = size - 1;
+  }
+  size_t i = name->hash & set->mask;
+  while(set->slot[i]){
+    if(set->slot[i] == name)
+      return true;
+    i = (i + 1) & set->mask;
+  }
+  set->slot[i] = name;
+  set->count += 1;
+  stats->name_count += 1;
+  stats->name_bytes += name->buffer.length;
+  return true;
+}
+
+// A node or attribute, and its data
+static void stats_object(struct ml666_st_stats* stats, size_t size, uint32_t block){
+  if(block){
+    stats->allocated_bytes += BLOCK_ROUND(size);
+  }else{
+    stats->allocation_count += 1;
+    stats->allocated_bytes += size;
+  }
+}
+
+static void stats_data(struct ml666_st_stats* stats, const struct ml666_buffer* buffer, const char* inline_data, const void* object, uint32_t block){
+  stats->data_bytes += buffer->length;
+  if(buffer_slab(buffer, inline_data))
+    stats->allocated_bytes += buffer->length;
+  if(!buffer_is_separate(buffer, inline_data, block_of(object, block)))
+    return;
+  stats->allocation_count += 1;
+  stats->allocated_bytes += buffer->length;
+}
+
+// The parts only the default builder has
+static void stats_node_default(struct ml666_st_stats* stats, struct ml666_st_node* node){
+  stats_object(stats, node_size(node->type), node->block);
+  switch(node->type){
+    case ML666_ST_NT_DOCUMENT: {
+      struct ml666_st_document* document = (struct ml666_st_document*)node;
+      if(document->name_index){
+        stats->allocation_count += 1;
+        stats->allocated_bytes += name_index_size(document->name_index);
+      }
+      if(document->child_index){
+        stats->allocation_count += 1;
+        stats->allocated_bytes += child_index_size(document->child_index);
+      }
+    } break;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      const struct ml666_st_element_extra* extra = element->extra;
+      if(!extra)
+        break;
+      stats->allocation_count += 1;
+      stats->allocated_bytes += sizeof(*extra);
+      if(extra->attribute_index){
+        stats->allocation_count += 1;
+        stats->allocated_bytes += attribute_index_size(extra->attribute_index);
+      }
+      if(extra->child_index){
+        stats->allocation_count += 1;
+        stats->allocated_bytes += child_index_size(extra->child_index);
+      }
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      struct ml666_st_content* content = (struct ml666_st_content*)node;
+      stats_data(stats, &content->buffer, content->inline_buffer, content, node->block);
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      struct ml666_st_comment* comment = (struct ml666_st_comment*)node;
+      stats_data(stats, &comment->buffer, comment->inline_buffer, comment, node->block);
+    } break;
+  }
+}
+
+bool ml666_st_node_get_stats(struct ml666_st_builder* stb, struct ml666_st_node* node, struct ml666_st_stats* stats){
+  const bool is_default = stb->cb == &ml666_default_st_api;
+  *stats = (struct ml666_st_stats){0};
+  // The allocator of the builder, if it's known
+  struct name_set names = {
+    .user_ptr = stb->user_ptr,
+    .malloc = is_default ? ((struct ml666_st_builder_default*)stb)->a.malloc : ml666__d__malloc,
+    .free = is_default ? ((struct ml666_st_builder_default*)stb)->a.free : ml666__d__free,
+  };
+  bool ok = true;
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(ok && (is_default ? cursor_walk((struct ml666_st_builder_default*)stb, &cursor, false) : ml666_st_cursor_next(stb, &cursor))){
+    if(cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    struct ml666_st_node* it = cursor.node;
+    if(is_default)
+      stats_node_default(stats, it);
+    switch(ML666_ST_TYPE(it)){
+      case ML666_ST_NT_DOCUMENT: stats->document_count += 1; break;
+      case ML666_ST_NT_ELEMENT: {
+        stats->element_count += 1;
+        struct ml666_st_element* element = (struct ml666_st_element*)it;
+        ok = name_set_add(&names, ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, element)), stats);
+        // Going through the list directly doesn't load the element
+        struct ml666_st_attribute* attribute = is_default
+          ? ml666__container_of(element->attribute_list.first, struct ml666_st_attribute, entry)
+          : ml666_st_attribute_get_first(stb, element);
+        for(; ok && attribute; attribute=ml666_st_attribute_get_next(stb, attribute)){
+          stats->attribute_count += 1;
+          ok = name_set_add(&names, ml666_st_attribute_get_name(stb, attribute), stats);
+          if(is_default){
+            stats_object(stats, sizeof(*attribute), attribute->block);
+            if(attribute->has_value)
+              stats_data(stats, &attribute->value, attribute->inline_value, attribute, attribute->block);
+          }else{
+            const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(stb, attribute);
+            if(value)
+              stats->data_bytes += value->length;
+          }
+        }
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        stats->content_count += 1;
+        if(!is_default)
+          stats->data_bytes += ml666_st_content_get(stb, (struct ml666_st_content*)it).length;
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        stats->comment_count += 1;
+        if(!is_default)
+          stats->data_bytes += ml666_st_comment_get(stb, (struct ml666_st_comment*)it).length;
+      } break;
+    }
+  }
+  if(names.slot)
+    names.free(names.user_ptr, names.slot);
+  return ok;
+}
+
+// Merges the adjacent content nodes among the children, and removes empty ones
+static bool compact_children(struct ml666_st_builder_default* stb, struct ml666_st_children* children){
+  struct ml666_st_member* it = children->first;
+  if(it && !clones_detach(stb, it->parent))
+    return false;
+  while(it){
+    struct ml666_st_member* next = it->next;
+    if(it->node.type != ML666_ST_NT_CONTENT){
+      it = next;
+      continue;
+    }
+    struct ml666_st_content* content = (struct ml666_st_content*)it;
+    if(!content->buffer.length){
+      ml666_st__d__member_set(&stb->public, 0, it, 0);
+      it = next;
+      continue;
+    }
+    if(!next || next->node.type != ML666_ST_NT_CONTENT){
+      it = next;
+      continue;
+    }
+    struct ml666_st_content* following = (struct ml666_st_content*)next;
+    if(!following->buffer.length){
+      // Nothing to copy, and its data may be null
+      ml666_st__d__member_set(&stb->public, 0, next, 0);
+      continue;
+    }
+    const size_t length = content->buffer.length + following->buffer.length;
+    char* data = stb->a.malloc(stb->public.user_ptr, length);
+    if(!data){
+      perror("malloc failed");
+      return false;
+    }
+    memcpy(data, content->buffer.data, content->buffer.length);
+    memcpy(data + content->buffer.length, following->buffer.data, following->buffer.length);
+    inline_buffer_clear(stb, &content->buffer, content->inline_buffer, block_of(content, it->node.block));
+    inline_buffer_set(stb, &content->buffer, content->inline_buffer, (struct ml666_buffer){ .data = data, .length = length });
+    node_changed(stb, &it->node);
+    // The next one is looked at again, so more than two get merged too
+    ml666_st__d__member_set(&stb->public, 0, next, 0);
+  }
+  return true;
+}
+
+enum compact_step {
+  COMPACT_SHRINK,
+  COMPACT_MEASURE,
+  COMPACT_MOVE,
+};
+
+struct compact {
+  struct ml666_st_builder_default* stb;
+  enum compact_step step;
+  size_t size; // Of the data to be moved into the slab
+  struct ml666_st_block* slab;
+  char* next;
+};
+
+static bool compact_buffer(struct compact* c, struct ml666_buffer* buffer, char* inline_data, const struct ml666_st_block* block){
+  struct ml666_st_builder_default* stb = c->stb;
+  struct ml666_st_block* slab = buffer_slab(buffer, inline_data);
+  if(!slab && !buffer_is_separate(buffer, inline_data, block))
+    return true;
+  switch(c->step){
+    case COMPACT_SHRINK: {
+      // How much was allocated for it isn't known, so it's always copied
+      if(slab)
+        return true;
+      char* data = stb->a.malloc(stb->public.user_ptr, buffer->length);
+      if(!data){
+        perror("malloc failed");
+        return false;
+      }
+      memcpy(data, buffer->data, buffer->length);
+      stb->a.free(stb->public.user_ptr, buffer->data);
+      buffer->data = data;
+    } break;
+    case COMPACT_MEASURE: {
+      c->size += buffer->length;
+    } break;
+    case COMPACT_MOVE: {
+      memcpy(c->next, buffer->data, buffer->length);
+      if(slab){
+        block_put(stb, slab);
+      }else{
+        builder_free(stb, buffer->data, buffer->length);
+      }
+      buffer->data = c->next;
+      c->next += buffer->length;
+      buffer_slab_set(inline_data, c->slab);
+      block_ref(stb, c->slab);
+    } break;
+  }
+  return true;
+}
+
+static bool compact_buffers(struct compact* c, struct ml666_st_node* node){
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(node);
+  while(cursor_walk(c->stb, &cursor, false)){
+    if(cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    struct ml666_st_node* it = cursor.node;
+    switch(it->type){
+      case ML666_ST_NT_DOCUMENT: break;
+      case ML666_ST_NT_ELEMENT: {
+        // Going through the list directly doesn't load the element
+        struct ml666_st_element* element = (struct ml666_st_element*)it;
+        for(struct ml666_st_attribute* attribute=ml666__container_of(element->attribute_list.first, struct ml666_st_attribute, entry); attribute; attribute=ml666_st__d__attribute_get_next(&c->stb->public, attribute))
+          if(attribute->has_value && !compact_buffer(c, &attribute->value, attribute->inline_value, block_of(attribute, attribute->block)))
+            return false;
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        struct ml666_st_content* content = (struct ml666_st_content*)it;
+        if(!compact_buffer(c, &content->buffer, content->inline_buffer, block_of(content, it->block)))
+          return false;
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        struct ml666_st_comment* comment = (struct ml666_st_comment*)it;
+        if(!compact_buffer(c, &comment->buffer, comment->inline_buffer, block_of(comment, it->block)))
+          return false;
+      } break;
+    }
+  }
+  return true;
+}
+
+bool ml666_st_compact_p(struct ml666_st_compact_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_compact_p: mandatory argument \"stb\" not set!\n");
+    return false;
+  }
+  if(!args.node){
+    fprintf(stderr, "ml666_st_compact_p: mandatory argument \"node\" not set!\n");
+    return false;
+  }
+  if(args.stb->cb != &ml666_default_st_api)
+    return false;
+  struct ml666_st_builder_default* stb = (struct ml666_st_builder_default*)args.stb;
+  // The children of a node are merged before the cursor gets to them
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(args.node);
+  while(cursor_walk(stb, &cursor, false)){
+    if(cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    struct ml666_st_children* children = 0;
+    if(cursor.node->type == ML666_ST_NT_DOCUMENT){
+      children = &((struct ml666_st_document*)cursor.node)->children;
+    }else if(cursor.node->type == ML666_ST_NT_ELEMENT){
+      children = &((struct ml666_st_element*)cursor.node)->children;
+    }
+    if(children && !compact_children(stb, children))
+      return false;
+  }
+  struct compact c = {
+    .stb = stb,
+    .step = args.slab ? COMPACT_MEASURE : COMPACT_SHRINK,
+  };
+  if(!compact_buffers(&c, args.node))
+    return false;
+  if(!args.slab || !c.size)
+    return true;
+  const size_t header = BLOCK_ROUND(sizeof(struct ml666_st_block));
+  c.slab = builder_malloc(stb, header + c.size);
+  if(!c.slab){
+    perror("malloc failed");
+    return false;
+  }
+  memset(c.slab, 0, sizeof(*c.slab));
+  c.slab->size = header + c.size;
+  block_ref(stb, c.slab); // Until everything has been moved
+  c.next = (char*)c.slab + header;
+  c.step = COMPACT_MOVE;
+  compact_buffers(&c, args.node);
+  block_put(stb, c.slab);
+  return true;
+}
@@ -0,0 +1,129 @@
+#include <ml666/simple-tree-clone.h>
+#include <ml666/utils.h>
+#include <string.h>
+#include <stdio.h>
+
+static bool text_copy(const struct ml666_st_clone_args* a, struct ml666_st_node* copy, struct ml666_buffer_ro value){
+  struct ml666_buffer buffer;
+  if(!ml666_buffer__dup(&buffer, value, a->user_ptr, a->malloc))
+    return false;
+  bool ok;
+  if(ML666_ST_TYPE(copy) == ML666_ST_NT_CONTENT){
+    ok = ml666_st_content_set(a->target, (struct ml666_st_content*)copy, buffer);
+  }else{
+    ok = ml666_st_comment_set(a->target, (struct ml666_st_comment*)copy, buffer);
+  }
+  if(!ok && buffer.data)
+    a->free(a->user_ptr, buffer.data);
+  return ok;
+}
+
+static bool attributes_copy(const struct ml666_st_clone_args* a, struct ml666_st_element* element, struct ml666_st_element* copy){
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(a->stb, element); it; it=ml666_st_attribute_get_next(a->stb, it)){
+    struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(a->target, copy, ml666_st_attribute_get_name(a->stb, it), ML666_ST_AOF_CREATE);
+    if(!attribute)
+      return false;
+    const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(a->stb, it);
+    if(!value)
+      continue;
+    struct ml666_buffer buffer;
+    if(!ml666_buffer__dup(&buffer, *value, a->user_ptr, a->malloc))
+      return false;
+    if(!ml666_st_attribute_set_value(a->target, attribute, &buffer)){
+      if(buffer.data)
+        a->free(a->user_ptr, buffer.data);
+      return false;
+    }
+  }
+  return true;
+}
+
+// A copy of the node itself, without its children
+static struct ml666_st_node* node_copy(const struct ml666_st_clone_args* a, struct ml666_st_node* node){
+  struct ml666_st_node* copy = 0;
+  bool ok = false;
+  switch(ML666_ST_TYPE(node)){
+    case ML666_ST_NT_DOCUMENT: {
+      copy = ML666_ST_NODE(ml666_st_document_create(a->target));
+      ok = copy;
+    } break;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      struct ml666_st_element* result = ml666_st_element_create(a->target, ml666_hashed_buffer_set__peek(ml666_st_element_get_name(a->stb, element)), true);
+      copy = ML666_ST_NODE(result);
+      ok = result && attributes_copy(a, element, result);
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      copy = ML666_ST_NODE(ml666_st_content_create(a->target));
+      ok = copy && text_copy(a, copy, ml666_st_content_get(a->stb, (struct ml666_st_content*)node));
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      copy = ML666_ST_NODE(ml666_st_comment_create(a->target));
+      ok = copy && text_copy(a, copy, ml666_st_comment_get(a->stb, (struct ml666_st_comment*)node));
+    } break;
+  }
+  if(!ok && copy){
+    ml666_st_node_put(a->target, copy);
+    copy = 0;
+  }
+  return copy;
+}
+
+struct ml666_st_node* ml666_st_clone_p(struct ml666_st_clone_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_clone_p: mandatory argument \"stb\" not set!\n");
+    return 0;
+  }
+  if(!args.node){
+    fprintf(stderr, "ml666_st_clone_p: mandatory argument \"node\" not set!\n");
+    return 0;
+  }
+  if(!args.target)
+    args.target = args.stb;
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_st_builder* stb = args.target;
+  struct ml666_st_node* root = 0;
+  struct ml666_st_node* parent = 0;
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(args.node);
+  while(ml666_st_cursor_next(args.stb, &cursor)){
+    const enum ml666_st_node_type type = ML666_ST_TYPE(cursor.node);
+    const bool has_children = type == ML666_ST_NT_DOCUMENT || type == ML666_ST_NT_ELEMENT;
+    if(cursor.event == ML666_ST_CE_LEAVE){
+      if(has_children && parent != root)
+        parent = ml666_st_member_get_parent(stb, (struct ml666_st_member*)parent);
+      continue;
+    }
+    if(cursor.event != ML666_ST_CE_ENTER)
+      continue;
+    struct ml666_st_node* copy = node_copy(&args, cursor.node);
+    if(!copy)
+      goto error;
+    if(!root){
+      // The caller gets the reference from creating it
+      root = copy;
+    }else{
+      const bool added = ml666_st_member_set(stb, parent, (struct ml666_st_member*)copy, 0);
+      ml666_st_node_put(stb, copy);
+      if(!added)
+        goto error;
+    }
+    if(has_children)
+      parent = copy;
+  }
+  if(cursor.error){
+    fprintf(stderr, "ml666_st_clone_p: not all of the subtree could be loaded\n");
+    goto error;
+  }
+  return root;
+error:
+  if(root){
+    struct ml666_st_children* children = ml666_st_node_get_children(stb, root);
+    if(children)
+      ml666_st_subtree_disintegrate(stb, children);
+    ml666_st_node_put(stb, root);
+  }
+  return 0;
+}
@@ -0,0 +1,488 @@
+#include <ml666/simple-tree-diff.h>
+#include <ml666/simple-tree-clone.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/utils.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+struct edit_script {
+  struct ml666_st_edit_script public;
+  struct ml666_st_diff_args a;
+  struct ml666_st_edit* edit;
+  size_t* edit_path; // Offsets into path, the pointers are only set once it's done growing
+  size_t edit_capacity;
+  size_t* path;
+  size_t path_count, path_capacity;
+};
+static_assert(offsetof(struct edit_script, public) == 0, "edit_script::public must be the first member");
+
+// A pair of nodes which differ, and whose children still need to be compared
+struct pending {
+  struct ml666_st_node *from, *to;
+  size_t path, depth;
+};
+
+struct child {
+  struct ml666_st_member* member;
+  uint64_t hash; // 0 if it isn't known
+  size_t match;  // For the new children, the old one it corresponds to, or SIZE_MAX
+  bool used;     // For the old children, whether a new one corresponds to it
+  bool modified; // For the new children, whether it differs from the one it corresponds to
+};
+
+struct hash_index {
+  uint64_t hash;
+  size_t index;
+};
+
+struct differ {
+  struct edit_script* script;
+  struct pending* pending;
+  size_t pending_count, pending_capacity;
+  struct child *from, *to;
+  struct hash_index* by_hash;
+  size_t* order;
+  size_t from_capacity, to_capacity, by_hash_capacity, order_capacity;
+};
+
+// Makes room for at least needed entries, keeping the first count of them
+static bool reserve(const struct ml666_st_diff_args* a, void* array, size_t* capacity, size_t count, size_t needed, size_t size){
+  if(needed <= *capacity)
+    return true;
+  size_t new_capacity = *capacity ? *capacity : 16;
+  while(new_capacity < needed)
+    new_capacity *= 2;
+  void* result = a->malloc(a->user_ptr, new_capacity * size);
+  if(!result){
+    perror("malloc failed");
+    return false;
+  }
+  void** old = array;
+  if(*old){
+    memcpy(result, *old, count * size);
+    a->free(a->user_ptr, *old);
+  }
+  *old = result;
+  *capacity = new_capacity;
+  return true;
+}
+
+// Appends the path of the parent followed by index. \returns the offset of the new path, or SIZE_MAX on failure.
+static size_t path_add(struct edit_script* script, size_t parent, size_t depth, size_t index){
+  if(!reserve(&script->a, &script->path, &script->path_capacity, script->path_count, script->path_count + depth + 1, sizeof(*script->path)))
+    return SIZE_MAX;
+  const size_t result = script->path_count;
+  if(depth)
+    memcpy(script->path + result, script->path + parent, depth * sizeof(*script->path));
+  script->path[result + depth] = index;
+  script->path_count += depth + 1;
+  return result;
+}
+
+static bool edit_add(struct edit_script* script, struct ml666_st_edit edit, size_t path, size_t depth){
+  if(path == SIZE_MAX)
+    return false;
+  const size_t count = script->public.count;
+  size_t capacity = script->edit_capacity;
+  if(!reserve(&script->a, &script->edit, &capacity, count, count + 1, sizeof(*script->edit)))
+    return false;
+  if(!reserve(&script->a, &script->edit_path, &script->edit_capacity, count, count + 1, sizeof(*script->edit_path)))
+    return false;
+  edit.depth = depth;
+  script->edit[script->public.count] = edit;
+  script->edit_path[script->public.count] = path;
+  script->public.count += 1;
+  return true;
+}
+
+static bool pending_add(struct differ* differ, struct ml666_st_node* from, struct ml666_st_node* to, size_t path, size_t depth){
+  if(path == SIZE_MAX)
+    return false;
+  if(!reserve(&differ->script->a, &differ->pending, &differ->pending_capacity, differ->pending_count, differ->pending_count + 1, sizeof(*differ->pending)))
+    return false;
+  differ->pending[differ->pending_count++] = (struct pending){ .from = from, .to = to, .path = path, .depth = depth };
+  return true;
+}
+
+static bool name_equal(const struct ml666_hashed_buffer* a, const struct ml666_hashed_buffer* b){
+  return a == b || (a->hash == b->hash && ml666_buffer__equal(a->buffer, b->buffer));
+}
+
+// Whether the nodes can be changed into one another, rather than being replaced
+static bool same_kind(struct ml666_st_builder* stb, struct ml666_st_node* a, struct ml666_st_node* b){
+  const enum ml666_st_node_type type = ML666_ST_TYPE(a);
+  if(type != ML666_ST_TYPE(b))
+    return false;
+  if(type != ML666_ST_NT_ELEMENT)
+    return true;
+  return name_equal(
+    ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, (struct ml666_st_element*)a)),
+    ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, (struct ml666_st_element*)b))
+  );
+}
+
+static bool value_equal(const struct ml666_buffer_ro* a, const struct ml666_buffer_ro* b){
+  if(!a || !b)
+    return a == b;
+  return ml666_buffer__equal(*a, *b);
+}
+
+static int hash_index_compare(const void* a, const void* b){
+  const struct hash_index *x=a, *y=b;
+  if(x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static struct ml666_buffer_ro text_get(struct ml666_st_builder* stb, struct ml666_st_node* node){
+  if(ML666_ST_TYPE(node) == ML666_ST_NT_CONTENT)
+    return ml666_st_content_get(stb, (struct ml666_st_content*)node);
+  return ml666_st_comment_get(stb, (struct ml666_st_comment*)node);
+}
+
+static bool diff_attributes(struct differ* differ, const struct pending* item){
+  struct edit_script* script = differ->script;
+  struct ml666_st_builder* stb = script->a.stb;
+  struct ml666_st_element* from = (struct ml666_st_element*)item->from;
+  struct ml666_st_element* to = (struct ml666_st_element*)item->to;
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, to); it; it=ml666_st_attribute_get_next(stb, it)){
+    const struct ml666_hashed_buffer* name = ml666_st_attribute_get_name(stb, it);
+    const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(stb, it);
+    struct ml666_st_attribute* old = ml666_st_attribute_lookup(stb, from, name, 0);
+    if(old && value_equal(ml666_st_attribute_get_value(stb, old), value))
+      continue;
+    const struct ml666_st_edit edit = {
+      .type = ML666_ST_ET_SET_ATTRIBUTE,
+      .name = name,
+      .value = value ? *value : (struct ml666_buffer_ro){0},
+      .has_value = !!value,
+    };
+    if(!edit_add(script, edit, item->path, item->depth))
+      return false;
+  }
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, from); it; it=ml666_st_attribute_get_next(stb, it)){
+    const struct ml666_hashed_buffer* name = ml666_st_attribute_get_name(stb, it);
+    if(ml666_st_attribute_lookup(stb, to, name, 0))
+      continue;
+    if(!edit_add(script, (struct ml666_st_edit){ .type = ML666_ST_ET_REMOVE_ATTRIBUTE, .name = name }, item->path, item->depth))
+      return false;
+  }
+  return true;
+}
+
+static size_t children_get(struct differ* differ, struct child** result, size_t* capacity, struct ml666_st_node* node){
+  struct ml666_st_builder* stb = differ->script->a.stb;
+  size_t count = 0;
+  struct ml666_st_children* children = ml666_st_node_get_children(stb, node);
+  if(!children){
+    fprintf(stderr, "ml666_st_diff_p: the children of an element couldn't be loaded\n");
+    return SIZE_MAX;
+  }
+  for(struct ml666_st_member* it=ml666_st_get_first_child(stb, children); it; it=ml666_st_member_get_next(stb, it)){
+    if(!reserve(&differ->script->a, result, capacity, count, count + 1, sizeof(**result)))
+      return SIZE_MAX;
+    (*result)[count++] = (struct child){
+      .member = it,
+      .hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(it)),
+      .match = SIZE_MAX,
+    };
+  }
+  return count;
+}
+
+static bool diff_children(struct differ* differ, const struct pending* item){
+  struct edit_script* script = differ->script;
+  struct ml666_st_builder* stb = script->a.stb;
+  const size_t n = children_get(differ, &differ->from, &differ->from_capacity, item->from);
+  if(n == SIZE_MAX)
+    return false;
+  const size_t m = children_get(differ, &differ->to, &differ->to_capacity, item->to);
+  if(m == SIZE_MAX)
+    return false;
+  if( !reserve(&script->a, &differ->by_hash, &differ->by_hash_capacity, 0, n, sizeof(*differ->by_hash))
+   || !reserve(&script->a, &differ->order, &differ->order_capacity, 0, n + m, sizeof(*differ->order))
+  ) return false;
+  struct child *from = differ->from, *to = differ->to;
+  // Equal subtrees first
+  for(size_t i=0; i<n; i++)
+    differ->by_hash[i] = (struct hash_index){ .hash = from[i].hash, .index = i };
+  qsort(differ->by_hash, n, sizeof(*differ->by_hash), hash_index_compare);
+  for(size_t j=0; j<m; j++){
+    if(!to[j].hash)
+      continue;
+    size_t low = 0, high = n;
+    while(low < high){
+      const size_t mid = low + (high - low) / 2;
+      if(differ->by_hash[mid].hash < to[j].hash){
+        low = mid + 1;
+      }else{
+        high = mid;
+      }
+    }
+    for(; low<n && differ->by_hash[low].hash == to[j].hash; low++){
+      struct child* candidate = &from[differ->by_hash[low].index];
+      if(candidate->used || !same_kind(stb, ML666_ST_NODE(candidate->member), ML666_ST_NODE(to[j].member)))
+        continue;
+      candidate->used = true;
+      to[j].match = differ->by_hash[low].index;
+      break;
+    }
+  }
+  // Then the remaining ones which can be changed into one another, in order
+  for(size_t j=0, k=0; j<m; j++){
+    if(to[j].match != SIZE_MAX)
+      continue;
+    for(size_t i=k; i<n; i++){
+      if(from[i].used || !same_kind(stb, ML666_ST_NODE(from[i].member), ML666_ST_NODE(to[j].member)))
+        continue;
+      from[i].used = true;
+      to[j].match = i;
+      to[j].modified = true;
+      k = i + 1;
+      break;
+    }
+  }
+  // Remove the rest, from the back, so the positions of the ones before stay the same
+  for(size_t i=n; i--; )
+    if(!from[i].used)
+      if(!edit_add(script, (struct ml666_st_edit){ .type = ML666_ST_ET_REMOVE }, path_add(script, item->path, item->depth, i), item->depth + 1))
+        return false;
+  // Then put everything where it belongs, front to back. order tracks which old child is where now.
+  size_t* order = differ->order;
+  size_t count = 0;
+  for(size_t i=0; i<n; i++)
+    if(from[i].used)
+      order[count++] = i;
+  for(size_t j=0; j<m; j++){
+    const size_t path = path_add(script, item->path, item->depth, j);
+    if(to[j].match == SIZE_MAX){
+      if(!edit_add(script, (struct ml666_st_edit){ .type = ML666_ST_ET_INSERT, .node = ML666_ST_NODE(to[j].member) }, path, item->depth + 1))
+        return false;
+      memmove(order + j + 1, order + j, (count - j) * sizeof(*order));
+      order[j] = SIZE_MAX;
+      count += 1;
+      continue;
+    }
+    size_t k = j;
+    while(order[k] != to[j].match)
+      k++;
+    if(k != j){
+      if(!edit_add(script, (struct ml666_st_edit){ .type = ML666_ST_ET_MOVE, .from = k }, path, item->depth + 1))
+        return false;
+      memmove(order + j + 1, order + j, (k - j) * sizeof(*order));
+      order[j] = to[j].match;
+    }
+    if(to[j].modified)
+      if(!pending_add(differ, ML666_ST_NODE(from[to[j].match].member), ML666_ST_NODE(to[j].member), path, item->depth + 1))
+        return false;
+  }
+  return true;
+}
+
+static bool diff_node(struct differ* differ, const struct pending* item){
+  struct edit_script* script = differ->script;
+  struct ml666_st_builder* stb = script->a.stb;
+  const uint64_t hash = ml666_st_node_get_hash(stb, item->from);
+  if(hash && hash == ml666_st_node_get_hash(stb, item->to))
+    return true;
+  switch(ML666_ST_TYPE(item->from)){
+    case ML666_ST_NT_CONTENT:
+    case ML666_ST_NT_COMMENT: {
+      const struct ml666_buffer_ro value = text_get(stb, item->to);
+      if(ml666_buffer__equal(text_get(stb, item->from), value))
+        return true;
+      return edit_add(script, (struct ml666_st_edit){ .type = ML666_ST_ET_SET_CONTENT, .value = value, .has_value = true }, item->path, item->depth);
+    }
+    case ML666_ST_NT_ELEMENT: {
+      if(!diff_attributes(differ, item))
+        return false;
+    } break;
+    case ML666_ST_NT_DOCUMENT: break;
+  }
+  return diff_children(differ, item);
+}
+
+struct ml666_st_edit_script* ml666_st_diff_p(struct ml666_st_diff_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_diff_p: mandatory argument \"stb\" not set!\n");
+    return 0;
+  }
+  if(!args.from || !args.to){
+    fprintf(stderr, "ml666_st_diff_p: mandatory argument \"from\" or \"to\" not set!\n");
+    return 0;
+  }
+  if(!same_kind(args.stb, args.from, args.to)){
+    fprintf(stderr, "ml666_st_diff_p: the roots of the trees must be of the same kind\n");
+    return 0;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct edit_script* script = args.malloc(args.user_ptr, sizeof(*script));
+  if(!script){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(script, 0, sizeof(*script));
+  script->a = args;
+  struct differ differ = { .script = script };
+  bool ok = pending_add(&differ, args.from, args.to, 0, 0);
+  while(ok && differ.pending_count){
+    const struct pending item = differ.pending[--differ.pending_count];
+    ok = diff_node(&differ, &item);
+  }
+  if(differ.pending)
+    args.free(args.user_ptr, differ.pending);
+  if(differ.from)
+    args.free(args.user_ptr, differ.from);
+  if(differ.to)
+    args.free(args.user_ptr, differ.to);
+  if(differ.by_hash)
+    args.free(args.user_ptr, differ.by_hash);
+  if(differ.order)
+    args.free(args.user_ptr, differ.order);
+  if(!ok){
+    ml666_st_edit_script_destroy(&script->public);
+    return 0;
+  }
+  // The paths don't move anymore now
+  for(size_t i=0; i<script->public.count; i++)
+    script->edit[i].path = script->path ? script->path + script->edit_path[i] : 0;
+  script->public.edit = script->edit;
+  return &script->public;
+}
+
+void ml666_st_edit_script_destroy(struct ml666_st_edit_script* _script){
+  struct edit_script* script = (struct edit_script*)_script;
+  if(script->edit)
+    script->a.free(script->a.user_ptr, script->edit);
+  if(script->edit_path)
+    script->a.free(script->a.user_ptr, script->edit_path);
+  if(script->path)
+    script->a.free(script->a.user_ptr, script->path);
+  script->a.free(script->a.user_ptr, script);
+}
+
+static struct ml666_st_member* child_at(struct ml666_st_builder* stb, struct ml666_st_node* node, size_t index){
+  return ml666_st_child_at(stb, ml666_st_node_get_children(stb, node), index);
+}
+
+static struct ml666_st_node* path_resolve(struct ml666_st_builder* stb, struct ml666_st_node* node, const size_t* path, size_t depth){
+  for(size_t i=0; node && i<depth; i++)
+    node = ML666_ST_NODE(child_at(stb, node, path[i]));
+  return node;
+}
+
+static void member_remove(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  struct ml666_st_children* children = ml666_st_node_get_children(stb, ML666_ST_NODE(member));
+  if(children)
+    ml666_st_subtree_disintegrate(stb, children);
+  ml666_st_member_set(stb, 0, member, 0);
+}
+
+// Copies the subtree of node from the new tree of the script, and inserts it before "before"
+static bool subtree_insert(struct ml666_st_builder* stb, const struct edit_script* script, struct ml666_st_node* node, struct ml666_st_node* parent, struct ml666_st_member* before){
+  struct ml666_st_node* copy = ml666_st_clone(
+    .stb = script->a.stb,
+    .node = node,
+    .target = stb,
+    .user_ptr = script->a.user_ptr,
+    .malloc = script->a.malloc,
+    .free = script->a.free,
+  );
+  if(!copy)
+    return false;
+  const bool added = ml666_st_member_set(stb, parent, (struct ml666_st_member*)copy, before);
+  if(!added)
+    member_remove(stb, (struct ml666_st_member*)copy);
+  ml666_st_node_put(stb, copy);
+  return added;
+}
+
+bool ml666_st_patch(struct ml666_st_builder* stb, struct ml666_st_node* root, const struct ml666_st_edit_script* _script){
+  const struct edit_script* script = (const struct edit_script*)_script;
+  for(size_t i=0; i<script->public.count; i++){
+    const struct ml666_st_edit* edit = &script->public.edit[i];
+    bool ok = false;
+    switch(edit->type){
+      case ML666_ST_ET_REMOVE: {
+        struct ml666_st_node* node = edit->depth ? path_resolve(stb, root, edit->path, edit->depth) : 0;
+        if(!node)
+          break;
+        member_remove(stb, (struct ml666_st_member*)node);
+        ok = true;
+      } break;
+      case ML666_ST_ET_INSERT: {
+        struct ml666_st_node* parent = edit->depth ? path_resolve(stb, root, edit->path, edit->depth-1) : 0;
+        if(!parent || !ml666_st_node_get_children(stb, parent))
+          break;
+        struct ml666_st_member* before = child_at(stb, parent, edit->path[edit->depth-1]);
+        ok = subtree_insert(stb, script, edit->node, parent, before);
+      } break;
+      case ML666_ST_ET_MOVE: {
+        struct ml666_st_node* parent = edit->depth ? path_resolve(stb, root, edit->path, edit->depth-1) : 0;
+        if(!parent)
+          break;
+        struct ml666_st_member* before = child_at(stb, parent, edit->path[edit->depth-1]);
+        struct ml666_st_member* member = child_at(stb, parent, edit->from);
+        if(!before || !member)
+          break;
+        ok = ml666_st_member_set(stb, parent, member, before);
+      } break;
+      case ML666_ST_ET_SET_ATTRIBUTE: {
+        struct ml666_st_node* node = path_resolve(stb, root, edit->path, edit->depth);
+        if(!node || ML666_ST_TYPE(node) != ML666_ST_NT_ELEMENT)
+          break;
+        struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, (struct ml666_st_element*)node, edit->name, ML666_ST_AOF_CREATE);
+        if(!attribute)
+          break;
+        if(!edit->has_value){
+          ok = ml666_st_attribute_set_value(stb, attribute, 0);
+          break;
+        }
+        struct ml666_buffer buffer;
+        if(!ml666_buffer__dup(&buffer, edit->value, script->a.user_ptr, script->a.malloc))
+          break;
+        ok = ml666_st_attribute_set_value(stb, attribute, &buffer);
+        if(!ok)
+          script->a.free(script->a.user_ptr, buffer.data);
+      } break;
+      case ML666_ST_ET_REMOVE_ATTRIBUTE: {
+        struct ml666_st_node* node = path_resolve(stb, root, edit->path, edit->depth);
+        if(!node || ML666_ST_TYPE(node) != ML666_ST_NT_ELEMENT)
+          break;
+        struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, (struct ml666_st_element*)node, edit->name, 0);
+        if(!attribute)
+          break;
+        ml666_st_attribute_remove(stb, attribute);
+        ok = true;
+      } break;
+      case ML666_ST_ET_SET_CONTENT: {
+        struct ml666_st_node* node = path_resolve(stb, root, edit->path, edit->depth);
+        if(!node)
+          break;
+        const enum ml666_st_node_type type = ML666_ST_TYPE(node);
+        if(type != ML666_ST_NT_CONTENT && type != ML666_ST_NT_COMMENT)
+          break;
+        struct ml666_buffer buffer;
+        if(!ml666_buffer__dup(&buffer, edit->value, script->a.user_ptr, script->a.malloc))
+          break;
+        if(type == ML666_ST_NT_CONTENT){
+          ok = ml666_st_content_set(stb, (struct ml666_st_content*)node, buffer);
+        }else{
+          ok = ml666_st_comment_set(stb, (struct ml666_st_comment*)node, buffer);
+        }
+        if(!ok)
+          script->a.free(script->a.user_ptr, buffer.data);
+      } break;
+    }
+    if(!ok){
+      fprintf(stderr, "ml666_st_patch: edit %zu couldn't be applied\n", i);
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,583 @@
+#include <ml666/simple-tree-frozen.h>
+#include <ml666/refcount.h>
+#include <ml666/utils.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+// A node is just its entry in the node table, everything else is in the columns of the document
+struct ml666_st_node {
+  enum ml666_st_node_type type;
+  uint32_t index;
+};
+
+struct ml666_st_attribute {
+  struct ml666_buffer_ro value;
+  const struct ml666_hashed_buffer* name;
+  bool has_value;
+  bool last; // The last attribute of its element
+};
+
+// All of this is a single allocation. The columns follow the node table.
+struct frozen_document {
+  struct ml666_refcount refcount;
+  uint32_t node_count;
+  uint32_t* parent;
+  uint32_t* previous; // 0 if there is none, the document can't be a sibling
+  uint32_t* size; // The number of nodes in the subtree, including the node itself
+  uint32_t* data; // The name of an element, or the text of a content or comment node
+  uint32_t* attribute; // The first attribute. The ones of a node end where the ones of the next node begin.
+  struct ml666_st_attribute* attribute_list;
+  struct ml666_hashed_buffer* name_list;
+  struct ml666_buffer_ro* text_list;
+  struct ml666_st_node node[];
+};
+
+struct ml666_st_builder_frozen {
+  struct ml666_st_builder public;
+  struct ml666_st_frozen_builder_create_args a;
+};
+static_assert(offsetof(struct ml666_st_builder_frozen, public) == 0, "ml666_st_builder_frozen::public must be the first member");
+
+static struct frozen_document* node_get_document(const struct ml666_st_node* node){
+  return (struct frozen_document*)((char*)(node - node->index) - offsetof(struct frozen_document, node));
+}
+
+static void read_only(const char* function){
+  fprintf(stderr, "%s failed: frozen documents are read-only\n", function);
+}
+
+void ml666_st__f__node_put(struct ml666_st_builder* _stb, struct ml666_st_node* node){
+  struct ml666_st_builder_frozen* stb = (struct ml666_st_builder_frozen*)_stb;
+  struct frozen_document* document = node_get_document(node);
+  if(ml666_refcount_decrement(&document->refcount))
+    return;
+  stb->a.free(stb->public.user_ptr, document);
+}
+
+void ml666_st__f__node_ref(struct ml666_st_builder* stb, struct ml666_st_node* node){
+  (void)stb;
+  ml666_refcount_increment(&node_get_document(node)->refcount);
+}
+
+bool ml666_st__f__member_set(
+  struct ml666_st_builder* stb,
+  struct ml666_st_node* parent,
+  struct ml666_st_member* member,
+  struct ml666_st_member* before
+){
+  (void)stb;
+  (void)parent;
+  (void)member;
+  (void)before;
+  read_only(__func__);
+  return false;
+}
+
+struct ml666_st_document* ml666_st__f__document_create(struct ml666_st_builder* stb){
+  (void)stb;
+  fprintf(stderr, "%s failed: use ml666_st_freeze to create frozen documents\n", __func__);
+  return 0;
+}
+
+struct ml666_st_element* ml666_st__f__element_create(struct ml666_st_builder* stb, const struct ml666_hashed_buffer* entry, bool copy_name){
+  (void)stb;
+  (void)entry;
+  (void)copy_name;
+  read_only(__func__);
+  return 0;
+}
+
+struct ml666_st_content* ml666_st__f__content_create(struct ml666_st_builder* stb){
+  (void)stb;
+  read_only(__func__);
+  return 0;
+}
+
+struct ml666_st_comment* ml666_st__f__comment_create(struct ml666_st_builder* stb){
+  (void)stb;
+  read_only(__func__);
+  return 0;
+}
+
+struct ml666_st_children* ml666_st__f__document_get_children(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  (void)stb;
+  return (struct ml666_st_children*)document;
+}
+
+struct ml666_st_children* ml666_st__f__element_get_children(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  return (struct ml666_st_children*)element;
+}
+
+struct ml666_st_node* ml666_st__f__member_get_parent(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)member;
+  struct frozen_document* document = node_get_document(node);
+  return &document->node[document->parent[node->index]];
+}
+
+struct ml666_st_member* ml666_st__f__member_get_previous(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)member;
+  struct frozen_document* document = node_get_document(node);
+  uint32_t previous = document->previous[node->index];
+  if(!previous)
+    return 0;
+  return (struct ml666_st_member*)&document->node[previous];
+}
+
+struct ml666_st_member* ml666_st__f__member_get_next(struct ml666_st_builder* stb, struct ml666_st_member* member){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)member;
+  struct frozen_document* document = node_get_document(node);
+  uint32_t next = node->index + document->size[node->index];
+  uint32_t parent = document->parent[node->index];
+  if(next >= parent + document->size[parent])
+    return 0;
+  return (struct ml666_st_member*)&document->node[next];
+}
+
+const struct ml666_hashed_buffer_set_entry* ml666_st__f__element_get_name(struct ml666_st_builder* stb, struct ml666_st_element* element){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)element;
+  struct frozen_document* document = node_get_document(node);
+  // An ml666_hashed_buffer_set_entry only needs to start with an ml666_hashed_buffer
+  return (const struct ml666_hashed_buffer_set_entry*)&document->name_list[document->data[node->index]];
+}
+
+static struct ml666_buffer_ro text_get(const struct ml666_st_node* node){
+  struct frozen_document* document = node_get_document(node);
+  return document->text_list[document->data[node->index]];
+}
+
+bool ml666_st__f__content_set(struct ml666_st_builder* stb, struct ml666_st_content* content, struct ml666_buffer buffer){
+  (void)stb;
+  (void)content;
+  (void)buffer;
+  read_only(__func__);
+  return false;
+}
+
+struct ml666_buffer_ro ml666_st__f__content_get(struct ml666_st_builder* stb, const struct ml666_st_content* content){
+  (void)stb;
+  return text_get((const struct ml666_st_node*)content);
+}
+
+struct ml666_buffer ml666_st__f__content_take(struct ml666_st_builder* stb, struct ml666_st_content* content){
+  (void)stb;
+  (void)content;
+  read_only(__func__);
+  return (struct ml666_buffer){0};
+}
+
+bool ml666_st__f__comment_set(struct ml666_st_builder* stb, struct ml666_st_comment* comment, struct ml666_buffer buffer){
+  (void)stb;
+  (void)comment;
+  (void)buffer;
+  read_only(__func__);
+  return false;
+}
+
+struct ml666_buffer_ro ml666_st__f__comment_get(struct ml666_st_builder* stb, const struct ml666_st_comment* comment){
+  (void)stb;
+  return text_get((const struct ml666_st_node*)comment);
+}
+
+struct ml666_buffer ml666_st__f__comment_take(struct ml666_st_builder* stb, struct ml666_st_comment* comment){
+  (void)stb;
+  (void)comment;
+  read_only(__func__);
+  return (struct ml666_buffer){0};
+}
+
+struct ml666_st_member* ml666_st__f__get_first_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)children;
+  struct frozen_document* document = node_get_document(node);
+  if(document->size[node->index] <= 1)
+    return 0;
+  return (struct ml666_st_member*)&document->node[node->index+1];
+}
+
+struct ml666_st_member* ml666_st__f__get_last_child(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  struct ml666_st_member* last = ml666_st__f__get_first_child(stb, children);
+  if(!last)
+    return 0;
+  for(struct ml666_st_member* it; (it=ml666_st__f__member_get_next(stb, last)); last=it);
+  return last;
+}
+
+struct ml666_st_attribute* ml666_st__f__attribute_get_first(const struct ml666_st_builder* stb, const struct ml666_st_element* element){
+  (void)stb;
+  const struct ml666_st_node* node = (const struct ml666_st_node*)element;
+  struct frozen_document* document = node_get_document(node);
+  uint32_t first = document->attribute[node->index];
+  if(first == document->attribute[node->index+1])
+    return 0;
+  return &document->attribute_list[first];
+}
+
+struct ml666_st_attribute* ml666_st__f__attribute_get_next(const struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  if(attribute->last)
+    return 0;
+  return (struct ml666_st_attribute*)attribute + 1;
+}
+
+struct ml666_st_attribute* ml666_st__f__attribute_lookup(struct ml666_st_builder* stb, struct ml666_st_element* element, const struct ml666_hashed_buffer* name, enum ml666_st_attribute_lookup_flags flags){
+  struct ml666_st_attribute* attribute = ml666_st__f__attribute_get_first(stb, element);
+  for(; attribute; attribute=ml666_st__f__attribute_get_next(stb, attribute))
+    if(attribute->name->hash == name->hash && ml666_buffer__equal(attribute->name->buffer, name->buffer))
+      break;
+  if(attribute){
+    if((flags & ML666_ST_AOF_CREATE_EXCLUSIVE) == ML666_ST_AOF_CREATE_EXCLUSIVE){
+      fprintf(stderr, "ml666_st__f__attribute_lookup failed: attribute already exists\n");
+      return 0;
+    }
+    return attribute;
+  }
+  if(flags & ML666_ST_AOF_CREATE)
+    read_only(__func__);
+  return 0;
+}
+
+void ml666_st__f__attribute_remove(struct ml666_st_builder* stb, struct ml666_st_attribute* attribute){
+  (void)stb;
+  (void)attribute;
+  read_only(__func__);
+}
+
+const struct ml666_hashed_buffer* ml666_st__f__attribute_get_name(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  return attribute->name;
+}
+
+bool ml666_st__f__attribute_set_value(struct ml666_st_builder* stb, struct ml666_st_attribute* attribute, struct ml666_buffer* value){
+  (void)stb;
+  (void)attribute;
+  (void)value;
+  read_only(__func__);
+  return false;
+}
+
+const struct ml666_buffer_ro* ml666_st__f__attribute_get_value(struct ml666_st_builder* stb, const struct ml666_st_attribute* attribute){
+  (void)stb;
+  if(!attribute->has_value)
+    return 0;
+  return &attribute->value;
+}
+
+const struct ml666_buffer* ml666_st__f__attribute_take_value(struct ml666_st_builder* stb, struct ml666_st_attribute* attribute){
+  (void)stb;
+  (void)attribute;
+  read_only(__func__);
+  return 0;
+}
+
+size_t ml666_st__f__child_count(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  return ml666_st_child_count_generic(stb, children);
+}
+
+struct ml666_st_member* ml666_st__f__child_at(struct ml666_st_builder* stb, struct ml666_st_children* children, size_t index){
+  return ml666_st_child_at_generic(stb, children, index);
+}
+
+bool ml666_st__f__cursor_next(struct ml666_st_builder* stb, struct ml666_st_cursor* cursor){
+  return ml666_st_cursor_next_generic(stb, cursor);
+}
+
+// The tree is freed as a whole once the last reference is released, there is nothing to detach
+void ml666_st__f__subtree_disintegrate(struct ml666_st_builder* stb, struct ml666_st_children* children){
+  (void)stb;
+  (void)children;
+}
+
+void ml666_st__f__builder_destroy(struct ml666_st_builder* _stb){
+  struct ml666_st_builder_frozen* stb = (struct ml666_st_builder_frozen*)_stb;
+  stb->a.free(stb->public.user_ptr, stb);
+}
+
+ML666_ST_IMPLEMENTATION_FULL(ml666_frozen, ml666_st__f_)
+
+struct ml666_st_builder* ml666_st_frozen_builder_create_p(struct ml666_st_frozen_builder_create_args args){
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_st_builder_frozen* stb = args.malloc(args.user_ptr, sizeof(*stb));
+  if(!stb){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(stb, 0, sizeof(*stb));
+  *(const struct ml666_st_cb**)&stb->public.cb = &ml666_frozen_st_api;
+  stb->public.user_ptr = args.user_ptr;
+  stb->a = args;
+  return &stb->public;
+}
+
+
+//// Freezing
+
+struct name_slot {
+  const struct ml666_hashed_buffer* name;
+  uint32_t id;
+};
+
+struct freezer {
+  struct ml666_st_builder_frozen* frozen;
+  struct ml666_st_builder* stb;
+  // Counted in the first pass
+  size_t node_count, attribute_count, text_count, byte_count;
+  // Every distinct name gets an ID
+  struct name_slot* name_map;
+  size_t name_mask;
+  uint32_t name_count;
+  // Filled in in the second pass
+  struct frozen_document* document;
+  char* pool;
+  uint32_t parent, previous;
+};
+
+typedef bool freeze_visit(struct freezer* freezer, struct ml666_st_node* node, bool enter);
+
+static bool walk(struct freezer* freezer, struct ml666_st_document* document, freeze_visit* visit){
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(ML666_ST_NODE(document));
+  while(ml666_st_cursor_next(freezer->stb, &cursor))
+    if(!visit(freezer, cursor.node, cursor.event == ML666_ST_CE_ENTER))
+      return false;
+  if(cursor.error)
+    fprintf(stderr, "ml666_st_freeze: not all of the document could be loaded\n");
+  return !cursor.error;
+}
+
+static size_t name_home(const struct freezer* freezer, const struct ml666_hashed_buffer* name){
+  return name->hash & freezer->name_mask;
+}
+
+static struct name_slot* name_find(struct freezer* freezer, const struct ml666_hashed_buffer* name){
+  size_t i = name_home(freezer, name);
+  for(struct name_slot* slot; (slot=&freezer->name_map[i])->name; i=(i+1)&freezer->name_mask){
+    if(slot->name == name)
+      return slot;
+    if(slot->name->hash == name->hash && ml666_buffer__equal(slot->name->buffer, name->buffer))
+      return slot;
+  }
+  return &freezer->name_map[i];
+}
+
+static bool name_add(struct freezer* freezer, const struct ml666_hashed_buffer* name){
+  if((freezer->name_count + 1) * 2 > freezer->name_mask + 1){
+    size_t size = freezer->name_map ? (freezer->name_mask + 1) * 2 : 64;
+    struct name_slot* old_map = freezer->name_map;
+    size_t old_size = old_map ? freezer->name_mask + 1 : 0;
+    struct name_slot* map = freezer->frozen->a.malloc(freezer->frozen->public.user_ptr, size * sizeof(*map));
+    if(!map){
+      perror("malloc failed");
+      return false;
+    }
+    memset(map, 0, size * sizeof(*map));
+    freezer->name_map = map;
+    freezer->name_mask = size - 1;
+    for(size_t i=0; i<old_size; i++)
+      if(old_map[i].name)
+        *name_find(freezer, old_map[i].name) = old_map[i];
+    if(old_map)
+      freezer->frozen->a.free(freezer->frozen->public.user_ptr, old_map);
+  }
+  struct name_slot* slot = name_find(freezer, name);
+  if(slot->name)
+    return true;
+  *slot = (struct name_slot){ .name = name, .id = freezer->name_count++ };
+  freezer->byte_count += name->buffer.length;
+  return true;
+}
+
+static uint32_t name_id(struct freezer* freezer, const struct ml666_hashed_buffer* name){
+  return name_find(freezer, name)->id;
+}
+
+static bool count(struct freezer* freezer, struct ml666_st_node* node, bool enter){
+  if(!enter)
+    return true;
+  struct ml666_st_builder* stb = freezer->stb;
+  if(++freezer->node_count >= UINT32_MAX){
+    fprintf(stderr, "ml666_st_freeze: too many nodes\n");
+    return false;
+  }
+  switch(ML666_ST_TYPE(node)){
+    case ML666_ST_NT_DOCUMENT: break;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      if(!name_add(freezer, ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, element))))
+        return false;
+      for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, element); it; it=ml666_st_attribute_get_next(stb, it)){
+        if(++freezer->attribute_count >= UINT32_MAX){
+          fprintf(stderr, "ml666_st_freeze: too many attributes\n");
+          return false;
+        }
+        if(!name_add(freezer, ml666_st_attribute_get_name(stb, it)))
+          return false;
+        const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(stb, it);
+        if(value)
+          freezer->byte_count += value->length;
+      }
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      freezer->text_count += 1;
+      freezer->byte_count += ml666_st_content_get(stb, (struct ml666_st_content*)node).length;
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      freezer->text_count += 1;
+      freezer->byte_count += ml666_st_comment_get(stb, (struct ml666_st_comment*)node).length;
+    } break;
+  }
+  return true;
+}
+
+static struct ml666_buffer_ro pool_copy(struct freezer* freezer, struct ml666_buffer_ro buffer){
+  char* data = freezer->pool;
+  if(buffer.length)
+    memcpy(data, buffer.data, buffer.length);
+  freezer->pool += buffer.length;
+  return (struct ml666_buffer_ro){ .data = data, .length = buffer.length };
+}
+
+static bool fill(struct freezer* freezer, struct ml666_st_node* node, bool enter){
+  struct ml666_st_builder* stb = freezer->stb;
+  struct frozen_document* document = freezer->document;
+  if(!enter){
+    uint32_t index = freezer->parent;
+    document->size[index] = freezer->node_count - index;
+    freezer->previous = index;
+    freezer->parent = document->parent[index];
+    return true;
+  }
+  uint32_t index = freezer->node_count++;
+  document->node[index] = (struct ml666_st_node){ .type = ML666_ST_TYPE(node), .index = index };
+  document->parent[index] = freezer->parent;
+  document->previous[index] = freezer->previous;
+  document->attribute[index] = freezer->attribute_count;
+  document->data[index] = 0;
+  switch(ML666_ST_TYPE(node)){
+    case ML666_ST_NT_DOCUMENT: break;
+    case ML666_ST_NT_ELEMENT: {
+      struct ml666_st_element* element = (struct ml666_st_element*)node;
+      document->data[index] = name_id(freezer, ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, element)));
+      struct ml666_st_attribute* attribute = 0;
+      for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, element); it; it=ml666_st_attribute_get_next(stb, it)){
+        attribute = &document->attribute_list[freezer->attribute_count++];
+        const struct ml666_buffer_ro* value = ml666_st_attribute_get_value(stb, it);
+        *attribute = (struct ml666_st_attribute){
+          .value = value ? pool_copy(freezer, *value) : (struct ml666_buffer_ro){0},
+          .name = &document->name_list[name_id(freezer, ml666_st_attribute_get_name(stb, it))],
+          .has_value = !!value,
+        };
+      }
+      if(attribute)
+        attribute->last = true;
+    } break;
+    case ML666_ST_NT_CONTENT: {
+      document->data[index] = freezer->text_count;
+      document->text_list[freezer->text_count++] = pool_copy(freezer, ml666_st_content_get(stb, (struct ml666_st_content*)node));
+    } break;
+    case ML666_ST_NT_COMMENT: {
+      document->data[index] = freezer->text_count;
+      document->text_list[freezer->text_count++] = pool_copy(freezer, ml666_st_comment_get(stb, (struct ml666_st_comment*)node));
+    } break;
+  }
+  freezer->parent = index;
+  freezer->previous = 0;
+  return true;
+}
+
+static bool size_add(size_t* size, size_t count, size_t element_size){
+  if(element_size && count > (SIZE_MAX - *size) / element_size)
+    return false;
+  *size += count * element_size;
+  return true;
+}
+
+struct ml666_st_document* ml666_st_freeze(struct ml666_st_builder* _frozen, struct ml666_st_builder* stb, struct ml666_st_document* source){
+  if(_frozen->cb != &ml666_frozen_st_api){
+    fprintf(stderr, "ml666_st_freeze: not a frozen simple tree builder\n");
+    return 0;
+  }
+  struct ml666_st_builder_frozen* frozen = (struct ml666_st_builder_frozen*)_frozen;
+  struct freezer freezer = {
+    .frozen = frozen,
+    .stb = stb,
+  };
+  struct frozen_document* document = 0;
+  if(!walk(&freezer, source, count))
+    goto error;
+
+  // The layout, ordered by alignment. The node table must come first.
+  const size_t n = freezer.node_count;
+  size_t size = sizeof(*document);
+  bool ok = size_add(&size, n, sizeof(*document->node));
+  const size_t attribute_offset = size;
+  ok = ok && size_add(&size, freezer.attribute_count, sizeof(*document->attribute_list));
+  const size_t name_offset = size;
+  ok = ok && size_add(&size, freezer.name_count, sizeof(*document->name_list));
+  const size_t text_offset = size;
+  ok = ok && size_add(&size, freezer.text_count, sizeof(*document->text_list));
+  const size_t column_offset = size;
+  ok = ok && size_add(&size, n * 5 + 1, sizeof(uint32_t));
+  const size_t pool_offset = size;
+  ok = ok && size_add(&size, freezer.byte_count, 1);
+  if(!ok){
+    fprintf(stderr, "ml666_st_freeze: document too big\n");
+    goto error;
+  }
+  document = frozen->a.malloc(frozen->public.user_ptr, size);
+  if(!document){
+    perror("malloc failed");
+    goto error;
+  }
+  char* base = (char*)document;
+  memset(document, 0, sizeof(*document));
+  ml666_refcount_increment(&document->refcount);
+  document->node_count = n;
+  document->attribute_list = (struct ml666_st_attribute*)(base + attribute_offset);
+  document->name_list = (struct ml666_hashed_buffer*)(base + name_offset);
+  document->text_list = (struct ml666_buffer_ro*)(base + text_offset);
+  uint32_t* column = (uint32_t*)(base + column_offset);
+  document->parent    = column + n * 0;
+  document->previous  = column + n * 1;
+  document->size      = column + n * 2;
+  document->data      = column + n * 3;
+  document->attribute = column + n * 4;
+  freezer.pool = base + pool_offset;
+  for(size_t i=0; i<=freezer.name_mask && freezer.name_map; i++){
+    const struct name_slot* slot = &freezer.name_map[i];
+    if(!slot->name)
+      continue;
+    document->name_list[slot->id] = (struct ml666_hashed_buffer){
+      .buffer = pool_copy(&freezer, slot->name->buffer),
+      .hash = slot->name->hash,
+    };
+  }
+
+  freezer.document = document;
+  freezer.node_count = 0;
+  freezer.attribute_count = 0;
+  freezer.text_count = 0;
+  if(!walk(&freezer, source, fill))
+    goto error;
+  document->attribute[n] = freezer.attribute_count;
+
+  if(freezer.name_map)
+    frozen->a.free(frozen->public.user_ptr, freezer.name_map);
+  return (struct ml666_st_document*)&document->node[0];
+
+error:
+  if(document)
+    frozen->a.free(frozen->public.user_ptr, document);
+  if(freezer.name_map)
+    frozen->a.free(frozen->public.user_ptr, freezer.name_map);
+  return 0;
+}
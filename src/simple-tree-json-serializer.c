@@ -8,11 +8,10 @@
 #include <sys/mman.h>
 
 enum serializer_state {
+  SERIALIZER_W_NEXT,
   SERIALIZER_W_START,
   SERIALIZER_W_DONE,
   SERIALIZER_W_FINAL_NEWLINE,
-  SERIALIZER_W_NEXT_CHILD,
-  SERIALIZER_W_NEXT_MEMBER,
   SERIALIZER_W_TAG_START,
   SERIALIZER_W_TAG,
   SERIALIZER_W_ATTRIBUTE_LIST_START,
@@ -48,6 +47,7 @@ struct ml666_st_serializer_private {
   unsigned level, spaces;
   struct ml666_buffer_info buffer_info;
 
+  struct ml666_st_cursor cursor;
   struct ml666_st_node* cur;
   struct ml666_st_attribute* current_attribute;
   enum serializer_state state;
@@ -59,6 +59,9 @@ struct ml666_st_serializer_private {
 
   bool has_attribute, has_children;
 
+  struct ml666_st_serializer_cache* cache;
+  size_t cached; // How much of outptr was passed to the cache already
+
   ml666__cb__malloc* malloc;
   ml666__cb__free*   free;
 };
@@ -128,6 +131,11 @@ struct ml666_st_serializer* ml666_st_json_serializer_create_p(struct ml666_st_js
     munmap(outbuf.data, outbuf.length*2);
     return 0;
   }
+  if(args.cache && !ml666_st_serializer_cache_begin(args.cache, args.stb, &st_serializer_default)){
+    args.free(args.user_ptr, sts);
+    munmap(outbuf.data, outbuf.length*2);
+    return 0;
+  }
   memset(sts, 0, sizeof(*sts));
   *(const struct ml666_st_serializer_cb**)&sts->public.cb = &st_serializer_default;
   *(struct ml666_st_builder**)&sts->public.stb = args.stb;
@@ -136,9 +144,10 @@ struct ml666_st_serializer* ml666_st_json_serializer_create_p(struct ml666_st_js
   sts->outptr.data = outbuf.data;
   sts->fd = args.fd;
   sts->node = args.node;
-  sts->cur = args.node;
+  sts->cursor = ml666_st_cursor_create(args.node);
   sts->malloc = args.malloc;
   sts->free = args.free;
+  sts->cache = args.cache;
   ml666_st_node_ref(sts->public.stb, sts->node);
   return &sts->public;
 }
@@ -295,6 +304,13 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
         }
       }
       if(outptr.length){
+        if(sts->cache){
+          ml666_st_serializer_cache_output(sts->cache, (struct ml666_buffer_ro){
+            .data = outptr.data + sts->cached,
+            .length = outptr.length - sts->cached,
+          });
+          sts->cached = outptr.length;
+        }
         int res = write(sts->fd, outptr.data, outptr.length);
         if(res < 0){
           sts->data = buf;
@@ -302,6 +318,7 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
           sts->public.error = strerror(errno);
           return false;
         }
+        sts->cached -= res;
         outptr.length -= res;
         outptr.data   += res;
         if((size_t)(outptr.data - sts->outbuf.data) > sts->outbuf.length)
@@ -313,49 +330,60 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
     if(!sts->data.length){
       switch(sts->state){
         case SERIALIZER_W_DONE: break;
-        case SERIALIZER_W_START: switch(ML666_ST_TYPE(sts->cur)){
+        case SERIALIZER_W_START: if(sts->cache){
+          if(ml666_st_serializer_cache_enter(sts->cache, sts->cur, sts->level, &sts->data)){
+            // The indentation is part of the cached output
+            sts->spaces = 0;
+            ml666_st_cursor_skip(&sts->cursor);
+            sts->state = SERIALIZER_W_NEXT;
+            break;
+          }
+        } switch(ML666_ST_TYPE(sts->cur)){
           case ML666_ST_NT_DOCUMENT: sts->state = SERIALIZER_W_TAG_START; break;
           case ML666_ST_NT_ELEMENT : sts->state = SERIALIZER_W_TAG_START; break;
           case ML666_ST_NT_CONTENT : sts->state = SERIALIZER_W_CONTENT; break;
           case ML666_ST_NT_COMMENT : sts->state = SERIALIZER_W_COMMENT_START; break;
         } break;
-        case SERIALIZER_W_NEXT_CHILD: {
-          struct ml666_st_children* children = ML666_ST_U_CHILDREN(sts->public.stb, sts->cur);
-          struct ml666_st_member* first_child = children ? ml666_st_get_first_child(sts->public.stb, children) : 0;
-          if(first_child){
-            sts->cur = ML666_ST_NODE(first_child);
-            sts->state = SERIALIZER_W_START;
-          }else{
-            sts->state = SERIALIZER_W_END_CHILDLIST;
-          }
-        } break;
-        case SERIALIZER_W_NEXT_MEMBER: {
-          sts->state = SERIALIZER_W_FINAL_NEWLINE;
-          if(sts->cur == sts->node)
+        case SERIALIZER_W_NEXT: {
+          const enum ml666_st_cursor_event previous = sts->cursor.event;
+          // All the output of the node which was left is out by now
+          if(sts->cache && previous == ML666_ST_CE_LEAVE)
+            ml666_st_serializer_cache_leave(sts->cache, sts->cursor.node);
+          if(!ml666_st_cursor_next(sts->public.stb, &sts->cursor)){
+            if(sts->cursor.error){
+              sts->state = SERIALIZER_W_DONE;
+              sts->public.error = "the children of an element couldn't be loaded";
+              return false;
+            }
+            sts->state = SERIALIZER_W_FINAL_NEWLINE;
             break;
-          struct ml666_st_member* member = ML666_ST_U_MEMBER(sts->cur);
-          struct ml666_st_member* next_child = member ? ml666_st_member_get_next(sts->public.stb, member) : 0;
-          if(next_child){
-            sts->data.data = ", \n";
-            sts->data.length = 3;
-            sts->cur = ML666_ST_NODE(next_child);
-            sts->state = SERIALIZER_W_START;
-          }else if(member){
-            struct ml666_st_node* parent = ml666_st_member_get_parent(sts->public.stb, member);
-            if(parent){
-              sts->cur = parent;
-              sts->state = SERIALIZER_W_END_CHILDLIST;
+          }
+          sts->cur = sts->cursor.node;
+          if(sts->cursor.event == ML666_ST_CE_ENTER){
+            if(previous == ML666_ST_CE_LEAVE){
+              sts->data.data = ", \n";
+              sts->data.length = 3;
             }
+            sts->state = SERIALIZER_W_START;
+          }else if(previous == ML666_ST_CE_LEAVE){
+            // Right after entering it means there were no children, and the node was already closed
+            sts->state = SERIALIZER_W_END_CHILDLIST;
           }
         } break;
         case SERIALIZER_W_FINAL_NEWLINE: {
           sts->data.data = "\n";
           sts->data.length = 1;
           sts->state = SERIALIZER_W_DONE;
+          if(sts->cache){
+            // The newline isn't part of any node, it only has to be there for the next one
+            ml666_st_serializer_cache_end(sts->cache, true);
+            sts->cache = 0;
+          }
         } break;
         case SERIALIZER_W_TAG_START: {
           sts->spaces = sts->level * 2;
           if(ML666_ST_TYPE(sts->cur) == ML666_ST_NT_DOCUMENT){
+            sts->has_attribute = false;
             sts->data.data = "[\"D\"";
             sts->data.length = 4;
             sts->state = SERIALIZER_W_CHILDREN_1;
@@ -443,7 +471,7 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
             if(!++sts->level)
               sts->level = ~0;
           }else{
-            sts->state = SERIALIZER_W_NEXT_MEMBER;
+            sts->state = SERIALIZER_W_NEXT;
             sts->data.data = ", []]";
             sts->data.length = 5;
             if(sts->has_children && sts->has_attribute)
@@ -453,7 +481,7 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
         } break;
         case SERIALIZER_W_CHILDREN_2: {
           sts->spaces = sts->level * 2;
-          sts->state = SERIALIZER_W_NEXT_CHILD;
+          sts->state = SERIALIZER_W_NEXT;
         } break;
         case SERIALIZER_W_END_CHILDLIST: {
           sts->data.data = "\n";
@@ -461,6 +489,9 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
           sts->state = SERIALIZER_W_END_CHILDLIST_2;
         } break;
         case SERIALIZER_W_END_CHILDLIST_2: {
+          // The flags were overwritten by the children
+          sts->has_children = true;
+          sts->has_attribute = ML666_ST_TYPE(sts->cur) == ML666_ST_NT_ELEMENT && ml666_st_attribute_get_first(sts->public.stb, ML666_ST_U_ELEMENT(sts->cur));
           if(sts->has_children && sts->has_attribute)
             if(sts->level)
               sts->level--;
@@ -469,13 +500,13 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
           sts->spaces = sts->level * 2;
           sts->data.data = "]]";
           sts->data.length = 2;
-          sts->state = SERIALIZER_W_NEXT_MEMBER;
+          sts->state = SERIALIZER_W_NEXT;
         } break;
         case SERIALIZER_W_CONTENT: {
           sts->spaces = sts->level * 2;
           sts->encoding = ENC_STRING;
           sts->data = ml666_st_content_get(sts->public.stb, ML666_ST_U_CONTENT(sts->cur));
-          sts->state = SERIALIZER_W_NEXT_MEMBER;
+          sts->state = SERIALIZER_W_NEXT;
         } break;
         case SERIALIZER_W_COMMENT_START: {
           sts->spaces = sts->level * 2;
@@ -491,7 +522,7 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
         case SERIALIZER_W_COMMENT_END: {
           sts->data.length = 1;
           sts->data.data = "]";
-          sts->state = SERIALIZER_W_NEXT_MEMBER;
+          sts->state = SERIALIZER_W_NEXT;
         } break;
       }
     }
@@ -501,6 +532,8 @@ static bool ml666_st_json_serializer_next(struct ml666_st_serializer* _sts){
 
 static void ml666_st_json_serializer_destroy(struct ml666_st_serializer* _sts){
   struct ml666_st_serializer_private* sts = (struct ml666_st_serializer_private*)_sts;
+  if(sts->cache)
+    ml666_st_serializer_cache_end(sts->cache, false);
   ml666_st_node_put(sts->public.stb, sts->node);
   munmap(sts->outbuf.data, sts->outbuf.length*2);
   sts->free(sts->public.user_ptr, sts);
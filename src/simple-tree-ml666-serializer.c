@@ -8,10 +8,8 @@
 #include <sys/mman.h>
 
 #define SERIALIZER_STATE \
-  X(SERIALIZER_W_START) \
+  X(SERIALIZER_W_NEXT) \
   X(SERIALIZER_W_DONE) \
-  X(SERIALIZER_W_NEXT_CHILD) \
-  X(SERIALIZER_W_NEXT_MEMBER) \
   X(SERIALIZER_W_TAG_START) \
   X(SERIALIZER_W_TAG) \
   X(SERIALIZER_W_ATTRIBUTE) \
@@ -55,6 +53,7 @@ struct ml666_st_serializer_private {
   const char* esc_chars;
   struct ml666_buffer_info buffer_info;
 
+  struct ml666_st_cursor cursor;
   struct ml666_st_node* cur;
   struct ml666_st_attribute* current_attribute;
   enum serializer_state state;
@@ -64,6 +63,9 @@ struct ml666_st_serializer_private {
   struct ml666_buffer outbuf;
   struct ml666_buffer outptr;
 
+  struct ml666_st_serializer_cache* cache;
+  size_t cached; // How much of outptr was passed to the cache already
+
   ml666__cb__malloc* malloc;
   ml666__cb__free*   free;
 };
@@ -133,6 +135,11 @@ struct ml666_st_serializer* ml666_st_ml666_serializer_create_p(struct ml666_st_m
     munmap(outbuf.data, outbuf.length*2);
     return 0;
   }
+  if(args.cache && !ml666_st_serializer_cache_begin(args.cache, args.stb, &st_serializer_default)){
+    args.free(args.user_ptr, sts);
+    munmap(outbuf.data, outbuf.length*2);
+    return 0;
+  }
   memset(sts, 0, sizeof(*sts));
   *(const struct ml666_st_serializer_cb**)&sts->public.cb = &st_serializer_default;
   *(struct ml666_st_builder**)&sts->public.stb = args.stb;
@@ -141,9 +148,10 @@ struct ml666_st_serializer* ml666_st_ml666_serializer_create_p(struct ml666_st_m
   sts->outptr.data = outbuf.data;
   sts->fd = args.fd;
   sts->node = args.node;
-  sts->cur = args.node;
+  sts->cursor = ml666_st_cursor_create(args.node);
   sts->malloc = args.malloc;
   sts->free = args.free;
+  sts->cache = args.cache;
   ml666_st_node_ref(sts->public.stb, sts->node);
   return &sts->public;
 }
@@ -275,6 +283,13 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
       if(!buf.length)
         sts->encoding = ENC_RAW;
       if(outptr.length){
+        if(sts->cache){
+          ml666_st_serializer_cache_output(sts->cache, (struct ml666_buffer_ro){
+            .data = outptr.data + sts->cached,
+            .length = outptr.length - sts->cached,
+          });
+          sts->cached = outptr.length;
+        }
         int res = write(sts->fd, outptr.data, outptr.length);
         if(res < 0){
           sts->data = buf;
@@ -282,6 +297,7 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
           sts->public.error = strerror(errno);
           return false;
         }
+        sts->cached -= res;
         outptr.length -= res;
         outptr.data   += res;
         if((size_t)(outptr.data - sts->outbuf.data) > sts->outbuf.length)
@@ -295,40 +311,45 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
 //       printf("%s\n", serializer_state_name[sts->state]); fflush(stdout);
       switch(sts->state){
         case SERIALIZER_W_DONE: break;
-        case SERIALIZER_W_START: switch(ML666_ST_TYPE(sts->cur)){
-          case ML666_ST_NT_DOCUMENT: sts->state = SERIALIZER_W_NEXT_CHILD; break;
-          case ML666_ST_NT_ELEMENT : sts->state = SERIALIZER_W_TAG_START; break;
-          case ML666_ST_NT_CONTENT : sts->state = SERIALIZER_W_CONTENT_START; break;
-          case ML666_ST_NT_COMMENT : sts->state = SERIALIZER_W_COMMENT_START; break;
-        } break;
-        case SERIALIZER_W_NEXT_CHILD: {
-          struct ml666_st_children* children = ML666_ST_U_CHILDREN(sts->public.stb, sts->cur);
-          struct ml666_st_member* first_child = children ? ml666_st_get_first_child(sts->public.stb, children) : 0;
-          sts->state = SERIALIZER_W_DONE;
-          if(first_child){
-            if(ML666_ST_TYPE(sts->cur) == ML666_ST_NT_ELEMENT)
-              sts->level += 1;
-            sts->cur = ML666_ST_NODE(first_child);
-            sts->state = SERIALIZER_W_START;
-          }
-        } break;
-        case SERIALIZER_W_NEXT_MEMBER: {
-          sts->state = SERIALIZER_W_DONE;
-          if(sts->cur != sts->node){
-            struct ml666_st_member* member = ML666_ST_U_MEMBER(sts->cur);
-            struct ml666_st_member* next_child = member ? ml666_st_member_get_next(sts->public.stb, member) : 0;
-            if(next_child){
-              sts->cur = ML666_ST_NODE(next_child);
-              sts->state = SERIALIZER_W_START;
-            }else if(member){
-              struct ml666_st_node* parent = ml666_st_member_get_parent(sts->public.stb, member);
-              if(parent && parent != sts->node && ML666_ST_TYPE(parent) == ML666_ST_NT_ELEMENT){
-                sts->cur = parent;
-                sts->state = SERIALIZER_W_END_TAG_START;
-                if(sts->level)
-                  sts->level -= 1;
-              }
+        case SERIALIZER_W_NEXT: {
+          const enum ml666_st_cursor_event previous = sts->cursor.event;
+          // All the output of the node which was left is out by now
+          if(sts->cache && previous == ML666_ST_CE_LEAVE)
+            ml666_st_serializer_cache_leave(sts->cache, sts->cursor.node);
+          if(!ml666_st_cursor_next(sts->public.stb, &sts->cursor)){
+            sts->state = SERIALIZER_W_DONE;
+            if(sts->cache){
+              ml666_st_serializer_cache_end(sts->cache, !sts->cursor.error);
+              sts->cache = 0;
+            }
+            if(sts->cursor.error){
+              sts->public.error = "the children of an element couldn't be loaded";
+              return false;
             }
+            break;
+          }
+          sts->cur = sts->cursor.node;
+          const enum ml666_st_node_type type = ML666_ST_TYPE(sts->cur);
+          // The children of a document aren't indented
+          sts->level = type == ML666_ST_NT_DOCUMENT ? 0 : sts->cursor.depth - (ML666_ST_TYPE(sts->node) == ML666_ST_NT_DOCUMENT);
+          if(sts->cache && sts->cursor.event == ML666_ST_CE_ENTER && ml666_st_serializer_cache_enter(sts->cache, sts->cur, sts->level, &sts->data)){
+            // It's left right away, without writing anything else
+            ml666_st_cursor_skip(&sts->cursor);
+            break;
+          }
+          if(type == ML666_ST_NT_DOCUMENT)
+            break;
+          if(sts->cursor.event == ML666_ST_CE_LEAVE){
+            // Right after entering it means the element had no children, and was already closed
+            if(type == ML666_ST_NT_ELEMENT && previous == ML666_ST_CE_LEAVE)
+              sts->state = SERIALIZER_W_END_TAG_START;
+            break;
+          }
+          switch(type){
+            case ML666_ST_NT_DOCUMENT: break;
+            case ML666_ST_NT_ELEMENT : sts->state = SERIALIZER_W_TAG_START; break;
+            case ML666_ST_NT_CONTENT : sts->state = SERIALIZER_W_CONTENT_START; break;
+            case ML666_ST_NT_COMMENT : sts->state = SERIALIZER_W_COMMENT_START; break;
           }
         } break;
         case SERIALIZER_W_TAG_START: {
@@ -376,12 +397,11 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
           if(ml666_st_get_first_child(sts->public.stb, ML666_ST_U_CHILDREN(sts->public.stb, sts->cur))){
             sts->data.data = ">\n";
             sts->data.length = 2;
-            sts->state = SERIALIZER_W_NEXT_CHILD;
           }else{
             sts->data.data = "/>\n";
             sts->data.length = 3;
-            sts->state = SERIALIZER_W_NEXT_MEMBER;
           }
+          sts->state = SERIALIZER_W_NEXT;
         } break;
         case SERIALIZER_W_END_TAG_START: {
           sts->spaces = sts->level * 2;
@@ -398,7 +418,7 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
         case SERIALIZER_W_END_TAG_END: {
           sts->data.data = ">\n";
           sts->data.length = 2;
-          sts->state = SERIALIZER_W_NEXT_MEMBER;
+          sts->state = SERIALIZER_W_NEXT;
         } break;
         case SERIALIZER_W_CONTENT_START: {
           struct ml666_buffer_ro buf;
@@ -456,7 +476,7 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
             sts->state = SERIALIZER_W_ATTRIBUTE_NEXT;
             sts->data.length = 1;
           }else{
-            sts->state = SERIALIZER_W_NEXT_MEMBER;
+            sts->state = SERIALIZER_W_NEXT;
             sts->data.length = 2;
           }
         } break;
@@ -483,7 +503,7 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
           sts->state = SERIALIZER_W_COMMENT_END_2;
         } break;
         case SERIALIZER_W_COMMENT_END_2: {
-          sts->state = SERIALIZER_W_NEXT_MEMBER;
+          sts->state = SERIALIZER_W_NEXT;
           if(sts->buffer_info.really_multi_line){
             sts->data.length = 3;
             sts->data.data = "*/\n";
@@ -501,6 +521,8 @@ static bool ml666_st_ml666_serializer_next(struct ml666_st_serializer* _sts){
 
 static void ml666_st_ml666_serializer_destroy(struct ml666_st_serializer* _sts){
   struct ml666_st_serializer_private* sts = (struct ml666_st_serializer_private*)_sts;
+  if(sts->cache)
+    ml666_st_serializer_cache_end(sts->cache, false);
   ml666_st_node_put(sts->public.stb, sts->node);
   munmap(sts->outbuf.data, sts->outbuf.length*2);
   sts->free(sts->public.user_ptr, sts);
@@ -0,0 +1,408 @@
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/structure-scanner.h>
+#include <ml666/simple-tree.h>
+#include <ml666/tokenizer.h>
+#include <ml666/utils.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * The names have to be interned in the buffer set of the main builder, but it isn't thread safe.
+ * Every worker gets a buffer set which caches the entries it got from the shared one, and counts
+ * the references it hands out itself. Only cache misses need to take the lock. When the worker
+ * is done, the references are transferred to the shared set, so the nodes can be released using it.
+ */
+
+struct shared_set {
+  pthread_mutex_t lock;
+  struct ml666_hashed_buffer_set* set;
+};
+
+struct worker_set_entry {
+  const ml666_hashed_buffer_set_entry* entry;
+  long count; // The references handed out. The shared set only has 1 of them.
+};
+
+struct worker_set {
+  struct ml666_hashed_buffer_set public;
+  struct shared_set* shared;
+  struct worker_set_entry* table;
+  size_t size, capacity;
+  void* user_ptr;
+  ml666__cb__malloc* malloc;
+  ml666__cb__free*   free;
+};
+static_assert(offsetof(struct worker_set, public) == 0, "worker_set::public must be the first member");
+
+static ml666_hashed_buffer_set__cb__lookup worker_set_lookup;
+static ml666_hashed_buffer_set__cb__put worker_set_put;
+static ml666_hashed_buffer_set__cb__destroy worker_set_destroy;
+
+static const struct ml666_hashed_buffer_set_cb worker_set_cb = {
+  .lookup = worker_set_lookup,
+  .put = worker_set_put,
+  .destroy = worker_set_destroy,
+};
+
+static size_t hash_to_slot(uint64_t hash, size_t capacity){
+  return (hash ^ (hash >> 32)) & (capacity - 1);
+}
+
+static bool worker_set_grow(struct worker_set* set){
+  const size_t capacity = set->capacity ? set->capacity * 2 : 64;
+  struct worker_set_entry* table = set->malloc(set->user_ptr, capacity * sizeof(*table));
+  if(!table)
+    return false;
+  memset(table, 0, capacity * sizeof(*table));
+  for(size_t i=0; i<set->capacity; i++){
+    if(!set->table[i].entry)
+      continue;
+    size_t j = hash_to_slot(ml666_hashed_buffer_set__peek(set->table[i].entry)->hash, capacity);
+    while(table[j].entry)
+      j = (j + 1) & (capacity - 1);
+    table[j] = set->table[i];
+  }
+  set->free(set->user_ptr, set->table);
+  set->table = table;
+  set->capacity = capacity;
+  return true;
+}
+
+static const ml666_hashed_buffer_set_entry* worker_set_lookup(
+  struct ml666_hashed_buffer_set* _set,
+  const struct ml666_hashed_buffer* key,
+  enum ml666_hashed_buffer_set_mode mode
+){
+  struct worker_set* set = (struct worker_set*)_set;
+  size_t i = 0;
+  // The shared set would have to free the buffer on a hit, so that's left to it
+  if(mode != ML666_HBS_M_ADD_TAKE && set->capacity){
+    for(i=hash_to_slot(key->hash, set->capacity); set->table[i].entry; i=(i+1)&(set->capacity-1)){
+      const struct ml666_hashed_buffer* cur = ml666_hashed_buffer_set__peek(set->table[i].entry);
+      if( cur == key || (
+          cur->hash == key->hash
+       && cur->buffer.length == key->buffer.length
+       && memcmp(cur->buffer.data, key->buffer.data, key->buffer.length) == 0
+      )){
+        set->table[i].count += 1;
+        return set->table[i].entry;
+      }
+    }
+  }
+  pthread_mutex_lock(&set->shared->lock);
+  const ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(set->shared->set, key, mode);
+  pthread_mutex_unlock(&set->shared->lock);
+  if(!entry || mode == ML666_HBS_M_ADD_TAKE)
+    return entry;
+  if((set->size + 1) * 2 > set->capacity){
+    if(!worker_set_grow(set))
+      return entry; // Just don't cache it, the put will be forwarded
+    i = hash_to_slot(key->hash, set->capacity);
+    while(set->table[i].entry)
+      i = (i + 1) & (set->capacity - 1);
+  }
+  set->table[i] = (struct worker_set_entry){ .entry = entry, .count = 1 };
+  set->size += 1;
+  return entry;
+}
+
+static void worker_set_put(struct ml666_hashed_buffer_set* _set, const ml666_hashed_buffer_set_entry* entry){
+  struct worker_set* set = (struct worker_set*)_set;
+  if(set->capacity){
+    for(size_t i=hash_to_slot(ml666_hashed_buffer_set__peek(entry)->hash, set->capacity); set->table[i].entry; i=(i+1)&(set->capacity-1)){
+      if(set->table[i].entry == entry){
+        set->table[i].count -= 1;
+        return;
+      }
+    }
+  }
+  pthread_mutex_lock(&set->shared->lock);
+  ml666_hashed_buffer_set__put(set->shared->set, entry);
+  pthread_mutex_unlock(&set->shared->lock);
+}
+
+static void worker_set_destroy(struct ml666_hashed_buffer_set* _set){
+  struct worker_set* set = (struct worker_set*)_set;
+  pthread_mutex_lock(&set->shared->lock);
+  for(size_t i=0; i<set->capacity; i++){
+    const ml666_hashed_buffer_set_entry* entry = set->table[i].entry;
+    if(!entry)
+      continue;
+    for(long count=set->table[i].count; count>1; count--)
+      ml666_hashed_buffer_set__lookup(set->shared->set, ml666_hashed_buffer_set__peek(entry), ML666_HBS_M_GET);
+    for(long count=set->table[i].count; count<1; count++)
+      ml666_hashed_buffer_set__put(set->shared->set, entry);
+  }
+  pthread_mutex_unlock(&set->shared->lock);
+  set->free(set->user_ptr, set->table);
+  set->free(set->user_ptr, set);
+}
+
+/*
+ * The document is split into jobs. The first one is the document with the content of the widest element cut out,
+ * the others are the parts of that content. They are only split in front of elements, so they are all valid documents.
+ */
+
+struct job {
+  struct ml666_buffer_ro input;
+  struct ml666_st_document* document;
+};
+
+struct context {
+  struct ml666_st_builder* stb;
+  struct shared_set shared;
+  struct job* job;
+  size_t job_count;
+  atomic_size_t next_job;
+  atomic_bool failed;
+  struct ml666_st_parse_parallel_args* a;
+};
+
+static void dispose_document(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  if(!document)
+    return;
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+static struct ml666_st_document* parse_job(struct context* ctx, struct ml666_st_builder* stb, struct ml666_buffer_ro input){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(
+    .input = input,
+    .user_ptr = ctx->a->user_ptr,
+    .malloc = ctx->a->malloc,
+    .free = ctx->a->free,
+  );
+  if(!tokenizer)
+    return 0;
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(
+    .stb = stb,
+    .tokenizer = tokenizer,
+    .user_ptr = ctx->a->user_ptr,
+    .malloc = ctx->a->malloc,
+    .realloc = ctx->a->realloc,
+    .free = ctx->a->free,
+  );
+  if(!stp)
+    return 0;
+  while(ml666_simple_tree_parser_next(stp));
+  // Errors aren't reported here, the document will be parsed again sequentially for a proper error message
+  struct ml666_st_document* document = stp->error ? 0 : ml666_simple_tree_parser_take_document(stp);
+  ml666_simple_tree_parser_destroy(stp);
+  return document;
+}
+
+static void* worker(void* _ctx){
+  struct context* ctx = _ctx;
+  struct worker_set* set = ctx->a->malloc(ctx->a->user_ptr, sizeof(*set));
+  if(!set){
+    ctx->failed = true;
+    return 0;
+  }
+  memset(set, 0, sizeof(*set));
+  *(const struct ml666_hashed_buffer_set_cb**)&set->public.cb = &worker_set_cb;
+  set->shared = &ctx->shared;
+  set->user_ptr = ctx->a->user_ptr;
+  set->malloc = ctx->a->malloc;
+  set->free = ctx->a->free;
+  struct ml666_st_builder* stb = ml666_st_builder_fork(ctx->stb, &set->public);
+  if(!stb){
+    ctx->failed = true;
+  }else{
+    while(!ctx->failed){
+      const size_t i = atomic_fetch_add_explicit(&ctx->next_job, 1, memory_order_relaxed);
+      if(i >= ctx->job_count)
+        break;
+      if(!(ctx->job[i].document = parse_job(ctx, stb, ctx->job[i].input)))
+        ctx->failed = true;
+    }
+    ml666_st_builder_destroy(stb);
+  }
+  ml666_hashed_buffer_set__destroy(&set->public);
+  return 0;
+}
+
+struct split_list {
+  size_t index; // The index of the element amongst the top level elements
+  size_t content_begin, content_end;
+  size_t count, capacity;
+  size_t* offset;
+};
+
+struct scan_state {
+  struct ml666_st_parse_parallel_args* a;
+  size_t element_count;
+  size_t last;
+  struct split_list current, best;
+};
+
+static bool scan_cb(void* user_ptr, enum ml666_structure_scan_event event, size_t offset, size_t depth){
+  struct scan_state* state = user_ptr;
+  if(depth == 0){
+    switch(event){
+      case ML666_SCAN_ELEMENT_BEGIN: {
+        state->current.index = state->element_count++;
+        state->current.count = 0;
+      } break;
+      case ML666_SCAN_CONTENT_BEGIN: {
+        state->current.content_begin = offset;
+        state->last = offset;
+      } break;
+      case ML666_SCAN_CONTENT_END: {
+        state->current.content_end = offset;
+        if(state->current.count > state->best.count){
+          const struct split_list tmp = state->best;
+          state->best = state->current;
+          state->current = tmp;
+        }
+      } break;
+      case ML666_SCAN_ELEMENT_END: break;
+    }
+    return true;
+  }
+  if(event != ML666_SCAN_ELEMENT_BEGIN || offset - state->last < state->a->min_slice_size)
+    return true;
+  struct split_list* list = &state->current;
+  if(list->count == list->capacity){
+    const size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    size_t* result = state->a->realloc(state->a->user_ptr, list->offset, capacity * sizeof(*list->offset));
+    if(!result)
+      return false;
+    list->offset = result;
+    list->capacity = capacity;
+  }
+  list->offset[list->count++] = offset;
+  state->last = offset;
+  return true;
+}
+
+static struct ml666_st_document* parse_sequential(struct ml666_st_parse_parallel_args* a){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=a->input, .user_ptr=a->user_ptr, .malloc=a->malloc, .free=a->free);
+  if(!tokenizer){
+    fprintf(stderr, "ml666_tokenizer_create failed\n");
+    return 0;
+  }
+  return ml666_st_parse(a->stb, .tokenizer=tokenizer, .user_ptr=a->user_ptr, .malloc=a->malloc, .realloc=a->realloc, .free=a->free);
+}
+
+static bool run(struct ml666_st_parse_parallel_args* a, const struct split_list* split, struct ml666_st_document** result){
+  const char* data = a->input.data;
+  const size_t size = a->input.length;
+  struct context ctx = {
+    .stb = a->stb,
+    .shared.set = ml666_st_builder_get_buffer_set(a->stb),
+    .job_count = split->count + 2,
+    .a = a,
+  };
+  if(!ctx.shared.set)
+    return false;
+
+  const size_t skeleton_size = split->content_begin + (size - split->content_end);
+  char* skeleton = a->malloc(a->user_ptr, skeleton_size);
+  if(!skeleton)
+    return false;
+  memcpy(skeleton, data, split->content_begin);
+  memcpy(skeleton + split->content_begin, data + split->content_end, size - split->content_end);
+
+  bool ok = false;
+  ctx.job = a->malloc(a->user_ptr, ctx.job_count * sizeof(*ctx.job));
+  if(!ctx.job)
+    goto error_skeleton;
+  ctx.job[0] = (struct job){ .input = { .data = skeleton, .length = skeleton_size } };
+  for(size_t i=0; i<=split->count; i++){
+    const size_t begin = i ? split->offset[i-1] : split->content_begin;
+    const size_t end = i < split->count ? split->offset[i] : split->content_end;
+    ctx.job[i+1] = (struct job){ .input = { .data = data + begin, .length = end - begin } };
+  }
+
+  if(pthread_mutex_init(&ctx.shared.lock, 0))
+    goto error_job;
+
+  size_t thread_count = a->thread_count;
+  if(thread_count > ctx.job_count)
+    thread_count = ctx.job_count;
+  pthread_t* thread = a->malloc(a->user_ptr, thread_count * sizeof(*thread));
+  if(!thread)
+    goto error_lock;
+  // This thread is one of the workers too
+  size_t started = 1;
+  for(; started<thread_count; started++){
+    int error = pthread_create(&thread[started], 0, worker, &ctx);
+    if(error){
+      fprintf(stderr, "%s:%u: pthread_create failed (%d): %s\n", __FILE__, __LINE__, error, strerror(error));
+      break;
+    }
+  }
+  worker(&ctx);
+  for(size_t i=1; i<started; i++)
+    pthread_join(thread[i], 0);
+  a->free(a->user_ptr, thread);
+
+  struct ml666_st_document* document = ctx.job[0].document;
+  struct ml666_st_element* root = 0;
+  if(!ctx.failed){
+    size_t index = split->index;
+    for(struct ml666_st_member* it=ml666_st_get_first_child(a->stb, ML666_ST_CHILDREN(a->stb, document)); it; it=ml666_st_member_get_next(a->stb, it)){
+      if(ML666_ST_TYPE(it) == ML666_ST_NT_ELEMENT && !index--){
+        root = (struct ml666_st_element*)it;
+        break;
+      }
+    }
+  }
+
+  if(root){
+    // Every slice is a fragment of the content of the root element, so its members just need to be moved there in order
+    for(size_t i=1; i<ctx.job_count; i++){
+      struct ml666_st_children* children = ML666_ST_CHILDREN(a->stb, ctx.job[i].document);
+      for(struct ml666_st_member* it; (it=ml666_st_get_first_child(a->stb, children)); )
+        ml666_st_member_set(a->stb, ML666_ST_NODE(root), it, 0);
+      ml666_st_node_put(a->stb, ML666_ST_NODE(ctx.job[i].document));
+    }
+    *result = document;
+    ok = true;
+  }else{
+    for(size_t i=0; i<ctx.job_count; i++)
+      dispose_document(a->stb, ctx.job[i].document);
+  }
+
+error_lock:
+  pthread_mutex_destroy(&ctx.shared.lock);
+error_job:
+  a->free(a->user_ptr, ctx.job);
+error_skeleton:
+  a->free(a->user_ptr, skeleton);
+  return ok;
+}
+
+struct ml666_st_document* ml666_st_parse_parallel_p(struct ml666_st_parse_parallel_args args){
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  if(!args.min_slice_size)
+    args.min_slice_size = 0x10000;
+  if(!args.thread_count){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    args.thread_count = n > 0 ? n : 1;
+  }
+
+  if(args.thread_count > 1){
+    struct scan_state state = { .a = &args };
+    struct ml666_st_document* document = 0;
+    // If anything doesn't work out, including syntax errors, it's just done the normal way
+    const bool ok = ml666_structure_scan(args.input, scan_cb, .max_depth=1, .user_ptr=&state)
+                 && state.best.count
+                 && run(&args, &state.best, &document);
+    args.free(args.user_ptr, state.current.offset);
+    args.free(args.user_ptr, state.best.offset);
+    if(ok)
+      return document;
+  }
+  return parse_sequential(&args);
+}
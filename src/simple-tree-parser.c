@@ -18,17 +18,86 @@ struct ml666_simple_tree_parser_default {
   struct ml666_st_content* current_content;
   struct ml666_st_comment* current_comment;
   struct ml666_st_attribute* current_attribute;
+  // The buffer of the text currently being appended to is grown geometrically, and trimmed once it's complete
+  struct {
+    const void* owner;
+    const char* data;
+    size_t capacity;
+  } pending;
   ml666__cb__malloc*  malloc;
   ml666__cb__realloc* realloc;
   ml666__cb__free*    free;
 };
 
+static void trim(struct ml666_simple_tree_parser_default* stp, struct ml666_buffer* buf){
+  if(buf->data != stp->pending.data || stp->pending.capacity <= buf->length)
+    return;
+  if(!buf->length){
+    stp->free(stp->public.user_ptr, buf->data);
+    buf->data = 0;
+    return;
+  }
+  char* data = stp->realloc(stp->public.user_ptr, buf->data, buf->length);
+  if(data) // If shrinking fails, just keep the bigger buffer
+    buf->data = data;
+}
+
+static void pending_finish(struct ml666_simple_tree_parser_default* stp){
+  const void* owner = stp->pending.owner;
+  if(!owner)
+    return;
+  if(owner == stp->current_content){
+    struct ml666_buffer buf = ml666_st_content_take(stp->public.stb, stp->current_content);
+    trim(stp, &buf);
+    ml666_st_content_set(stp->public.stb, stp->current_content, buf);
+  }else if(owner == stp->current_comment){
+    struct ml666_buffer buf = ml666_st_comment_take(stp->public.stb, stp->current_comment);
+    trim(stp, &buf);
+    ml666_st_comment_set(stp->public.stb, stp->current_comment, buf);
+  }else if(owner == stp->current_attribute){
+    const struct ml666_buffer* pvalue = ml666_st_attribute_take_value(stp->public.stb, stp->current_attribute);
+    if(pvalue){
+      struct ml666_buffer buf = *pvalue;
+      trim(stp, &buf);
+      ml666_st_attribute_set_value(stp->public.stb, stp->current_attribute, &buf);
+    }
+  }
+  stp->pending.owner = 0;
+  stp->pending.data = 0;
+  stp->pending.capacity = 0;
+}
+
+static bool pending_append(struct ml666_simple_tree_parser_default* stp, const void* owner, struct ml666_buffer* buf, struct ml666_buffer_ro data){
+  // If the builder kept our buffer, we still know its capacity. Otherwise, it only has the space it needs.
+  size_t capacity = owner == stp->pending.owner && buf->data == stp->pending.data ? stp->pending.capacity : buf->length;
+  if(!ml666_buffer__append(buf, data, stp->public.user_ptr, stp->realloc, &capacity))
+    return false;
+  stp->pending.owner = owner;
+  stp->pending.data = buf->data;
+  stp->pending.capacity = capacity;
+  return true;
+}
+
+// Builders may copy short texts elsewhere and free our buffer. There is nothing to trim then, and the buffer must be forgotten.
+static void pending_check(struct ml666_simple_tree_parser_default* stp, const char* data){
+  if(data == stp->pending.data)
+    return;
+  stp->pending.owner = 0;
+  stp->pending.data = 0;
+  stp->pending.capacity = 0;
+}
+
+static void done(struct ml666_parser* parser){
+  pending_finish(parser->user_ptr);
+}
+
 static bool tag_push(struct ml666_parser* parser, ml666_opaque_tag_name* name){
   struct ml666_simple_tree_parser_default* stp = parser->user_ptr;
   if(!stp->cur){
     parser->error = "simple_tree_parser::tag_push: invalid parser state\n";
     return false;
   }
+  pending_finish(stp);
   stp->current_content = 0;
   stp->current_comment = 0;
   stp->current_attribute = 0;
@@ -75,6 +144,7 @@ static bool tag_pop(struct ml666_parser* parser){
   struct ml666_st_node* parent = ml666_st_member_get_parent(stp->public.stb, ML666_ST_MEMBER(element));
   if(!parent)
     return false;
+  pending_finish(stp);
   stp->current_content = 0;
   stp->current_comment = 0;
   stp->current_attribute = 0;
@@ -88,6 +158,8 @@ static bool data_append(struct ml666_parser* parser, struct ml666_buffer_ro data
     parser->error = "simple_tree_parser::data_append: invalid parser state\n";
     return false;
   }
+  if(stp->pending.owner != stp->current_content)
+    pending_finish(stp);
   stp->current_comment = 0;
   stp->current_attribute = 0;
   if(!stp->current_content){
@@ -105,11 +177,12 @@ static bool data_append(struct ml666_parser* parser, struct ml666_buffer_ro data
     stp->current_content = content;
   }
   struct ml666_buffer buf = ml666_st_content_take(stp->public.stb, stp->current_content);
-  if(!ml666_buffer__append(&buf, data, stp->public.user_ptr, stp->realloc)){
+  if(!pending_append(stp, stp->current_content, &buf, data)){
     parser->error = "simple_tree_parser::data_append: realloc failed\n";
     return false;
   }
   ml666_st_content_set(stp->public.stb, stp->current_content, buf);
+  pending_check(stp, ml666_st_content_get(stp->public.stb, stp->current_content).data);
   return true;
 }
 
@@ -119,6 +192,8 @@ static bool comment_append(struct ml666_parser* parser, struct ml666_buffer_ro d
     parser->error = "simple_tree_parser::data_append: invalid parser state\n";
     return false;
   }
+  if(stp->pending.owner != stp->current_comment)
+    pending_finish(stp);
   stp->current_content = 0;
   stp->current_attribute = 0;
   if(!stp->current_comment){
@@ -136,11 +211,12 @@ static bool comment_append(struct ml666_parser* parser, struct ml666_buffer_ro d
     stp->current_comment = comment;
   }
   struct ml666_buffer buf = ml666_st_comment_take(stp->public.stb, stp->current_comment);
-  if(!ml666_buffer__append(&buf, data, stp->public.user_ptr, stp->realloc)){
+  if(!pending_append(stp, stp->current_comment, &buf, data)){
     parser->error = "simple_tree_parser::data_append: realloc failed\n";
     return false;
   }
   ml666_st_comment_set(stp->public.stb, stp->current_comment, buf);
+  pending_check(stp, ml666_st_comment_get(stp->public.stb, stp->current_comment).data);
   return true;
 }
 
@@ -151,6 +227,7 @@ static bool set_attribute(struct ml666_parser* parser, ml666_opaque_attribute_na
     parser->error = "simple_tree_parser::data_append: invalid parser state\n";
     return false;
   }
+  pending_finish(stp);
   struct ml666_hashed_buffer entry = ml666_hashed_buffer__create((*name)->buffer.ro);
   bool copy_name = true; // Note: "false" only works if the allocator actually used malloc. Any other case will fail. "true" always works, but is more expencive.
   struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stp->public.stb, element, &entry, ML666_ST_AOF_CREATE_EXCLUSIVE | (copy_name?0:ML666_ST_AOF_CREATE_NOCOPY));
@@ -168,11 +245,14 @@ static bool value_append(struct ml666_parser* parser, struct ml666_buffer_ro dat
   struct ml666_buffer buf = {0};
   if(pvalue)
     buf = *pvalue;
-  if(!ml666_buffer__append(&buf, data, stp->public.user_ptr, stp->realloc)){
+  if(!pending_append(stp, stp->current_attribute, &buf, data)){
     parser->error = "simple_tree_parser::data_append: realloc failed\n";
     return false;
   }
-  return ml666_st_attribute_set_value(stp->public.stb, stp->current_attribute, &buf);
+  if(!ml666_st_attribute_set_value(stp->public.stb, stp->current_attribute, &buf))
+    return false;
+  pending_check(stp, ml666_st_attribute_get_value(stp->public.stb, stp->current_attribute)->data);
+  return true;
 }
 
 static ml666_simple_tree_parser_cb_destroy ml666_simple_tree_parser_d_destroy;
@@ -185,7 +265,9 @@ static const struct ml666_simple_tree_parser_cb simple_tree_parser_cb = {
   .take_document = ml666_simple_tree_parser_d_take_document,
 };
 
-static const struct ml666_parser_api callbacks = {
+const struct ml666_parser_api ml666_simple_tree_parser_api = {
+  .done = done,
+
   .tag_name_append       = ml666_parser__d_mal__tag_name_append,
   .tag_name_free         = ml666_parser__d_mal__tag_name_free,
   .attribute_name_append = ml666_parser__d_mal__attribute_name_append,
@@ -230,11 +312,11 @@ struct ml666_simple_tree_parser* ml666_simple_tree_parser_create_p(struct ml666_
   stp->free = args.free;
   if(args.parser){
     stp->parser = args.parser;
-  }else{
+  }else if(!args.detached){
     stp->parser = ml666_parser_create(
       .fd = args.fd,
       .tokenizer = args.tokenizer,
-      .api = &callbacks,
+      .api = &ml666_simple_tree_parser_api,
       .user_ptr = stp
     );
     if(!stp->parser){
@@ -274,6 +356,8 @@ static bool ml666_simple_tree_parser_d_next(struct ml666_simple_tree_parser* _st
   bool res = ml666_parser_next(stp->parser);
   stp->public.line = stp->parser->line;
   stp->public.column = stp->parser->column;
+  stp->public.offset = stp->parser->offset;
+  stp->public.token_count = stp->parser->token_count;
   if(stp->parser->error)
     stp->public.error = stp->parser->error;
   return res;
@@ -282,6 +366,7 @@ static bool ml666_simple_tree_parser_d_next(struct ml666_simple_tree_parser* _st
 
 static struct ml666_st_document* ml666_simple_tree_parser_d_take_document(struct ml666_simple_tree_parser* _stp){
   struct ml666_simple_tree_parser_default* stp = (struct ml666_simple_tree_parser_default*)_stp;
+  pending_finish(stp);
   struct ml666_st_document* document = stp->document;
   stp->document = 0;
   return document;
@@ -0,0 +1,251 @@
+#include <ml666/simple-tree-reclaimer.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/utils.h>
+#include <pthread.h>
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * The thread releases the nodes using a fork of the builder. The buffer set of the fork
+ * doesn't release the names, it only counts how often they were released, and
+ * ml666_st_reclaimer_collect then releases them in the buffer set of the builder.
+ */
+
+struct name_count {
+  const ml666_hashed_buffer_set_entry* entry;
+  size_t count;
+};
+
+struct deferred_set {
+  struct ml666_hashed_buffer_set public;
+  struct ml666_st_reclaimer* reclaimer;
+};
+static_assert(offsetof(struct deferred_set, public) == 0, "deferred_set::public must be the first member");
+
+struct queue_entry {
+  struct queue_entry* next;
+  struct ml666_st_node* node;
+};
+
+struct ml666_st_reclaimer {
+  struct ml666_st_reclaimer_create_args a;
+  struct ml666_st_builder* fork;
+  struct deferred_set set;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  // Protected by the lock
+  struct queue_entry *first, *last;
+  bool stop;
+  struct name_count* pending; // Open addressing
+  size_t pending_size, pending_capacity;
+};
+
+static ml666_hashed_buffer_set__cb__lookup deferred_set_lookup;
+static ml666_hashed_buffer_set__cb__put deferred_set_put;
+static ml666_hashed_buffer_set__cb__destroy deferred_set_destroy;
+
+static const struct ml666_hashed_buffer_set_cb deferred_set_cb = {
+  .lookup = deferred_set_lookup,
+  .put = deferred_set_put,
+  .destroy = deferred_set_destroy,
+};
+
+static size_t hash_to_slot(uint64_t hash, size_t capacity){
+  return (hash ^ (hash >> 32)) & (capacity - 1);
+}
+
+static struct name_count* pending_find(struct name_count* table, size_t capacity, const ml666_hashed_buffer_set_entry* entry){
+  size_t i = hash_to_slot(ml666_hashed_buffer_set__peek(entry)->hash, capacity);
+  while(table[i].entry && table[i].entry != entry)
+    i = (i + 1) & (capacity - 1);
+  return &table[i];
+}
+
+static bool pending_grow(struct ml666_st_reclaimer* reclaimer){
+  const size_t capacity = reclaimer->pending_capacity ? reclaimer->pending_capacity * 2 : 64;
+  struct name_count* table = reclaimer->a.malloc(reclaimer->a.user_ptr, capacity * sizeof(*table));
+  if(!table)
+    return false;
+  memset(table, 0, capacity * sizeof(*table));
+  for(size_t i=0; i<reclaimer->pending_capacity; i++)
+    if(reclaimer->pending[i].entry)
+      *pending_find(table, capacity, reclaimer->pending[i].entry) = reclaimer->pending[i];
+  if(reclaimer->pending)
+    reclaimer->a.free(reclaimer->a.user_ptr, reclaimer->pending);
+  reclaimer->pending = table;
+  reclaimer->pending_capacity = capacity;
+  return true;
+}
+
+static const ml666_hashed_buffer_set_entry* deferred_set_lookup(
+  struct ml666_hashed_buffer_set* set,
+  const struct ml666_hashed_buffer* key,
+  enum ml666_hashed_buffer_set_mode mode
+){
+  (void)set;
+  (void)key;
+  (void)mode;
+  fprintf(stderr, "ml666_st_reclaimer: the reclaimer thread can't create names\n");
+  return 0;
+}
+
+static void deferred_set_put(struct ml666_hashed_buffer_set* _set, const ml666_hashed_buffer_set_entry* entry){
+  struct ml666_st_reclaimer* reclaimer = ((struct deferred_set*)_set)->reclaimer;
+  pthread_mutex_lock(&reclaimer->lock);
+  if((reclaimer->pending_size + 1) * 2 > reclaimer->pending_capacity && !pending_grow(reclaimer)){
+    pthread_mutex_unlock(&reclaimer->lock);
+    fprintf(stderr, "ml666_st_reclaimer: malloc failed, a name reference is leaked\n");
+    return;
+  }
+  struct name_count* slot = pending_find(reclaimer->pending, reclaimer->pending_capacity, entry);
+  if(!slot->entry){
+    slot->entry = entry;
+    reclaimer->pending_size += 1;
+  }
+  slot->count += 1;
+  pthread_mutex_unlock(&reclaimer->lock);
+}
+
+static void deferred_set_destroy(struct ml666_hashed_buffer_set* set){
+  (void)set;
+}
+
+static void* reclaimer_main(void* ptr){
+  struct ml666_st_reclaimer* reclaimer = ptr;
+  struct ml666_st_builder* stb = reclaimer->fork;
+  pthread_mutex_lock(&reclaimer->lock);
+  while(true){
+    while(!reclaimer->first && !reclaimer->stop)
+      pthread_cond_wait(&reclaimer->wake, &reclaimer->lock);
+    struct queue_entry* job = reclaimer->first;
+    if(!job)
+      break;
+    reclaimer->first = job->next;
+    if(!reclaimer->first)
+      reclaimer->last = 0;
+    pthread_mutex_unlock(&reclaimer->lock);
+    struct ml666_st_children* children = ml666_st_node_get_children(stb, job->node);
+    if(children)
+      ml666_st_subtree_disintegrate(stb, children);
+    ml666_st_node_put(stb, job->node);
+    reclaimer->a.free(reclaimer->a.user_ptr, job);
+    pthread_mutex_lock(&reclaimer->lock);
+  }
+  pthread_mutex_unlock(&reclaimer->lock);
+  return 0;
+}
+
+struct ml666_st_reclaimer* ml666_st_reclaimer_create_p(struct ml666_st_reclaimer_create_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_reclaimer_create_p: mandatory argument \"stb\" not set!\n");
+    return 0;
+  }
+  if(!ml666_st_builder_get_buffer_set(args.stb)){
+    fprintf(stderr, "ml666_st_reclaimer_create_p: only the default builder is supported\n");
+    return 0;
+  }
+  if(ml666_st_builder_is_thread_confined(args.stb)){
+    // The blocks the nodes are in are shared with the builder, and their refcounts aren't atomic
+    fprintf(stderr, "ml666_st_reclaimer_create_p: the builder is thread confined\n");
+    return 0;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_st_reclaimer* reclaimer = args.malloc(args.user_ptr, sizeof(*reclaimer));
+  if(!reclaimer){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(reclaimer, 0, sizeof(*reclaimer));
+  reclaimer->a = args;
+  *(const struct ml666_hashed_buffer_set_cb**)&reclaimer->set.public.cb = &deferred_set_cb;
+  reclaimer->set.reclaimer = reclaimer;
+  reclaimer->fork = ml666_st_builder_fork(args.stb, &reclaimer->set.public);
+  if(!reclaimer->fork){
+    fprintf(stderr, "ml666_st_builder_fork failed\n");
+    goto error;
+  }
+  if(pthread_mutex_init(&reclaimer->lock, 0)){
+    fprintf(stderr, "pthread_mutex_init failed\n");
+    goto error_fork;
+  }
+  if(pthread_cond_init(&reclaimer->wake, 0)){
+    fprintf(stderr, "pthread_cond_init failed\n");
+    goto error_mutex;
+  }
+  if(pthread_create(&reclaimer->thread, 0, reclaimer_main, reclaimer)){
+    fprintf(stderr, "pthread_create failed\n");
+    goto error_cond;
+  }
+  return reclaimer;
+
+error_cond:
+  pthread_cond_destroy(&reclaimer->wake);
+error_mutex:
+  pthread_mutex_destroy(&reclaimer->lock);
+error_fork:
+  ml666_st_builder_destroy(reclaimer->fork);
+error:
+  args.free(args.user_ptr, reclaimer);
+  return 0;
+}
+
+bool ml666_st_reclaim(struct ml666_st_reclaimer* reclaimer, struct ml666_st_node* node){
+  struct ml666_st_member* member = ML666_ST_U_MEMBER(node);
+  if(member && ml666_st_member_get_parent(reclaimer->a.stb, member)){
+    fprintf(stderr, "ml666_st_reclaim: the node still has a parent\n");
+    return false;
+  }
+  struct queue_entry* job = reclaimer->a.malloc(reclaimer->a.user_ptr, sizeof(*job));
+  if(!job){
+    perror("malloc failed");
+    return false;
+  }
+  *job = (struct queue_entry){ .node = node };
+  pthread_mutex_lock(&reclaimer->lock);
+  if(reclaimer->last){
+    reclaimer->last->next = job;
+  }else{
+    reclaimer->first = job;
+  }
+  reclaimer->last = job;
+  pthread_cond_signal(&reclaimer->wake);
+  pthread_mutex_unlock(&reclaimer->lock);
+  ml666_st_reclaimer_collect(reclaimer);
+  return true;
+}
+
+void ml666_st_reclaimer_collect(struct ml666_st_reclaimer* reclaimer){
+  pthread_mutex_lock(&reclaimer->lock);
+  struct name_count* pending = reclaimer->pending;
+  const size_t capacity = reclaimer->pending_capacity;
+  reclaimer->pending = 0;
+  reclaimer->pending_size = 0;
+  reclaimer->pending_capacity = 0;
+  pthread_mutex_unlock(&reclaimer->lock);
+  if(!pending)
+    return;
+  struct ml666_hashed_buffer_set* buffer_set = ml666_st_builder_get_buffer_set(reclaimer->a.stb);
+  for(size_t i=0; i<capacity; i++)
+    for(size_t count=pending[i].count; count; count--)
+      ml666_hashed_buffer_set__put(buffer_set, pending[i].entry);
+  reclaimer->a.free(reclaimer->a.user_ptr, pending);
+}
+
+void ml666_st_reclaimer_destroy(struct ml666_st_reclaimer* reclaimer){
+  pthread_mutex_lock(&reclaimer->lock);
+  reclaimer->stop = true;
+  pthread_cond_signal(&reclaimer->wake);
+  pthread_mutex_unlock(&reclaimer->lock);
+  pthread_join(reclaimer->thread, 0);
+  ml666_st_reclaimer_collect(reclaimer);
+  pthread_cond_destroy(&reclaimer->wake);
+  pthread_mutex_destroy(&reclaimer->lock);
+  ml666_st_builder_destroy(reclaimer->fork);
+  reclaimer->a.free(reclaimer->a.user_ptr, reclaimer);
+}
@@ -0,0 +1,484 @@
+#include <ml666/simple-tree-reparse.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/structure-scanner.h>
+#include <ml666/tokenizer.h>
+#include <ml666/utils.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * The map is the list of the events of the structure scanner, in a gap buffer.
+ * The offsets in front of the gap are counted from the start of the source, the ones after it from its end.
+ * An edit only ever changes the boundaries at the gap, so the ones after it don't have to be touched.
+ */
+
+struct boundary {
+  struct ml666_st_node* node;
+  size_t offset;
+  size_t depth;
+  enum ml666_structure_scan_event event;
+};
+
+struct ml666_st_source_map {
+  struct ml666_st_builder* stb;
+  struct ml666_st_document* document;
+  struct boundary* boundary;
+  size_t capacity, gap_begin, gap_end;
+  size_t length; // The length of the source
+  void* user_ptr;
+  ml666__cb__malloc* malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free* free;
+};
+
+static inline size_t boundary_count(const struct ml666_st_source_map* map){
+  return map->capacity - (map->gap_end - map->gap_begin);
+}
+
+static inline struct boundary* boundary_at(const struct ml666_st_source_map* map, size_t i){
+  return &map->boundary[i < map->gap_begin ? i : i + (map->gap_end - map->gap_begin)];
+}
+
+static inline size_t offset_at(const struct ml666_st_source_map* map, size_t i){
+  const size_t offset = boundary_at(map, i)->offset;
+  return i < map->gap_begin ? offset : map->length - offset;
+}
+
+static void gap_move(struct ml666_st_source_map* map, size_t i){
+  while(map->gap_begin > i){
+    struct boundary b = map->boundary[--map->gap_begin];
+    b.offset = map->length - b.offset;
+    map->boundary[--map->gap_end] = b;
+  }
+  while(map->gap_begin < i){
+    struct boundary b = map->boundary[map->gap_end++];
+    b.offset = map->length - b.offset;
+    map->boundary[map->gap_begin++] = b;
+  }
+}
+
+static bool gap_reserve(struct ml666_st_source_map* map, size_t count){
+  if(map->gap_end - map->gap_begin >= count)
+    return true;
+  size_t capacity = map->capacity ? map->capacity * 2 : 64;
+  while(capacity - boundary_count(map) < count)
+    capacity *= 2;
+  struct boundary* boundary = map->realloc(map->user_ptr, map->boundary, capacity * sizeof(*boundary));
+  if(!boundary){
+    perror("realloc failed");
+    return false;
+  }
+  const size_t tail = map->capacity - map->gap_end;
+  memmove(&boundary[capacity - tail], &boundary[map->gap_end], tail * sizeof(*boundary));
+  map->boundary = boundary;
+  map->gap_end = capacity - tail;
+  map->capacity = capacity;
+  return true;
+}
+
+// Collects the boundaries of a source, and the elements they belong to. The elements come in the same order as their start tags.
+struct collect {
+  struct ml666_st_source_map* map;
+  struct ml666_st_builder* stb;
+  struct ml666_st_cursor cursor;
+  struct ml666_st_node* current;
+  size_t base_offset, base_depth;
+  size_t length; // The length of the source scanned
+  bool open; // Whether elements may be left open. Only at the end of the whole source, everything else ends them early.
+  struct boundary* boundary;
+  size_t count, capacity;
+};
+
+static struct ml666_st_node* next_element(struct collect* c){
+  while(ml666_st_cursor_next(c->stb, &c->cursor))
+    if(c->cursor.event == ML666_ST_CE_ENTER && ML666_ST_TYPE(c->cursor.node) == ML666_ST_NT_ELEMENT)
+      return c->cursor.node;
+  return 0;
+}
+
+static bool collect_cb(void* user_ptr, enum ml666_structure_scan_event event, size_t offset, size_t depth){
+  struct collect* c = user_ptr;
+  struct ml666_st_node* node = c->current;
+  // Only the end of the source ends an element there, an end tag is longer than that
+  if(event == ML666_SCAN_CONTENT_END && offset == c->length && !c->open)
+    return false;
+  if(event == ML666_SCAN_ELEMENT_BEGIN)
+    node = c->current = next_element(c);
+  if(!node)
+    return false;
+  if(event == ML666_SCAN_ELEMENT_END)
+    c->current = ml666_st_member_get_parent(c->stb, (struct ml666_st_member*)node);
+  if(c->count == c->capacity){
+    const size_t capacity = c->capacity ? c->capacity * 2 : 64;
+    struct boundary* boundary = c->map->realloc(c->map->user_ptr, c->boundary, capacity * sizeof(*boundary));
+    if(!boundary){
+      perror("realloc failed");
+      return false;
+    }
+    c->boundary = boundary;
+    c->capacity = capacity;
+  }
+  c->boundary[c->count++] = (struct boundary){
+    .node = node,
+    .offset = c->base_offset + offset,
+    .depth = c->base_depth + depth,
+    .event = event,
+  };
+  return true;
+}
+
+// Scans the source of a document. There mustn't be any elements left over either.
+static bool collect(struct collect* c, struct ml666_st_node* root, struct ml666_buffer_ro input, bool open){
+  c->cursor = ml666_st_cursor_create(root);
+  c->current = root;
+  c->length = input.length;
+  c->open = open;
+  return ml666_structure_scan(input, collect_cb, .max_depth=SIZE_MAX, .user_ptr=c) && !next_element(c) && !c->cursor.error;
+}
+
+// A "//" comment on the last line of a part could go on past its end. This also catches some which don't, the caller just tries a bigger part then.
+static bool may_end_in_line_comment(struct ml666_buffer_ro input){
+  for(size_t i=input.length; i-- > 1 && input.data[i] != '\n'; )
+    if(input.data[i] == '/' && input.data[i-1] == '/')
+      return true;
+  return false;
+}
+
+struct ml666_st_source_map* ml666_st_source_map_create_p(struct ml666_st_source_map_create_args args){
+  if(!args.stb){
+    fprintf(stderr, "ml666_st_source_map_create_p: mandatory argument \"stb\" not set!\n");
+    return 0;
+  }
+  if(!args.document){
+    fprintf(stderr, "ml666_st_source_map_create_p: mandatory argument \"document\" not set!\n");
+    return 0;
+  }
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_st_source_map* map = args.malloc(args.user_ptr, sizeof(*map));
+  if(!map){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(map, 0, sizeof(*map));
+  map->stb = args.stb;
+  map->document = args.document;
+  map->length = args.input.length;
+  map->user_ptr = args.user_ptr;
+  map->malloc = args.malloc;
+  map->realloc = args.realloc;
+  map->free = args.free;
+  struct collect c = {
+    .map = map,
+    .stb = args.stb,
+  };
+  if(!collect(&c, ML666_ST_NODE(args.document), args.input, true)){
+    fprintf(stderr, "ml666_st_source_map_create_p: the input doesn't match the document\n");
+    if(c.boundary)
+      map->realloc(map->user_ptr, c.boundary, 0);
+    map->free(map->user_ptr, map);
+    return 0;
+  }
+  map->boundary = c.boundary;
+  map->capacity = c.capacity;
+  map->gap_begin = c.count;
+  map->gap_end = c.capacity;
+  return map;
+}
+
+void ml666_st_source_map_destroy(struct ml666_st_source_map* map){
+  if(map->boundary)
+    map->realloc(map->user_ptr, map->boundary, 0);
+  map->free(map->user_ptr, map);
+}
+
+/*
+ * A boundary is a place in the list of members of an element. The start tag of an element is in front of it in the
+ * members of its parent, the end of the start tag is in front of its first member, and so on. The part to be parsed
+ * again starts & ends at places in the same list.
+ */
+
+struct place {
+  size_t index; // Index of the boundary. SIZE_MAX for the start of the source, the number of boundaries for the end.
+  size_t offset;
+  size_t level; // How many elements the place is in
+  struct ml666_st_node* container; // The node it's a place in the members of
+};
+
+static struct place place_at(const struct ml666_st_source_map* map, size_t index){
+  if(index == SIZE_MAX || index == boundary_count(map)){
+    return (struct place){
+      .index = index,
+      .offset = index == SIZE_MAX ? 0 : map->length,
+      .container = ML666_ST_NODE(map->document),
+    };
+  }
+  const struct boundary* b = boundary_at(map, index);
+  const bool inside = b->event == ML666_SCAN_CONTENT_BEGIN || b->event == ML666_SCAN_CONTENT_END;
+  return (struct place){
+    .index = index,
+    .offset = offset_at(map, index),
+    .level = b->depth + inside,
+    .container = inside ? b->node : ml666_st_member_get_parent(map->stb, (struct ml666_st_member*)b->node),
+  };
+}
+
+// To the place in front of the container
+static struct place place_up_begin(const struct ml666_st_source_map* map, struct place p){
+  size_t i = p.index;
+  do i--; while(boundary_at(map, i)->node != p.container || boundary_at(map, i)->event != ML666_SCAN_ELEMENT_BEGIN);
+  return place_at(map, i);
+}
+
+// To the place after the container
+static struct place place_up_end(const struct ml666_st_source_map* map, struct place p){
+  size_t i = p.index;
+  do i++; while(boundary_at(map, i)->node != p.container || boundary_at(map, i)->event != ML666_SCAN_ELEMENT_END);
+  return place_at(map, i);
+}
+
+/*
+ * The start tag of an element is after the place in front of it, and its end tag is in front of the place after it.
+ * When a part starts or ends at such a place, the boundary of the place is in the part too, and gets replaced.
+ */
+
+// The index of the first boundary in a part starting at the place
+static size_t place_first_inside(const struct ml666_st_source_map* map, struct place p){
+  if(p.index == SIZE_MAX)
+    return 0;
+  return boundary_at(map, p.index)->event == ML666_SCAN_ELEMENT_BEGIN ? p.index : p.index + 1;
+}
+
+// The index after the last boundary in a part ending at the place
+static size_t place_last_inside(const struct ml666_st_source_map* map, struct place p){
+  if(p.index == boundary_count(map))
+    return p.index;
+  return boundary_at(map, p.index)->event == ML666_SCAN_ELEMENT_END ? p.index + 1 : p.index;
+}
+
+// The first member after the place, 0 if there is none
+static struct ml666_st_member* member_after(const struct ml666_st_source_map* map, struct place p){
+  if(p.index == SIZE_MAX || p.index == boundary_count(map))
+    return p.index == SIZE_MAX ? ml666_st_get_first_child(map->stb, ML666_ST_U_CHILDREN(map->stb, p.container)) : 0;
+  const struct boundary* b = boundary_at(map, p.index);
+  switch(b->event){
+    case ML666_SCAN_ELEMENT_BEGIN: return (struct ml666_st_member*)b->node;
+    case ML666_SCAN_CONTENT_BEGIN: return ml666_st_get_first_child(map->stb, ML666_ST_U_CHILDREN(map->stb, b->node));
+    case ML666_SCAN_CONTENT_END: return 0;
+    case ML666_SCAN_ELEMENT_END: return ml666_st_member_get_next(map->stb, (struct ml666_st_member*)b->node);
+  }
+  return 0;
+}
+
+// Neighbouring contents become one, and so do comments, if there are only spaces between them
+static bool merge(struct ml666_st_member* a, struct ml666_st_member* b){
+  if(!a || !b || ML666_ST_TYPE(ML666_ST_NODE(a)) != ML666_ST_TYPE(ML666_ST_NODE(b)))
+    return false;
+  return ML666_ST_TYPE(ML666_ST_NODE(a)) == ML666_ST_NT_CONTENT || ML666_ST_TYPE(ML666_ST_NODE(a)) == ML666_ST_NT_COMMENT;
+}
+
+// Checks if the members at the ends of the part would have become one with the members around it
+static bool merges_with_neighbours(const struct ml666_st_source_map* map, struct place begin, struct place end, struct ml666_st_document* part){
+  struct ml666_st_builder* stb = map->stb;
+  struct ml666_st_member* first = member_after(map, begin);
+  struct ml666_st_member* next = member_after(map, end);
+  struct ml666_st_member* previous = first ? ml666_st_member_get_previous(stb, first) : ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, begin.container));
+  struct ml666_st_children* children = ML666_ST_CHILDREN(stb, part);
+  struct ml666_st_member* part_first = ml666_st_get_first_child(stb, children);
+  if(!part_first)
+    return merge(previous, next);
+  return merge(previous, part_first) || merge(ml666_st_get_last_child(stb, children), next);
+}
+
+// Finds the first boundary after offset, or the first one at or after it
+static size_t boundary_search(const struct ml666_st_source_map* map, size_t offset, bool after){
+  size_t begin = 0;
+  size_t end = boundary_count(map);
+  while(begin < end){
+    const size_t middle = begin + (end - begin) / 2;
+    const size_t it = offset_at(map, middle);
+    if(it < offset || (after && it == offset)){
+      begin = middle + 1;
+    }else{
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+static void dispose_document(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+// Errors aren't reported, the part is just made bigger
+static struct ml666_st_document* parse_part(struct ml666_st_source_map* map, struct ml666_buffer_ro input){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(
+    .input = input,
+    .user_ptr = map->user_ptr,
+    .malloc = map->malloc,
+    .free = map->free,
+  );
+  if(!tokenizer)
+    return 0;
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(
+    .stb = map->stb,
+    .tokenizer = tokenizer,
+    .user_ptr = map->user_ptr,
+    .malloc = map->malloc,
+    .realloc = map->realloc,
+    .free = map->free,
+  );
+  if(!stp)
+    return 0;
+  while(ml666_simple_tree_parser_next(stp));
+  struct ml666_st_document* document = stp->error ? 0 : ml666_simple_tree_parser_take_document(stp);
+  ml666_simple_tree_parser_destroy(stp);
+  return document;
+}
+
+bool ml666_st_reparse_p(struct ml666_st_reparse_args args){
+  struct ml666_st_source_map* map = args.map;
+  if(!map){
+    fprintf(stderr, "ml666_st_reparse_p: mandatory argument \"map\" not set!\n");
+    return false;
+  }
+  if(args.input.length != map->length){
+    fprintf(stderr, "ml666_st_reparse_p: the input isn't the one the map is for\n");
+    return false;
+  }
+  if(args.offset > args.input.length || args.length > args.input.length - args.offset){
+    fprintf(stderr, "ml666_st_reparse_p: the edit is out of range\n");
+    return false;
+  }
+  struct ml666_st_builder* stb = map->stb;
+  const char* data = args.input.data;
+
+  // The part starts & ends at places in the same list of members, the tightest ones around the edit
+  const size_t first = boundary_search(map, args.offset, true) - 1; // SIZE_MAX if there is none
+  size_t last = boundary_search(map, args.offset + args.length, false);
+  if(last <= first && first != SIZE_MAX)
+    last = first + 1;
+  struct place begin = place_at(map, first);
+  struct place end = place_at(map, last);
+  while(begin.level != end.level || begin.container != end.container){
+    const size_t level = begin.level;
+    if(begin.level >= end.level)
+      begin = place_up_begin(map, begin);
+    if(end.level >= level)
+      end = place_up_end(map, end);
+  }
+  // Elements left open end with the source. An edit at its end can change where they end, so they are all parsed again.
+  const size_t count = boundary_count(map);
+  if(args.offset + args.length == map->length && count >= 2 && boundary_at(map, count - 2)->event == ML666_SCAN_CONTENT_END && offset_at(map, count - 2) == map->length){
+    const struct place outermost = place_up_begin(map, (struct place){ .index = count - 1, .container = boundary_at(map, count - 1)->node });
+    if(begin.container != ML666_ST_NODE(map->document) || (begin.index != SIZE_MAX && begin.index > outermost.index))
+      begin = outermost;
+    end = place_at(map, count);
+  }
+  // Comments in a start tag become the first members of the element, so a part can't start after such a tag
+  if(begin.index != SIZE_MAX && boundary_at(map, begin.index)->event == ML666_SCAN_CONTENT_BEGIN){
+    const size_t tag = offset_at(map, begin.index - 1);
+    if(memchr(&data[tag], '/', begin.offset - tag)){
+      begin = place_up_begin(map, begin);
+      end = place_up_end(map, end);
+    }
+  }
+
+  char* buffer = 0;
+  size_t size = 0;
+  struct ml666_st_document* part = 0;
+  struct collect c = {
+    .map = map,
+    .stb = stb,
+  };
+  bool ok = false;
+  while(true){
+    const size_t length = (args.offset - begin.offset) + args.replacement.length + (end.offset - args.offset - args.length);
+    if(length > size){
+      char* result = map->realloc(map->user_ptr, buffer, length);
+      if(!result){
+        perror("realloc failed");
+        goto end;
+      }
+      buffer = result;
+      size = length;
+    }
+    if(length){ // The part is empty if an empty edit is made between two boundaries
+      memcpy(buffer, data + begin.offset, args.offset - begin.offset);
+      memcpy(buffer + args.offset - begin.offset, args.replacement.data, args.replacement.length);
+      memcpy(buffer + args.offset - begin.offset + args.replacement.length, data + args.offset + args.length, end.offset - args.offset - args.length);
+    }
+    // The tokenizer reads from the fd if there is no data, so an empty part still needs some
+    const struct ml666_buffer_ro input = { .data = length ? buffer : "", .length = length };
+    if(args.reparsed)
+      *args.reparsed = length;
+    part = end.offset == map->length || !may_end_in_line_comment(input) ? parse_part(map, input) : 0;
+    if(part){
+      c.count = 0;
+      c.base_offset = begin.offset;
+      c.base_depth = begin.level;
+      if(collect(&c, ML666_ST_NODE(part), input, end.offset == map->length) && !merges_with_neighbours(map, begin, end, part))
+        break;
+      dispose_document(stb, part);
+      part = 0;
+    }
+    // It didn't work out, the tokens after the part must be different now. Try again with the whole container.
+    if(begin.container == ML666_ST_NODE(map->document)){
+      if(begin.index == SIZE_MAX && end.index == boundary_count(map)){
+        fprintf(stderr, "ml666_st_reparse_p: the edited source isn't a valid document\n");
+        goto end;
+      }
+      begin = place_at(map, SIZE_MAX);
+      end = place_at(map, boundary_count(map));
+    }else{
+      begin = place_up_begin(map, begin);
+      end = place_up_end(map, end);
+    }
+  }
+
+  // From here on, nothing can fail anymore
+  const size_t first_removed = place_first_inside(map, begin);
+  const size_t removed = place_last_inside(map, end) - first_removed;
+  if(c.count > removed && !gap_reserve(map, c.count - removed))
+    goto end;
+
+  struct ml666_st_member* before = member_after(map, end);
+  for(struct ml666_st_member* it=member_after(map, begin); it!=before; ){
+    struct ml666_st_member* next = ml666_st_member_get_next(stb, it);
+    ml666_st_node_ref(stb, ML666_ST_NODE(it));
+    ml666_st_member_set(stb, 0, it, 0);
+    struct ml666_st_children* children = ML666_ST_U_CHILDREN(stb, it);
+    if(children)
+      ml666_st_subtree_disintegrate(stb, children);
+    ml666_st_node_put(stb, ML666_ST_NODE(it));
+    it = next;
+  }
+  struct ml666_st_children* children = ML666_ST_CHILDREN(stb, part);
+  for(struct ml666_st_member* it; (it=ml666_st_get_first_child(stb, children)); )
+    ml666_st_member_set(stb, begin.container, it, before);
+  ml666_st_node_put(stb, ML666_ST_NODE(part));
+  part = 0;
+
+  gap_move(map, first_removed);
+  map->gap_end += removed;
+  if(c.count)
+    memcpy(&map->boundary[map->gap_begin], c.boundary, c.count * sizeof(*c.boundary));
+  map->gap_begin += c.count;
+  map->length = map->length - args.length + args.replacement.length;
+  ok = true;
+
+end:
+  if(part)
+    dispose_document(stb, part);
+  if(c.boundary)
+    map->realloc(map->user_ptr, c.boundary, 0);
+  if(buffer)
+    map->realloc(map->user_ptr, buffer, 0);
+  return ok;
+}
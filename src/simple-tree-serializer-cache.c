@@ -0,0 +1,243 @@
+#include <ml666/simple-tree-serializer.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/utils.h>
+#include <string.h>
+#include <stdio.h>
+
+// The output of a node in a run. Entries are in the order the nodes were entered, so the ones of the nodes
+// in a subtree come right after the one of its root.
+struct entry {
+  const struct ml666_st_node* node; // 0 if nothing is remembered for it
+  uint64_t generation;
+  unsigned level;
+  size_t start, length;
+};
+
+struct run {
+  struct entry* entry;
+  size_t count, entry_capacity;
+  char* output;
+  size_t length, output_capacity;
+};
+
+struct ml666_st_serializer_cache {
+  struct ml666_st_serializer_cache_create_args a;
+  struct ml666_st_builder* stb;
+  const void* format;
+  bool busy, failed;
+  struct run last, current;
+  size_t* table; // Indices into last.entry, plus one
+  size_t table_mask;
+  size_t* open; // Indices into current.entry of the nodes which have been entered but not left yet
+  size_t open_count, open_capacity;
+};
+
+static bool reserve(struct ml666_st_serializer_cache* cache, void* array, size_t* capacity, size_t count, size_t needed, size_t size){
+  if(needed <= *capacity)
+    return true;
+  size_t new_capacity = *capacity ? *capacity : 16;
+  while(new_capacity < needed)
+    new_capacity *= 2;
+  void* result = cache->a.malloc(cache->a.user_ptr, new_capacity * size);
+  if(!result){
+    perror("malloc failed");
+    return false;
+  }
+  void** old = array;
+  if(*old){
+    memcpy(result, *old, count * size);
+    cache->a.free(cache->a.user_ptr, *old);
+  }
+  *old = result;
+  *capacity = new_capacity;
+  return true;
+}
+
+static size_t slot_of(const struct ml666_st_node* node, unsigned level){
+  uint64_t key = (uint64_t)(uintptr_t)node ^ ((uint64_t)level << 48);
+  key *= 0x9E3779B97F4A7C15u;
+  return key ^ (key >> 32);
+}
+
+static const struct entry* lookup(const struct ml666_st_serializer_cache* cache, const struct ml666_st_node* node, unsigned level){
+  if(!cache->table)
+    return 0;
+  for(size_t i=slot_of(node, level); cache->table[i & cache->table_mask]; i++){
+    const struct entry* it = &cache->last.entry[cache->table[i & cache->table_mask] - 1];
+    if(it->node == node && it->level == level)
+      return it;
+  }
+  return 0;
+}
+
+static void run_free(struct ml666_st_serializer_cache* cache, struct run* run){
+  if(run->entry)
+    cache->a.free(cache->a.user_ptr, run->entry);
+  if(run->output)
+    cache->a.free(cache->a.user_ptr, run->output);
+  memset(run, 0, sizeof(*run));
+}
+
+static void table_free(struct ml666_st_serializer_cache* cache){
+  if(cache->table)
+    cache->a.free(cache->a.user_ptr, cache->table);
+  cache->table = 0;
+  cache->table_mask = 0;
+}
+
+// Drops the entries of the nodes which weren't remembered, and indexes the rest
+static bool table_build(struct ml666_st_serializer_cache* cache){
+  struct run* run = &cache->last;
+  size_t count = 0;
+  for(size_t i=0; i<run->count; i++)
+    if(run->entry[i].node)
+      run->entry[count++] = run->entry[i];
+  run->count = count;
+  table_free(cache);
+  if(!count)
+    return true;
+  size_t size = 16;
+  while(size < count * 2)
+    size *= 2;
+  cache->table = cache->a.malloc(cache->a.user_ptr, size * sizeof(*cache->table));
+  if(!cache->table){
+    perror("malloc failed");
+    return false;
+  }
+  memset(cache->table, 0, size * sizeof(*cache->table));
+  cache->table_mask = size - 1;
+  for(size_t i=0; i<count; i++){
+    size_t j = slot_of(run->entry[i].node, run->entry[i].level);
+    while(cache->table[j & cache->table_mask])
+      j++;
+    cache->table[j & cache->table_mask] = i + 1;
+  }
+  return true;
+}
+
+struct ml666_st_serializer_cache* ml666_st_serializer_cache_create_p(struct ml666_st_serializer_cache_create_args args){
+  if(!args.min_size)
+    args.min_size = 256;
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666_st_serializer_cache* cache = args.malloc(args.user_ptr, sizeof(*cache));
+  if(!cache){
+    perror("malloc failed");
+    return 0;
+  }
+  memset(cache, 0, sizeof(*cache));
+  cache->a = args;
+  return cache;
+}
+
+void ml666_st_serializer_cache_destroy(struct ml666_st_serializer_cache* cache){
+  run_free(cache, &cache->last);
+  run_free(cache, &cache->current);
+  table_free(cache);
+  if(cache->open)
+    cache->a.free(cache->a.user_ptr, cache->open);
+  cache->a.free(cache->a.user_ptr, cache);
+}
+
+bool ml666_st_serializer_cache_begin(struct ml666_st_serializer_cache* cache, struct ml666_st_builder* stb, const void* format){
+  if(cache->busy){
+    fprintf(stderr, "ml666_st_serializer_cache_begin: the cache is already in use\n");
+    return false;
+  }
+  if(cache->format && (cache->format != format || cache->stb != stb)){
+    fprintf(stderr, "ml666_st_serializer_cache_begin: the cache was used with another serializer or builder\n");
+    return false;
+  }
+  cache->format = format;
+  cache->stb = stb;
+  cache->busy = true;
+  cache->failed = false;
+  cache->current.count = 0;
+  cache->current.length = 0;
+  cache->open_count = 0;
+  return true;
+}
+
+bool ml666_st_serializer_cache_enter(struct ml666_st_serializer_cache* cache, struct ml666_st_node* node, unsigned level, struct ml666_buffer_ro* output){
+  if(cache->failed)
+    return false;
+  const uint64_t generation = ml666_st_node_get_generation(cache->stb, node);
+  if(!generation)
+    return false;
+  struct run* run = &cache->current;
+  const struct entry* entry = lookup(cache, node, level);
+  if(entry && entry->generation == generation){
+    // The entries of the nodes in the subtree are still valid too
+    const struct entry* end = entry + 1;
+    while(end < cache->last.entry + cache->last.count && end->start < entry->start + entry->length)
+      end++;
+    const size_t count = end - entry;
+    if(!reserve(cache, &run->entry, &run->entry_capacity, run->count, run->count + count, sizeof(*run->entry))){
+      cache->failed = true;
+      return false;
+    }
+    for(size_t i=0; i<count; i++){
+      struct entry* it = &run->entry[run->count++];
+      *it = entry[i];
+      it->start = entry[i].start - entry->start + run->length;
+    }
+    *output = (struct ml666_buffer_ro){
+      .data = cache->last.output + entry->start,
+      .length = entry->length,
+    };
+    return true;
+  }
+  if( !reserve(cache, &run->entry, &run->entry_capacity, run->count, run->count + 1, sizeof(*run->entry))
+   || !reserve(cache, &cache->open, &cache->open_capacity, cache->open_count, cache->open_count + 1, sizeof(*cache->open))
+  ){
+    cache->failed = true;
+    return false;
+  }
+  cache->open[cache->open_count++] = run->count;
+  run->entry[run->count++] = (struct entry){
+    .node = node,
+    .generation = generation,
+    .level = level,
+    .start = run->length,
+  };
+  return false;
+}
+
+void ml666_st_serializer_cache_leave(struct ml666_st_serializer_cache* cache, struct ml666_st_node* node){
+  if(!cache->open_count)
+    return;
+  struct entry* entry = &cache->current.entry[cache->open[cache->open_count-1]];
+  if(entry->node != node)
+    return;
+  cache->open_count -= 1;
+  entry->length = cache->current.length - entry->start;
+  if(entry->length < cache->a.min_size)
+    entry->node = 0;
+}
+
+void ml666_st_serializer_cache_output(struct ml666_st_serializer_cache* cache, struct ml666_buffer_ro data){
+  if(cache->failed || !data.length)
+    return;
+  struct run* run = &cache->current;
+  if(!reserve(cache, &run->output, &run->output_capacity, run->length, run->length + data.length, 1)){
+    cache->failed = true;
+    return;
+  }
+  memcpy(run->output + run->length, data.data, data.length);
+  run->length += data.length;
+}
+
+void ml666_st_serializer_cache_end(struct ml666_st_serializer_cache* cache, bool complete){
+  cache->busy = false;
+  cache->open_count = 0;
+  if(!complete || cache->failed)
+    return;
+  // The buffers of the last run are reused for the next one
+  const struct run last = cache->last;
+  cache->last = cache->current;
+  cache->current = last;
+  if(!table_build(cache))
+    run_free(cache, &cache->last);
+}
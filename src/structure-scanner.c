@@ -0,0 +1,161 @@
+#include <ml666/structure-scanner.h>
+#include <stdint.h>
+#include <string.h>
+
+// All of these return the offset after the skipped thing, or SIZE_MAX if the input ended early or was invalid
+
+// i is the offset after the opening "`"
+static size_t skip_string(const char* data, size_t n, size_t i){
+  while(i < n){
+    const char* x = memchr(&data[i], '`', n-i);
+    if(!x)
+      return SIZE_MAX;
+    size_t e = x - data;
+    // An odd number of backslashes in front of it means it's escaped
+    size_t b = e;
+    while(b > i && data[b-1] == '\\')
+      b--;
+    if(!((e-b) & 1))
+      return e + 1;
+    i = e + 1;
+  }
+  return SIZE_MAX;
+}
+
+// i is the offset of the first "/"
+static size_t skip_comment(const char* data, size_t n, size_t i){
+  if(i+1 >= n)
+    return SIZE_MAX;
+  if(data[i+1] == '/'){
+    // It may also end with the input
+    const char* x = memchr(&data[i+2], '\n', n-i-2);
+    return x ? (size_t)(x - data) + 1 : n;
+  }
+  if(data[i+1] != '*')
+    return SIZE_MAX;
+  for(i+=2; i<n; i++){
+    if(data[i] == '\\'){
+      i++;
+    }else if(data[i] == '*'){
+      return i+1 < n && data[i+1] == '/' ? i + 2 : SIZE_MAX;
+    }
+  }
+  return SIZE_MAX;
+}
+
+// i is the offset of the "`", "H" or "B" of a string
+static size_t skip_any_string(const char* data, size_t n, size_t i){
+  if(data[i] == 'H' || data[i] == 'B'){
+    if(i+1 >= n || data[i+1] != '`')
+      return SIZE_MAX;
+    i++;
+  }else if(data[i] != '`'){
+    return SIZE_MAX;
+  }
+  return skip_string(data, n, i+1);
+}
+
+// i is the offset after the "<". Sets *self_closing for "/>".
+static size_t skip_start_tag(const char* data, size_t n, size_t i, bool* self_closing){
+  *self_closing = false;
+  for(; i<n; i++){
+    const char ch = data[i];
+    if(ch == ' ' || ch == '\n' || ch == '/' || ch == '>')
+      break;
+    if(ch == '\\')
+      i++;
+  }
+  while(i < n){
+    switch(data[i]){
+      case ' ': case '\n': i++; break;
+      case '>': return i + 1;
+      case '/': {
+        if(i+1 < n && data[i+1] == '>'){
+          *self_closing = true;
+          return i + 2;
+        }
+        i = skip_comment(data, n, i);
+        if(i == SIZE_MAX)
+          return SIZE_MAX;
+        // A "//" comment ending with the input ends the tag too
+        if(i == n)
+          return n;
+      } break;
+      case '=': {
+        if(++i >= n)
+          return SIZE_MAX;
+        i = skip_any_string(data, n, i);
+        if(i == SIZE_MAX)
+          return SIZE_MAX;
+      } break;
+      case '\\': i += 2; break;
+      default: i++; break;
+    }
+  }
+  return SIZE_MAX;
+}
+
+// i is the offset after the "</"
+static size_t skip_end_tag(const char* data, size_t n, size_t i){
+  for(; i<n; i++){
+    if(data[i] == '\\'){
+      i++;
+    }else if(data[i] == '>'){
+      return i + 1;
+    }
+  }
+  return SIZE_MAX;
+}
+
+bool ml666_structure_scan_p(struct ml666_structure_scan_args args){
+  const char*const data = args.input.data;
+  const size_t n = args.input.length;
+  size_t depth = 0;
+  size_t i = 0;
+#define EMIT(EVENT, OFFSET) \
+  if(depth <= args.max_depth && !args.cb(args.user_ptr, (EVENT), (OFFSET), depth)) \
+    return false;
+  while(i < n){
+    switch(data[i]){
+      case ' ': case '\n': i++; continue;
+      case '`': case 'H': case 'B': i = skip_any_string(data, n, i); break;
+      case '/': i = skip_comment(data, n, i); break;
+      case '<': {
+        const size_t start = i;
+        if(i+1 < n && data[i+1] == '/'){
+          if(!depth)
+            return false;
+          i = skip_end_tag(data, n, i+2);
+          if(i == SIZE_MAX)
+            return false;
+          depth -= 1;
+          EMIT(ML666_SCAN_CONTENT_END, start);
+          EMIT(ML666_SCAN_ELEMENT_END, i);
+          continue;
+        }
+        EMIT(ML666_SCAN_ELEMENT_BEGIN, start);
+        bool self_closing;
+        i = skip_start_tag(data, n, i+1, &self_closing);
+        if(i == SIZE_MAX)
+          return false;
+        if(self_closing){
+          EMIT(ML666_SCAN_ELEMENT_END, i);
+        }else{
+          EMIT(ML666_SCAN_CONTENT_BEGIN, i);
+          depth += 1;
+        }
+      } continue;
+      default: return false;
+    }
+    if(i == SIZE_MAX)
+      return false;
+  }
+  // Like the tokenizer, the end of the input ends the elements which are still open
+  while(depth){
+    depth -= 1;
+    EMIT(ML666_SCAN_CONTENT_END, n);
+    EMIT(ML666_SCAN_ELEMENT_END, n);
+  }
+#undef EMIT
+  return true;
+}
@@ -0,0 +1,575 @@
+#include <ml666/tape.h>
+#include <ml666/utils.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+
+ML666_DEFAULT_OPAQUE_TAG_NAME
+ML666_DEFAULT_OPAQUE_ATTRIBUTE_NAME
+
+#define ML666_TAPE_BUFFER_SIZE ((size_t)1<<16)
+
+//// Recorder
+
+struct ml666__tape_recorder_name {
+  const ml666_hashed_buffer_set_entry* name; // 0 if the slot is free
+  size_t id;
+};
+
+struct ml666__tape_recorder_private {
+  struct ml666_tape_recorder public;
+  int fd;
+  struct ml666_hashed_buffer_set* buffer_set;
+
+  // Maps the interned names to their ID. Open addressing, the size is always a power of 2.
+  struct ml666__tape_recorder_name* name_map;
+  size_t name_map_size;
+  // The names by ID
+  const ml666_hashed_buffer_set_entry** name;
+  size_t name_count;
+
+  // The IDs of the names of the open elements
+  size_t* stack;
+  size_t stack_size;
+  size_t depth;
+
+  char* buffer;
+  size_t buffer_length;
+  bool terminated;
+
+  ml666__cb__malloc* malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free* free;
+};
+static_assert(offsetof(struct ml666__tape_recorder_private, public) == 0);
+
+static bool write_all(int fd, const char* data, size_t length){
+  size_t offset = 0;
+  while(offset < length){
+    ssize_t result = write(fd, data + offset, length - offset);
+    if(result < 0){
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    offset += result;
+  }
+  return true;
+}
+
+static bool tape_flush(struct ml666__tape_recorder_private* that){
+  if(!write_all(that->fd, that->buffer, that->buffer_length))
+    return false;
+  that->buffer_length = 0;
+  return true;
+}
+
+static bool tape_write(struct ml666__tape_recorder_private* that, const void* data, size_t length){
+  if(!length)
+    return true;
+  that->public.size += length;
+  if(that->buffer_length + length > ML666_TAPE_BUFFER_SIZE){
+    if(!tape_flush(that))
+      return false;
+    // Big chunks are written directly, there is no point in copying them first
+    if(length >= ML666_TAPE_BUFFER_SIZE)
+      return write_all(that->fd, data, length);
+  }
+  if(!that->buffer){
+    that->buffer = that->malloc(that->public.user_ptr, ML666_TAPE_BUFFER_SIZE);
+    if(!that->buffer)
+      return false;
+  }
+  memcpy(that->buffer + that->buffer_length, data, length);
+  that->buffer_length += length;
+  return true;
+}
+
+static bool tape_write_op(struct ml666__tape_recorder_private* that, enum ml666_tape_opcode op, size_t number){
+  unsigned char record[1+(sizeof(size_t)*8+6)/7];
+  size_t length = 0;
+  record[length++] = op;
+  do {
+    record[length] = number & 0x7F;
+    number >>= 7;
+    if(number)
+      record[length] |= 0x80;
+    length += 1;
+  } while(number);
+  return tape_write(that, record, length);
+}
+
+static bool tape_write_chunk(struct ml666__tape_recorder_private* that, enum ml666_tape_opcode op, struct ml666_buffer_ro data){
+  if(!tape_write_op(that, op, data.length))
+    return false;
+  return tape_write(that, data.data, data.length);
+}
+
+static struct ml666__tape_recorder_name* name_map_find(struct ml666__tape_recorder_private* that, const ml666_hashed_buffer_set_entry* name){
+  const size_t mask = that->name_map_size - 1;
+  for(size_t i=ml666_hashed_buffer_set__peek(name)->hash & mask; ; i=(i+1) & mask){
+    struct ml666__tape_recorder_name* it = &that->name_map[i];
+    if(!it->name || it->name == name)
+      return it;
+  }
+}
+
+static bool name_map_grow(struct ml666__tape_recorder_private* that){
+  const size_t size = that->name_map_size ? that->name_map_size * 2 : 64;
+  struct ml666__tape_recorder_name* name_map = that->malloc(that->public.user_ptr, size * sizeof(*name_map));
+  if(!name_map)
+    return false;
+  memset(name_map, 0, size * sizeof(*name_map));
+  const ml666_hashed_buffer_set_entry** name = that->realloc(that->public.user_ptr, that->name, size / 2 * sizeof(*name));
+  if(!name){
+    that->free(that->public.user_ptr, name_map);
+    return false;
+  }
+  that->name = name;
+  if(that->name_map)
+    that->free(that->public.user_ptr, that->name_map);
+  that->name_map = name_map;
+  that->name_map_size = size;
+  for(size_t i=0; i<that->name_count; i++)
+    *name_map_find(that, name[i]) = (struct ml666__tape_recorder_name){ .name = name[i], .id = i };
+  return true;
+}
+
+// Returns the ID of the name, and adds it to the tape if it isn't there yet
+static bool tape_name(struct ml666__tape_recorder_private* that, struct ml666_buffer_ro buffer, size_t* id){
+  if((that->name_count + 1) * 2 > that->name_map_size)
+    if(!name_map_grow(that))
+      return false;
+  const ml666_hashed_buffer_set_entry* entry = ml666_hashed_buffer_set__lookup(that->buffer_set, ML666_LCPTR(ml666_hashed_buffer__create(buffer)), ML666_HBS_M_ADD_COPY);
+  if(!entry)
+    return false;
+  struct ml666__tape_recorder_name* it = name_map_find(that, entry);
+  if(it->name){
+    ml666_hashed_buffer_set__put(that->buffer_set, entry);
+    *id = it->id;
+    return true;
+  }
+  if(!tape_write_chunk(that, ML666_TAPE_OP_NAME, buffer)){
+    ml666_hashed_buffer_set__put(that->buffer_set, entry);
+    return false;
+  }
+  it->name = entry;
+  it->id = that->name_count;
+  that->name[that->name_count++] = entry;
+  *id = it->id;
+  return true;
+}
+
+struct ml666_tape_recorder* ml666_tape_recorder_create_p(struct ml666_tape_recorder_create_args args){
+  if(args.fd < 0){
+    fprintf(stderr, "ml666_tape_recorder_create_p: invalid fd argument\n");
+    return 0;
+  }
+  if(!args.buffer_set)
+    args.buffer_set = ml666_hashed_buffer_set__get_default();
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666__tape_recorder_private* recorder = args.malloc(args.user_ptr, sizeof(*recorder));
+  if(!recorder){
+    fprintf(stderr, "ml666_tape_recorder_create_p: *malloc failed (%d): %s\n", errno, strerror(errno));
+    close(args.fd);
+    return 0;
+  }
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->public.user_ptr = args.user_ptr;
+  recorder->fd = args.fd;
+  recorder->buffer_set = args.buffer_set;
+  recorder->malloc = args.malloc;
+  recorder->realloc = args.realloc;
+  recorder->free = args.free;
+  return &recorder->public;
+}
+
+void ml666_tape_recorder_destroy(struct ml666_tape_recorder* _recorder){
+  struct ml666__tape_recorder_private* recorder = (struct ml666__tape_recorder_private*)_recorder;
+  if(recorder->buffer_length && !tape_flush(recorder))
+    fprintf(stderr, "ml666_tape_recorder_destroy: write failed (%d): %s\n", errno, strerror(errno));
+  if(close(recorder->fd))
+    fprintf(stderr, "%s:%u: close failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+  for(size_t i=0; i<recorder->name_count; i++)
+    ml666_hashed_buffer_set__put(recorder->buffer_set, recorder->name[i]);
+  if(recorder->name_map)
+    recorder->free(recorder->public.user_ptr, recorder->name_map);
+  if(recorder->name)
+    recorder->realloc(recorder->public.user_ptr, recorder->name, 0);
+  if(recorder->stack)
+    recorder->realloc(recorder->public.user_ptr, recorder->stack, 0);
+  if(recorder->buffer)
+    recorder->free(recorder->public.user_ptr, recorder->buffer);
+  recorder->free(recorder->public.user_ptr, recorder);
+}
+
+static bool ml666_tape_recorder__init(struct ml666_parser* parser){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  if(!tape_write(that, ML666_TAPE_MAGIC, 8)){
+    parser->error = "ml666_tape_recorder: write failed";
+    return false;
+  }
+  return true;
+}
+
+static void ml666_tape_recorder__done(struct ml666_parser* parser){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  if(!parser->error && !that->terminated){
+    const char end = ML666_TAPE_OP_END;
+    if(!tape_write(that, &end, 1) || !tape_flush(that)){
+      parser->error = "ml666_tape_recorder: write failed";
+      return;
+    }
+    that->terminated = true;
+  }
+}
+
+static bool ml666_tape_recorder__tag_push(struct ml666_parser* parser, ml666_opaque_tag_name* name){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  if(that->depth >= that->stack_size){
+    const size_t size = that->stack_size ? that->stack_size * 2 : 64;
+    size_t* stack = that->realloc(that->public.user_ptr, that->stack, size * sizeof(*stack));
+    if(!stack){
+      parser->error = "ml666_tape_recorder: *realloc failed";
+      return false;
+    }
+    that->stack = stack;
+    that->stack_size = size;
+  }
+  size_t id;
+  if(!tape_name(that, *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0}, &id) || !tape_write_op(that, ML666_TAPE_OP_TAG, id)){
+    parser->error = "ml666_tape_recorder: tag_push failed";
+    return false;
+  }
+  that->stack[that->depth++] = id;
+  return true;
+}
+
+static bool ml666_tape_recorder__end_tag_check(struct ml666_parser* parser, ml666_opaque_tag_name name){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  if(!that->depth)
+    return false;
+  const struct ml666_hashed_buffer* current = ml666_hashed_buffer_set__peek(that->name[that->stack[that->depth-1]]);
+  return ml666_buffer__equal(current->buffer, name ? name->buffer.ro : (struct ml666_buffer_ro){0});
+}
+
+static bool ml666_tape_recorder__tag_pop(struct ml666_parser* parser){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  if(!that->depth){
+    parser->error = "ml666_tape_recorder: end tag without matching opening tag";
+    return false;
+  }
+  that->depth -= 1;
+  const char op = ML666_TAPE_OP_END_TAG;
+  if(!tape_write(that, &op, 1)){
+    parser->error = "ml666_tape_recorder: write failed";
+    return false;
+  }
+  return true;
+}
+
+static bool ml666_tape_recorder__set_attribute(struct ml666_parser* parser, ml666_opaque_attribute_name* name){
+  struct ml666__tape_recorder_private* that = parser->user_ptr;
+  size_t id;
+  if(!tape_name(that, *name ? (*name)->buffer.ro : (struct ml666_buffer_ro){0}, &id) || !tape_write_op(that, ML666_TAPE_OP_ATTRIBUTE, id)){
+    parser->error = "ml666_tape_recorder: set_attribute failed";
+    return false;
+  }
+  return true;
+}
+
+static bool ml666_tape_recorder__value_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  if(!tape_write_chunk(parser->user_ptr, ML666_TAPE_OP_VALUE, data)){
+    parser->error = "ml666_tape_recorder: write failed";
+    return false;
+  }
+  return true;
+}
+
+static bool ml666_tape_recorder__data_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  if(!tape_write_chunk(parser->user_ptr, ML666_TAPE_OP_TEXT, data)){
+    parser->error = "ml666_tape_recorder: write failed";
+    return false;
+  }
+  return true;
+}
+
+static bool ml666_tape_recorder__comment_append(struct ml666_parser* parser, struct ml666_buffer_ro data){
+  if(!tape_write_chunk(parser->user_ptr, ML666_TAPE_OP_COMMENT, data)){
+    parser->error = "ml666_tape_recorder: write failed";
+    return false;
+  }
+  return true;
+}
+
+const struct ml666_parser_api ml666_tape_recorder_api = {
+  .init = ml666_tape_recorder__init,
+  .done = ml666_tape_recorder__done,
+
+  .tag_name_append       = ml666_parser__d_mal__tag_name_append,
+  .tag_name_free         = ml666_parser__d_mal__tag_name_free,
+  .attribute_name_append = ml666_parser__d_mal__attribute_name_append,
+  .attribute_name_free   = ml666_parser__d_mal__attribute_name_free,
+
+  .tag_push      = ml666_tape_recorder__tag_push,
+  .end_tag_check = ml666_tape_recorder__end_tag_check,
+  .tag_pop       = ml666_tape_recorder__tag_pop,
+
+  .set_attribute = ml666_tape_recorder__set_attribute,
+
+  .value_append   = ml666_tape_recorder__value_append,
+  .data_append    = ml666_tape_recorder__data_append,
+  .comment_append = ml666_tape_recorder__comment_append,
+};
+
+//// Token emmiter
+
+struct ml666__tape_token_emmiter_private {
+  struct ml666_tokenizer public;
+  const char* memory;
+  size_t size;
+  size_t position;
+  bool mapped;
+  struct ml666_buffer_ro* name;
+  size_t name_count;
+  size_t name_size;
+  ml666__cb__malloc*  malloc;
+  ml666__cb__realloc* realloc;
+  ml666__cb__free*    free;
+};
+static_assert(offsetof(struct ml666__tape_token_emmiter_private, public) == 0, "ml666__tape_token_emmiter_private::public must be the first member");
+
+static ml666_tokenizer_cb_next ml666_tape_token_emmiter_d_next;
+static ml666_tokenizer_cb_destroy ml666_tape_token_emmiter_d_destroy;
+
+static const struct ml666_tokenizer_cb tokenizer_cb = {
+  .next = ml666_tape_token_emmiter_d_next,
+  .destroy = ml666_tape_token_emmiter_d_destroy,
+};
+
+static void tape_release(struct ml666__tape_token_emmiter_private* tte){
+  if(!tte->memory)
+    return;
+  if(tte->mapped){
+    if(munmap((void*)tte->memory, tte->size))
+      fprintf(stderr, "%s:%u: munmap failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+  }else{
+    tte->realloc(tte->public.user_ptr, (void*)tte->memory, 0);
+  }
+  tte->memory = 0;
+}
+
+static bool tape_load(struct ml666__tape_token_emmiter_private* tte, int fd){
+  struct stat st;
+  if(fstat(fd, &st) == -1){
+    fprintf(stderr, "%s:%u: fstat failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+    return false;
+  }
+  if(S_ISREG(st.st_mode) && st.st_size > 0){
+    void* memory = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(memory != MAP_FAILED){
+      tte->memory = memory;
+      tte->size = st.st_size;
+      tte->mapped = true;
+      return true;
+    }
+  }
+  char* memory = 0;
+  size_t size = 0;
+  size_t length = 0;
+  while(true){
+    if(length == size){
+      size = size ? size * 2 : ML666_TAPE_BUFFER_SIZE;
+      char* new_memory = tte->realloc(tte->public.user_ptr, memory, size);
+      if(!new_memory){
+        fprintf(stderr, "%s:%u: *realloc failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+        goto error;
+      }
+      memory = new_memory;
+    }
+    ssize_t result = read(fd, memory + length, size - length);
+    if(result < 0){
+      if(errno == EINTR || errno == EWOULDBLOCK)
+        continue;
+      fprintf(stderr, "%s:%u: read failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+      goto error;
+    }
+    if(result == 0)
+      break;
+    length += result;
+  }
+  tte->memory = memory;
+  tte->size = length;
+  tte->mapped = false;
+  return true;
+error:
+  if(memory)
+    tte->realloc(tte->public.user_ptr, memory, 0);
+  return false;
+}
+
+struct ml666_tokenizer* ml666_tape_token_emmiter_create_p(struct ml666_tape_token_emmiter_create_args args){
+  if(!args.malloc)
+    args.malloc = ml666__d__malloc;
+  if(!args.realloc)
+    args.realloc = ml666__d__realloc;
+  if(!args.free)
+    args.free = ml666__d__free;
+  struct ml666__tape_token_emmiter_private*restrict tte = args.malloc(args.user_ptr, sizeof(*tte));
+  if(!tte){
+    fprintf(stderr, "%s:%u: malloc failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
+    goto error;
+  }
+  memset(tte, 0, sizeof(*tte));
+  *(const struct ml666_tokenizer_cb**)&tte->public.cb = &tokenizer_cb;
+  tte->public.user_ptr = args.user_ptr;
+  tte->malloc = args.malloc;
+  tte->realloc = args.realloc;
+  tte->free = args.free;
+
+  if(!tape_load(tte, args.fd))
+    goto error_after_malloc;
+  if(tte->size < 8 || memcmp(tte->memory, ML666_TAPE_MAGIC, 8)){
+    fprintf(stderr, "ml666_tape_token_emmiter_create_p: not an ml666 tape\n");
+    tape_release(tte);
+    goto error_after_malloc;
+  }
+  tte->position = 8;
+  close(args.fd);
+  return &tte->public;
+
+error_after_malloc:
+  args.free(args.user_ptr, tte);
+error:
+  close(args.fd);
+  return 0;
+}
+
+static inline bool tape_read_number(struct ml666__tape_token_emmiter_private* tte, size_t* ret){
+  size_t number = 0;
+  for(unsigned shift=0; tte->position < tte->size && shift < sizeof(size_t)*8; shift += 7){
+    const unsigned char ch = tte->memory[tte->position++];
+    number |= (size_t)(ch & 0x7F) << shift;
+    if(!(ch & 0x80)){
+      *ret = number;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool tape_read_chunk(struct ml666__tape_token_emmiter_private* tte, struct ml666_buffer_ro* ret){
+  size_t length;
+  if(!tape_read_number(tte, &length) || length > tte->size - tte->position)
+    return false;
+  *ret = (struct ml666_buffer_ro){
+    .data = &tte->memory[tte->position],
+    .length = length,
+  };
+  tte->position += length;
+  return true;
+}
+
+static bool tape_read_name(struct ml666__tape_token_emmiter_private* tte, struct ml666_buffer_ro* ret){
+  size_t id;
+  if(!tape_read_number(tte, &id) || id >= tte->name_count)
+    return false;
+  *ret = tte->name[id];
+  return true;
+}
+
+static bool ml666_tape_token_emmiter_d_next(struct ml666_tokenizer* _tokenizer){
+  struct ml666__tape_token_emmiter_private*restrict tte = (struct ml666__tape_token_emmiter_private*)_tokenizer;
+  tte->public.token = ML666_NONE;
+  tte->public.match = (struct ml666_buffer_ro){0};
+  if(!tte->memory)
+    return false;
+
+  while(!tte->public.token){
+    if(tte->position >= tte->size){
+      tte->public.error = "ml666 tape truncated";
+      goto error;
+    }
+    const enum ml666_tape_opcode op = (unsigned char)tte->memory[tte->position++];
+    tte->public.complete = true;
+    switch(op){
+      case ML666_TAPE_OP_END: {
+        tte->public.token = ML666_EOF;
+        tte->public.offset = tte->position;
+        goto final;
+      } break;
+      case ML666_TAPE_OP_NAME: {
+        if(tte->name_count >= tte->name_size){
+          const size_t size = tte->name_size ? tte->name_size * 2 : 64;
+          struct ml666_buffer_ro* name = tte->realloc(tte->public.user_ptr, tte->name, size * sizeof(*name));
+          if(!name){
+            tte->public.error = "ml666 tape: *realloc failed";
+            goto error;
+          }
+          tte->name = name;
+          tte->name_size = size;
+        }
+        if(!tape_read_chunk(tte, &tte->name[tte->name_count]))
+          goto invalid;
+        tte->name_count += 1;
+      } break;
+      case ML666_TAPE_OP_TAG: {
+        if(!tape_read_name(tte, &tte->public.match))
+          goto invalid;
+        tte->public.token = ML666_TAG;
+      } break;
+      case ML666_TAPE_OP_END_TAG: {
+        tte->public.token = ML666_END_TAG;
+      } break;
+      case ML666_TAPE_OP_ATTRIBUTE: {
+        if(!tape_read_name(tte, &tte->public.match))
+          goto invalid;
+        tte->public.token = ML666_ATTRIBUTE;
+      } break;
+      case ML666_TAPE_OP_VALUE:
+      case ML666_TAPE_OP_TEXT:
+      case ML666_TAPE_OP_COMMENT: {
+        if(!tape_read_chunk(tte, &tte->public.match))
+          goto invalid;
+        tte->public.token = op == ML666_TAPE_OP_VALUE ? ML666_ATTRIBUTE_VALUE
+                          : op == ML666_TAPE_OP_TEXT  ? ML666_TEXT
+                          : ML666_COMMENT;
+        // Consecutive chunks of the same kind belong to the same token
+        tte->public.complete = tte->position >= tte->size || (unsigned char)tte->memory[tte->position] != op;
+      } break;
+      default: goto invalid;
+    }
+  }
+
+  tte->public.offset = tte->position;
+  return true;
+
+invalid:
+  tte->public.error = "ml666 tape: invalid record";
+error:
+  tte->public.token = ML666_EOF;
+  tte->public.match = (struct ml666_buffer_ro){0};
+final:
+  tape_release(tte);
+  return false;
+}
+
+static void ml666_tape_token_emmiter_d_destroy(struct ml666_tokenizer* _tokenizer){
+  if(!_tokenizer) return;
+  struct ml666__tape_token_emmiter_private*restrict tte = (struct ml666__tape_token_emmiter_private*)_tokenizer;
+  tape_release(tte);
+  if(tte->name)
+    tte->realloc(tte->public.user_ptr, tte->name, 0);
+  tte->free(tte->public.user_ptr, tte);
+}
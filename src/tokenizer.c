@@ -56,10 +56,11 @@ enum ml666__text_encoding {
 struct ml666__tokenizer_private {
   struct ml666_tokenizer public;
   int fd;
+  struct ml666_buffer_ro input;
   unsigned offset, index, length, cpo, spaces;
   enum ml666__state state;
   char* memory; // This is a ring buffer
-  bool may_block, eof, spnf, ecsp, disable_utf8_validation;
+  bool may_block, eof, spnf, ecsp, disable_utf8_validation, done;
   struct ml666_streaming_utf8_validator utf8_validator;
   uint8_t decode_akku, decode_index;
   union {
@@ -122,7 +123,8 @@ struct ml666_tokenizer* ml666_tokenizer_create_p(struct ml666_tokenizer_create_a
   }
   memset(tokenizer, 0, sizeof(*tokenizer));
   *(const struct ml666_tokenizer_cb**)&tokenizer->public.cb = &tokenizer_cb;
-  tokenizer->fd = args.fd;
+  tokenizer->fd = args.input.data ? -1 : args.fd;
+  tokenizer->input = args.input;
   tokenizer->malloc = args.malloc;
   tokenizer->free = args.free;
   tokenizer->disable_utf8_validation = args.disable_utf8_validation;
@@ -188,7 +190,8 @@ error_memfd:
 error_calloc:
   args.free(args.user_ptr, tokenizer);
 error:
-  close(args.fd);
+  if(!args.input.data)
+    close(args.fd);
   return 0;
 }
 
@@ -227,7 +230,7 @@ static bool ml666_tokenizer_d_next(struct ml666_tokenizer* _tokenizer){
   size_t column = tokenizer->public.column;
 
   const int fd = tokenizer->fd;
-  if(fd == -1) return false;
+  if(!tokenizer->memory || tokenizer->done) return false;
   enum ml666__state state = tokenizer->state;
   if(state >= ML666__STATE_COUNT || state < 0){
     tokenizer->public.error = "Invalid state";
@@ -684,7 +687,16 @@ static bool ml666_tokenizer_d_next(struct ml666_tokenizer* _tokenizer){
       unsigned write_end = offset + length;
       if(write_end >= size)
         write_end -= size;
-      int result = read(fd, &memory[write_end], size - length);
+      int result;
+      if(tokenizer->input.data){
+        // The ring buffer is mapped twice in a row, so this can't overrun it
+        result = tokenizer->input.length < size - length ? tokenizer->input.length : size - length;
+        memcpy(&memory[write_end], tokenizer->input.data, result);
+        tokenizer->input.data   += result;
+        tokenizer->input.length -= result;
+      }else{
+        result = read(fd, &memory[write_end], size - length);
+      }
       if(result < 0 && errno == EWOULDBLOCK){
         result = 0;
       }else{
@@ -710,6 +722,7 @@ static bool ml666_tokenizer_d_next(struct ml666_tokenizer* _tokenizer){
         }
       }
       tokenizer->may_block = (unsigned)result < size - length;
+      tokenizer->public.offset += result;
       length += result;
       progress = true;
       break;
@@ -772,11 +785,14 @@ error:
   tokenizer->public.match = (struct ml666_buffer_ro){0};
 
 final:
-  // Let's free this stuff as early as possible
+  tokenizer->done = true;
+  // Let's free this stuff as early as possible. When reading from a buffer, it's kept for ml666_tokenizer_reset.
+  if(fd == -1)
+    return false;
   if(munmap(tokenizer->memory, size*4))
     fprintf(stderr, "%s:%u: munmap failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
   tokenizer->memory = 0;
-  if(close(tokenizer->fd))
+  if(tokenizer->fd != -1 && close(tokenizer->fd))
     fprintf(stderr, "%s:%u: close failed (%d): %s\n", __FILE__, __LINE__, errno, strerror(errno));
   tokenizer->fd = -1;
   return false;
@@ -784,6 +800,29 @@ final:
   #undef memory_ro
 }
 
+bool ml666_tokenizer_reset(struct ml666_tokenizer* _tokenizer, struct ml666_buffer_ro input){
+  if(_tokenizer->cb != &tokenizer_cb)
+    return false;
+  struct ml666__tokenizer_private*restrict tokenizer = (struct ml666__tokenizer_private*)_tokenizer;
+  if(tokenizer->fd != -1 || !tokenizer->memory || !input.data)
+    return false;
+  // Everything else is set up like in ml666_tokenizer_create_p. The ring buffer is kept, its content doesn't matter.
+  const struct ml666__tokenizer_private old = *tokenizer;
+  memset(tokenizer, 0, sizeof(*tokenizer));
+  *(const struct ml666_tokenizer_cb**)&tokenizer->public.cb = &tokenizer_cb;
+  tokenizer->fd = -1;
+  tokenizer->input = input;
+  tokenizer->malloc = old.malloc;
+  tokenizer->free = old.free;
+  tokenizer->disable_utf8_validation = old.disable_utf8_validation;
+  tokenizer->public.user_ptr = old.public.user_ptr;
+  tokenizer->public.line = 1;
+  tokenizer->public.column = 1;
+  tokenizer->memory = old.memory;
+  tokenizer->state = ML666__STATE_MEMBER;
+  return true;
+}
+
 static void ml666_tokenizer_d_destroy(struct ml666_tokenizer* _tokenizer){
   if(!_tokenizer) return;
   const unsigned size = get_ringbuffer_size();
@@ -20,10 +20,25 @@ struct ml666_hashed_buffer_set_entry {
 struct ml666_hashed_buffer_set_default {
   struct ml666_hashed_buffer_set super;
   struct ml666_refcount entry_count;
+  size_t name_count, name_bytes; // For ml666_default_hashed_buffer_set__get_size
   struct ml666_hashed_buffer_set_entry* (*bucket)[BUCKET_COUNT];
   struct ml666_default_hashed_buffer_set__create_args a;
 };
 
+static inline void set_refcount_increment(const struct ml666_hashed_buffer_set_default* buffer_set, struct ml666_refcount* refcount){
+  if(buffer_set->a.thread_confined){
+    ml666_refcount_increment_local(refcount);
+  }else{
+    ml666_refcount_increment(refcount);
+  }
+}
+
+static inline bool set_refcount_decrement(const struct ml666_hashed_buffer_set_default* buffer_set, struct ml666_refcount* refcount){
+  if(buffer_set->a.thread_confined)
+    return ml666_refcount_decrement_local(refcount);
+  return ml666_refcount_decrement(refcount);
+}
+
 static unsigned hash_to_bucket(uint64_t hash){
   return ( (hash >> 0 ) ^ (hash >> 16) ^ (hash >> 32) ^ (hash >> 48) ) % BUCKET_COUNT;
 }
@@ -82,9 +97,21 @@ bool ml666_buffer__append_p(struct ml666_buffer__append_args args){
   const size_t new_size = old_size + args.data.length;
   if(new_size < args.data.length)
     return false;
-  char* content = (args.realloc ? args.realloc : ml666__d__realloc)(args.that, args.buffer->data, new_size);
-  if(!content)
-    return false;
+  char* content = args.buffer->data;
+  if(!args.capacity || *args.capacity < new_size){
+    size_t allocation = new_size;
+    if(args.capacity){
+      // Grow geometrically, so appending many small chunks doesn't reallocate & copy every time
+      const size_t capacity = *args.capacity > old_size ? *args.capacity : old_size;
+      if(capacity * 2 > allocation && capacity * 2 > capacity)
+        allocation = capacity * 2;
+    }
+    content = (args.realloc ? args.realloc : ml666__d__realloc)(args.that, content, allocation);
+    if(!content)
+      return false;
+    if(args.capacity)
+      *args.capacity = allocation;
+  }
   args.buffer->data = content;
   memcpy(&content[old_size], args.data.data, args.data.length);
   args.buffer->length = new_size;
@@ -134,7 +161,7 @@ struct ml666_buffer_info ml666_buffer__analyze(struct ml666_buffer_ro buffer){
   }
   bi.is_valid_utf8 = true;
   size_t approximated_escaped_overhead = 0;
-  struct ml666_streaming_utf8_validator u8v;
+  struct ml666_streaming_utf8_validator u8v = {0};
   unsigned l = 0;
   for(size_t i=0; i<length; i++){
     {
@@ -172,16 +199,18 @@ struct ml666_buffer_info ml666_buffer__analyze(struct ml666_buffer_ro buffer){
 static inline void destroy_entry(struct ml666_hashed_buffer_set_default* buffer_set, struct ml666_hashed_buffer_set_entry** it){
   struct ml666_hashed_buffer_set_entry* cur = *it;
   *it = cur->next;
+  buffer_set->name_count -= 1;
+  buffer_set->name_bytes -= cur->data.buffer.length;
   ml666_hashed_buffer__clear(&cur->data, buffer_set->a.that, buffer_set->a.free, buffer_set->a.clear_buffer);
   buffer_set->a.free(buffer_set->a.that, cur);
-  if(!ml666_refcount_decrement(&buffer_set->entry_count))
+  if(!set_refcount_decrement(buffer_set, &buffer_set->entry_count))
     buffer_set->a.free(buffer_set->a.that, buffer_set->bucket);
 }
 
 void ml666_hashed_buffer_set__d__put(struct ml666_hashed_buffer_set* _buffer_set, const struct ml666_hashed_buffer_set_entry* _entry){
   struct ml666_hashed_buffer_set_default* buffer_set = (struct ml666_hashed_buffer_set_default*)_buffer_set;
   struct ml666_hashed_buffer_set_entry* entry = (struct ml666_hashed_buffer_set_entry*)_entry;
-  if(ml666_refcount_decrement(&entry->refcount))
+  if(set_refcount_decrement(buffer_set, &entry->refcount))
     return;
   unsigned bucket = hash_to_bucket(entry->data.hash);
   for(struct ml666_hashed_buffer_set_entry **it=&(*buffer_set->bucket)[bucket], *cur; (cur=*it); it=&cur->next){
@@ -210,7 +239,7 @@ const struct ml666_hashed_buffer_set_entry* ml666_hashed_buffer_set__d__lookup(
     }
     memset(buffer_set->bucket, 0, sizeof(*buffer_set->bucket));
   }
-  ml666_refcount_increment(&buffer_set->entry_count);
+  set_refcount_increment(buffer_set, &buffer_set->entry_count);
 
   struct ml666_hashed_buffer c = *entry;
   unsigned bucket = hash_to_bucket(c.hash);
@@ -256,15 +285,17 @@ const struct ml666_hashed_buffer_set_entry* ml666_hashed_buffer_set__d__lookup(
     result->data = *entry;
   }
   result->refcount.value = 0;
-  ml666_refcount_increment(&result->refcount);
+  set_refcount_increment(buffer_set, &result->refcount);
   result->next = cur;
   *it = result;
+  buffer_set->name_count += 1;
+  buffer_set->name_bytes += result->data.buffer.length;
   return result;
 
 found:;
-  ml666_refcount_increment(&cur->refcount);
+  set_refcount_increment(buffer_set, &cur->refcount);
   if(0) out: cur=0;
-  if(!ml666_refcount_decrement(&buffer_set->entry_count))
+  if(!set_refcount_decrement(buffer_set, &buffer_set->entry_count))
     buffer_set->a.free(buffer_set->a.that, buffer_set->bucket);
   return cur;
 }
@@ -325,14 +356,23 @@ struct ml666_hashed_buffer_set* ml666_default_hashed_buffer_set__create_p(struct
 
 void ml666_hashed_buffer_set__d__destroy(struct ml666_hashed_buffer_set* _buffer_set){
   struct ml666_hashed_buffer_set_default* buffer_set = (struct ml666_hashed_buffer_set_default*)_buffer_set;
-  struct ml666_hashed_buffer_set_entry** bucket = *buffer_set->bucket;
+  // The buckets only exist while there are entries, they are freed together with the last one
   for(unsigned i=0; i<BUCKET_COUNT; i++)
-    while(bucket[i])
-      destroy_entry(buffer_set, &bucket[i]);
+    while(!ml666_refcount_is_zero(&buffer_set->entry_count) && (*buffer_set->bucket)[i])
+      destroy_entry(buffer_set, &(*buffer_set->bucket)[i]);
   if(buffer_set != &default_buffer_set)
     buffer_set->a.free(buffer_set->a.that, buffer_set);
 }
 
+bool ml666_default_hashed_buffer_set__get_size(struct ml666_hashed_buffer_set* _buffer_set, size_t* count, size_t* bytes){
+  if(_buffer_set->cb != &ml666_default_hashed_buffer_cb)
+    return false;
+  struct ml666_hashed_buffer_set_default* buffer_set = (struct ml666_hashed_buffer_set_default*)_buffer_set;
+  *count = buffer_set->name_count;
+  *bytes = buffer_set->name_bytes;
+  return true;
+}
+
 static struct ml666_hashed_buffer_set* get_default(void){
   return &default_buffer_set.super;
 }
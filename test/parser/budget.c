@@ -0,0 +1,179 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/parser.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/tokenizer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char document[] = "<a><b>`hello`</b>/* comment */<c/></a>";
+
+static int open_document(void){
+  int fds[2];
+  if(pipe(fds) == -1)
+    return -1;
+  if(write(fds[1], document, sizeof(document)-1) != sizeof(document)-1){
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+ML666_TEST("token-budget"){
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  int fd = open_document();
+  if(fd == -1)
+    return 1;
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(stb, fd);
+  if(!stp)
+    return 2;
+  int result = 0;
+  size_t calls = 0;
+  while(true){
+    const size_t token_count = stp->token_count;
+    bool more = ml666_simple_tree_parser_next_budget(stp, 0, 2);
+    calls += 1;
+    if(stp->token_count - token_count > 2){
+      result = 3;
+      break;
+    }
+    if(!more)
+      break;
+  }
+  if(!result && stp->error)
+    result = 4;
+  if(!result && calls < 3)
+    result = 5;
+  if(!result && stp->offset != sizeof(document)-1)
+    result = 6;
+  struct ml666_st_document* doc = ml666_simple_tree_parser_take_document(stp);
+  ml666_simple_tree_parser_destroy(stp);
+  if(doc){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, doc));
+    ml666_st_node_put(stb, ML666_ST_NODE(doc));
+  }else if(!result){
+    result = 7;
+  }
+  ml666_st_builder_destroy(stb);
+  return result;
+}
+
+#define ITEM "<item x=`1`>`some text`</item>"
+#define ITEM_COUNT 2000
+
+// Big enough for many reads
+static char* big_document(size_t* length){
+  *length = ITEM_COUNT * (sizeof(ITEM)-1);
+  char* result = malloc(*length);
+  if(result)
+    for(size_t i=0; i<ITEM_COUNT; i++)
+      memcpy(result + i * (sizeof(ITEM)-1), ITEM, sizeof(ITEM)-1);
+  return result;
+}
+
+// Each read fills at most the buffer of the tokenizer, which is this big
+static size_t buffer_size(void){
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  return (page_size - 1 + 4096) / page_size * page_size;
+}
+
+// The limit isn't a multiple of the buffer size, so reads cross it
+#define MAX_BYTES 1000
+
+static int check_document(struct ml666_st_builder* stb, struct ml666_st_document* doc){
+  if(!doc)
+    return 1;
+  const size_t count = ml666_st_child_count(stb, ML666_ST_CHILDREN(stb, doc));
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, doc));
+  ml666_st_node_put(stb, ML666_ST_NODE(doc));
+  return count == ITEM_COUNT ? 0 : 2;
+}
+
+ML666_TEST("byte-budget"){
+  size_t length;
+  char* input = big_document(&length);
+  if(!input)
+    return 1;
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(stb, .tokenizer=ml666_tokenizer_create(.input={length, input}));
+  if(!stp)
+    return 2;
+  int result = 0;
+  size_t calls = 0;
+  bool crossed = false;
+  while(true){
+    const size_t offset = stp->offset;
+    const bool more = ml666_simple_tree_parser_next_budget(stp, MAX_BYTES, 0);
+    calls += 1;
+    // It stops after the read which reached the limit
+    if(stp->offset - offset >= MAX_BYTES + buffer_size()){
+      result = 3;
+      break;
+    }
+    if(stp->offset - offset > MAX_BYTES)
+      crossed = true;
+    if(!more)
+      break;
+  }
+  if(!result && stp->error)
+    result = 4;
+  if(!result && (!crossed || calls < length / (MAX_BYTES + buffer_size())))
+    result = 5;
+  if(!result && stp->offset != length)
+    result = 6;
+  struct ml666_st_document* doc = ml666_simple_tree_parser_take_document(stp);
+  ml666_simple_tree_parser_destroy(stp);
+  const int check = check_document(stb, doc);
+  if(!result && check)
+    result = 6 + check;
+  ml666_st_builder_destroy(stb);
+  free(input);
+  return result;
+}
+
+ML666_TEST("parser-byte-budget"){
+  size_t length;
+  char* input = big_document(&length);
+  if(!input)
+    return 1;
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(stb, .detached=true);
+  struct ml666_parser* parser = ml666_parser_create(
+    .api = &ml666_simple_tree_parser_api,
+    .tokenizer = ml666_tokenizer_create(.input={length, input}),
+    .user_ptr = stp
+  );
+  if(!stp || !parser)
+    return 2;
+  int result = 0;
+  size_t calls = 0;
+  while(true){
+    const size_t offset = parser->offset;
+    const bool more = ml666_parser_next_budget(parser, MAX_BYTES, 0);
+    calls += 1;
+    if(parser->offset - offset >= MAX_BYTES + buffer_size()){
+      result = 3;
+      break;
+    }
+    if(!more)
+      break;
+  }
+  if(!result && (parser->error || parser->offset != length))
+    result = 4;
+  if(!result && calls < length / (MAX_BYTES + buffer_size()))
+    result = 5;
+  ml666_parser_destroy(parser);
+  struct ml666_st_document* doc = ml666_simple_tree_parser_take_document(stp);
+  ml666_simple_tree_parser_destroy(stp);
+  const int check = check_document(stb, doc);
+  if(!result && check)
+    result = 5 + check;
+  ml666_st_builder_destroy(stb);
+  free(input);
+  return result;
+}
@@ -0,0 +1,108 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/parser.h>
+#include <ml666/parser-dispatch.h>
+#include <unistd.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+struct ml666_parser_dispatch* dispatch;
+
+struct counter {
+  size_t push, pop, attribute, data;
+};
+
+static bool count_push(struct ml666_parser* parser, void* ptr, const ml666_hashed_buffer_set_entry* name, size_t depth){
+  (void)parser; (void)name; (void)depth;
+  ((struct counter*)ptr)->push += 1;
+  return true;
+}
+
+static bool count_pop(struct ml666_parser* parser, void* ptr, const ml666_hashed_buffer_set_entry* name, size_t depth){
+  (void)parser; (void)name; (void)depth;
+  ((struct counter*)ptr)->pop += 1;
+  return true;
+}
+
+static bool count_attribute(struct ml666_parser* parser, void* ptr, struct ml666_buffer_ro name){
+  (void)parser; (void)name;
+  ((struct counter*)ptr)->attribute += 1;
+  return true;
+}
+
+static bool count_data(struct ml666_parser* parser, void* ptr, struct ml666_buffer_ro data){
+  (void)parser;
+  ((struct counter*)ptr)->data += data.length;
+  return true;
+}
+
+static const struct ml666_parser_dispatch_handler counter_handler = {
+  .tag_push = count_push,
+  .tag_pop = count_pop,
+  .set_attribute = count_attribute,
+  .data_append = count_data,
+};
+
+static bool parse(const char* document){
+  int fds[2];
+  if(pipe(fds) == -1)
+    return false;
+  size_t length = strlen(document);
+  if(write(fds[1], document, length) != (ssize_t)length){
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  close(fds[1]);
+  struct ml666_parser* parser = ml666_parser_create(.api=&ml666_parser_dispatch_api, .fd=fds[0], .user_ptr=dispatch);
+  if(!parser)
+    return false;
+  while(ml666_parser_next(parser));
+  bool result = !parser->error;
+  ml666_parser_destroy(parser);
+  return result;
+}
+
+void test_setup(void){
+  dispatch = ml666_parser_dispatch_create(0);
+}
+
+void test_teardown(void){
+  ml666_parser_dispatch_destroy(dispatch);
+}
+
+ML666_TEST("any-depth"){
+  struct counter c = {0};
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("b"), ML666_PARSER_DISPATCH_ANY_DEPTH, &counter_handler, &c))
+    return 1;
+  if(!parse("<a><b x y>`hi`</b><c><b>`abc`</b></c>`xyz`</a><b/>"))
+    return 2;
+  if(c.push != 3 || c.pop != 3)
+    return 3;
+  if(c.attribute != 2 || c.data != 5)
+    return 4;
+  return 0;
+}
+
+ML666_TEST("depth"){
+  struct counter any = {0};
+  struct counter top = {0};
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("b"), ML666_PARSER_DISPATCH_ANY_DEPTH, &counter_handler, &any))
+    return 1;
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("b"), 1, &counter_handler, &top))
+    return 2;
+  if(!parse("<b/><a><b/></a><b/>"))
+    return 3;
+  if(top.push != 2 || any.push != 1)
+    return 4;
+  return 0;
+}
+
+ML666_TEST("end-tag-mismatch"){
+  struct counter c = {0};
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("a"), ML666_PARSER_DISPATCH_ANY_DEPTH, &counter_handler, &c))
+    return 1;
+  if(parse("<a></b>"))
+    return 2;
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/parser.h>
+#include <ml666/parser-schema.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <string.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char schema_text[] =
+  "<schema root=`catalog`>"
+    "<element name=`catalog` children=`item*`/>"
+    "<element name=`item` children=`title (price | free) tag*`>"
+      "<attribute name=`id` required/>"
+      "<attribute name=`lang` value=`ascii`/>"
+    "</element>"
+    "<element name=`title` content=`utf8`/>"
+    "<element name=`price` content=`ascii`/>"
+    "<element name=`free`/>"
+    "<element name=`tag` content=`utf8` extra-attributes/>"
+  "</schema>";
+
+struct ml666_schema* schema;
+struct ml666_parser_schema* validator;
+
+void test_setup(void){
+  schema = ml666_schema_compile(.tokenizer=ml666_tokenizer_create(.input=ML666_BUFFER_STR(schema_text)));
+  if(schema)
+    validator = ml666_parser_schema_create(schema);
+}
+
+void test_teardown(void){
+  if(validator)
+    ml666_parser_schema_destroy(validator);
+  if(schema)
+    ml666_schema_destroy(schema);
+}
+
+// The number of tokens processed, or 0 if the document was valid
+static size_t rejected_at(const char* document){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=(struct ml666_buffer_ro){strlen(document), document});
+  struct ml666_parser* parser = ml666_parser_create(.api=&ml666_parser_schema_api, .tokenizer=tokenizer, .user_ptr=validator);
+  if(!parser)
+    return (size_t)-1;
+  while(ml666_parser_next(parser));
+  const size_t result = parser->error ? parser->token_count + 1 : 0;
+  ml666_parser_destroy(parser);
+  return result;
+}
+
+ML666_TEST("valid"){
+  if(!validator)
+    return 1;
+  if(rejected_at("<catalog/>"))
+    return 2;
+  if(rejected_at(
+    "<catalog>"
+      "<item id=`1` lang=`en`><title>`Gr\xC3\xBCn`</title><price>`3`</price><tag x=`y`>`a`</tag><tag/></item>"
+      "/* comment */"
+      "<item id=`2`><title/><free/></item>"
+    "</catalog>"
+  )) return 3;
+  return 0;
+}
+
+ML666_TEST("invalid"){
+  if(!validator)
+    return 1;
+  static const char*const documents[] = {
+    "", // The root element is missing
+    "<item id=`1`><title/><free/></item>", // Not allowed as root
+    "<catalog><item><title/><free/></item></catalog>", // Required attribute missing
+    "<catalog><item id=`1` x=`y`><title/><free/></item></catalog>", // Attribute not declared
+    "<catalog><item id=`1` lang=`\xC3\xBC`><title/><free/></item></catalog>", // Not ASCII
+    "<catalog><item id=`1`><free/><title/></item></catalog>", // Wrong order
+    "<catalog><item id=`1`><title/></item></catalog>", // Child missing
+    "<catalog><item id=`1`><title/><free/><price/></item></catalog>", // Not both
+    "<catalog><item id=`1`><title>`\\xC3`</title><free/></item></catalog>", // Invalid UTF-8
+    "<catalog><item id=`1`><title/><free>`x`</free></item></catalog>", // No content allowed
+    "<catalog><other/></catalog>", // Element not declared
+  };
+  for(size_t i=0; i<sizeof(documents)/sizeof(*documents); i++)
+    if(!rejected_at(documents[i]))
+      return 2 + i;
+  return 0;
+}
+
+ML666_TEST("early"){
+  if(!validator)
+    return 1;
+  // Nothing after the problem is looked at
+  static const char document[] =
+    "<catalog><bogus/>"
+    "<item id=`1`><title/><free/></item><item id=`2`><title/><free/></item><item id=`3`><title/><free/></item>"
+    "</catalog>";
+  const size_t tokens = rejected_at(document);
+  if(!tokens || tokens > 3)
+    return 2;
+  return 0;
+}
+
+ML666_TEST("tree"){
+  if(!validator)
+    return 1;
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_simple_tree_parser* stp = ml666_simple_tree_parser_create(stb, .detached=true);
+  struct ml666_parser_schema* filter = ml666_parser_schema_create(schema, .next=&ml666_simple_tree_parser_api, .next_user_ptr=stp);
+  static const char document[] = "<catalog><item id=`1`><title>`a`</title><free/></item></catalog>";
+  struct ml666_parser* parser = ml666_parser_create(
+    .api = &ml666_parser_schema_api,
+    .tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document)),
+    .user_ptr = filter
+  );
+  int result = 0;
+  while(ml666_parser_next(parser));
+  struct ml666_st_document* tree = parser->error ? 0 : ml666_simple_tree_parser_take_document(stp);
+  if(!tree){
+    result = 2;
+    goto end;
+  }
+  if(!ml666_schema_validate_tree(schema, stb, ML666_ST_NODE(tree), 0)){
+    result = 3;
+    goto end;
+  }
+  // An item with only a title
+  struct ml666_st_member* item = ml666_st_get_first_child(stb, ML666_ST_U_CHILDREN(stb, ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, tree))));
+  ml666_st_member_set(stb, 0, ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, item)), 0);
+  const char* error = 0;
+  if(ml666_schema_validate_tree(schema, stb, ML666_ST_NODE(tree), &error) || !error)
+    result = 4;
+end:
+  if(tree){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, tree));
+    ml666_st_node_put(stb, ML666_ST_NODE(tree));
+  }
+  ml666_parser_destroy(parser);
+  ml666_parser_schema_destroy(filter);
+  ml666_simple_tree_parser_destroy(stp);
+  ml666_st_builder_destroy(stb);
+  return result;
+}
@@ -0,0 +1,114 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/parser.h>
+#include <ml666/parser-dispatch.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <unistd.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document[] = "<a><b>`hello`</b><c><b/></c></a>";
+
+static int open_document(void){
+  int fds[2];
+  if(pipe(fds) == -1)
+    return -1;
+  if(write(fds[1], document, sizeof(document)-1) != sizeof(document)-1){
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+static bool count_push(struct ml666_parser* parser, void* ptr, const ml666_hashed_buffer_set_entry* name, size_t depth){
+  (void)parser; (void)name; (void)depth;
+  *(size_t*)ptr += 1;
+  return true;
+}
+
+static bool fail_push(struct ml666_parser* parser, void* ptr, const ml666_hashed_buffer_set_entry* name, size_t depth){
+  (void)ptr; (void)name; (void)depth;
+  parser->error = "fail_push";
+  return false;
+}
+
+static const struct ml666_parser_dispatch_handler counter_handler = {
+  .tag_push = count_push,
+};
+
+static const struct ml666_parser_dispatch_handler failing_handler = {
+  .tag_push = fail_push,
+};
+
+struct ml666_st_builder* stb;
+struct ml666_simple_tree_parser* stp;
+struct ml666_parser_dispatch* dispatch;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  stp = ml666_simple_tree_parser_create(stb, .detached=true);
+  dispatch = ml666_parser_dispatch_create(0);
+}
+
+void test_teardown(void){
+  ml666_parser_dispatch_destroy(dispatch);
+  ml666_simple_tree_parser_destroy(stp);
+  ml666_st_builder_destroy(stb);
+}
+
+static int run(size_t* count){
+  int fd = open_document();
+  if(fd == -1)
+    return 1;
+  struct ml666_parser* tee = ml666_parser_tee_create(
+    .fd = fd,
+    .consumer_count = 2,
+    .consumers = (const struct ml666_parser_tee_consumer[]){
+      { .api = &ml666_simple_tree_parser_api, .user_ptr = stp },
+      { .api = &ml666_parser_dispatch_api, .user_ptr = dispatch },
+    },
+  );
+  if(!tee)
+    return 2;
+  while(ml666_parser_next(tee));
+  int result = 0;
+  if(tee->error)
+    result = 3;
+  if(!result && ml666_parser_tee_get_consumer(tee, 0)->error)
+    result = 4;
+  if(!result && !!ml666_parser_tee_get_consumer(tee, 1)->error != !count)
+    result = 5;
+  ml666_parser_destroy(tee);
+  if(result)
+    return result;
+  struct ml666_st_document* doc = ml666_simple_tree_parser_take_document(stp);
+  if(!doc)
+    return 6;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, doc));
+  if(!a || !ML666_ST_U_ELEMENT(a))
+    result = 7;
+  else if(!ml666_buffer__equal(ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, ML666_ST_U_ELEMENT(a)))->buffer, ML666_BUFFER_STR("a")))
+    result = 8;
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, doc));
+  ml666_st_node_put(stb, ML666_ST_NODE(doc));
+  if(count && *count != 2)
+    return 9;
+  return result;
+}
+
+ML666_TEST("two-consumers"){
+  size_t count = 0;
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("b"), ML666_PARSER_DISPATCH_ANY_DEPTH, &counter_handler, &count))
+    return 10;
+  return run(&count);
+}
+
+ML666_TEST("failing-consumer"){
+  if(!ml666_parser_dispatch_register(dispatch, ML666_BUFFER_STR("c"), ML666_PARSER_DISPATCH_ANY_DEPTH, &failing_handler, 0))
+    return 10;
+  return run(0);
+}
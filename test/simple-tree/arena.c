@@ -0,0 +1,60 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-arena-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b x=`2`/>/* comment */<b>`world`</b></a>";
+
+static struct ml666_st_document* parse(struct ml666_st_builder* stb){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  return ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+ML666_TEST("release-document"){
+  // Tiny blocks, so there are lots of them
+  struct ml666_st_builder* stb = ml666_st_arena_builder_create(.block_size=64);
+  struct ml666_st_document* document = parse(stb);
+  if(!document)
+    return 1;
+  struct ml666_st_element* a = ML666_ST_U_ELEMENT(ML666_ST_NODE(ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document))));
+  if(!a)
+    return 2;
+  struct ml666_st_element* b = ML666_ST_U_ELEMENT(ML666_ST_NODE(ml666_st_member_get_next(stb, ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, a)))));
+  if(!b)
+    return 3;
+  // Names are interned per document
+  const struct ml666_hashed_buffer* ax = ml666_st_attribute_get_name(stb, ml666_st_attribute_get_first(stb, a));
+  const struct ml666_hashed_buffer* bx = ml666_st_attribute_get_name(stb, ml666_st_attribute_get_first(stb, b));
+  if(ax != bx)
+    return 4;
+  // Everything is freed with the document, the allocation counter checks that
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+  ml666_st_builder_destroy(stb);
+  return 0;
+}
+
+ML666_TEST("other-document"){
+  struct ml666_st_builder* stb = ml666_st_arena_builder_create(0);
+  struct ml666_st_document* first = parse(stb);
+  struct ml666_st_document* second = parse(stb);
+  if(!first || !second)
+    return 1;
+  int result = 0;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, second));
+  if(ml666_st_member_set(stb, ML666_ST_NODE(first), a, 0))
+    result = 2;
+  // Creating nodes after the newer document is gone uses the arena of the older one again
+  ml666_st_node_put(stb, ML666_ST_NODE(second));
+  struct ml666_st_comment* comment = ml666_st_comment_create(stb);
+  if(!result && !ml666_st_member_set(stb, ML666_ST_NODE(first), ML666_ST_MEMBER(comment), 0))
+    result = 3;
+  ml666_st_node_put(stb, ML666_ST_NODE(comment));
+  ml666_st_node_put(stb, ML666_ST_NODE(first));
+  ml666_st_builder_destroy(stb);
+  return result;
+}
@@ -0,0 +1,55 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/simple-tree-builder.h>
+#include <stdio.h>
+
+#define ATTRIBUTE_COUNT 1000
+
+struct ml666_st_builder* stb;
+struct ml666_st_element* element;
+
+static struct ml666_hashed_buffer name(unsigned i, char str[static 16]){
+  int length = snprintf(str, 16, "a%u", i);
+  return ml666_hashed_buffer__create((struct ml666_buffer_ro){.data=str, .length=length});
+}
+
+static struct ml666_st_attribute* lookup(unsigned i, enum ml666_st_attribute_lookup_flags flags){
+  char str[16];
+  struct ml666_hashed_buffer entry = name(i, str);
+  return ml666_st_attribute_lookup(stb, element, &entry, flags);
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  struct ml666_hashed_buffer entry = ml666_hashed_buffer__create((struct ml666_buffer_ro){.data="e", .length=1});
+  element = ml666_st_element_create(stb, &entry, true);
+}
+
+void test_teardown(void){
+  ml666_st_node_put(stb, ML666_ST_NODE(element));
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("many"){
+  for(unsigned i=0; i<ATTRIBUTE_COUNT; i++)
+    if(!lookup(i, ML666_ST_AOF_CREATE_EXCLUSIVE))
+      return 1;
+  if(lookup(ATTRIBUTE_COUNT/2, ML666_ST_AOF_CREATE_EXCLUSIVE))
+    return 2;
+  for(unsigned i=0; i<ATTRIBUTE_COUNT; i+=2)
+    ml666_st_attribute_remove(stb, lookup(i, 0));
+  for(unsigned i=0; i<ATTRIBUTE_COUNT; i++)
+    if(!lookup(i, 0) != !(i % 2))
+      return 3;
+  // The insertion order is kept
+  unsigned i = 1;
+  for(struct ml666_st_attribute* it=ml666_st_attribute_get_first(stb, element); it; it=ml666_st_attribute_get_next(stb, it), i+=2){
+    char str[16];
+    struct ml666_hashed_buffer entry = name(i, str);
+    if(!ml666_buffer__equal(ml666_st_attribute_get_name(stb, it)->buffer, entry.buffer))
+      return 4;
+  }
+  if(i != ATTRIBUTE_COUNT+1)
+    return 5;
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-arena-builder.h>
+#include <ml666/simple-tree-clone.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+#define TEXT(X) {sizeof(X)-1, (X)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b z=`a value which is too long to be stored inline`/>/* comment */<b>`a content which is too long to be stored inline`<c/></b></a>`tail`";
+
+struct ml666_hashed_buffer a, b, c, x, y, z;
+
+static const struct ml666_st_attribute_description a_attributes[] = {
+  {.name=&x, .value=TEXT("1"), .has_value=true},
+  {.name=&y},
+};
+
+static const struct ml666_st_attribute_description b_attributes[] = {
+  {.name=&z, .value=TEXT("a value which is too long to be stored inline"), .has_value=true},
+};
+
+static const struct ml666_st_member_description members[] = {
+  {ML666_ST_NT_ELEMENT, ML666_ST_BUILD_PARENT, .name=&a, .attribute_count=2, .attribute=a_attributes},
+  {ML666_ST_NT_CONTENT, 0, .data=TEXT("hello")},
+  {ML666_ST_NT_ELEMENT, 0, .name=&b, .attribute_count=1, .attribute=b_attributes},
+  {ML666_ST_NT_COMMENT, 0, .data=TEXT("comment")},
+  {ML666_ST_NT_ELEMENT, 0, .name=&b},
+  {ML666_ST_NT_CONTENT, 4, .data=TEXT("a content which is too long to be stored inline")},
+  {ML666_ST_NT_ELEMENT, 4, .name=&c},
+  {ML666_ST_NT_CONTENT, ML666_ST_BUILD_PARENT, .data=TEXT("tail")},
+};
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+struct ml666_st_document* built;
+
+static void put(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  if(!document)
+    return;
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+void test_setup(void){
+  a = ml666_hashed_buffer__create(ML666_BUFFER_STR("a"));
+  b = ml666_hashed_buffer__create(ML666_BUFFER_STR("b"));
+  c = ml666_hashed_buffer__create(ML666_BUFFER_STR("c"));
+  x = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  y = ml666_hashed_buffer__create(ML666_BUFFER_STR("y"));
+  z = ml666_hashed_buffer__create(ML666_BUFFER_STR("z"));
+  stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+  built = ml666_st_document_create(stb);
+}
+
+void test_teardown(void){
+  put(stb, built);
+  put(stb, document);
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("default"){
+  if(!document || !built)
+    return 1;
+  if(!ml666_st_build(stb, ML666_ST_NODE(built), sizeof(members)/sizeof(*members), members))
+    return 2;
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(built)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(document)))
+    return 3;
+  // Parts of it can be changed and freed in any order
+  struct ml666_st_member* first = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, built));
+  struct ml666_st_children* children = ML666_ST_U_CHILDREN(stb, first);
+  struct ml666_st_member* hello = ml666_st_get_first_child(stb, children);
+  struct ml666_buffer value = ml666_st_content_take(stb, ML666_ST_U_CONTENT(hello));
+  if(value.length != 5 || memcmp(value.data, "hello", 5))
+    return 4;
+  if(!ml666_st_content_set(stb, ML666_ST_U_CONTENT(hello), value))
+    return 5;
+  struct ml666_st_member* last_b = ml666_st_get_last_child(stb, children);
+  ml666_st_subtree_disintegrate(stb, ML666_ST_U_CHILDREN(stb, last_b));
+  ml666_st_member_set(stb, 0, last_b, 0);
+  ml666_st_attribute_remove(stb, ml666_st_attribute_get_first(stb, ML666_ST_U_ELEMENT(first)));
+  return 0;
+}
+
+ML666_TEST("generic"){
+  if(!document)
+    return 1;
+  struct ml666_st_builder* arena = ml666_st_arena_builder_create(0);
+  struct ml666_st_document* other = arena ? ml666_st_document_create(arena) : 0;
+  if(!other)
+    return 2;
+  int result = 0;
+  if(!ml666_st_build(arena, ML666_ST_NODE(other), sizeof(members)/sizeof(*members), members)){
+    result = 3;
+  }else{
+    struct ml666_st_node* copy = ml666_st_clone(.stb=arena, .node=ML666_ST_NODE(other), .target=stb);
+    if(!copy || ml666_st_node_get_hash(stb, copy) != ml666_st_node_get_hash(stb, ML666_ST_NODE(document)))
+      result = 4;
+    put(stb, (struct ml666_st_document*)copy);
+  }
+  ml666_st_node_put(arena, ML666_ST_NODE(other));
+  ml666_st_builder_destroy(arena);
+  return result;
+}
+
+ML666_TEST("failure"){
+  if(!built)
+    return 1;
+  static const struct ml666_st_attribute_description twice[] = {{.name=&x}, {.name=&x}};
+  const struct ml666_st_member_description broken[] = {
+    {ML666_ST_NT_ELEMENT, ML666_ST_BUILD_PARENT, .name=&a},
+    {ML666_ST_NT_ELEMENT, 0, .name=&b, .attribute_count=2, .attribute=twice},
+  };
+  if(ml666_st_build(stb, ML666_ST_NODE(built), 2, broken))
+    return 2;
+  if(ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, built)))
+    return 3;
+  return 0;
+}
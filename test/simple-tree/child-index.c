@@ -0,0 +1,66 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR("<a><b/><c/><d/></a>"));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+void test_teardown(void){
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(stb);
+}
+
+// The first letters of the names of the children, in index order
+static bool check(struct ml666_st_children* children, const char* expected){
+  size_t count = ml666_st_child_count(stb, children);
+  if(count != strlen(expected) || ml666_st_child_at(stb, children, count))
+    return false;
+  struct ml666_st_member* it = ml666_st_get_first_child(stb, children);
+  for(size_t i=0; i<count; i++, it=ml666_st_member_get_next(stb, it)){
+    struct ml666_st_member* child = ml666_st_child_at(stb, children, i);
+    if(child != it || *ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, ML666_ST_U_ELEMENT(child)))->buffer.data != expected[i])
+      return false;
+  }
+  return true;
+}
+
+ML666_TEST("update"){
+  if(!document)
+    return 1;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_children* children = ML666_ST_U_CHILDREN(stb, a);
+  if(!check(children, "bcd"))
+    return 2;
+  // Appending
+  struct ml666_hashed_buffer e = ml666_hashed_buffer__create(ML666_BUFFER_STR("e"));
+  struct ml666_st_element* element = ml666_st_element_create(stb, &e, true);
+  if(!element)
+    return 3;
+  bool ok = ml666_st_member_set(stb, ML666_ST_NODE(a), ML666_ST_MEMBER(element), 0);
+  ml666_st_node_put(stb, ML666_ST_NODE(element));
+  if(!ok || !check(children, "bcde"))
+    return 4;
+  // Moving to the front, and removing
+  if(!ml666_st_member_set(stb, 0, ml666_st_child_at(stb, children, 2), ml666_st_child_at(stb, children, 0)))
+    return 5;
+  if(!check(children, "dbce"))
+    return 6;
+  ml666_st_member_set(stb, 0, ml666_st_child_at(stb, children, 1), 0);
+  if(!check(children, "dce"))
+    return 7;
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-clone.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b z=`a value which is too long to be stored inline`/>/* comment */<b>`world`<c/></b></a>`tail`";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+
+static void put(struct ml666_st_node* node){
+  if(!node)
+    return;
+  struct ml666_st_children* children = ml666_st_node_get_children(stb, node);
+  if(children)
+    ml666_st_subtree_disintegrate(stb, children);
+  ml666_st_node_put(stb, node);
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(.stats=true);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+void test_teardown(void){
+  put(ML666_ST_NODE(document));
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("document"){
+  if(!document)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(document));
+  struct ml666_st_node* copy = ml666_st_clone(.stb=stb, .node=ML666_ST_NODE(document));
+  if(!copy)
+    return 2;
+  int result = 0;
+  if(ml666_st_node_get_hash(stb, copy) != hash){
+    result = 3;
+  }else{
+    // Changing the copy leaves the original alone
+    struct ml666_st_member* tail = ml666_st_get_last_child(stb, ml666_st_node_get_children(stb, copy));
+    ml666_st_member_set(stb, 0, tail, 0);
+    if(ml666_st_node_get_hash(stb, copy) == hash || ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) != hash)
+      result = 4;
+  }
+  put(copy);
+  return result;
+}
+
+ML666_TEST("member"){
+  if(!document)
+    return 1;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_node* copy = ml666_st_clone(.stb=stb, .node=ML666_ST_NODE(a));
+  if(!copy)
+    return 2;
+  int result = 0;
+  if(ml666_st_member_get_parent(stb, (struct ml666_st_member*)copy)){
+    result = 3;
+  }else if(ml666_st_node_get_hash(stb, copy) != ml666_st_node_get_hash(stb, ML666_ST_NODE(a))){
+    result = 4;
+  }else if(!ml666_st_member_set(stb, ML666_ST_NODE(document), (struct ml666_st_member*)copy, 0)){
+    result = 5;
+  }
+  ml666_st_node_put(stb, copy);
+  return result;
+}
+
+static size_t element_count(void){
+  struct ml666_st_stats stats;
+  return ml666_st_builder_get_stats(stb, &stats) ? stats.element_count : 0;
+}
+
+ML666_TEST("lazy document"){
+  if(!document)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(document));
+  const size_t count = element_count();
+  struct ml666_st_node* copy = ml666_st_clone_lazy(stb, ML666_ST_NODE(document));
+  if(!copy)
+    return 2;
+  int result = 0;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_member* c = ml666_st_get_last_child(stb, ml666_st_node_get_children(stb, ML666_ST_NODE(ml666_st_get_last_child(stb, ml666_st_node_get_children(stb, ML666_ST_NODE(a))))));
+  if(element_count() != count + 1){
+    // Only the top level element is there yet
+    result = 3;
+  }else if(!ml666_st_member_set(stb, 0, c, 0)){
+    result = 4;
+  }else if(ml666_st_node_get_hash(stb, copy) != hash || ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) == hash){
+    // The clone still has the element removed from the original
+    result = 5;
+  }
+  put(copy);
+  return result;
+}
+
+ML666_TEST("lazy changes"){
+  if(!document)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(document));
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_node* copy = ml666_st_clone_lazy(stb, ML666_ST_NODE(a));
+  if(!copy)
+    return 2;
+  int result = 0;
+  struct ml666_st_member* b = ml666_st_get_last_child(stb, ml666_st_node_get_children(stb, copy));
+  const struct ml666_hashed_buffer name = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, (struct ml666_st_element*)copy, &name, 0);
+  const struct ml666_buffer_ro* value = attribute ? ml666_st_attribute_get_value(stb, attribute) : 0;
+  if(!b || !value || value->length != 1 || *value->data != '1'){
+    result = 3;
+  }else if(!ml666_st_member_set(stb, 0, ml666_st_get_first_child(stb, ml666_st_node_get_children(stb, ML666_ST_NODE(b))), 0)){
+    result = 4;
+  }else if(ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) != hash){
+    // Changing the clone left the original alone
+    result = 5;
+  }else if(!ml666_st_member_set(stb, ML666_ST_NODE(document), (struct ml666_st_member*)copy, 0)){
+    result = 6;
+  }
+  ml666_st_node_put(stb, copy);
+  return result;
+}
+
+ML666_TEST("lazy release"){
+  if(!document)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(document));
+  struct ml666_st_node* copy = ml666_st_clone_lazy(stb, ML666_ST_NODE(document));
+  if(!copy)
+    return 2;
+  // The clone keeps what it needs of the original
+  put(ML666_ST_NODE(document));
+  document = 0;
+  int result = 0;
+  if(ml666_st_node_get_hash(stb, copy) != hash)
+    result = 3;
+  put(copy);
+  struct ml666_st_stats stats;
+  if(!result && (!ml666_st_builder_get_stats(stb, &stats) || stats.element_count || stats.allocation_count))
+    result = 4;
+  return result;
+}
@@ -0,0 +1,91 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`a value which is too long to be stored inline`>`the first content, which is long enough`/* a comment which doesn't fit inline either */</a>";
+
+static const char expected_text[] =
+  "<a x=`a value which is too long to be stored inline`>`the first content, which is long enough`/* a comment which doesn't fit inline either */`and the second one, also quite long!`</a>";
+
+struct ml666_st_builder* stb;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(.stats=true);
+}
+
+void test_teardown(void){
+  ml666_st_builder_destroy(stb);
+}
+
+static struct ml666_st_document* parse(struct ml666_buffer_ro text){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=text);
+  return ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+static bool append_content(struct ml666_st_member* parent, struct ml666_buffer_ro text){
+  struct ml666_st_content* content = ml666_st_content_create(stb);
+  if(!content)
+    return false;
+  struct ml666_buffer data = {0};
+  bool ok = ml666_buffer__dup(&data, text)
+         && ml666_st_content_set(stb, content, data)
+         && ml666_st_member_set(stb, ML666_ST_NODE(parent), ML666_ST_MEMBER(content), 0);
+  ml666_st_node_put(stb, ML666_ST_NODE(content));
+  return ok;
+}
+
+static void destroy(struct ml666_st_document* document){
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+ML666_TEST("merge"){
+  struct ml666_st_document* document = parse(ML666_BUFFER_STR(document_text));
+  struct ml666_st_document* expected = parse(ML666_BUFFER_STR(expected_text));
+  int result = 0;
+  struct ml666_st_member* a = document ? ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document)) : 0;
+  if(!a || !expected){
+    result = 1;
+  }else if(!append_content(a, ML666_BUFFER_STR("and the second one, also quite long"))
+        || !append_content(a, ML666_BUFFER_STR(""))
+        || !append_content(a, ML666_BUFFER_STR("!"))
+  ){
+    result = 2;
+  }else if(!ml666_st_compact(stb, ML666_ST_NODE(document))){
+    result = 3;
+  }else if(ml666_st_child_count(stb, ML666_ST_U_CHILDREN(stb, a)) != 3){
+    result = 4;
+  }else if(ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(expected))){
+    result = 5;
+  }else if(!ml666_st_compact(stb, ML666_ST_NODE(document), .slab=true)){
+    result = 6;
+  }else if(ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(expected))){
+    result = 7;
+  }else{
+    // Replacing some of the data in the slab leaves the rest of it alone
+    struct ml666_st_content* first = (struct ml666_st_content*)ml666_st_get_first_child(stb, ML666_ST_U_CHILDREN(stb, a));
+    struct ml666_buffer data = {0};
+    if(!ml666_buffer__dup(&data, ML666_BUFFER_STR("the first content, which is long enough")) || !ml666_st_content_set(stb, first, data))
+      result = 8;
+    else if(ml666_st_node_get_hash(stb, ML666_ST_NODE(document)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(expected)))
+      result = 9;
+  }
+  if(document)
+    destroy(document);
+  if(expected)
+    destroy(expected);
+  if(result)
+    return result;
+  struct ml666_st_stats stats;
+  if(!ml666_st_builder_get_stats(stb, &stats))
+    return 10;
+  if(stats.content_count || stats.data_bytes || stats.allocation_count || stats.allocated_bytes)
+    return 11;
+  return 0;
+}
@@ -26,7 +26,7 @@ ML666_TEST("set"){
   ml666_buffer__dup(&dest, ML666_BUFFER_STR("Hello World!"));
   ml666_st_content_set(stb, content, dest);
   struct ml666_buffer_ro current = ml666_st_content_get(stb, content);
-  if(!ml666_buffer__equal(current, dest.ro))
+  if(!ml666_buffer__equal(current, ML666_BUFFER_STR("Hello World!")))
     return 1;
   return 0;
 }
@@ -45,10 +45,25 @@ ML666_TEST("take"){
   ml666_buffer__dup(&dest, ML666_BUFFER_STR("Hello World!"));
   ml666_st_content_set(stb, content, dest);
   struct ml666_buffer current = ml666_st_content_take(stb, content);
-  if(!ml666_buffer__equal(current.ro, dest.ro))
+  if(!ml666_buffer__equal(current.ro, ML666_BUFFER_STR("Hello World!")))
     return 1;
   if(ml666_st_content_get(stb, content).length)
     return 2;
   ml666_buffer__clear(&current);
   return 0;
 }
+
+ML666_TEST("long"){
+  // Long enough not to be stored in the node
+  static const char text[] = "Hello World! Hello World! Hello World!";
+  struct ml666_buffer dest;
+  ml666_buffer__dup(&dest, ML666_BUFFER_STR(text));
+  ml666_st_content_set(stb, content, dest);
+  struct ml666_buffer current = ml666_st_content_take(stb, content);
+  if(!ml666_buffer__equal(current.ro, ML666_BUFFER_STR(text)))
+    return 1;
+  ml666_st_content_set(stb, content, current);
+  if(!ml666_buffer__equal(ml666_st_content_get(stb, content), ML666_BUFFER_STR(text)))
+    return 2;
+  return 0;
+}
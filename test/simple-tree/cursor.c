@@ -0,0 +1,102 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-frozen.h>
+#include <string.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1`>`hello`<b/>/* comment */<b>`world`<c/><c/></b></a>`tail`";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+void test_teardown(void){
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(stb);
+}
+
+// The types & depths of all the steps. D=document, E=element, T=content, C=comment, lower case when leaving.
+static bool trace(struct ml666_st_builder* b, struct ml666_st_cursor cursor, char* result, size_t size, bool skip_b){
+  size_t i = 0;
+  while(ml666_st_cursor_next(b, &cursor)){
+    if(i+2 >= size)
+      return false;
+    const bool enter = cursor.event == ML666_ST_CE_ENTER;
+    if(!enter && cursor.event != ML666_ST_CE_LEAVE)
+      return false;
+    result[i++] = "DETC"[ML666_ST_TYPE(cursor.node)] | (enter ? 0 : 0x20);
+    result[i++] = '0' + cursor.depth;
+    if(enter && skip_b && ML666_ST_TYPE(cursor.node) == ML666_ST_NT_ELEMENT){
+      const struct ml666_hashed_buffer* name = ml666_hashed_buffer_set__peek(ml666_st_element_get_name(b, (struct ml666_st_element*)cursor.node));
+      if(ml666_buffer__equal(name->buffer, ML666_BUFFER_STR("b")))
+        ml666_st_cursor_skip(&cursor);
+    }
+  }
+  result[i] = 0;
+  return cursor.event == ML666_ST_CE_END && !ml666_st_cursor_next(b, &cursor);
+}
+
+ML666_TEST("walk"){
+  if(!document)
+    return 1;
+  char result[64];
+  if(!trace(stb, ml666_st_cursor_create(ML666_ST_NODE(document)), result, sizeof(result), false))
+    return 2;
+  if(strcmp(result, "D0E1T2t2E2e2C2c2E2T3t3E3e3E3e3e2e1T1t1d0"))
+    return 3;
+  return 0;
+}
+
+ML666_TEST("skip"){
+  if(!document)
+    return 1;
+  char result[64];
+  if(!trace(stb, ml666_st_cursor_create(ML666_ST_NODE(document)), result, sizeof(result), true))
+    return 2;
+  if(strcmp(result, "D0E1T2t2E2e2C2c2E2e2e1T1t1d0"))
+    return 3;
+  // Only the subtree of the root is walked
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  if(!trace(stb, ml666_st_cursor_create(ML666_ST_NODE(ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, a)))), result, sizeof(result), false))
+    return 4;
+  if(strcmp(result, "E0T1t1E1e1E1e1e0"))
+    return 5;
+  return 0;
+}
+
+ML666_TEST("generic"){
+  if(!document)
+    return 1;
+  // The frozen builder uses the generic implementation
+  struct ml666_st_builder* frozen = ml666_st_frozen_builder_create(0);
+  struct ml666_st_document* frozen_document = ml666_st_freeze(frozen, stb, document);
+  int result = 0;
+  char a[64], b[64];
+  if(!frozen_document){
+    result = 2;
+  }else if(!trace(stb, ml666_st_cursor_create(ML666_ST_NODE(document)), a, sizeof(a), true)){
+    result = 3;
+  }else if(!trace(frozen, ml666_st_cursor_create(ML666_ST_NODE(frozen_document)), b, sizeof(b), true)){
+    result = 4;
+  }else if(strcmp(a, b)){
+    result = 5;
+  }
+  if(frozen_document)
+    ml666_st_node_put(frozen, ML666_ST_NODE(frozen_document));
+  ml666_st_builder_destroy(frozen);
+  return result;
+}
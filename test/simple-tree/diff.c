@@ -0,0 +1,123 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-arena-builder.h>
+#include <ml666/simple-tree-diff.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char old_text[] =
+  "<config version=`1`>"
+    "<server name=`a` port=`80`/>"
+    "<server name=`b` port=`81`/>"
+    "/* the rest */"
+    "<limits>`100`</limits>"
+    "<server name=`c`/>"
+  "</config>";
+
+static const char new_text[] =
+  "<config version=`2`>"
+    "<server name=`c`/>"
+    "<server name=`a` port=`80`/>"
+    "/* the rest */"
+    "<limits tls>`200`</limits>"
+    "<server name=`d` port=`82`><alias>`e`</alias></server>"
+  "</config>";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document *old, *new;
+
+static struct ml666_st_document* parse(struct ml666_st_builder* b, struct ml666_buffer_ro input){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=input);
+  return ml666_st_parse(b, .tokenizer=tokenizer);
+}
+
+static void put(struct ml666_st_builder* b, struct ml666_st_document* document){
+  if(!document)
+    return;
+  ml666_st_subtree_disintegrate(b, ML666_ST_CHILDREN(b, document));
+  ml666_st_node_put(b, ML666_ST_NODE(document));
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  old = parse(stb, ML666_BUFFER_STR(old_text));
+  new = parse(stb, ML666_BUFFER_STR(new_text));
+}
+
+void test_teardown(void){
+  put(stb, old);
+  put(stb, new);
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("equal"){
+  if(!old || !new)
+    return 1;
+  struct ml666_st_document* copy = parse(stb, ML666_BUFFER_STR(old_text));
+  if(!copy)
+    return 2;
+  struct ml666_st_edit_script* script = ml666_st_diff(.stb=stb, .from=ML666_ST_NODE(old), .to=ML666_ST_NODE(copy));
+  int result = 0;
+  if(!script){
+    result = 3;
+  }else if(script->count){
+    result = 4;
+  }
+  if(script)
+    ml666_st_edit_script_destroy(script);
+  put(stb, copy);
+  return result;
+}
+
+ML666_TEST("patch"){
+  if(!old || !new)
+    return 1;
+  struct ml666_st_edit_script* script = ml666_st_diff(.stb=stb, .from=ML666_ST_NODE(old), .to=ML666_ST_NODE(new));
+  if(!script)
+    return 2;
+  int result = 0;
+  if(!ml666_st_patch(stb, ML666_ST_NODE(old), script)){
+    result = 3;
+  }else if(ml666_st_node_get_hash(stb, ML666_ST_NODE(old)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(new))){
+    result = 4;
+  }
+  ml666_st_edit_script_destroy(script);
+  return result;
+}
+
+ML666_TEST("other builder"){
+  if(!old || !new)
+    return 1;
+  // The tree being patched can belong to any builder
+  struct ml666_st_builder* arena = ml666_st_arena_builder_create(0);
+  if(!arena)
+    return 2;
+  // The arena builder creates nodes in the document created last
+  struct ml666_st_document* expected = parse(arena, ML666_BUFFER_STR(new_text));
+  struct ml666_st_document* target = parse(arena, ML666_BUFFER_STR(old_text));
+  struct ml666_st_edit_script* script = ml666_st_diff(.stb=stb, .from=ML666_ST_NODE(old), .to=ML666_ST_NODE(new));
+  struct ml666_st_edit_script* check = 0;
+  int result = 0;
+  if(!target || !expected || !script){
+    result = 3;
+  }else if(!ml666_st_patch(arena, ML666_ST_NODE(target), script)){
+    result = 4;
+  // Without hashes, everything is compared
+  }else if(!(check = ml666_st_diff(.stb=arena, .from=ML666_ST_NODE(target), .to=ML666_ST_NODE(expected)))){
+    result = 5;
+  }else if(check->count){
+    result = 6;
+  }
+  if(check)
+    ml666_st_edit_script_destroy(check);
+  if(script)
+    ml666_st_edit_script_destroy(script);
+  put(arena, target);
+  put(arena, expected);
+  ml666_st_builder_destroy(arena);
+  return result;
+}
@@ -0,0 +1,135 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-frozen.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b x=`2`/>/* comment */<b>`world`<c/><c/></b></a>`tail`";
+
+struct ml666_st_builder* stb;
+struct ml666_st_builder* frozen;
+struct ml666_st_document* document;
+struct ml666_st_document* frozen_document;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  frozen = ml666_st_frozen_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+  if(document)
+    frozen_document = ml666_st_freeze(frozen, stb, document);
+}
+
+void test_teardown(void){
+  if(frozen_document)
+    ml666_st_node_put(frozen, ML666_ST_NODE(frozen_document));
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(frozen);
+  ml666_st_builder_destroy(stb);
+}
+
+static bool same_name(const struct ml666_hashed_buffer* a, const struct ml666_hashed_buffer* b){
+  return a->hash == b->hash && ml666_buffer__equal(a->buffer, b->buffer);
+}
+
+static bool same_attributes(struct ml666_st_element* a, struct ml666_st_element* b){
+  struct ml666_st_attribute* x = ml666_st_attribute_get_first(stb, a);
+  struct ml666_st_attribute* y = ml666_st_attribute_get_first(frozen, b);
+  for(; x && y; x=ml666_st_attribute_get_next(stb, x), y=ml666_st_attribute_get_next(frozen, y)){
+    if(!same_name(ml666_st_attribute_get_name(stb, x), ml666_st_attribute_get_name(frozen, y)))
+      return false;
+    const struct ml666_buffer_ro* vx = ml666_st_attribute_get_value(stb, x);
+    const struct ml666_buffer_ro* vy = ml666_st_attribute_get_value(frozen, y);
+    if(!vx != !vy || (vx && !ml666_buffer__equal(*vx, *vy)))
+      return false;
+  }
+  return !x && !y;
+}
+
+static bool same_tree(struct ml666_st_children* a, struct ml666_st_children* b){
+  struct ml666_st_member* x = ml666_st_get_first_child(stb, a);
+  struct ml666_st_member* y = ml666_st_get_first_child(frozen, b);
+  struct ml666_st_member* previous = 0;
+  for(; x && y; x=ml666_st_member_get_next(stb, x), y=ml666_st_member_get_next(frozen, y)){
+    if(ML666_ST_TYPE(x) != ML666_ST_TYPE(y))
+      return false;
+    if(ml666_st_member_get_previous(frozen, y) != previous)
+      return false;
+    if(ML666_ST_U_CHILDREN(frozen, ml666_st_member_get_parent(frozen, y)) != b)
+      return false;
+    previous = y;
+    switch(ML666_ST_TYPE(x)){
+      case ML666_ST_NT_ELEMENT: {
+        struct ml666_st_element* ex = (struct ml666_st_element*)x;
+        struct ml666_st_element* ey = (struct ml666_st_element*)y;
+        if(!same_name(ml666_hashed_buffer_set__peek(ml666_st_element_get_name(stb, ex)), ml666_hashed_buffer_set__peek(ml666_st_element_get_name(frozen, ey))))
+          return false;
+        if(!same_attributes(ex, ey))
+          return false;
+        if(!same_tree(ML666_ST_CHILDREN(stb, ex), ML666_ST_CHILDREN(frozen, ey)))
+          return false;
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        if(!ml666_buffer__equal(ml666_st_content_get(stb, (struct ml666_st_content*)x), ml666_st_content_get(frozen, (struct ml666_st_content*)y)))
+          return false;
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        if(!ml666_buffer__equal(ml666_st_comment_get(stb, (struct ml666_st_comment*)x), ml666_st_comment_get(frozen, (struct ml666_st_comment*)y)))
+          return false;
+      } break;
+      default: return false;
+    }
+  }
+  if(ml666_st_get_last_child(frozen, b) != previous)
+    return false;
+  return !x && !y;
+}
+
+ML666_TEST("same-tree"){
+  if(!frozen_document)
+    return 1;
+  if(!same_tree(ML666_ST_CHILDREN(stb, document), ML666_ST_CHILDREN(frozen, frozen_document)))
+    return 2;
+  return 0;
+}
+
+ML666_TEST("read-only"){
+  if(!frozen_document)
+    return 1;
+  struct ml666_st_element* a = ML666_ST_U_ELEMENT(ml666_st_get_first_child(frozen, ML666_ST_CHILDREN(frozen, frozen_document)));
+  if(!a)
+    return 2;
+  struct ml666_hashed_buffer x = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  struct ml666_hashed_buffer z = ml666_hashed_buffer__create(ML666_BUFFER_STR("z"));
+  if(!ml666_st_attribute_lookup(frozen, a, &x, 0))
+    return 3;
+  if(ml666_st_attribute_lookup(frozen, a, &z, ML666_ST_AOF_CREATE))
+    return 4;
+  if(ml666_st_member_set(frozen, 0, ML666_ST_MEMBER(a), 0))
+    return 5;
+  if(ml666_st_get_first_child(frozen, ML666_ST_CHILDREN(frozen, frozen_document)) != ML666_ST_MEMBER(a))
+    return 6;
+  return 0;
+}
+
+ML666_TEST("reference"){
+  if(!frozen_document)
+    return 1;
+  // Any node keeps the whole document alive
+  struct ml666_st_member* a = ml666_st_get_first_child(frozen, ML666_ST_CHILDREN(frozen, frozen_document));
+  ml666_st_node_ref(frozen, ML666_ST_NODE(a));
+  ml666_st_node_put(frozen, ML666_ST_NODE(frozen_document));
+  frozen_document = 0;
+  if(ML666_ST_TYPE(ml666_st_member_get_parent(frozen, a)) != ML666_ST_NT_DOCUMENT)
+    return 2;
+  ml666_st_node_put(frozen, ML666_ST_NODE(a));
+  return 0;
+}
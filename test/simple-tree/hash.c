@@ -0,0 +1,88 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+struct ml666_st_builder* stb;
+struct ml666_st_document *a, *b;
+
+static struct ml666_st_document* parse(struct ml666_buffer_ro input){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=input);
+  return ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+static void put(struct ml666_st_document* document){
+  if(!document)
+    return;
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  // Only the order of the attributes differs
+  a = parse(ML666_BUFFER_STR("<a x=`1` y>`hello`<b/>/* comment */</a>"));
+  b = parse(ML666_BUFFER_STR("<a y x=`1`>`hello`<b/>/* comment */</a>"));
+}
+
+void test_teardown(void){
+  put(a);
+  put(b);
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("equal"){
+  if(!a || !b)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(a));
+  if(!hash || hash != ml666_st_node_get_hash(stb, ML666_ST_NODE(b)))
+    return 2;
+  struct ml666_st_member* ea = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, a));
+  struct ml666_st_member* eb = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, b));
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(ea)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(eb)))
+    return 3;
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(ea)) == hash)
+    return 4;
+  return 0;
+}
+
+ML666_TEST("invalidate"){
+  if(!a || !b)
+    return 1;
+  const uint64_t hash = ml666_st_node_get_hash(stb, ML666_ST_NODE(a));
+  struct ml666_st_member* element = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, b));
+  struct ml666_st_content* content = ML666_ST_U_CONTENT(ml666_st_get_first_child(stb, ML666_ST_U_CHILDREN(stb, element)));
+  if(!content)
+    return 2;
+  // Changing the content of a descendant changes the hash, changing it back restores it
+  ml666_st_node_get_hash(stb, ML666_ST_NODE(b));
+  struct ml666_buffer old = ml666_st_content_take(stb, content);
+  struct ml666_buffer other = {0};
+  ml666_buffer__dup(&other, ML666_BUFFER_STR("world"));
+  ml666_st_content_set(stb, content, other);
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(b)) == hash)
+    return 3;
+  ml666_st_content_set(stb, content, old);
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(b)) != hash)
+    return 4;
+  // So do attributes
+  struct ml666_hashed_buffer y = ml666_hashed_buffer__create(ML666_BUFFER_STR("y"));
+  struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, ML666_ST_U_ELEMENT(element), &y, 0);
+  if(!attribute)
+    return 5;
+  ml666_st_attribute_remove(stb, attribute);
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(b)) == hash)
+    return 6;
+  // And moving the last child to the front
+  struct ml666_st_member* comment = ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, element));
+  const uint64_t before = ml666_st_node_get_hash(stb, ML666_ST_NODE(b));
+  if(!ml666_st_member_set(stb, 0, comment, ML666_ST_MEMBER(content)))
+    return 7;
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(b)) == before)
+    return 8;
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "/* head */ `before`\n"
+  "<a x=`1` y z=``><b/>`text` `more`/* comment */<c\\ d q=`\\x41`>\n"
+  "  <e><f>B`aGVsbG8=`</f></e>\n"
+  "</c\\ d>H`0a0b`</a>\n"
+  "<g/>`after`\n";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document *lazy, *eager;
+
+static void put(struct ml666_st_document* document){
+  if(!document)
+    return;
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+}
+
+void test_teardown(void){
+  put(lazy);
+  put(eager);
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("equal"){
+  lazy = ml666_st_parse_lazy(stb, ML666_BUFFER_STR(document_text));
+  if(!lazy)
+    return 1;
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  eager = ml666_st_parse(stb, .tokenizer=tokenizer);
+  if(!eager)
+    return 2;
+  // This loads everything
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(lazy)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(eager)))
+    return 3;
+  return 0;
+}
+
+ML666_TEST("open elements"){
+  // The end of the input ends them, as it does for the parser
+  static const char open_text[] = "<a>`x`<b y=`1`><<c>`z`";
+  lazy = ml666_st_parse_lazy(stb, ML666_BUFFER_STR(open_text));
+  if(!lazy)
+    return 1;
+  eager = ml666_st_parse(stb, .tokenizer=ml666_tokenizer_create(.input=ML666_BUFFER_STR(open_text)));
+  if(!eager)
+    return 2;
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(lazy)) != ml666_st_node_get_hash(stb, ML666_ST_NODE(eager)))
+    return 3;
+  return 0;
+}
+
+ML666_TEST("on demand"){
+  // Broken elements are only noticed once they are used
+  lazy = ml666_st_parse_lazy(stb, ML666_BUFFER_STR("<a><b x=`1`/></a><c>`\\q`</c>"));
+  if(!lazy)
+    return 1;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, lazy));
+  struct ml666_st_member* b = ml666_st_get_first_child(stb, ML666_ST_U_CHILDREN(stb, a));
+  struct ml666_hashed_buffer x = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  struct ml666_st_attribute* attribute = b ? ml666_st_attribute_lookup(stb, ML666_ST_U_ELEMENT(b), &x, 0) : 0;
+  if(!attribute || ml666_st_attribute_get_value(stb, attribute)->data[0] != '1')
+    return 2;
+  struct ml666_st_member* c = ml666_st_member_get_next(stb, a);
+  if(!c || ml666_st_node_get_children(stb, ML666_ST_NODE(c)))
+    return 3;
+  // Walking the whole document fails there, instead of leaving it out
+  if(ml666_st_node_get_hash(stb, ML666_ST_NODE(lazy)))
+    return 4;
+  struct ml666_st_cursor cursor = ml666_st_cursor_create(ML666_ST_NODE(lazy));
+  while(ml666_st_cursor_next(stb, &cursor));
+  if(!cursor.error || cursor.node != ML666_ST_NODE(c))
+    return 5;
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a><b x=`1`/><c><b x=`2`/></c></a><b x=`3`/>";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+void test_teardown(void){
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(stb);
+}
+
+// The values of the x attributes of the elements named b, in index order
+static bool list_b(struct ml666_st_document* d, const char* expected){
+  struct ml666_hashed_buffer b = ml666_hashed_buffer__create(ML666_BUFFER_STR("b"));
+  struct ml666_hashed_buffer x = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  for(struct ml666_st_element* it=ml666_st_document_get_first_by_name(stb, d, &b); it; it=ml666_st_element_get_next_by_name(stb, it)){
+    struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, it, &x, 0);
+    if(!attribute || *expected != *ml666_st_attribute_get_value(stb, attribute)->data)
+      return false;
+    expected++;
+  }
+  return !*expected;
+}
+
+ML666_TEST("lookup"){
+  if(!document)
+    return 1;
+  if(!ml666_st_document_index_names(stb, document))
+    return 2;
+  if(!list_b(document, "123"))
+    return 3;
+  struct ml666_hashed_buffer z = ml666_hashed_buffer__create(ML666_BUFFER_STR("z"));
+  if(ml666_st_document_get_first_by_name(stb, document, &z))
+    return 4;
+  return 0;
+}
+
+ML666_TEST("update"){
+  if(!document)
+    return 1;
+  if(!ml666_st_document_index_names(stb, document))
+    return 2;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_member* c = ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, a));
+  // Moving within the document keeps the order
+  if(!ml666_st_member_set(stb, ML666_ST_NODE(document), c, 0))
+    return 3;
+  if(!list_b(document, "123"))
+    return 4;
+  // Removing a subtree removes all of its elements
+  ml666_st_node_ref(stb, ML666_ST_NODE(c));
+  ml666_st_member_set(stb, 0, c, 0);
+  if(!list_b(document, "13"))
+    return 5;
+  // Moving it to another indexed document
+  struct ml666_st_document* other = ml666_st_document_create(stb);
+  if(!other || !ml666_st_document_index_names(stb, other))
+    return 6;
+  int result = 0;
+  if(!ml666_st_member_set(stb, ML666_ST_NODE(other), c, 0))
+    result = 7;
+  else if(!list_b(other, "2"))
+    result = 8;
+  else if(!ml666_st_member_set(stb, ML666_ST_NODE(document), c, a))
+    result = 9;
+  else if(!list_b(document, "132") || !list_b(other, ""))
+    result = 10;
+  ml666_st_node_put(stb, ML666_ST_NODE(c));
+  ml666_st_node_put(stb, ML666_ST_NODE(other));
+  return result;
+}
+
+ML666_TEST("detached"){
+  if(!document)
+    return 1;
+  if(!ml666_st_document_index_names(stb, document))
+    return 2;
+  struct ml666_st_document* other = ml666_st_parse(stb, .tokenizer=ml666_tokenizer_create(.input=ML666_BUFFER_STR("<b x=`4`/>")));
+  if(!other)
+    return 3;
+  struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+  struct ml666_st_member* c = ml666_st_get_last_child(stb, ML666_ST_U_CHILDREN(stb, a));
+  ml666_st_node_ref(stb, ML666_ST_NODE(c));
+  ml666_st_member_set(stb, 0, c, 0);
+  int result = 0;
+  // Elements added outside of the document only get indexed once their subtree is added to it
+  if(!ml666_st_member_set(stb, ML666_ST_NODE(c), ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, other)), 0))
+    result = 4;
+  else if(!list_b(document, "13"))
+    result = 5;
+  else if(!ml666_st_member_set(stb, ML666_ST_NODE(a), c, 0))
+    result = 6;
+  else if(!list_b(document, "1324"))
+    result = 7;
+  ml666_st_node_put(stb, ML666_ST_NODE(c));
+  ml666_st_node_put(stb, ML666_ST_NODE(other));
+  return result;
+}
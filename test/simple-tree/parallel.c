@@ -0,0 +1,95 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/structure-scanner.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "/* head */<meta/>\n"
+  "<list>`x` <item>`1`</item>/* c\\*/ */<item><sub /* > */>`2\\``</sub></item>`y`<item/>H`7a`<item>`</item>`</item></list>\n"
+  "// tail\n";
+#define DOCUMENT ML666_BUFFER_STR(document_text)
+
+static bool same_tree(struct ml666_st_builder* stb, struct ml666_st_children* a, struct ml666_st_children* b){
+  struct ml666_st_member* x = ml666_st_get_first_child(stb, a);
+  struct ml666_st_member* y = ml666_st_get_first_child(stb, b);
+  for(; x && y; x=ml666_st_member_get_next(stb, x), y=ml666_st_member_get_next(stb, y)){
+    if(ML666_ST_TYPE(x) != ML666_ST_TYPE(y))
+      return false;
+    switch(ML666_ST_TYPE(x)){
+      case ML666_ST_NT_ELEMENT: {
+        struct ml666_st_element* ex = (struct ml666_st_element*)x;
+        struct ml666_st_element* ey = (struct ml666_st_element*)y;
+        if(ml666_st_element_get_name(stb, ex) != ml666_st_element_get_name(stb, ey))
+          return false;
+        if(!same_tree(stb, ML666_ST_CHILDREN(stb, ex), ML666_ST_CHILDREN(stb, ey)))
+          return false;
+      } break;
+      case ML666_ST_NT_CONTENT: {
+        if(!ml666_buffer__equal(ml666_st_content_get(stb, (struct ml666_st_content*)x), ml666_st_content_get(stb, (struct ml666_st_content*)y)))
+          return false;
+      } break;
+      case ML666_ST_NT_COMMENT: {
+        if(!ml666_buffer__equal(ml666_st_comment_get(stb, (struct ml666_st_comment*)x), ml666_st_comment_get(stb, (struct ml666_st_comment*)y)))
+          return false;
+      } break;
+      default: return false;
+    }
+  }
+  return !x && !y;
+}
+
+static void dispose(struct ml666_st_builder* stb, struct ml666_st_document* document){
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+}
+
+ML666_TEST("same-tree"){
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=DOCUMENT);
+  struct ml666_st_document* expected = ml666_st_parse(stb, .tokenizer=tokenizer);
+  if(!expected)
+    return 1;
+  struct ml666_st_document* result = ml666_st_parse_parallel(stb, DOCUMENT, .thread_count=4, .min_slice_size=1);
+  if(!result)
+    return 2;
+  int ret = 0;
+  if(!same_tree(stb, ML666_ST_CHILDREN(stb, expected), ML666_ST_CHILDREN(stb, result)))
+    ret = 3;
+  dispose(stb, result);
+  dispose(stb, expected);
+  ml666_st_builder_destroy(stb);
+  return ret;
+}
+
+static bool count_split_points(void* user_ptr, enum ml666_structure_scan_event event, size_t offset, size_t depth){
+  (void)offset;
+  if(event == ML666_SCAN_ELEMENT_BEGIN && depth == 1)
+    *(size_t*)user_ptr += 1;
+  return true;
+}
+
+ML666_TEST("scan"){
+  size_t count = 0;
+  if(!ml666_structure_scan(DOCUMENT, count_split_points, .max_depth=1, .user_ptr=&count))
+    return 1;
+  if(count != 4)
+    return 2;
+  // An end tag without a start tag is broken, elements still open at the end are fine
+  if(ml666_structure_scan(ML666_BUFFER_STR("<a></a></b>"), count_split_points, .user_ptr=&count))
+    return 3;
+  if(!ml666_structure_scan(ML666_BUFFER_STR("<a><b>"), count_split_points, .user_ptr=&count))
+    return 4;
+  return 0;
+}
+
+ML666_TEST("syntax-error"){
+  struct ml666_st_builder* stb = ml666_st_builder_create(0);
+  struct ml666_st_document* result = ml666_st_parse_parallel(stb, ML666_BUFFER_STR("<a><b/><c></d></a>"), .thread_count=4, .min_slice_size=1);
+  ml666_st_builder_destroy(stb);
+  return result ? 1 : 0;
+}
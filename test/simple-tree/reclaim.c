@@ -0,0 +1,85 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-reclaimer.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b x=`2`/>/* comment */<b>`world`<c/><c/></b></a>`tail`";
+
+struct ml666_st_builder* stb;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+}
+
+void test_teardown(void){
+  ml666_st_builder_destroy(stb);
+}
+
+static struct ml666_st_document* parse(void){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  return ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+ML666_TEST("deep"){
+  // Far too deep for one stack frame per level
+  struct ml666_st_document* document = ml666_st_document_create(stb);
+  if(!document)
+    return 1;
+  struct ml666_hashed_buffer name = ml666_hashed_buffer__create(ML666_BUFFER_STR("e"));
+  struct ml666_st_node* parent = ML666_ST_NODE(document);
+  for(unsigned i=0; i<1000000; i++){
+    struct ml666_st_element* element = ml666_st_element_create(stb, &name, true);
+    if(!element || !ml666_st_member_set(stb, parent, ML666_ST_MEMBER(element), 0))
+      return 2;
+    ml666_st_node_put(stb, ML666_ST_NODE(element));
+    parent = ML666_ST_NODE(element);
+  }
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  if(ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document)))
+    return 3;
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+  return 0;
+}
+
+ML666_TEST("reclaim"){
+  struct ml666_st_reclaimer* reclaimer = ml666_st_reclaimer_create(stb);
+  if(!reclaimer)
+    return 1;
+  int result = 0;
+  for(unsigned i=0; i<8; i++){
+    struct ml666_st_document* document = parse();
+    if(!document){
+      result = 2;
+      break;
+    }
+    // A detached subtree
+    struct ml666_st_member* a = ml666_st_get_first_child(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_ref(stb, ML666_ST_NODE(a));
+    ml666_st_member_set(stb, 0, a, 0);
+    if(!ml666_st_reclaim(reclaimer, ML666_ST_NODE(a)))
+      result = 3;
+    if(!ml666_st_reclaim(reclaimer, ML666_ST_NODE(document)))
+      result = 4;
+  }
+  ml666_st_reclaimer_destroy(reclaimer);
+  return result;
+}
+
+ML666_TEST("thread confined"){
+  // Its blocks would be released from two threads without atomic refcounts
+  struct ml666_st_builder* confined = ml666_st_builder_create(.thread_confined=true);
+  if(!confined)
+    return 1;
+  struct ml666_st_reclaimer* reclaimer = ml666_st_reclaimer_create(confined);
+  const bool rejected = !reclaimer;
+  if(reclaimer)
+    ml666_st_reclaimer_destroy(reclaimer);
+  ml666_st_builder_destroy(confined);
+  return rejected ? 0 : 2;
+}
@@ -0,0 +1,208 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-reparse.h>
+#include <ml666/simple-tree-ml666-serializer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static const char document_text[] =
+  "<list>\n"
+  "  <item id=`1`><name>`first`</name><tags><tag/><tag/></tags></item>\n"
+  "  <item id=`2`><name>`second`</name></item>\n"
+  "  /* a comment */\n"
+  "  <item id=`3`>`some text`<name>`third`</name></item>\n"
+  "</list>\n";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+struct ml666_st_source_map* map;
+char* text;
+size_t length;
+
+static struct ml666_st_document* parse(const char* input, size_t size){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input={size, input});
+  return ml666_st_parse(stb, .tokenizer=tokenizer);
+}
+
+static void dispose(struct ml666_st_document* d){
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, d));
+  ml666_st_node_put(stb, ML666_ST_NODE(d));
+}
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  length = sizeof(document_text) - 1;
+  text = malloc(length + 1);
+  memcpy(text, document_text, length + 1);
+  document = parse(text, length);
+  if(document)
+    map = ml666_st_source_map_create(stb, document, {length, text});
+}
+
+void test_teardown(void){
+  if(map)
+    ml666_st_source_map_destroy(map);
+  if(document)
+    dispose(document);
+  free(text);
+  ml666_st_builder_destroy(stb);
+}
+
+// The output, or 0 on failure. It has to be freed.
+static char* serialize(struct ml666_st_document* d){
+  FILE* file = tmpfile();
+  if(!file)
+    return 0;
+  struct ml666_st_serializer* serializer = ml666_st_ml666_serializer_create(fileno(file), stb, ML666_ST_NODE(d));
+  char* result = 0;
+  if(serializer && ml666_st_serialize(serializer)){
+    const long size = ftell(file);
+    result = size >= 0 ? calloc(size + 1, 1) : 0;
+    rewind(file);
+    if(result && fread(result, 1, size, file) != (size_t)size){
+      free(result);
+      result = 0;
+    }
+  }
+  if(serializer)
+    ml666_st_serializer_destroy(serializer);
+  fclose(file);
+  return result;
+}
+
+// Replaces the given part of the text, and checks the result is the same as parsing the whole new text
+static bool edit_at(size_t offset, size_t removed, const char* replacement, size_t* reparsed){
+  const size_t inserted = strlen(replacement);
+  if(!ml666_st_reparse(map, {length, text}, offset, removed, {inserted, replacement}, .reparsed=reparsed))
+    return false;
+  char* result = malloc(length - removed + inserted + 1);
+  memcpy(result, text, offset);
+  memcpy(result + offset, replacement, inserted);
+  memcpy(result + offset + inserted, text + offset + removed, length - offset - removed);
+  length = length - removed + inserted;
+  result[length] = 0;
+  free(text);
+  text = result;
+  struct ml666_st_document* expected_document = parse(text, length);
+  char* expected = expected_document ? serialize(expected_document) : 0;
+  char* actual = serialize(document);
+  const bool same = expected && actual && !strcmp(expected, actual);
+  free(expected);
+  free(actual);
+  if(expected_document)
+    dispose(expected_document);
+  return same;
+}
+
+// Replaces the first occurrence of what
+static bool edit(const char* what, const char* replacement, size_t* reparsed){
+  const char* at = strstr(text, what);
+  if(!at)
+    return false;
+  return edit_at(at - text, strlen(what), replacement, reparsed);
+}
+
+ML666_TEST("edits"){
+  if(!map)
+    return 1;
+  size_t reparsed;
+  // Only the content of the name is parsed again
+  if(!edit("`second`", "`changed`", &reparsed) || reparsed != sizeof("`changed`") - 1)
+    return 2;
+  if(!edit("<tag/><tag/>", "<tag/><tag/><tag/>", &reparsed) || reparsed != sizeof("<tag/><tag/><tag/>") - 1)
+    return 3;
+  // An edit of a tag is done in the parent
+  if(!edit("<item id=`3`>", "<item id=`3` new>", 0))
+    return 4;
+  // Joining two elements
+  if(!edit("</item>\n  <item id=`2`>", "", &reparsed) || reparsed >= length)
+    return 5;
+  // Before and after everything
+  if(!edit("<list>", "/* start */<list>", 0) || !edit("</list>\n", "</list>\n<end/>", 0))
+    return 6;
+  if(!edit("`first`", "`1st`", &reparsed) || reparsed != sizeof("`1st`") - 1)
+    return 7;
+  return 0;
+}
+
+ML666_TEST("invalid"){
+  if(!map)
+    return 1;
+  char* before = serialize(document);
+  const size_t old_length = length;
+  // The string is never closed. The document isn't changed.
+  const bool changed = ml666_st_reparse(map, {length, text}, strstr(text, "`first`") - text, 1, {0, ""});
+  char* after = serialize(document);
+  const bool same = before && after && !strcmp(before, after);
+  free(before);
+  free(after);
+  if(changed || !same || length != old_length)
+    return 2;
+  // It still works afterwards
+  if(!edit("`third`", "`3rd`", 0))
+    return 3;
+  return 0;
+}
+
+ML666_TEST("edits in a row"){
+  if(!map)
+    return 1;
+  // The first one has to be parsed again with the whole element around it, the ones after it use the updated map
+  const char* at = strstr(text, "</item>\n  /*");
+  if(!at || !edit_at(at - text + 4, 0, "", 0))
+    return 2;
+  at = strstr(text, "<item id=`2`>");
+  if(!at || !edit_at(at - text - 1, 0, "<y/>", 0))
+    return 3;
+  at = strstr(text, "<item id=`3`>");
+  if(!at || !edit_at(at - text, 0, "<new>`x`</new>", 0))
+    return 3;
+  at = strstr(text, "<tag/>");
+  if(!at)
+    return 4;
+  const size_t offset = at - text;
+  for(size_t i=0; i<8; i++)
+    if(!edit_at(offset + 4, 0, " a", 0) || !edit_at(offset + 1, 3, "tag", 0) || !edit_at(offset + 4, 2, "", 0))
+      return 4;
+  if(!edit("<y/>", "", 0) || !edit("<new>`x`</new>", "`y`", 0) || !edit("`first`", "`1st`", 0))
+    return 5;
+  return 0;
+}
+
+ML666_TEST("open elements"){
+  if(!map)
+    return 1;
+  // Elements which aren't closed end with the source, so appending to it adds to them
+  if(!edit("</list>\n", "", 0))
+    return 2;
+  if(!edit_at(length, 0, "<z/>", 0) || !edit_at(length, 0, "<y>`y`", 0))
+    return 3;
+  // Closing them again
+  if(!edit_at(length, 0, "</y></list>", 0) || !edit_at(length, 0, "<after/>", 0))
+    return 4;
+  return 0;
+}
+
+ML666_TEST("tokens around the part"){
+  if(!map)
+    return 1;
+  // Neighbouring comments become one, and so do contents
+  const char* at = strstr(text, "<item id=`3`>");
+  if(!at || !edit_at(at - text, 0, "/* another one */", 0))
+    return 2;
+  at = strstr(text, "<name>`third`");
+  if(!at || !edit_at(at - text, 0, "`more text`", 0))
+    return 3;
+  // Comments in a start tag become the first members of the element
+  if(!edit("<item id=`3`>", "<item id=`3` /* in the tag */>", 0) || !edit("`some text`", "`other text`", 0))
+    return 4;
+  // A line comment goes on past the end of the part
+  if(!edit("</list>", "  <x/>`y`\n</list>", 0) || !edit("<x/>", "//<x/>", 0))
+    return 5;
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+#include <ml666/simple-tree-ml666-serializer.h>
+#include <ml666/simple-tree-json-serializer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y=`2`><b z=`3`>`some content`<c/>/* a comment */</b><d><e>`more`</e><f w=`4`/></d></a><g>`last`</g>";
+
+struct ml666_st_builder* stb;
+struct ml666_st_document* document;
+struct ml666_st_serializer_cache* cache;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(0);
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  document = ml666_st_parse(stb, .tokenizer=tokenizer);
+  // Remember everything, so that every node is reused at some point
+  cache = ml666_st_serializer_cache_create(.min_size=1);
+}
+
+void test_teardown(void){
+  if(cache)
+    ml666_st_serializer_cache_destroy(cache);
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(stb);
+}
+
+// The output, or 0 on failure. It has to be freed.
+static char* serialize(bool json, struct ml666_st_serializer_cache* c){
+  FILE* file = tmpfile();
+  if(!file)
+    return 0;
+  struct ml666_st_serializer* serializer = json
+    ? ml666_st_json_serializer_create(fileno(file), stb, ML666_ST_NODE(document), .cache=c)
+    : ml666_st_ml666_serializer_create(fileno(file), stb, ML666_ST_NODE(document), .cache=c);
+  char* result = 0;
+  if(serializer && ml666_st_serialize(serializer)){
+    const long size = ftell(file);
+    result = size >= 0 ? calloc(size + 1, 1) : 0;
+    rewind(file);
+    if(result && fread(result, 1, size, file) != (size_t)size){
+      free(result);
+      result = 0;
+    }
+  }
+  if(serializer)
+    ml666_st_serializer_destroy(serializer);
+  fclose(file);
+  return result;
+}
+
+// Whether serializing with the cache gives the same result as without it
+static bool same(bool json){
+  char* cached = serialize(json, cache);
+  char* expected = serialize(json, 0);
+  const bool result = cached && expected && !strcmp(cached, expected);
+  free(cached);
+  free(expected);
+  return result;
+}
+
+static struct ml666_st_member* child(struct ml666_st_node* node, size_t index){
+  return ml666_st_child_at(stb, ml666_st_node_get_children(stb, node), index);
+}
+
+static bool set_attribute(struct ml666_st_member* element, const char* name, const char* value){
+  struct ml666_hashed_buffer hashed_name = ml666_hashed_buffer__create((struct ml666_buffer_ro){strlen(name), name});
+  struct ml666_st_attribute* attribute = ml666_st_attribute_lookup(stb, (struct ml666_st_element*)element, &hashed_name, ML666_ST_AOF_CREATE);
+  struct ml666_buffer buffer = {0};
+  return attribute
+      && ml666_buffer__dup(&buffer, (struct ml666_buffer_ro){strlen(value), value})
+      && ml666_st_attribute_set_value(stb, attribute, &buffer);
+}
+
+static int changes(bool json){
+  if(!document || !cache)
+    return 1;
+  if(!same(json) || !same(json))
+    return 2;
+  struct ml666_st_member* a = child(ML666_ST_NODE(document), 0);
+  struct ml666_st_member* b = child(ML666_ST_NODE(a), 0);
+  struct ml666_st_member* d = child(ML666_ST_NODE(a), 1);
+  if(!set_attribute(child(ML666_ST_NODE(d), 1), "w", "changed") || !same(json))
+    return 3;
+  // Removing an attribute and adding it again only changes the order
+  struct ml666_hashed_buffer x = ml666_hashed_buffer__create(ML666_BUFFER_STR("x"));
+  ml666_st_attribute_remove(stb, ml666_st_attribute_lookup(stb, (struct ml666_st_element*)a, &x, 0));
+  if(!set_attribute(a, "x", "1") || !same(json))
+    return 4;
+  // Moving a subtree changes how deep it is
+  if(!ml666_st_member_set(stb, ML666_ST_NODE(document), d, 0) || !same(json))
+    return 5;
+  ml666_st_node_ref(stb, ML666_ST_NODE(b));
+  ml666_st_member_set(stb, 0, b, 0);
+  const bool removed = same(json);
+  const bool added = ml666_st_member_set(stb, ML666_ST_NODE(d), b, 0) && same(json);
+  ml666_st_node_put(stb, ML666_ST_NODE(b));
+  if(!removed || !added)
+    return 6;
+  return 0;
+}
+
+ML666_TEST("ml666"){
+  return changes(false);
+}
+
+ML666_TEST("json"){
+  return changes(true);
+}
@@ -0,0 +1,77 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] =
+  "<a x=`1` y>`hello`<b x=`a value which is too long to be stored inline`/>/* comment */<b>`world`</b></a>";
+
+struct ml666_st_builder* stb;
+
+void test_setup(void){
+  stb = ml666_st_builder_create(.stats=true);
+}
+
+void test_teardown(void){
+  ml666_st_builder_destroy(stb);
+}
+
+ML666_TEST("document"){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  struct ml666_st_document* document = ml666_st_parse(stb, .tokenizer=tokenizer);
+  if(!document)
+    return 1;
+  int result = 0;
+  struct ml666_st_stats node, builder;
+  if(!ml666_st_node_get_stats(stb, ML666_ST_NODE(document), &node) || !ml666_st_builder_get_stats(stb, &builder)){
+    result = 2;
+  }else if(node.document_count != 1 || node.element_count != 3 || node.content_count != 2 || node.comment_count != 1 || node.attribute_count != 3){
+    result = 3;
+  }else if(node.data_bytes != 1 + 5 + 45 + 7 + 5 || node.name_count != 4 || node.name_bytes != 4){
+    result = 4;
+  }else if(memcmp(&node, &builder, offsetof(struct ml666_st_stats, name_count))){
+    // Nothing else exists in the builder
+    result = 5;
+  }
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+  if(result)
+    return result;
+  if(!ml666_st_builder_get_stats(stb, &builder))
+    return 6;
+  if(builder.document_count || builder.element_count || builder.content_count || builder.comment_count || builder.attribute_count)
+    return 7;
+  if(builder.data_bytes || builder.allocation_count || builder.allocated_bytes)
+    return 8;
+  return 0;
+}
+
+ML666_TEST("extra parts"){
+  struct ml666_tokenizer* tokenizer = ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text));
+  struct ml666_st_document* document = ml666_st_parse(stb, .tokenizer=tokenizer);
+  if(!document)
+    return 1;
+  int result = 0;
+  struct ml666_st_stats before, node, builder;
+  // The cached hashes of the elements are the first thing they need an extra allocation for
+  if(!ml666_st_builder_get_stats(stb, &before) || !ml666_st_node_get_hash(stb, ML666_ST_NODE(document))){
+    result = 2;
+  }else if(!ml666_st_node_get_stats(stb, ML666_ST_NODE(document), &node) || !ml666_st_builder_get_stats(stb, &builder)){
+    result = 3;
+  }else if(builder.allocation_count != before.allocation_count + 3){
+    result = 4;
+  }else if(memcmp(&node, &builder, offsetof(struct ml666_st_stats, name_count))){
+    result = 5;
+  }
+  ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+  ml666_st_node_put(stb, ML666_ST_NODE(document));
+  if(result)
+    return result;
+  if(!ml666_st_builder_get_stats(stb, &builder) || builder.allocation_count || builder.allocated_bytes)
+    return 6;
+  return 0;
+}
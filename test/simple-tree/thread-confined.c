@@ -0,0 +1,43 @@
+#include <-ml666/test.x>
+#include <ml666/utils.h>
+#include <ml666/tokenizer.h>
+#include <ml666/simple-tree.h>
+#include <ml666/simple-tree-parser.h>
+#include <ml666/simple-tree-builder.h>
+
+#define ML666_BUFFER_STR(...) (struct ml666_buffer_ro){sizeof(__VA_ARGS__)-1, (__VA_ARGS__)}
+
+static const char document_text[] = "<a x=`1`><b/><b y/></a>";
+
+ML666_TEST("own buffer set"){
+  struct ml666_st_builder* stb = ml666_st_builder_create(.thread_confined=true);
+  if(!stb)
+    return 1;
+  int result = 0;
+  // The global default set is shared, so it's left alone
+  struct ml666_hashed_buffer_set* buffer_set = ml666_st_builder_get_buffer_set(stb);
+  size_t count = 0, bytes = 0;
+  struct ml666_st_document* document = ml666_st_parse(stb, .tokenizer=ml666_tokenizer_create(.input=ML666_BUFFER_STR(document_text)));
+  if(!document){
+    result = 2;
+  }else if(buffer_set == ml666_hashed_buffer_set__get_default()){
+    result = 3;
+  }else if(!ml666_default_hashed_buffer_set__get_size(buffer_set, &count, &bytes) || count != 4){
+    result = 4;
+  }
+  if(document){
+    ml666_st_subtree_disintegrate(stb, ML666_ST_CHILDREN(stb, document));
+    ml666_st_node_put(stb, ML666_ST_NODE(document));
+  }
+  ml666_st_builder_destroy(stb);
+  return result;
+}
+
+ML666_TEST("given buffer set"){
+  struct ml666_st_builder* stb = ml666_st_builder_create(.thread_confined=true, .buffer_set=ml666_hashed_buffer_set__get_default());
+  if(!stb)
+    return 1;
+  const bool ok = ml666_st_builder_get_buffer_set(stb) == ml666_hashed_buffer_set__get_default();
+  ml666_st_builder_destroy(stb);
+  return ok ? 0 : 2;
+}